@@ -0,0 +1,428 @@
+/*! \file harness.hpp
+ *  \brief Measurement of hardware counters and heap allocations around each
+ *         benchmark, reported as one JSON object per benchmark.
+ */
+
+#pragma once
+
+#include <hayai.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#ifdef RETRO_BENCHMARK_HARNESS
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace retro
+{
+
+namespace benchmarks
+{
+
+#ifdef RETRO_BENCHMARK_HARNESS
+
+/*! \brief Counts the heap allocations made by the process.
+ *  \p The counts are updated by the replacements of the global allocation
+ *     functions in harness_main.cpp, from any thread.
+ */
+struct allocation_stats
+{
+  std::atomic<std::uint64_t> allocations;
+  std::atomic<std::uint64_t> bytes;
+  std::atomic<std::uint64_t> live;
+  std::atomic<std::uint64_t> peak;
+
+  void allocated(std::size_t size)
+  {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    bytes.fetch_add(size, std::memory_order_relaxed);
+
+    // Raise the peak if this allocation went past it.
+    std::uint64_t now = live.fetch_add(size, std::memory_order_relaxed) + size;
+    std::uint64_t old = peak.load(std::memory_order_relaxed);
+    while (now > old && !peak.compare_exchange_weak(old, now,
+                                                    std::memory_order_relaxed))
+    {
+    }
+  }
+
+  void released(std::size_t size)
+  {
+    live.fetch_sub(size, std::memory_order_relaxed);
+  }
+};
+
+/*! The allocations of the whole process, zero-initialized before any
+ *  dynamic initialization can allocate.
+ */
+inline allocation_stats &allocations(void)
+{
+  static allocation_stats stats;
+  return stats;
+}
+
+/*! \brief Represents a group of hardware counters for the calling thread and
+ *  the threads it creates.
+ *  \p The counters are unavailable when the kernel does not allow them, for
+ *     example in a container without perf_event access, and are then
+ *     reported as null.
+ */
+class perf_counters
+{
+  public:
+    enum counter
+    {
+      cycles,
+      instructions,
+      llc_misses,
+      branch_misses,
+      counter_count
+    };
+
+    perf_counters(void)
+      : leader_(-1)
+    {
+      static const std::uint64_t configs[counter_count] = {
+        PERF_COUNT_HW_CPU_CYCLES,
+        PERF_COUNT_HW_INSTRUCTIONS,
+        PERF_COUNT_HW_CACHE_MISSES,
+        PERF_COUNT_HW_BRANCH_MISSES
+      };
+
+      // The other counters are only opened in the group of the first one,
+      // so that they start and stop together.
+      for (int i = 0; i < counter_count; i++)
+      {
+        fds_[i] = i == 0 || leader_ >= 0 ? open_counter(configs[i], leader_)
+                                         : -1;
+        if (i == 0) leader_ = fds_[0];
+      }
+    }
+
+    perf_counters(const perf_counters &other) = delete;
+
+    perf_counters &operator=(const perf_counters &other) = delete;
+
+    ~perf_counters()
+    {
+      for (int i = 0; i < counter_count; i++)
+        if (fds_[i] >= 0) ::close(fds_[i]);
+    }
+
+    /*! Reset every counter to zero and start counting.
+     */
+    void start(void)
+    {
+      if (leader_ < 0) return;
+      ::ioctl(leader_, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+      ::ioctl(leader_, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    }
+
+    /*! Stop counting.
+     */
+    void stop(void)
+    {
+      if (leader_ < 0) return;
+      ::ioctl(leader_, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+    }
+
+    /*! Read a counter.
+     *  \return Whether the counter is available.
+     */
+    bool read(counter c, std::uint64_t &value) const
+    {
+      return fds_[c] >= 0
+             && ::read(fds_[c], &value, sizeof(value)) == sizeof(value);
+    }
+
+  private:
+    static int open_counter(std::uint64_t config, int leader)
+    {
+      perf_event_attr attr;
+      std::memset(&attr, 0, sizeof(attr));
+      attr.size = sizeof(attr);
+      attr.type = PERF_TYPE_HARDWARE;
+      attr.config = config;
+      attr.disabled = leader < 0;
+      attr.inherit = 1;
+      attr.exclude_kernel = 1;
+      attr.exclude_hv = 1;
+
+      return static_cast<int>(::syscall(__NR_perf_event_open, &attr, 0, -1,
+                                        leader, 0));
+    }
+
+    int leader_;
+    int fds_[counter_count];
+}; // end perf_counters
+
+/*! \brief Measures windows of time during a benchmark, summing the
+ *  hardware counters, heap allocations and wall time of each.
+ *  \p The counters run for the whole benchmark and are read at the edges of
+ *     each window. Peak memory is the highest number of bytes allocated at
+ *     once beyond those allocated when a window opened, over every window.
+ */
+class measurement
+{
+  public:
+    //! The sums over the windows that were measured.
+    struct totals
+    {
+      totals(void)
+        : wall_ns(0), allocations(0), bytes(0), peak(0), windows(0)
+      {
+        for (int i = 0; i < perf_counters::counter_count; i++)
+        {
+          counters[i] = 0;
+          counted[i] = true;
+        }
+      }
+
+      std::uint64_t wall_ns;
+      std::uint64_t counters[perf_counters::counter_count];
+
+      // Whether each counter could be read at every edge.
+      bool counted[perf_counters::counter_count];
+
+      std::uint64_t allocations;
+      std::uint64_t bytes;
+      std::uint64_t peak;
+      std::size_t windows;
+    };
+
+    /*! Start measuring a benchmark, forgetting the last one. Everything
+     *  until end_test() is measured as one window.
+     */
+    void begin_test(void)
+    {
+      test_ = totals();
+      runs_ = totals();
+      counters_.start();
+      open(test_start_);
+    }
+
+    /*! Stop measuring a benchmark.
+     */
+    void end_test(void)
+    {
+      close(test_start_, test_);
+      counters_.stop();
+    }
+
+    /*! Start measuring a run of a benchmark, after its fixture is set up.
+     */
+    void begin_run(void)
+    {
+      open(run_start_);
+    }
+
+    /*! Stop measuring a run of a benchmark, before its fixture is torn down.
+     */
+    void end_run(void)
+    {
+      close(run_start_, runs_);
+    }
+
+    /*! Return the sums over the runs of the benchmark if its fixture marked
+     *  them, or over the whole benchmark otherwise.
+     */
+    const totals &result(void) const
+    {
+      return runs_.windows ? runs_ : test_;
+    }
+
+  private:
+    struct snapshot
+    {
+      std::chrono::steady_clock::time_point begin;
+      std::uint64_t counters[perf_counters::counter_count];
+      bool counted[perf_counters::counter_count];
+      std::uint64_t allocations;
+      std::uint64_t bytes;
+      std::uint64_t live;
+    };
+
+    void open(snapshot &s)
+    {
+      allocation_stats &stats = allocations();
+      s.live = stats.live.load();
+      s.allocations = stats.allocations.load();
+      s.bytes = stats.bytes.load();
+      stats.peak.store(s.live);
+
+      for (int i = 0; i < perf_counters::counter_count; i++)
+        s.counted[i] = counters_.read(perf_counters::counter(i),
+                                      s.counters[i]);
+      s.begin = std::chrono::steady_clock::now();
+    }
+
+    void close(const snapshot &s, totals &t)
+    {
+      auto end = std::chrono::steady_clock::now();
+      for (int i = 0; i < perf_counters::counter_count; i++)
+      {
+        std::uint64_t value;
+        bool counted = s.counted[i]
+                       && counters_.read(perf_counters::counter(i), value);
+        t.counted[i] = t.counted[i] && counted;
+        if (counted) t.counters[i] += value - s.counters[i];
+      }
+
+      allocation_stats &stats = allocations();
+      t.allocations += stats.allocations.load() - s.allocations;
+      t.bytes += stats.bytes.load() - s.bytes;
+      t.peak = std::max<std::uint64_t>(t.peak, stats.peak.load() - s.live);
+      t.wall_ns += static_cast<std::uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+          end - s.begin).count());
+      t.windows++;
+    }
+
+    perf_counters counters_;
+    snapshot test_start_;
+    snapshot run_start_;
+    totals test_;
+    totals runs_;
+}; // end measurement
+
+/*! The measurement of the benchmark that is running.
+ */
+inline measurement &current_measurement(void)
+{
+  static measurement m;
+  return m;
+}
+
+/*! \brief Reports the hardware counters and heap allocations of each
+ *  benchmark as a line of JSON.
+ *  \p For a fixture derived from measured_fixture, only its runs are
+ *     measured. For any other benchmark, measurement starts when hayai
+ *     begins its runs and ends when they finish, so it includes the set up
+ *     and tear down of its fixture.
+ */
+class harness_outputter : public ::hayai::Outputter
+{
+  public:
+    /*! Construct an outputter that writes to a file.
+     *  \param out The file to write to, which must outlive the outputter.
+     */
+    explicit harness_outputter(std::FILE *out)
+      : out_(out)
+    {
+    }
+
+    virtual void Begin(const std::size_t &, const std::size_t &)
+    {
+    }
+
+    virtual void End(const std::size_t &, const std::size_t &)
+    {
+    }
+
+    virtual void BeginTest(const std::string &,
+                           const std::string &,
+                           const ::hayai::TestParametersDescriptor &,
+                           const std::size_t &,
+                           const std::size_t &)
+    {
+      current_measurement().begin_test();
+    }
+
+    virtual void SkipDisabledTest(const std::string &,
+                                  const std::string &,
+                                  const ::hayai::TestParametersDescriptor &,
+                                  const std::size_t &,
+                                  const std::size_t &)
+    {
+    }
+
+    virtual void EndTest(const std::string &fixtureName,
+                         const std::string &testName,
+                         const ::hayai::TestParametersDescriptor &,
+                         const ::hayai::TestResult &)
+    {
+      current_measurement().end_test();
+      const measurement::totals &t = current_measurement().result();
+
+      std::fprintf(out_, "{\"fixture\":\"%s\",\"benchmark\":\"%s\","
+                         "\"wall_ns\":%llu",
+                   fixtureName.c_str(), testName.c_str(),
+                   static_cast<unsigned long long>(t.wall_ns));
+
+      write_counter(t, "cycles", perf_counters::cycles);
+      write_counter(t, "instructions", perf_counters::instructions);
+      write_counter(t, "llc_misses", perf_counters::llc_misses);
+      write_counter(t, "branch_misses", perf_counters::branch_misses);
+
+      std::fprintf(out_, ",\"allocations\":%llu,\"allocated_bytes\":%llu,"
+                         "\"peak_bytes\":%llu}\n",
+                   static_cast<unsigned long long>(t.allocations),
+                   static_cast<unsigned long long>(t.bytes),
+                   static_cast<unsigned long long>(t.peak));
+      std::fflush(out_);
+    }
+
+  private:
+    void write_counter(const measurement::totals &t, const char *name,
+                       perf_counters::counter c)
+    {
+      if (t.counted[c])
+        std::fprintf(out_, ",\"%s\":%llu", name,
+                     static_cast<unsigned long long>(t.counters[c]));
+      else
+        std::fprintf(out_, ",\"%s\":null", name);
+    }
+
+    std::FILE *out_;
+}; // end harness_outputter
+
+#endif // RETRO_BENCHMARK_HARNESS
+
+/*! \brief Represents a fixture whose set up and tear down are left out of
+ *  the measurements of the harness.
+ *  \p Derived fixtures override BeforeRun() and AfterRun() rather than
+ *     SetUp() and TearDown(), so that only the runs themselves are counted.
+ *     Without the harness it is an ordinary fixture.
+ */
+class measured_fixture : public ::hayai::Fixture
+{
+  public:
+    virtual void SetUp()
+    {
+      BeforeRun();
+#ifdef RETRO_BENCHMARK_HARNESS
+      current_measurement().begin_run();
+#endif
+    }
+
+    virtual void TearDown()
+    {
+#ifdef RETRO_BENCHMARK_HARNESS
+      current_measurement().end_run();
+#endif
+      AfterRun();
+    }
+
+  protected:
+    virtual void BeforeRun()
+    {
+    }
+
+    virtual void AfterRun()
+    {
+    }
+};
+
+} // end benchmarks
+
+} // end retro
@@ -0,0 +1,207 @@
+#include <hayai.hpp>
+
+#include "harness.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstddef>
+#include <new>
+
+namespace
+{
+
+// Each allocation is preceded by its size, padded so that the memory handed
+// out keeps the alignment of malloc.
+const std::size_t header_size = 16;
+
+void *allocate(std::size_t size)
+{
+  char *block = static_cast<char *>(std::malloc(header_size + size));
+  if (!block) return 0;
+
+  *reinterpret_cast<std::size_t *>(block) = size;
+  retro::benchmarks::allocations().allocated(size);
+  return block + header_size;
+}
+
+void deallocate(void *ptr)
+{
+  if (!ptr) return;
+
+  char *block = static_cast<char *>(ptr) - header_size;
+  retro::benchmarks::allocations().released(
+    *reinterpret_cast<std::size_t *>(block));
+  std::free(block);
+}
+
+void *allocate_or_throw(std::size_t size)
+{
+  void *ptr = allocate(size);
+  if (!ptr) throw std::bad_alloc();
+  return ptr;
+}
+
+#ifdef __cpp_aligned_new
+// Over-aligned allocations pad the header up to their alignment, and keep the
+// padding next to the size so that the block can be found again.
+void *allocate_aligned(std::size_t size, std::align_val_t align)
+{
+  std::size_t alignment = static_cast<std::size_t>(align);
+  std::size_t header = alignment > header_size ? alignment : header_size;
+
+  void *block;
+  if (::posix_memalign(&block, alignment, header + size)) return 0;
+
+  char *ptr = static_cast<char *>(block) + header;
+  reinterpret_cast<std::size_t *>(ptr)[-2] = size;
+  reinterpret_cast<std::size_t *>(ptr)[-1] = header;
+  retro::benchmarks::allocations().allocated(size);
+  return ptr;
+}
+
+void deallocate_aligned(void *ptr)
+{
+  if (!ptr) return;
+
+  std::size_t *sizes = static_cast<std::size_t *>(ptr);
+  retro::benchmarks::allocations().released(sizes[-2]);
+  std::free(static_cast<char *>(ptr) - sizes[-1]);
+}
+
+void *allocate_aligned_or_throw(std::size_t size, std::align_val_t align)
+{
+  void *ptr = allocate_aligned(size, align);
+  if (!ptr) throw std::bad_alloc();
+  return ptr;
+}
+#endif
+
+} // end namespace
+
+void *operator new(std::size_t size)
+{
+  return allocate_or_throw(size);
+}
+
+void *operator new[](std::size_t size)
+{
+  return allocate_or_throw(size);
+}
+
+void *operator new(std::size_t size, const std::nothrow_t &) noexcept
+{
+  return allocate(size);
+}
+
+void *operator new[](std::size_t size, const std::nothrow_t &) noexcept
+{
+  return allocate(size);
+}
+
+void operator delete(void *ptr) noexcept
+{
+  deallocate(ptr);
+}
+
+void operator delete[](void *ptr) noexcept
+{
+  deallocate(ptr);
+}
+
+void operator delete(void *ptr, std::size_t) noexcept
+{
+  deallocate(ptr);
+}
+
+void operator delete[](void *ptr, std::size_t) noexcept
+{
+  deallocate(ptr);
+}
+
+void operator delete(void *ptr, const std::nothrow_t &) noexcept
+{
+  deallocate(ptr);
+}
+
+void operator delete[](void *ptr, const std::nothrow_t &) noexcept
+{
+  deallocate(ptr);
+}
+
+#ifdef __cpp_aligned_new
+void *operator new(std::size_t size, std::align_val_t align)
+{
+  return allocate_aligned_or_throw(size, align);
+}
+
+void *operator new[](std::size_t size, std::align_val_t align)
+{
+  return allocate_aligned_or_throw(size, align);
+}
+
+void *operator new(std::size_t size, std::align_val_t align,
+                   const std::nothrow_t &) noexcept
+{
+  return allocate_aligned(size, align);
+}
+
+void *operator new[](std::size_t size, std::align_val_t align,
+                     const std::nothrow_t &) noexcept
+{
+  return allocate_aligned(size, align);
+}
+
+void operator delete(void *ptr, std::align_val_t) noexcept
+{
+  deallocate_aligned(ptr);
+}
+
+void operator delete[](void *ptr, std::align_val_t) noexcept
+{
+  deallocate_aligned(ptr);
+}
+
+void operator delete(void *ptr, std::size_t, std::align_val_t) noexcept
+{
+  deallocate_aligned(ptr);
+}
+
+void operator delete[](void *ptr, std::size_t, std::align_val_t) noexcept
+{
+  deallocate_aligned(ptr);
+}
+
+void operator delete(void *ptr, std::align_val_t,
+                     const std::nothrow_t &) noexcept
+{
+  deallocate_aligned(ptr);
+}
+
+void operator delete[](void *ptr, std::align_val_t,
+                       const std::nothrow_t &) noexcept
+{
+  deallocate_aligned(ptr);
+}
+#endif
+
+// Runs every benchmark, printing the usual results and writing the JSON
+// results to the file named by RETRO_BENCHMARK_JSON, or to stderr.
+int main()
+{
+  const char *path = std::getenv("RETRO_BENCHMARK_JSON");
+  std::FILE *out = path ? std::fopen(path, "w") : stderr;
+  if (!out)
+  {
+    std::perror(path);
+    return 1;
+  }
+
+  ::hayai::ConsoleOutputter console;
+  retro::benchmarks::harness_outputter harness(out);
+  ::hayai::Benchmarker::AddOutputter(console);
+  ::hayai::Benchmarker::AddOutputter(harness);
+  ::hayai::Benchmarker::RunAllTests();
+
+  if (out != stderr) std::fclose(out);
+  return 0;
+}
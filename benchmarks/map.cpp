@@ -3,6 +3,8 @@
 #include "retro/map.hpp"
 
 #include <map>
+#include <vector>
+#include <iterator>
 
 BENCHMARK(FullMap, InsertAndFindNumericKeys, 1, 10)
 {
@@ -25,3 +27,100 @@ BENCHMARK(StlMap, InsertAndFindNumericKeys, 1, 10)
   for (int i = 0; i < 100000; i++)
     q.find(i);
 }
+
+BENCHMARK(FullDenseMap, InsertAndFindNumericKeys, 1, 10)
+{
+  retro::full_dense_map<int, int> q;
+
+  for (int i = 0; i < 100000; i++)
+    q.insert(std::make_pair(i, i));
+
+  for (int i = 0; i < 100000; i++)
+    q.find(i);
+}
+
+namespace
+{
+
+// A log of operations on keys in no particular order.
+std::vector<retro::full_map<int, int>::log_entry> make_log(void)
+{
+  std::vector<retro::full_map<int, int>::log_entry> log;
+  for (int i = 0; i < 200000; i++)
+  {
+    retro::map op = i % 5 == 0 ? retro::map::erase : retro::map::assign;
+    log.push_back(retro::full_map<int, int>::log_entry(op, (i * 7919) % 50000,
+                                                       i));
+  }
+  return log;
+}
+
+const std::vector<retro::full_map<int, int>::log_entry> events = make_log();
+
+} // end namespace
+
+BENCHMARK(FullMap, ReplayLogOneAtATime, 1, 10)
+{
+  retro::full_map<int, int> q;
+
+  for (auto &entry : events)
+  {
+    if (std::get<0>(entry) == retro::map::erase)
+      q.erase(std::get<1>(entry));
+    else
+      q.assign(std::get<1>(entry), std::get<2>(entry));
+  }
+}
+
+BENCHMARK(FullMap, BuildFromLog, 1, 10)
+{
+  retro::full_map<int, int> q(events.begin(), events.end());
+}
+
+namespace
+{
+
+// The log replayed one operation at a time, keeping the time of each.
+struct replayed
+{
+  explicit replayed(std::size_t interval)
+  {
+    q.set_checkpoint_interval(interval);
+    for (auto &entry : events)
+    {
+      if (std::get<0>(entry) == retro::map::erase)
+        times.push_back(q.erase(std::get<1>(entry)));
+      else
+        times.push_back(q.assign(std::get<1>(entry), std::get<2>(entry)));
+    }
+  }
+
+  retro::full_map<int, int> q;
+  std::vector<retro::full_map<int, int>::time_point> times;
+};
+
+replayed without_checkpoints(0), with_checkpoints(4096);
+
+} // end namespace
+
+BENCHMARK(FullMap, SnapshotInThePast, 1, 10)
+{
+  auto &r = without_checkpoints;
+  std::vector<std::pair<int, int>> contents;
+  for (std::size_t i = 1; i < r.times.size(); i += r.times.size() / 8)
+  {
+    contents.clear();
+    r.q.snapshot(r.times[i], std::back_inserter(contents));
+  }
+}
+
+BENCHMARK(FullMap, SnapshotInThePastFromCheckpoints, 1, 10)
+{
+  auto &r = with_checkpoints;
+  std::vector<std::pair<int, int>> contents;
+  for (std::size_t i = 1; i < r.times.size(); i += r.times.size() / 8)
+  {
+    contents.clear();
+    r.q.snapshot(r.times[i], std::back_inserter(contents));
+  }
+}
@@ -0,0 +1,274 @@
+// Replays traces recorded by traced_full_map and traced_partial_queue
+// against variants of the containers, and reports the time each one takes.
+// The order of the operations in time is also replayed on ordered lists with
+// labels of different widths, which relabel at different rates.
+//
+// Usage: run_replay trace...
+
+#include "retro/map.hpp"
+#include "retro/queue.hpp"
+#include "retro/detail/ordered_list.hpp"
+#include "retro/detail/log_file.hpp"
+#include "retro/detail/trace.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+namespace
+{
+
+volatile std::size_t sink;
+
+const int rounds = 3;
+
+struct record
+{
+  std::uint8_t code;
+  std::uint64_t at;
+  std::uint64_t key;
+};
+
+// Whether a record creates a time point, as opposed to a revert or a query.
+bool is_operation(std::uint8_t code)
+{
+  return code != retro::detail::trace_revert
+         && code != retro::detail::trace_find
+         && code != retro::detail::trace_scan;
+}
+
+// Read a trace, checking that each record only refers to earlier operations
+// that have not been reverted.
+bool read(const char *path, const char *magic, std::size_t payload,
+          std::vector<record> &records)
+{
+  std::vector<bool> reverted;
+  return retro::detail::read_trace(path, magic, payload,
+                                   [&](std::uint8_t code, std::uint64_t at,
+                                       const char *data)
+  {
+    bool now = at == retro::detail::log_file::present;
+    if (!now && (at >= reverted.size() || reverted[at])) return false;
+    if (now && code == retro::detail::trace_revert) return false;
+
+    record r = { code, at, 0 };
+    std::memcpy(&r.key, data, payload);
+    records.push_back(r);
+    if (code == retro::detail::trace_revert) reverted[at] = true;
+    if (is_operation(code)) reverted.push_back(false);
+    return true;
+  });
+}
+
+// Time a replay of a trace, keeping the fastest of several rounds.
+template <class Function>
+double time_replay(Function replay)
+{
+  double best = 0;
+  for (int r = 0; r < rounds; r++)
+  {
+    auto begin = std::chrono::steady_clock::now();
+    replay();
+    auto elapsed = std::chrono::steady_clock::now() - begin;
+
+    double ms = std::chrono::duration<double, std::milli>(elapsed).count();
+    if (r == 0 || ms < best) best = ms;
+  }
+  return best;
+}
+
+void report(const char *variant, const std::vector<record> &records,
+            double ms)
+{
+  std::printf("  %-28s %12.2f ms %10.1f ns/op\n", variant, ms,
+              ms * 1e6 / std::max<std::size_t>(records.size(), 1));
+}
+
+template <class Map>
+void replay_map(const std::vector<record> &records, Map &m)
+{
+  typedef typename Map::time_point time_point;
+
+  std::vector<time_point> times;
+  for (const record &r : records)
+  {
+    bool now = r.at == retro::detail::log_file::present;
+    time_point t = now ? m.present() : times[r.at];
+    auto val = static_cast<typename Map::mapped_type>(times.size());
+
+    switch (r.code)
+    {
+      case retro::detail::trace_revert:
+        m.revert(t);
+        break;
+      case retro::detail::trace_find:
+        sink += m.find(t, r.key) != m.end(t);
+        break;
+      case retro::detail::trace_scan:
+        sink += m.begin(t) != m.end(t);
+        break;
+      default:
+        switch (static_cast<retro::map>(r.code))
+        {
+          case retro::map::insert:
+            times.push_back(m.insert(t, std::make_pair(r.key, val)));
+            break;
+          case retro::map::erase:
+            times.push_back(m.erase(t, r.key));
+            break;
+          case retro::map::assign:
+            times.push_back(m.assign(t, r.key, val));
+            break;
+        }
+    }
+  }
+  sink += times.size();
+}
+
+void replay_queue(const std::vector<record> &records,
+                  retro::partial_queue<std::uint64_t> &q)
+{
+  typedef retro::partial_queue<std::uint64_t>::time_point time_point;
+
+  std::vector<time_point> times;
+  for (const record &r : records)
+  {
+    if (r.code == retro::detail::trace_revert)
+    {
+      q.revert(times[r.at]);
+      continue;
+    }
+    if (r.code == retro::detail::trace_find)
+    {
+      sink += q.front();
+      continue;
+    }
+
+    bool now = r.at == retro::detail::log_file::present;
+    switch (static_cast<retro::queue>(r.code))
+    {
+      case retro::queue::push:
+        times.push_back(now ? q.push(times.size())
+                            : q.push(times[r.at], times.size()));
+        break;
+      case retro::queue::pop:
+        times.push_back(now ? q.pop() : q.pop(times[r.at]));
+        break;
+    }
+  }
+  sink += q.size();
+}
+
+// Replay only where each operation falls in time, which is the work that
+// the event list of every container does. Queries compare the time point
+// they were made at with the latest operation.
+template <class LabelType>
+void replay_order(const std::vector<record> &records)
+{
+  typedef retro::detail::ordered_list<std::uint64_t, LabelType> list_type;
+  typedef typename list_type::iterator iterator;
+
+  list_type l;
+  std::vector<iterator> times;
+  for (const record &r : records)
+  {
+    bool now = r.at == retro::detail::log_file::present;
+    if (r.code == retro::detail::trace_revert)
+    {
+      l.erase(times[r.at]);
+    }
+    else if (!is_operation(r.code))
+    {
+      if (!now && !times.empty()) sink += times[r.at] < times.back();
+    }
+    else if (now)
+    {
+      l.push_back(times.size());
+      times.push_back(std::prev(l.end()));
+    }
+    else
+    {
+      times.push_back(l.insert(times[r.at], times.size()));
+    }
+  }
+  sink += l.size();
+}
+
+template <class Map>
+double time_map(const std::vector<record> &records,
+                std::size_t checkpoint_interval)
+{
+  return time_replay([&]
+  {
+    Map m;
+    m.set_checkpoint_interval(checkpoint_interval);
+    replay_map(records, m);
+  });
+}
+
+} // end namespace
+
+int main(int argc, char **argv)
+{
+  if (argc < 2)
+  {
+    std::fprintf(stderr, "usage: %s trace...\n", argv[0]);
+    return 2;
+  }
+
+  typedef retro::full_map<std::uint64_t, std::uint64_t> map_type;
+  typedef retro::full_dense_map<std::uint64_t, std::uint64_t> dense_map_type;
+
+  for (int i = 1; i < argc; i++)
+  {
+    std::vector<record> map_records, queue_records;
+    if (read(argv[i], retro::detail::trace_map_magic, sizeof(std::uint64_t),
+             map_records))
+    {
+      std::printf("%s: map trace of %zu records\n", argv[i],
+                  map_records.size());
+      report("full_map", map_records, time_map<map_type>(map_records, 0));
+      report("full_map, checkpoints", map_records,
+             time_map<map_type>(map_records, 1024));
+      report("full_dense_map", map_records,
+             time_map<dense_map_type>(map_records, 0));
+      report("ordered_list, 64-bit labels", map_records, time_replay([&]
+      {
+        replay_order<unsigned long long int>(map_records);
+      }));
+      report("ordered_list, 32-bit labels", map_records, time_replay([&]
+      {
+        replay_order<std::uint32_t>(map_records);
+      }));
+    }
+    else if (read(argv[i], retro::detail::trace_queue_magic, 0,
+                  queue_records))
+    {
+      std::printf("%s: queue trace of %zu records\n", argv[i],
+                  queue_records.size());
+      report("partial_queue", queue_records, time_replay([&]
+      {
+        retro::partial_queue<std::uint64_t> q;
+        replay_queue(queue_records, q);
+      }));
+      report("ordered_list, 64-bit labels", queue_records, time_replay([&]
+      {
+        replay_order<unsigned long long int>(queue_records);
+      }));
+      report("ordered_list, 32-bit labels", queue_records, time_replay([&]
+      {
+        replay_order<std::uint32_t>(queue_records);
+      }));
+    }
+    else
+    {
+      std::fprintf(stderr, "%s: not a valid trace\n", argv[i]);
+      return 1;
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,218 @@
+#include <hayai.hpp>
+
+#include "harness.hpp"
+#include "retro/map.hpp"
+
+#include <map>
+#include <vector>
+#include <random>
+#include <cstddef>
+
+namespace
+{
+
+const std::size_t operations = 10000;
+const int keys = 1000;
+const std::size_t changes = 200;
+const std::size_t queries = 200;
+const std::size_t scans = 20;
+
+struct operation
+{
+  bool erase;
+  int key;
+  int val;
+};
+
+// A map built from the same history at present, both as a full_map and as
+// a log that a map without retroactivity must copy and replay. Building it
+// is left out of the harness's measurements.
+class RetroactiveWorkload : public retro::benchmarks::measured_fixture
+{
+  protected:
+    virtual void BeforeRun()
+    {
+      rng.seed(42);
+      sink = 0;
+      m = retro::full_map<int, int>();
+      times.clear();
+      log.clear();
+      before.assign(operations + 1, std::vector<operation>());
+
+      for (std::size_t i = 0; i < operations; i++)
+      {
+        operation op = { i % 7 == 6, static_cast<int>(i % keys),
+                         static_cast<int>(i) };
+        log.push_back(op);
+        times.push_back(op.erase ? m.erase(op.key) : m.assign(op.key, op.val));
+      }
+    }
+
+    virtual void AfterRun()
+    {
+      m = retro::full_map<int, int>();
+    }
+
+    // The position of an operation in the original history, chosen
+    // uniformly, mostly near the start, or mostly near the end.
+    std::size_t uniform(void)
+    {
+      std::uniform_int_distribution<std::size_t> pos(0, operations - 1);
+      return pos(rng);
+    }
+
+    std::size_t front_loaded(void)
+    {
+      double u = std::uniform_real_distribution<double>(0, 1)(rng);
+      return static_cast<std::size_t>(u * u * u * (operations - 1));
+    }
+
+    std::size_t tail_loaded(void)
+    {
+      return operations - 1 - front_loaded();
+    }
+
+    operation random_operation(void)
+    {
+      int key = std::uniform_int_distribution<int>(0, keys - 1)(rng);
+      operation op = { key % 5 == 0, key, key * 3 };
+      return op;
+    }
+
+    retro::full_map<int, int>::time_point
+      perform(std::size_t pos, const operation &op)
+    {
+      return op.erase ? m.erase(times[pos], op.key)
+                      : m.assign(times[pos], op.key, op.val);
+    }
+
+    // Rebuild the contents just before an operation of the original history
+    // by replaying the log, including the operations inserted before it.
+    std::map<int, int> replay(std::size_t until) const
+    {
+      std::map<int, int> state;
+      for (std::size_t i = 0; i <= until; i++)
+      {
+        for (auto &op : before[i]) apply(state, op);
+        if (i < until) apply(state, log[i]);
+      }
+      return state;
+    }
+
+    static void apply(std::map<int, int> &state, const operation &op)
+    {
+      if (op.erase)
+        state.erase(op.key);
+      else
+        state[op.key] = op.val;
+    }
+
+    std::mt19937 rng;
+    retro::full_map<int, int> m;
+    std::vector<retro::full_map<int, int>::time_point> times;
+
+    // The original history, and the operations inserted before each one.
+    std::vector<operation> log;
+    std::vector<std::vector<operation>> before;
+
+    std::size_t sink;
+};
+
+} // end namespace
+
+BENCHMARK_F(RetroactiveWorkload, FullMapRandomPastOperations, 5, 1)
+{
+  for (std::size_t i = 0; i < changes; i++)
+    perform(uniform(), random_operation());
+}
+
+BENCHMARK_F(RetroactiveWorkload, ReplayRandomPastOperations, 5, 1)
+{
+  for (std::size_t i = 0; i < changes; i++)
+  {
+    before[uniform()].push_back(random_operation());
+    sink += replay(operations).size();
+  }
+}
+
+BENCHMARK_F(RetroactiveWorkload, FullMapFrontLoadedOperations, 5, 1)
+{
+  for (std::size_t i = 0; i < changes; i++)
+    perform(front_loaded(), random_operation());
+}
+
+BENCHMARK_F(RetroactiveWorkload, ReplayFrontLoadedOperations, 5, 1)
+{
+  for (std::size_t i = 0; i < changes; i++)
+  {
+    before[front_loaded()].push_back(random_operation());
+    sink += replay(operations).size();
+  }
+}
+
+BENCHMARK_F(RetroactiveWorkload, FullMapTailLoadedOperations, 5, 1)
+{
+  for (std::size_t i = 0; i < changes; i++)
+    perform(tail_loaded(), random_operation());
+}
+
+BENCHMARK_F(RetroactiveWorkload, ReplayTailLoadedOperations, 5, 1)
+{
+  for (std::size_t i = 0; i < changes; i++)
+  {
+    before[tail_loaded()].push_back(random_operation());
+    sink += replay(operations).size();
+  }
+}
+
+BENCHMARK_F(RetroactiveWorkload, FullMapRevertChurn, 5, 1)
+{
+  for (std::size_t i = 0; i < changes; i++)
+    m.revert(perform(uniform(), random_operation()));
+}
+
+BENCHMARK_F(RetroactiveWorkload, ReplayRevertChurn, 5, 1)
+{
+  for (std::size_t i = 0; i < changes; i++)
+  {
+    auto &ops = before[uniform()];
+    ops.push_back(random_operation());
+    sink += replay(operations).size();
+    ops.pop_back();
+    sink += replay(operations).size();
+  }
+}
+
+BENCHMARK_F(RetroactiveWorkload, FullMapFindAtRandomTime, 5, 1)
+{
+  for (std::size_t i = 0; i < queries; i++)
+  {
+    auto t = times[uniform()];
+    sink += m.find(t, random_operation().key) != m.end(t);
+  }
+}
+
+BENCHMARK_F(RetroactiveWorkload, ReplayFindAtRandomTime, 5, 1)
+{
+  for (std::size_t i = 0; i < queries; i++)
+    sink += replay(uniform()).count(random_operation().key);
+}
+
+BENCHMARK_F(RetroactiveWorkload, FullMapScanAtRandomTime, 5, 1)
+{
+  for (std::size_t i = 0; i < scans; i++)
+  {
+    auto t = times[uniform()];
+    for (auto it = m.begin(t); it != m.end(t); ++it)
+      sink += it->second;
+  }
+}
+
+BENCHMARK_F(RetroactiveWorkload, ReplayScanAtRandomTime, 5, 1)
+{
+  for (std::size_t i = 0; i < scans; i++)
+  {
+    for (auto &entry : replay(uniform()))
+      sink += entry.second;
+  }
+}
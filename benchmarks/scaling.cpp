@@ -0,0 +1,529 @@
+// Measures the time of each container operation as the container grows from
+// 10^3 to 10^k elements, where k is 7 unless given, and fits the growth
+// against O(1), O(log n), O(sqrt n) and O(n).
+//
+// Usage: run_scaling [largest power of ten]
+//
+// Each model is fitted as t = a + b * f(n), where a covers the constant
+// overhead that dominates small containers, and the best fit is the model
+// with the smallest residual. The program points out any operation whose
+// best fit grows faster than its documented complexity. Timings vary too
+// much between machines and runs to fail on that, so the program only
+// reports it. Once a container outgrows a cache, every step through it
+// slows down at once, and no model fits that jump well; the error of each
+// fit is printed so that a poor best fit can be told apart from a real
+// change in growth.
+
+#include "retro/map.hpp"
+#include "retro/queue.hpp"
+#include "retro/detail/ordered_list.hpp"
+#include "retro/detail/slab.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+namespace
+{
+
+volatile std::size_t sink;
+
+std::mt19937 rng;
+
+std::size_t random_index(std::size_t n)
+{
+  return std::uniform_int_distribution<std::size_t>(0, n - 1)(rng);
+}
+
+// The number of operations timed on a container of n elements, few enough
+// not to change its size much.
+std::size_t batch_size(std::size_t n)
+{
+  return std::min<std::size_t>(std::max<std::size_t>(n / 10, 100), 10000);
+}
+
+// The number of parts a batch is timed in.
+const std::size_t samples = 5;
+
+// Time a batch of operations in a few parts and return the nanoseconds per
+// operation of the fastest part, which is the one least disturbed by
+// anything else running.
+template <class Function>
+double time_per_operation(std::size_t ops, Function f)
+{
+  std::size_t part = std::max<std::size_t>(ops / samples, 1);
+  double best = 0;
+  for (std::size_t done = 0; done < ops; done += part)
+  {
+    auto begin = std::chrono::steady_clock::now();
+    for (std::size_t i = 0; i < part; i++)
+      f();
+    auto elapsed = std::chrono::steady_clock::now() - begin;
+
+    double t = std::chrono::duration<double, std::nano>(elapsed).count()
+               / part;
+    if (done == 0 || t < best) best = t;
+  }
+  return best;
+}
+
+// Remove an element from a vector in constant time, without keeping order.
+template <class U>
+U take(std::vector<U> &v, std::size_t i)
+{
+  U result = v[i];
+  v[i] = v.back();
+  v.pop_back();
+  return result;
+}
+
+typedef retro::detail::ordered_list<int> list_type;
+
+std::vector<list_type::iterator> fill(list_type &l, std::size_t n)
+{
+  std::vector<list_type::iterator> its;
+  for (std::size_t i = 0; i < n; i++)
+  {
+    l.push_back(static_cast<int>(i));
+    its.push_back(std::prev(l.end()));
+  }
+  return its;
+}
+
+double ordered_list_insert(std::size_t n)
+{
+  list_type l;
+  auto its = fill(l, n);
+  return time_per_operation(batch_size(n), [&]
+  {
+    l.insert(its[random_index(n)], 0);
+  });
+}
+
+// Appending is how every container records operations at present, and it
+// keeps filling the labels at the end of the list.
+double ordered_list_push_back(std::size_t n)
+{
+  list_type l;
+  fill(l, n);
+  return time_per_operation(batch_size(n), [&]
+  {
+    l.push_back(0);
+  });
+}
+
+double ordered_list_erase(std::size_t n)
+{
+  list_type l;
+  auto its = fill(l, n);
+  return time_per_operation(batch_size(n), [&]
+  {
+    l.erase(take(its, random_index(its.size())));
+  });
+}
+
+double ordered_list_compare(std::size_t n)
+{
+  list_type l;
+  auto its = fill(l, n);
+  return time_per_operation(batch_size(n), [&]
+  {
+    sink += its[random_index(n)] < its[random_index(n)];
+  });
+}
+
+// Growing a slab must not reallocate its bookkeeping on every insert, or
+// building any container becomes quadratic.
+double slab_insert(std::size_t n)
+{
+  retro::detail::slab<int> s;
+  for (std::size_t i = 0; i < n; i++)
+    s.insert(static_cast<int>(i));
+  return time_per_operation(batch_size(n), [&]
+  {
+    s.insert(0);
+  });
+}
+
+typedef retro::partial_queue<int> queue_type;
+
+std::vector<queue_type::time_point> fill(queue_type &q, std::size_t n)
+{
+  std::vector<queue_type::time_point> times;
+  for (std::size_t i = 0; i < n; i++)
+    times.push_back(q.push(static_cast<int>(i)));
+  return times;
+}
+
+double partial_queue_push(std::size_t n)
+{
+  queue_type q;
+  fill(q, n);
+  return time_per_operation(batch_size(n), [&]
+  {
+    q.push(0);
+  });
+}
+
+double partial_queue_push_in_past(std::size_t n)
+{
+  queue_type q;
+  auto times = fill(q, n);
+  return time_per_operation(batch_size(n), [&]
+  {
+    q.push(times[random_index(n)], 0);
+  });
+}
+
+double partial_queue_pop(std::size_t n)
+{
+  queue_type q;
+  fill(q, n);
+  return time_per_operation(batch_size(n), [&]
+  {
+    q.pop();
+  });
+}
+
+double partial_queue_revert(std::size_t n)
+{
+  queue_type q;
+  auto times = fill(q, n);
+  return time_per_operation(batch_size(n), [&]
+  {
+    q.revert(take(times, random_index(times.size())));
+  });
+}
+
+typedef retro::full_map<int, int> map_type;
+
+// Every key is assigned eight times on average.
+int key_count(std::size_t n)
+{
+  return static_cast<int>(std::max<std::size_t>(n / 8, 1));
+}
+
+int random_key(std::size_t n)
+{
+  return static_cast<int>(random_index(key_count(n)));
+}
+
+std::vector<map_type::time_point> fill(map_type &m, std::size_t n)
+{
+  std::vector<map_type::time_point> times;
+  for (std::size_t i = 0; i < n; i++)
+    times.push_back(m.assign(random_key(n), static_cast<int>(i)));
+  return times;
+}
+
+double full_map_assign(std::size_t n)
+{
+  map_type m;
+  fill(m, n);
+  return time_per_operation(batch_size(n), [&]
+  {
+    m.assign(random_key(n), 0);
+  });
+}
+
+double full_map_assign_in_past(std::size_t n)
+{
+  map_type m;
+  auto times = fill(m, n);
+  return time_per_operation(batch_size(n), [&]
+  {
+    m.assign(times[random_index(n)], random_key(n), 0);
+  });
+}
+
+double full_map_insert(std::size_t n)
+{
+  map_type m;
+  fill(m, n);
+  return time_per_operation(batch_size(n), [&]
+  {
+    m.insert(std::make_pair(random_key(n), 0));
+  });
+}
+
+double full_map_insert_in_past(std::size_t n)
+{
+  map_type m;
+  auto times = fill(m, n);
+  return time_per_operation(batch_size(n), [&]
+  {
+    m.insert(times[random_index(n)], std::make_pair(random_key(n), 0));
+  });
+}
+
+double full_map_erase(std::size_t n)
+{
+  map_type m;
+  fill(m, n);
+  return time_per_operation(batch_size(n), [&]
+  {
+    m.erase(random_key(n));
+  });
+}
+
+double full_map_erase_in_past(std::size_t n)
+{
+  map_type m;
+  auto times = fill(m, n);
+  return time_per_operation(batch_size(n), [&]
+  {
+    m.erase(times[random_index(n)], random_key(n));
+  });
+}
+
+// Every key is assigned once more, so each search finds its key.
+double full_map_find(std::size_t n)
+{
+  map_type m;
+  fill(m, n);
+  for (int key = 0; key < key_count(n); key++)
+    m.assign(key, key);
+  return time_per_operation(batch_size(n), [&]
+  {
+    sink += m.find(random_key(n))->second;
+  });
+}
+
+double full_map_find_in_past(std::size_t n)
+{
+  map_type m;
+  auto times = fill(m, n);
+  return time_per_operation(batch_size(n), [&]
+  {
+    auto t = times[random_index(n)];
+    sink += m.find(t, random_key(n)) != m.end(t);
+  });
+}
+
+double full_map_begin_in_past(std::size_t n)
+{
+  map_type m;
+  auto times = fill(m, n);
+  return time_per_operation(batch_size(n), [&]
+  {
+    auto t = times[random_index(n)];
+    sink += m.begin(t) != m.end(t);
+  });
+}
+
+double full_map_lower_bound(std::size_t n)
+{
+  map_type m;
+  fill(m, n);
+  return time_per_operation(batch_size(n), [&]
+  {
+    sink += m.lower_bound(random_key(n)) != m.end();
+  });
+}
+
+double full_map_lower_bound_in_past(std::size_t n)
+{
+  map_type m;
+  auto times = fill(m, n);
+  return time_per_operation(batch_size(n), [&]
+  {
+    auto t = times[random_index(n)];
+    sink += m.lower_bound(t, random_key(n)) != m.end(t);
+  });
+}
+
+double full_map_upper_bound(std::size_t n)
+{
+  map_type m;
+  fill(m, n);
+  return time_per_operation(batch_size(n), [&]
+  {
+    sink += m.upper_bound(random_key(n)) != m.end();
+  });
+}
+
+double full_map_upper_bound_in_past(std::size_t n)
+{
+  map_type m;
+  auto times = fill(m, n);
+  return time_per_operation(batch_size(n), [&]
+  {
+    auto t = times[random_index(n)];
+    sink += m.upper_bound(t, random_key(n)) != m.end(t);
+  });
+}
+
+double full_map_revert(std::size_t n)
+{
+  map_type m;
+  auto times = fill(m, n);
+  return time_per_operation(batch_size(n), [&]
+  {
+    m.revert(take(times, random_index(times.size())));
+  });
+}
+
+struct complexity
+{
+  const char *name;
+  double (*scale)(double n);
+};
+
+double constant(double) { return 0; }
+double logarithmic(double n) { return std::log2(n); }
+double square_root(double n) { return std::sqrt(n); }
+double linear(double n) { return n; }
+
+const complexity complexities[] = {
+  { "O(1)", constant },
+  { "O(log n)", logarithmic },
+  { "O(sqrt n)", square_root },
+  { "O(n)", linear }
+};
+
+const std::size_t complexity_count = sizeof(complexities)
+                                     / sizeof(complexities[0]);
+
+enum complexity_class { o_1, o_log_n, o_sqrt_n, o_n };
+
+// The documented complexity of each operation, amortized where the
+// documentation says so.
+struct sweep
+{
+  const char *name;
+  double (*measure)(std::size_t n);
+  complexity_class documented;
+};
+
+const sweep sweeps[] = {
+  { "OrderedList.Insert", ordered_list_insert, o_log_n },
+  { "OrderedList.PushBack", ordered_list_push_back, o_1 },
+  { "OrderedList.Erase", ordered_list_erase, o_1 },
+  { "OrderedList.Compare", ordered_list_compare, o_1 },
+  { "Slab.Insert", slab_insert, o_1 },
+  { "PartialQueue.Push", partial_queue_push, o_log_n },
+  { "PartialQueue.PushInPast", partial_queue_push_in_past, o_log_n },
+  { "PartialQueue.Pop", partial_queue_pop, o_log_n },
+  { "PartialQueue.Revert", partial_queue_revert, o_log_n },
+  { "FullMap.Insert", full_map_insert, o_log_n },
+  { "FullMap.InsertInPast", full_map_insert_in_past, o_log_n },
+  { "FullMap.Erase", full_map_erase, o_log_n },
+  { "FullMap.EraseInPast", full_map_erase_in_past, o_log_n },
+  { "FullMap.Assign", full_map_assign, o_log_n },
+  { "FullMap.AssignInPast", full_map_assign_in_past, o_log_n },
+  { "FullMap.Find", full_map_find, o_log_n },
+  { "FullMap.FindInPast", full_map_find_in_past, o_log_n },
+  { "FullMap.BeginInPast", full_map_begin_in_past, o_log_n },
+  { "FullMap.LowerBound", full_map_lower_bound, o_log_n },
+  { "FullMap.LowerBoundInPast", full_map_lower_bound_in_past, o_log_n },
+  { "FullMap.UpperBound", full_map_upper_bound, o_log_n },
+  { "FullMap.UpperBoundInPast", full_map_upper_bound_in_past, o_log_n },
+  { "FullMap.Revert", full_map_revert, o_log_n }
+};
+
+// Fit the times to a + b * scale(n) with b not negative, and return
+// the typical relative error of the fit. The fit minimizes the relative
+// errors, since the times span several orders of magnitude. The squared
+// errors are divided by the degrees of freedom left, so that O(1), which
+// has no b to fit, is not beaten by models that fit one more parameter to
+// noise.
+double fit(const std::vector<double> &sizes, const std::vector<double> &times,
+           const complexity &c)
+{
+  // Dividing by the time turns the fit into least squares on
+  // a * x + b * y = 1.
+  double xx = 0, xy = 0, yy = 0, x1 = 0, y1 = 0;
+  for (std::size_t i = 0; i < sizes.size(); i++)
+  {
+    double x = 1 / times[i], y = c.scale(sizes[i]) / times[i];
+    xx += x * x; xy += x * y; yy += y * y; x1 += x; y1 += y;
+  }
+
+  double a = x1 / xx, b = 0;
+  std::size_t parameters = 1;
+  if (c.scale != constant)
+  {
+    parameters = 2;
+    double det = xx * yy - xy * xy;
+    double full_a = (x1 * yy - y1 * xy) / det;
+    double full_b = (y1 * xx - x1 * xy) / det;
+    if (full_b >= 0)
+    {
+      a = full_a;
+      b = full_b;
+    }
+  }
+
+  double error = 0;
+  for (std::size_t i = 0; i < sizes.size(); i++)
+  {
+    double diff = (a + b * c.scale(sizes[i])) / times[i] - 1;
+    error += diff * diff;
+  }
+  return std::sqrt(error / (sizes.size() - parameters));
+}
+
+} // end namespace
+
+int main(int argc, char **argv)
+{
+  // Three sizes at least leave a degree of freedom for every model.
+  int largest = argc > 1 ? std::atoi(argv[1]) : 7;
+  if (largest < 5)
+  {
+    std::fprintf(stderr, "usage: %s [largest power of ten, at least 5]\n",
+                 argv[0]);
+    return 2;
+  }
+
+  int faster = 0;
+  for (const sweep &s : sweeps)
+  {
+    std::printf("%s\n%12s %12s\n", s.name, "n", "ns/op");
+
+    std::vector<double> sizes, times;
+    for (std::size_t n = 1000; sizes.size() <= largest - 3u; n *= 10)
+    {
+      // Small containers are timed on several fresh copies, keeping the
+      // fastest, since a single batch is too short to time reliably.
+      std::size_t rounds = std::max<std::size_t>(100000 / n, 1);
+      double best = 0;
+      rng.seed(42);
+      for (std::size_t r = 0; r < rounds; r++)
+      {
+        double t = s.measure(n);
+        if (r == 0 || t < best) best = t;
+      }
+
+      std::printf("%12zu %12.1f\n", n, best);
+      std::fflush(stdout);
+      sizes.push_back(static_cast<double>(n));
+      times.push_back(best);
+    }
+
+    std::size_t best_fit = 0;
+    double errors[complexity_count];
+    for (std::size_t c = 0; c < complexity_count; c++)
+    {
+      errors[c] = fit(sizes, times, complexities[c]);
+      if (errors[c] < errors[best_fit]) best_fit = c;
+      std::printf("  %s: %.1f%%", complexities[c].name, errors[c] * 100);
+    }
+    std::printf("\n  best fit: %s, documented: %s\n\n",
+                complexities[best_fit].name,
+                complexities[s.documented].name);
+
+    if (best_fit > static_cast<std::size_t>(s.documented))
+      faster++;
+  }
+
+  if (faster)
+    std::printf("%d operations fit a faster growth than documented.\n",
+                faster);
+  return 0;
+}
@@ -0,0 +1,57 @@
+#include <hayai.hpp>
+
+#include "retro/sharded_map.hpp"
+
+#include <thread>
+#include <vector>
+
+namespace
+{
+
+// Insert the same number of keys in total from a number of threads.
+void insert_from_threads(int threads)
+{
+  const int total = 200000;
+  retro::sharded_full_map<int, int> m(16);
+
+  std::vector<std::thread> workers;
+  for (int t = 0; t < threads; t++)
+  {
+    workers.emplace_back([&m, t, threads, total]()
+    {
+      for (int i = t; i < total; i += threads)
+        m.insert(std::make_pair(i, i));
+    });
+  }
+  for (auto &w : workers) w.join();
+}
+
+} // end namespace
+
+BENCHMARK(ShardedFullMap, InsertFromOneThread, 1, 10)
+{
+  insert_from_threads(1);
+}
+
+BENCHMARK(ShardedFullMap, InsertFromTwoThreads, 1, 10)
+{
+  insert_from_threads(2);
+}
+
+BENCHMARK(ShardedFullMap, InsertFromFourThreads, 1, 10)
+{
+  insert_from_threads(4);
+}
+
+BENCHMARK(ShardedFullMap, InsertFromEightThreads, 1, 10)
+{
+  insert_from_threads(8);
+}
+
+BENCHMARK(FullMap, InsertFromOneThread, 1, 10)
+{
+  retro::full_map<int, int> m;
+
+  for (int i = 0; i < 200000; i++)
+    m.insert(std::make_pair(i, i));
+}
@@ -0,0 +1,27 @@
+#include <hayai.hpp>
+
+#include "retro/unordered_map.hpp"
+
+#include <unordered_map>
+
+BENCHMARK(FullUnorderedMap, InsertAndFindNumericKeys, 1, 10)
+{
+  retro::full_unordered_map<int, int> q;
+
+  for (int i = 0; i < 100000; i++)
+    q.insert(std::make_pair(i, i));
+
+  for (int i = 0; i < 100000; i++)
+    q.find(i);
+}
+
+BENCHMARK(StlUnorderedMap, InsertAndFindNumericKeys, 1, 10)
+{
+  std::unordered_map<int, int> q;
+
+  for (int i = 0; i < 100000; i++)
+    q.insert(std::make_pair(i, i));
+
+  for (int i = 0; i < 100000; i++)
+    q.find(i);
+}
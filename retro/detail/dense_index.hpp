@@ -0,0 +1,242 @@
+/*! \file dense_index.hpp
+ *  \brief Implementation of a direct-address table that maps small
+ *         non-negative integer keys to values with an interface similar to an
+ *         STL map.
+ */
+
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <iterator>
+#include <utility>
+#include <type_traits>
+#include <functional>
+#include <stdexcept>
+#include <cstddef>
+
+#include "retro/memory.hpp"
+
+namespace retro
+{
+
+namespace detail
+{
+
+/*! \brief Represents an ordered map from integer keys to values that stores
+ *  the value of key i in slot i of an array.
+ *  \p Every key below the largest key inserted has a slot, so this is only
+ *     efficient when the keys are dense. Keys must be non-negative: a
+ *     negative key is never found, and storing one throws std::out_of_range
+ *     rather than growing the array to a huge size. A key is considered to
+ *     be in the index when its value is not empty, so the mapped type must be
+ *     a container.
+ *
+ *  \tparam Key The integer type of keys to store.
+ *  \tparam T The type of the container associated with each key.
+ *  \tparam Allocator The allocator that the slots are allocated from. The
+ *                    container of each slot allocates from a copy of it.
+ */
+template <class Key, class T,
+          class Allocator = std::allocator<std::pair<const Key, T>>>
+class dense_index
+{
+  static_assert(std::is_integral<Key>::value,
+                "dense_index requires an integer key type");
+
+  public:
+    typedef Key key_type;
+    typedef T mapped_type;
+    typedef std::pair<const Key, T> value_type;
+    typedef Allocator allocator_type;
+    typedef std::vector<value_type,
+                        typename std::allocator_traits<Allocator>
+                          ::template rebind_alloc<value_type>> container_type;
+    typedef typename container_type::size_type size_type;
+
+    /*! Bidirectional iterator that traverses every slot in key order.
+     *  Iterators remain valid when the index grows.
+     */
+    class iterator
+      : public std::iterator<std::bidirectional_iterator_tag, value_type>
+    {
+      public:
+        typedef value_type& reference;
+        typedef value_type* pointer;
+
+        iterator(void)
+          : slots(0), pos(0)
+        {
+        }
+
+        reference operator*() const
+        {
+          return (*slots)[pos];
+        }
+
+        pointer operator->() const
+        {
+          return &(*slots)[pos];
+        }
+
+        iterator &operator++()
+        {
+          ++pos;
+          return *this;
+        }
+
+        iterator operator++(int)
+        {
+          iterator old = *this;
+          ++pos;
+          return old;
+        }
+
+        iterator &operator--()
+        {
+          --pos;
+          return *this;
+        }
+
+        iterator operator--(int)
+        {
+          iterator old = *this;
+          --pos;
+          return old;
+        }
+
+        bool operator==(const iterator &other) const
+        {
+          return pos == other.pos;
+        }
+
+        bool operator!=(const iterator &other) const
+        {
+          return !(*this == other);
+        }
+
+      private:
+        iterator(container_type *slots, size_type pos)
+          : slots(slots), pos(pos)
+        {
+        }
+
+        container_type *slots;
+        size_type pos;
+
+        friend class dense_index<Key, T, Allocator>;
+    }; // end iterator
+
+    /*! Construct an empty index.
+     *  \param alloc The allocator to allocate the slots from.
+     */
+    explicit dense_index(const allocator_type &alloc = allocator_type());
+
+    /*! Construct an empty index. The comparison is implied by the order of
+     *  the keys and is ignored.
+     *  \param alloc The allocator to allocate the slots from.
+     */
+    template <class Compare>
+    explicit dense_index(const Compare &,
+                const allocator_type &alloc = allocator_type());
+
+    dense_index(const dense_index &other) = default;
+
+    dense_index &operator=(const dense_index &other);
+
+    /*! Return the number of slots in the index.
+     */
+    size_type size(void) const;
+
+    /*! Return the number of bytes allocated for slots.
+     */
+    std::size_t bytes(void) const;
+
+    /*! Return the function object that orders keys.
+     */
+    std::less<Key> key_comp(void) const;
+
+    /*! Get an iterator to the slot of the smallest key.
+     */
+    iterator begin(void);
+
+    /*! Get an iterator past the slot of the largest key.
+     */
+    iterator end(void);
+
+    /*! Search for a key that is in the index.
+     *  \param key The key to search for.
+     *  \return An iterator to the slot of the key, or end() if it is empty.
+     */
+    iterator find(const key_type &key);
+
+    /*! Return an iterator to the first slot whose key is not less than key.
+     */
+    iterator lower_bound(const key_type &key);
+
+    /*! Return an iterator to the first slot whose key is greater than key.
+     */
+    iterator upper_bound(const key_type &key);
+
+    /*! Return the range of slots that have a given key.
+     */
+    std::pair<iterator, iterator> equal_range(const key_type &key);
+
+    /*! Return whether a key can be stored, which it can unless it is
+     *  negative.
+     */
+    static bool storable(const key_type &key);
+
+    /*! Get the value in the slot of a key, growing the index if the key is
+     *  larger than any seen before.
+     *  \param key The key to search for.
+     *  \throw std::out_of_range If the key is negative.
+     */
+    mapped_type &operator[](const key_type &key);
+
+    /*! Insert a value into the slot of a key if that slot is empty.
+     *  \param val The key and the value to insert.
+     *  \return An iterator to the slot of the key, and whether the value was
+     *          inserted.
+     */
+    std::pair<iterator, bool> insert(const value_type &val);
+
+    /*! Insert a value into the slot of a key if that slot is empty. The hint
+     *  is ignored, as the slot is found directly.
+     *  \return An iterator to the slot of the key.
+     */
+    iterator insert(iterator hint, const value_type &val);
+
+    /*! Empty the slot referred to by an iterator.
+     *  \param it An iterator to the slot to empty.
+     */
+    void erase(iterator it);
+
+  private:
+    T empty(void) const;
+
+    size_type slot(const key_type &key) const;
+
+    static bool negative(const key_type &key);
+
+    static bool negative(const key_type &key, std::true_type);
+
+    static bool negative(const key_type &key, std::false_type);
+
+    container_type slots_;
+}; // end dense_index
+
+/*! Return the number of bytes allocated by a dense index.
+ */
+template <class Key, class T, class Allocator>
+std::size_t container_bytes(const dense_index<Key, T, Allocator> &index)
+{
+  return index.bytes();
+}
+
+} // end detail
+
+} // end retro
+
+#include <retro/detail/dense_index.inl>
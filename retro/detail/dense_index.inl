@@ -0,0 +1,204 @@
+namespace retro
+{
+
+namespace detail
+{
+
+template <class Key, class T, class Allocator>
+  dense_index<Key, T, Allocator>
+    ::dense_index(const allocator_type &alloc)
+    : slots_(alloc)
+{
+}
+
+template <class Key, class T, class Allocator>
+  template <class Compare>
+    dense_index<Key, T, Allocator>
+      ::dense_index(const Compare &, const allocator_type &alloc)
+    : slots_(alloc)
+{
+}
+
+template <class Key, class T, class Allocator>
+  dense_index<Key, T, Allocator> &
+    dense_index<Key, T, Allocator>
+      ::operator=(const dense_index &other)
+{
+  // The key of each slot is const, so the slots can't be assigned in place.
+  container_type slots(other.slots_, slots_.get_allocator());
+  slots_.swap(slots);
+  return *this;
+}
+
+template <class Key, class T, class Allocator>
+  typename dense_index<Key, T, Allocator>::size_type
+    dense_index<Key, T, Allocator>
+      ::size(void) const
+{
+  return slots_.size();
+}
+
+template <class Key, class T, class Allocator>
+  std::size_t dense_index<Key, T, Allocator>
+    ::bytes(void) const
+{
+  return container_bytes(slots_);
+}
+
+template <class Key, class T, class Allocator>
+  std::less<Key>
+    dense_index<Key, T, Allocator>
+      ::key_comp(void) const
+{
+  return std::less<Key>();
+}
+
+template <class Key, class T, class Allocator>
+  typename dense_index<Key, T, Allocator>::iterator
+    dense_index<Key, T, Allocator>
+      ::begin(void)
+{
+  return iterator(&slots_, 0);
+}
+
+template <class Key, class T, class Allocator>
+  typename dense_index<Key, T, Allocator>::iterator
+    dense_index<Key, T, Allocator>
+      ::end(void)
+{
+  return iterator(&slots_, slots_.size());
+}
+
+template <class Key, class T, class Allocator>
+  typename dense_index<Key, T, Allocator>::iterator
+    dense_index<Key, T, Allocator>
+      ::find(const key_type &key)
+{
+  if (negative(key)) return end();
+
+  size_type pos = slot(key);
+  if (pos < slots_.size() && !slots_[pos].second.empty())
+    return iterator(&slots_, pos);
+  return end();
+}
+
+template <class Key, class T, class Allocator>
+  typename dense_index<Key, T, Allocator>::iterator
+    dense_index<Key, T, Allocator>
+      ::lower_bound(const key_type &key)
+{
+  if (negative(key)) return begin();
+  return iterator(&slots_, std::min(slot(key), slots_.size()));
+}
+
+template <class Key, class T, class Allocator>
+  typename dense_index<Key, T, Allocator>::iterator
+    dense_index<Key, T, Allocator>
+      ::upper_bound(const key_type &key)
+{
+  if (negative(key)) return begin();
+  return iterator(&slots_, std::min(slot(key) + 1, slots_.size()));
+}
+
+template <class Key, class T, class Allocator>
+  std::pair<typename dense_index<Key, T, Allocator>::iterator,
+            typename dense_index<Key, T, Allocator>::iterator>
+    dense_index<Key, T, Allocator>
+      ::equal_range(const key_type &key)
+{
+  return std::make_pair(lower_bound(key), upper_bound(key));
+}
+
+template <class Key, class T, class Allocator>
+  bool dense_index<Key, T, Allocator>
+    ::storable(const key_type &key)
+{
+  return !negative(key);
+}
+
+template <class Key, class T, class Allocator>
+  typename dense_index<Key, T, Allocator>::mapped_type &
+    dense_index<Key, T, Allocator>
+      ::operator[](const key_type &key)
+{
+  // A negative key would wrap around to a slot far beyond every other.
+  if (!storable(key))
+    throw std::out_of_range("dense_index: negative keys cannot be stored");
+
+  // Give every key up to this one a slot of its own.
+  size_type pos = slot(key);
+  while (slots_.size() <= pos)
+    slots_.push_back(value_type(static_cast<Key>(slots_.size()), empty()));
+
+  return slots_[pos].second;
+}
+
+template <class Key, class T, class Allocator>
+  std::pair<typename dense_index<Key, T, Allocator>::iterator, bool>
+    dense_index<Key, T, Allocator>
+      ::insert(const value_type &val)
+{
+  mapped_type &mapped = (*this)[val.first];
+  bool inserted = mapped.empty();
+  if (inserted) mapped = val.second;
+
+  return std::make_pair(iterator(&slots_, slot(val.first)), inserted);
+}
+
+template <class Key, class T, class Allocator>
+  typename dense_index<Key, T, Allocator>::iterator
+    dense_index<Key, T, Allocator>
+      ::insert(iterator, const value_type &val)
+{
+  return insert(val).first;
+}
+
+template <class Key, class T, class Allocator>
+  void dense_index<Key, T, Allocator>
+    ::erase(iterator it)
+{
+  // Swap rather than clear, so that a container that keeps its storage
+  // releases it too.
+  T(it->second.get_allocator()).swap(it->second);
+}
+
+template <class Key, class T, class Allocator>
+  T dense_index<Key, T, Allocator>
+    ::empty(void) const
+{
+  // Each slot allocates from the same allocator as the index.
+  return T(typename T::allocator_type(slots_.get_allocator()));
+}
+
+template <class Key, class T, class Allocator>
+  typename dense_index<Key, T, Allocator>::size_type
+    dense_index<Key, T, Allocator>
+      ::slot(const key_type &key) const
+{
+  return static_cast<size_type>(key);
+}
+
+template <class Key, class T, class Allocator>
+  bool dense_index<Key, T, Allocator>
+    ::negative(const key_type &key)
+{
+  return negative(key, std::is_signed<Key>());
+}
+
+template <class Key, class T, class Allocator>
+  bool dense_index<Key, T, Allocator>
+    ::negative(const key_type &key, std::true_type)
+{
+  return key < 0;
+}
+
+template <class Key, class T, class Allocator>
+  bool dense_index<Key, T, Allocator>
+    ::negative(const key_type &, std::false_type)
+{
+  return false;
+}
+
+} // end detail
+
+} // end retro
@@ -0,0 +1,164 @@
+/*! \file frozen.hpp
+ *  \brief Definitions shared by the functions that save containers in a
+ *         binary format, load them again, and map them into memory.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <ios>
+#include <istream>
+#include <limits>
+#include <ostream>
+#include <type_traits>
+
+namespace retro
+{
+
+namespace detail
+{
+
+/*! The alignment of every section of a saved container, so that a section
+ *  may be used in place when the whole file is mapped into memory.
+ */
+const std::size_t frozen_alignment = 16;
+
+/*! The version of the format written by this library. Version 2 added the
+ *  timestamps of full_map operations.
+ */
+const std::uint32_t frozen_version = 2;
+
+/*! \brief Represents the header at the start of every saved container.
+ *  \p The sizes of the key and value types are recorded so that a file is
+ *     never read with types that do not match the ones it was written with.
+ */
+struct frozen_header
+{
+  char magic[8];
+  std::uint32_t version;
+  std::uint32_t key_size;
+  std::uint32_t value_size;
+  std::uint32_t reserved;
+  std::uint64_t keys;
+  std::uint64_t events;
+};
+
+/*! Raw storage for one value of a section, so that keys and values are
+ *  read and written without default constructing them.
+ */
+template <class T>
+using frozen_slot =
+  typename std::aligned_storage<sizeof(T), alignof(T)>::type;
+
+/*! Return the number of bytes needed to pad a section of a given size to the
+ *  next multiple of frozen_alignment.
+ */
+inline std::size_t frozen_padding(std::size_t size)
+{
+  return (frozen_alignment - size % frozen_alignment) % frozen_alignment;
+}
+
+/*! Build the header of a saved container.
+ *  \param magic The eight characters that identify the kind of container.
+ */
+inline frozen_header make_frozen_header(const char *magic,
+                                        std::uint32_t key_size,
+                                        std::uint32_t value_size,
+                                        std::uint64_t keys,
+                                        std::uint64_t events)
+{
+  frozen_header header;
+  std::memcpy(header.magic, magic, sizeof(header.magic));
+  header.version = frozen_version;
+  header.key_size = key_size;
+  header.value_size = value_size;
+  header.reserved = 0;
+  header.keys = keys;
+  header.events = events;
+  return header;
+}
+
+/*! Check whether a header was written for the given kind of container and
+ *  element sizes by this version of the library.
+ */
+inline bool check_frozen_header(const frozen_header &header, const char *magic,
+                                std::uint32_t key_size,
+                                std::uint32_t value_size)
+{
+  return std::memcmp(header.magic, magic, sizeof(header.magic)) == 0
+         && header.version == frozen_version
+         && header.key_size == key_size
+         && header.value_size == value_size;
+}
+
+/*! Write an array of trivially copyable values as a section.
+ */
+template <class T>
+void write_section(std::ostream &os, const T *data, std::size_t n)
+{
+  static_assert(std::is_trivially_copyable<T>::value,
+                "only trivially copyable types can be saved");
+
+  static const char zeros[frozen_alignment] = {};
+  os.write(reinterpret_cast<const char *>(data), n * sizeof(T));
+  os.write(zeros, frozen_padding(n * sizeof(T)));
+}
+
+/*! Read an array of trivially copyable values written by write_section.
+ *  \return Whether the whole section was read.
+ */
+template <class T>
+bool read_section(std::istream &is, T *data, std::size_t n)
+{
+  static_assert(std::is_trivially_copyable<T>::value,
+                "only trivially copyable types can be loaded");
+
+  char padding[frozen_alignment];
+  is.read(reinterpret_cast<char *>(data), n * sizeof(T));
+  is.read(padding, frozen_padding(n * sizeof(T)));
+  return static_cast<bool>(is);
+}
+
+/*! Return the number of bytes left to read in a stream, so that the counts
+ *  in a header can be checked before anything is allocated for them.
+ *  \return The bytes left, or the largest stream offset if the stream cannot
+ *          seek. Reading past the end of such a stream still fails, but only
+ *          after the sections have been allocated.
+ */
+inline std::uint64_t remaining_bytes(std::istream &is)
+{
+  std::istream::pos_type pos = is.tellg();
+  if (pos == std::istream::pos_type(-1))
+    return std::numeric_limits<std::streamoff>::max();
+
+  is.seekg(0, std::ios::end);
+  std::istream::pos_type end = is.tellg();
+  is.seekg(pos);
+  if (end == std::istream::pos_type(-1) || !is)
+    return std::numeric_limits<std::streamoff>::max();
+  return static_cast<std::uint64_t>(end - pos);
+}
+
+/*! Check whether a section of n values of a given size, with its padding,
+ *  fits in the bytes left to read, and take it from them.
+ *  \param left The bytes left, which is reduced by the size of the section.
+ *  \return Whether the section fits.
+ */
+inline bool take_section(std::uint64_t &left, std::uint64_t n,
+                         std::size_t size)
+{
+  if (size != 0 && n > left / size) return false;
+
+  std::uint64_t bytes = n * size;
+  bytes += frozen_padding(static_cast<std::size_t>(bytes % frozen_alignment));
+  if (bytes > left) return false;
+
+  left -= bytes;
+  return true;
+}
+
+} // end detail
+
+} // end retro
@@ -0,0 +1,134 @@
+/*! \file hash_table.hpp
+ *  \brief Implementation of an open-addressing hash table whose entries are
+ *         stored contiguously in insertion order.
+ */
+
+#pragma once
+
+#include <vector>
+#include <utility>
+#include <functional>
+#include <iterator>
+
+namespace retro
+{
+
+namespace detail
+{
+
+/*! \brief Represents a hash table that uses linear probing over an array of
+ *  slots, each referring to an entry in a densely packed array.
+ *  \p Entries are never removed, so the entry array doubles as an iteration
+ *     order that does not depend on the hash function. Keys are not const
+ *     in the entries, so that growing the array moves each entry rather than
+ *     copying it along with its value. Callers must not change them.
+ *
+ *  \tparam Key The type of keys to store.
+ *  \tparam T The type of the value associated with each key.
+ *  \tparam Hash The function object used to hash keys.
+ *  \tparam KeyEqual The function object used to compare keys for equality.
+ */
+template <class Key, class T, class Hash = std::hash<Key>,
+          class KeyEqual = std::equal_to<Key>>
+class hash_table
+{
+  public:
+    typedef Key key_type;
+    typedef T mapped_type;
+    typedef std::pair<Key, T> value_type;
+    typedef std::vector<value_type> container_type;
+    typedef typename container_type::size_type size_type;
+    typedef typename container_type::iterator iterator;
+    typedef typename container_type::const_iterator const_iterator;
+    typedef Hash hasher;
+    typedef KeyEqual key_equal;
+
+    /*! Construct an empty hash table.
+     *  \param n The minimum number of entries to reserve space for.
+     *  \param hash The hash function to use.
+     *  \param equal The key equality function to use.
+     */
+    explicit hash_table(size_type n = 0, const hasher &hash = hasher(),
+                        const key_equal &equal = key_equal());
+
+    /*! Return the number of entries in the table.
+     */
+    size_type size(void) const;
+
+    /*! Return the hash function of the table.
+     */
+    hasher hash_function(void) const;
+
+    /*! Return the key equality function of the table.
+     */
+    key_equal key_eq(void) const;
+
+    /*! Return whether the table has no entries.
+     */
+    bool empty(void) const;
+
+    /*! Get an iterator to the first entry in insertion order.
+     */
+    iterator begin(void);
+
+    /*! Get an iterator past the last entry in insertion order.
+     */
+    iterator end(void);
+
+    /*! Search for the entry with a specific key.
+     *  \param key The key to search for.
+     *  \return An iterator to the entry, or end() if there is none.
+     */
+    iterator find(const key_type &key);
+
+    /*! Get the value associated with a key, inserting a default constructed
+     *  value if the key is not in the table. Inserting invalidates all
+     *  iterators.
+     *  \param key The key to search for.
+     */
+    mapped_type &operator[](const key_type &key);
+
+    /*! Get the entry with a specific key, inserting one with a default
+     *  constructed value if the key is not in the table. Inserting
+     *  invalidates all iterators, but entries keep their positions.
+     *  \param key The key to search for.
+     */
+    iterator find_or_insert(const key_type &key);
+
+    /*! Make sure that the table can hold at least n entries without
+     *  rehashing.
+     *  \param n The number of entries to reserve space for.
+     */
+    void reserve(size_type n);
+
+  private:
+    struct slot
+    {
+      slot()
+        : index(0), hash(0)
+      {
+      }
+
+      // One more than the index of the entry, or zero if the slot is empty.
+      size_type index;
+      size_type hash;
+    };
+
+    size_type hash_key(const key_type &key) const;
+
+    size_type probe(const key_type &key, size_type hash) const;
+
+    void rehash(size_type n);
+
+    container_type entries_;
+    std::vector<slot> slots_;
+    size_type mask_;
+    hasher hash_;
+    key_equal equal_;
+}; // end hash_table
+
+} // end detail
+
+} // end retro
+
+#include <retro/detail/hash_table.inl>
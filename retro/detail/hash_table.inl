@@ -0,0 +1,164 @@
+namespace retro
+{
+
+namespace detail
+{
+
+template <class Key, class T, class Hash, class KeyEqual>
+  hash_table<Key, T, Hash, KeyEqual>
+    ::hash_table(size_type n, const hasher &hash, const key_equal &equal)
+      : mask_(0), hash_(hash), equal_(equal)
+{
+  rehash(n);
+}
+
+template <class Key, class T, class Hash, class KeyEqual>
+  typename hash_table<Key, T, Hash, KeyEqual>::size_type
+    hash_table<Key, T, Hash, KeyEqual>
+      ::size(void) const
+{
+  return entries_.size();
+}
+
+template <class Key, class T, class Hash, class KeyEqual>
+  typename hash_table<Key, T, Hash, KeyEqual>::hasher
+    hash_table<Key, T, Hash, KeyEqual>
+      ::hash_function(void) const
+{
+  return hash_;
+}
+
+template <class Key, class T, class Hash, class KeyEqual>
+  typename hash_table<Key, T, Hash, KeyEqual>::key_equal
+    hash_table<Key, T, Hash, KeyEqual>
+      ::key_eq(void) const
+{
+  return equal_;
+}
+
+template <class Key, class T, class Hash, class KeyEqual>
+  bool hash_table<Key, T, Hash, KeyEqual>
+    ::empty(void) const
+{
+  return entries_.empty();
+}
+
+template <class Key, class T, class Hash, class KeyEqual>
+  typename hash_table<Key, T, Hash, KeyEqual>::iterator
+    hash_table<Key, T, Hash, KeyEqual>
+      ::begin(void)
+{
+  return entries_.begin();
+}
+
+template <class Key, class T, class Hash, class KeyEqual>
+  typename hash_table<Key, T, Hash, KeyEqual>::iterator
+    hash_table<Key, T, Hash, KeyEqual>
+      ::end(void)
+{
+  return entries_.end();
+}
+
+template <class Key, class T, class Hash, class KeyEqual>
+  typename hash_table<Key, T, Hash, KeyEqual>::iterator
+    hash_table<Key, T, Hash, KeyEqual>
+      ::find(const key_type &key)
+{
+  const slot &s = slots_[probe(key, hash_key(key))];
+  return s.index ? entries_.begin() + (s.index - 1) : entries_.end();
+}
+
+template <class Key, class T, class Hash, class KeyEqual>
+  typename hash_table<Key, T, Hash, KeyEqual>::mapped_type &
+    hash_table<Key, T, Hash, KeyEqual>
+      ::operator[](const key_type &key)
+{
+  return find_or_insert(key)->second;
+}
+
+template <class Key, class T, class Hash, class KeyEqual>
+  typename hash_table<Key, T, Hash, KeyEqual>::iterator
+    hash_table<Key, T, Hash, KeyEqual>
+      ::find_or_insert(const key_type &key)
+{
+  size_type hash = hash_key(key);
+  size_type pos = probe(key, hash);
+  if (slots_[pos].index) return entries_.begin() + (slots_[pos].index - 1);
+
+  // Keep the load factor at most one half so that probe sequences stay
+  // short. The slot has to be found again if the table grows.
+  if (2 * (entries_.size() + 1) > slots_.size())
+  {
+    rehash(entries_.size() + 1);
+    pos = probe(key, hash);
+  }
+
+  entries_.push_back(value_type(key, mapped_type()));
+  slots_[pos].index = entries_.size();
+  slots_[pos].hash = hash;
+  return std::prev(entries_.end());
+}
+
+template <class Key, class T, class Hash, class KeyEqual>
+  void hash_table<Key, T, Hash, KeyEqual>
+    ::reserve(size_type n)
+{
+  if (2 * n > slots_.size()) rehash(n);
+  entries_.reserve(n);
+}
+
+template <class Key, class T, class Hash, class KeyEqual>
+  typename hash_table<Key, T, Hash, KeyEqual>::size_type
+    hash_table<Key, T, Hash, KeyEqual>
+      ::hash_key(const key_type &key) const
+{
+  // Scramble the user's hash with a Fibonacci multiplier since hashes such
+  // as std::hash<int> are the identity and would cluster under probing.
+  return static_cast<size_type>(
+      (static_cast<unsigned long long>(hash_(key)) * 11400714819323198485ull)
+        >> 32);
+}
+
+template <class Key, class T, class Hash, class KeyEqual>
+  typename hash_table<Key, T, Hash, KeyEqual>::size_type
+    hash_table<Key, T, Hash, KeyEqual>
+      ::probe(const key_type &key, size_type hash) const
+{
+  // Walk the slots linearly until we find either the key or an empty slot.
+  // There is always an empty slot because the load factor is bounded.
+  size_type pos = hash & mask_;
+  while (slots_[pos].index &&
+         (slots_[pos].hash != hash ||
+          !equal_(entries_[slots_[pos].index - 1].first, key)))
+  {
+    pos = (pos + 1) & mask_;
+  }
+  return pos;
+}
+
+template <class Key, class T, class Hash, class KeyEqual>
+  void hash_table<Key, T, Hash, KeyEqual>
+    ::rehash(size_type n)
+{
+  size_type capacity = 8;
+  while (capacity < 2 * n) capacity *= 2;
+
+  std::vector<slot> slots(capacity);
+  mask_ = capacity - 1;
+
+  // Entries don't move, so only the slots have to be redistributed.
+  for (const slot &s : slots_)
+  {
+    if (!s.index) continue;
+
+    size_type pos = s.hash & mask_;
+    while (slots[pos].index) pos = (pos + 1) & mask_;
+    slots[pos] = s;
+  }
+
+  slots_.swap(slots);
+}
+
+} // end detail
+
+} // end retro
@@ -0,0 +1,371 @@
+/*! \file log_file.hpp
+ *  \brief Implementation of an append-only file of fixed-size records that
+ *         are written in batches.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <vector>
+
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "retro/detail/frozen.hpp"
+
+namespace retro
+{
+
+namespace detail
+{
+
+/*! Compute the CRC-32 checksum of some bytes, as used by zlib.
+ */
+inline std::uint32_t crc32(const char *data, std::size_t size)
+{
+  struct table_type
+  {
+    table_type(void)
+    {
+      for (std::uint32_t i = 0; i < 256; i++)
+      {
+        std::uint32_t c = i;
+        for (int k = 0; k < 8; k++)
+          c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+        entries[i] = c;
+      }
+    }
+
+    std::array<std::uint32_t, 256> entries;
+  };
+  static const table_type table;
+
+  std::uint32_t crc = 0xffffffffu;
+  for (std::size_t i = 0; i < size; i++)
+    crc = table.entries[(crc ^ static_cast<unsigned char>(data[i])) & 0xff]
+          ^ (crc >> 8);
+  return crc ^ 0xffffffffu;
+}
+
+/*! \brief Represents an append-only log of operations on a container.
+ *  \p Each record holds an operation code, the ordinal of the time point it
+ *     was performed at, a payload of a fixed size, and a CRC-32 checksum of
+ *     the rest of the record. Records are buffered and written once a batch
+ *     is full, or when the log is flushed. Opening the log stops at the first
+ *     record that is incomplete or whose checksum does not match, as a write
+ *     cut short by the process stopping leaves behind, and discards it along
+ *     with everything after it.
+ */
+class log_file
+{
+  public:
+    typedef std::size_t size_type;
+
+    /*! The ordinal recorded for operations performed at present.
+     */
+    static const std::uint64_t present = static_cast<std::uint64_t>(-1);
+
+    /*! Construct a log that is not attached to a file.
+     *  \param batch The number of bytes to buffer before writing.
+     */
+    explicit log_file(size_type batch)
+      : fd_(-1), batch_(batch), payload_(0), end_(0), broken_(false)
+    {
+    }
+
+    log_file(const log_file &other) = delete;
+
+    log_file &operator=(const log_file &other) = delete;
+
+    ~log_file()
+    {
+      close();
+    }
+
+    /*! Open a log, creating it if it does not exist, and read its records.
+     *  \param path The path of the log.
+     *  \param magic The eight characters that identify the kind of log.
+     *  \param payload The number of bytes in the payload of each record.
+     *  \param key_size The size of the keys in the payload, to check against.
+     *  \param value_size The size of the values in the payload.
+     *  \param f The function called with the code, ordinal and payload of
+     *           each intact record in order. It returns whether the record
+     *           is valid.
+     *  \return Whether the log was opened and every intact record was valid.
+     */
+    template <class Function>
+    bool open(const char *path, const char *magic, size_type payload,
+              std::uint32_t key_size, std::uint32_t value_size, Function f)
+    {
+      close();
+
+      // Every write goes to the end, even after a partial record is dropped.
+      int fd = ::open(path, O_RDWR | O_CREAT | O_APPEND, 0644);
+      if (fd < 0) return false;
+
+      // Only the header and one batch of records are in memory at a time.
+      frozen_header header = make_header(magic, key_size, value_size);
+      std::vector<char> head(header_size());
+      size_type read;
+      if (!read_all(fd, &head[0], head.size(), read))
+      {
+        ::close(fd);
+        return false;
+      }
+
+      size_type end = head.size();
+      if (read < head.size())
+      {
+        // A new log, or one that stopped before its header was written.
+        std::fill(head.begin(), head.end(), 0);
+        std::memcpy(&head[0], &header, sizeof(header));
+        if (::ftruncate(fd, 0) != 0 || !write_all(fd, &head[0], head.size()))
+        {
+          ::close(fd);
+          return false;
+        }
+      }
+      else if (!check_header(&head[0], read, magic, key_size, value_size)
+               || !read_records(fd, payload, f, end)
+               || !truncate(fd, end))
+      {
+        // Any records after the last intact one are dropped.
+        ::close(fd);
+        return false;
+      }
+
+      fd_ = fd;
+      payload_ = payload;
+      end_ = end;
+      broken_ = false;
+      return true;
+    }
+
+    /*! Build the header of a log.
+     *  \param magic The eight characters that identify the kind of log.
+     */
+    static frozen_header make_header(const char *magic, std::uint32_t key_size,
+                                     std::uint32_t value_size)
+    {
+      frozen_header header = make_frozen_header(magic, key_size, value_size,
+                                                0, 0);
+      header.reserved = record_format;
+      return header;
+    }
+
+    /*! Check whether the bytes of a log start with a header for the given
+     *  kind of log, whose records are in the format written by this library.
+     */
+    static bool check_header(const char *data, size_type size,
+                             const char *magic, std::uint32_t key_size,
+                             std::uint32_t value_size)
+    {
+      frozen_header header;
+      if (size < sizeof(header) + frozen_padding(sizeof(header))) return false;
+      std::memcpy(&header, data, sizeof(header));
+      return check_frozen_header(header, magic, key_size, value_size)
+             && header.reserved == record_format;
+    }
+
+    /*! Return the number of bytes that the header of a log takes, including
+     *  its padding.
+     */
+    static size_type header_size(void)
+    {
+      return sizeof(frozen_header) + frozen_padding(sizeof(frozen_header));
+    }
+
+    /*! Read from a file until a buffer is full or the file ends.
+     *  \param read Set to the number of bytes read.
+     *  \return Whether reading succeeded.
+     */
+    static bool read_all(int fd, char *data, size_type size, size_type &read)
+    {
+      for (read = 0; read < size; )
+      {
+        ssize_t n = ::read(fd, data + read, size - read);
+        if (n < 0) return false;
+        if (n == 0) break;
+        read += static_cast<size_type>(n);
+      }
+      return true;
+    }
+
+    /*! Read the records of a log, stopping at the first one that is
+     *  incomplete or whose checksum does not match. Records are read in
+     *  batches, so a log of any length is read in constant memory.
+     *  \param fd The file, read from just past the header of the log.
+     *  \param payload The number of bytes in the payload of each record.
+     *  \param f The function called with the code, ordinal and payload of
+     *           each intact record in order. It returns whether the record
+     *           is valid.
+     *  \param end Set to the offset just past the last intact record.
+     *  \return Whether the records were read and every intact one was valid.
+     */
+    template <class Function>
+    static bool read_records(int fd, size_type payload, Function f,
+                             size_type &end)
+    {
+      size_type record = record_size(payload);
+      std::vector<char> batch(record * std::max<size_type>(1, read_batch
+                                                              / record));
+      end = header_size();
+      for (;;)
+      {
+        size_type read;
+        if (!read_all(fd, &batch[0], batch.size(), read)) return false;
+
+        for (size_type at = 0; at + record <= read; at += record)
+        {
+          const char *bytes = &batch[at];
+          std::uint32_t checksum;
+          std::memcpy(&checksum, bytes + record - sizeof(checksum),
+                      sizeof(checksum));
+          if (checksum != crc32(bytes, record - sizeof(checksum)))
+            return true;
+
+          std::uint64_t ordinal;
+          std::memcpy(&ordinal, bytes + 1, sizeof(ordinal));
+          if (!f(static_cast<std::uint8_t>(bytes[0]), ordinal,
+                 bytes + 1 + sizeof(ordinal)))
+            return false;
+          end += record;
+        }
+
+        // A short batch is the end of the file.
+        if (read < batch.size()) return true;
+      }
+    }
+
+    /*! Write any buffered records and close the file.
+     *  \return Whether the records were written.
+     */
+    bool close(void)
+    {
+      if (fd_ < 0) return true;
+      bool written = flush();
+      ::close(fd_);
+      fd_ = -1;
+      buffer_.clear();
+      return written;
+    }
+
+    /*! Return whether the log is attached to a file.
+     */
+    bool is_open(void) const
+    {
+      return fd_ >= 0;
+    }
+
+    /*! Buffer a record, writing the batch if it is full.
+     *  \param code The operation code.
+     *  \param ordinal The ordinal of the time point of the operation.
+     *  \param payload The bytes of the payload.
+     *  \return Whether any write that was needed succeeded. If not, the
+     *          record is dropped, and the records buffered before it are
+     *          kept to be written again.
+     */
+    bool append(std::uint8_t code, std::uint64_t ordinal, const void *payload)
+    {
+      if (fd_ < 0) return true;
+
+      size_type start = buffer_.size();
+      const char *ordinal_bytes = reinterpret_cast<const char *>(&ordinal);
+      buffer_.push_back(static_cast<char>(code));
+      buffer_.insert(buffer_.end(), ordinal_bytes,
+                     ordinal_bytes + sizeof(ordinal));
+      const char *bytes = static_cast<const char *>(payload);
+      buffer_.insert(buffer_.end(), bytes, bytes + payload_);
+
+      std::uint32_t checksum = crc32(&buffer_[start], buffer_.size() - start);
+      const char *checksum_bytes = reinterpret_cast<const char *>(&checksum);
+      buffer_.insert(buffer_.end(), checksum_bytes,
+                     checksum_bytes + sizeof(checksum));
+
+      if (buffer_.size() < batch_ || flush()) return true;
+      buffer_.resize(start);
+      return false;
+    }
+
+    /*! Write every buffered record to the file.
+     *  \return Whether the records were written. If not, they stay buffered.
+     */
+    bool flush(void)
+    {
+      if (fd_ < 0 || buffer_.empty()) return true;
+
+      if (broken_ || !write_all(fd_, &buffer_[0], buffer_.size()))
+      {
+        // Cut off any part of the batch that was written, so that writing it
+        // again does not leave a torn record in the middle of the log.
+        broken_ = ::ftruncate(fd_, static_cast<off_t>(end_)) != 0;
+        return false;
+      }
+
+      end_ += buffer_.size();
+      buffer_.clear();
+      return true;
+    }
+
+    /*! Write every buffered record and wait until it is stored durably.
+     *  \return Whether the records were stored.
+     */
+    bool sync(void)
+    {
+      return flush() && (fd_ < 0 || ::fsync(fd_) == 0);
+    }
+
+  private:
+    // Marks the header of a log whose records end in a checksum.
+    static const std::uint32_t record_format = 1;
+
+    // The number of bytes of records read at a time when a log is opened.
+    static const size_type read_batch = 1 << 16;
+
+    static size_type record_size(size_type payload)
+    {
+      return 1 + sizeof(std::uint64_t) + payload + sizeof(std::uint32_t);
+    }
+
+    // Cut off anything in a file after some offset.
+    static bool truncate(int fd, size_type end)
+    {
+      struct stat st;
+      if (::fstat(fd, &st) != 0) return false;
+      return static_cast<size_type>(st.st_size) == end
+             || ::ftruncate(fd, static_cast<off_t>(end)) == 0;
+    }
+
+    static bool write_all(int fd, const char *data, size_type size)
+    {
+      while (size > 0)
+      {
+        ssize_t n = ::write(fd, data, size);
+        if (n < 0) return false;
+        data += n;
+        size -= static_cast<size_type>(n);
+      }
+      return true;
+    }
+
+    int fd_;
+    size_type batch_;
+    size_type payload_;
+    std::vector<char> buffer_;
+
+    // The size of the file, up to the end of the last batch written.
+    size_type end_;
+
+    // Whether part of a batch could not be cut off the file after a failed
+    // write, so that nothing more can be written after it.
+    bool broken_;
+}; // end log_file
+
+} // end detail
+
+} // end retro
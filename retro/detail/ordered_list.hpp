@@ -7,9 +7,17 @@
 #pragma once
 
 #include <list>
+#include <vector>
+#include <memory>
 #include <iterator>
 #include <algorithm>
 #include <cmath>
+#include <limits>
+#include <istream>
+#include <ostream>
+
+#include "retro/memory.hpp"
+#include "retro/detail/frozen.hpp"
 
 namespace retro
 {
@@ -25,26 +33,53 @@ namespace detail
  *  \tparam LabelType The integer type used to store labels for each element.
  *                    Using label types with larger ranges improves the speed
  *                    of insertions.
+ *  \tparam Allocator The allocator that the nodes of the list are allocated
+ *                    from, after rebinding to the type of each node.
  */
-template <class T, class LabelType = unsigned long long int>
+template <class T, class LabelType = unsigned long long int,
+          class Allocator = std::allocator<T>>
 class ordered_list
 {
   private:
     struct upper_node;
     struct lower_node;
 
-    typedef std::list<upper_node> upper_container;
-    typedef std::list<lower_node> lower_container;
+    typedef std::allocator_traits<Allocator> allocator_traits;
+    typedef typename allocator_traits::template rebind_alloc<upper_node>
+      upper_allocator;
+    typedef typename allocator_traits::template rebind_alloc<lower_node>
+      lower_allocator;
+
+    typedef std::list<upper_node, upper_allocator> upper_container;
+    typedef std::list<lower_node, lower_allocator> lower_container;
     typedef typename upper_container::iterator upper_iterator;
     typedef typename lower_container::iterator lower_iterator;
 
   public:
     typedef T value_type;
     typedef LabelType label_type;
+    typedef Allocator allocator_type;
     typedef T& reference;
     typedef const T& const_reference;
     typedef typename lower_container::size_type size_type;
 
+    /*! The labels that order an element, copied out of the list so that an
+     *  element can be compared repeatedly without following its pointers.
+     *  A rank is only valid until the next insertion, which may relabel.
+     */
+    struct rank
+    {
+      label_type upper;
+      label_type lower;
+
+      bool operator<(const rank &other) const
+      {
+        if (upper == other.upper)
+          return lower < other.lower; // Same sublist
+        return upper < other.upper;
+      }
+    };
+
     /*! Bidirectional iterator that traverses the list in order.
      */
     class iterator
@@ -53,6 +88,13 @@ class ordered_list
       public:
         typedef T* pointer;
 
+        /*! Construct an iterator that refers to no element, which may only
+         *  be assigned to.
+         */
+        iterator()
+        {
+        }
+
         reference operator*()
         {
           return lower->value;
@@ -97,6 +139,13 @@ class ordered_list
           return !(*this == other || *this < other);
         }
 
+        /*! Get the current labels of the element.
+         */
+        ordered_list::rank rank() const
+        {
+          return { lower->upper->label, lower->label };
+        }
+
       private:
         iterator(lower_iterator lower)
           : lower(lower)
@@ -105,12 +154,13 @@ class ordered_list
 
         lower_iterator lower;
 
-        friend class ordered_list<T, LabelType>;
+        friend class ordered_list<T, LabelType, Allocator>;
     }; // end iterator
 
     /*! Construct an empty ordered list.
+     *  \param alloc The allocator to allocate the nodes of the list from.
      */
-    ordered_list(void);
+    explicit ordered_list(const allocator_type &alloc = allocator_type());
 
     /*! Construct a ordered list with default constructed elements.
      *  \param n The number of elements to create.
@@ -123,6 +173,10 @@ class ordered_list
      */
     ordered_list(size_type n, const_reference &value);
 
+    /*! Returns a copy of the allocator of the list.
+     */
+    allocator_type get_allocator(void) const;
+
     /*! Returns the number of elements in the list.
      */
     size_type size(void) const;
@@ -135,6 +189,11 @@ class ordered_list
      */
     bool empty(void) const;
 
+    /*! Returns the memory allocated by the list. The elements are reported
+     *  as payloads.
+     */
+    memory_report memory_usage(void) const;
+
     /*! Get an iterator to the beginning of the list.
      */
     iterator begin(void);
@@ -167,14 +226,43 @@ class ordered_list
 
     void push_front(const T &val);
 
+    /*! Replace the contents of the list with a sequence of elements.
+     *  \p The labels are assigned in a single pass and spaced evenly, which
+     *     is faster than inserting the elements one at a time.
+     *  \param first An iterator to the first element to copy.
+     *  \param last An iterator past the last element to copy.
+     */
+    template <class ForwardIt>
+    void assign(ForwardIt first, ForwardIt last);
+
+    /*! Write the elements of the list to a stream in a binary format. The
+     *  labels are not written, as load() assigns them afresh. Elements must
+     *  be trivially copyable.
+     *  \param os The stream to write to, opened in binary mode.
+     *  \return Whether the list was written successfully.
+     */
+    bool save(std::ostream &os) const;
+
+    /*! Replace the contents of the list with a list written by save().
+     *  \param is The stream to read from, opened in binary mode.
+     *  \return Whether a valid list was read. If not, the list is unchanged.
+     */
+    bool load(std::istream &is);
+
+    /*! Remove an element from the list.
+     *  \param it An iterator to the element to remove.
+     *  \return An iterator to the element that followed the removed one.
+     */
+    iterator erase(iterator it);
+
   private:
-    constexpr LabelType M() { return std::numeric_limits<LabelType>::max() / 2; }
+    static constexpr LabelType M() { return std::numeric_limits<LabelType>::max() / 2; }
 
-    constexpr LabelType LOGM() { return std::log2(M()); }
+    static constexpr LabelType LOGM() { return std::log2(M()); }
 
-    constexpr LabelType MSTART() { return M() / 2; }
+    static constexpr LabelType MSTART() { return M() / 2; }
 
-    constexpr LabelType MSTEP() { return MSTART() / LOGM(); }
+    static constexpr LabelType MSTEP() { return MSTART() / LOGM(); }
 
     struct upper_node
     {
@@ -200,9 +288,6 @@ class ordered_list
 
     upper_iterator insert_upper(upper_iterator it);
 
-    bool relabel_upper(upper_iterator from, upper_iterator to,
-        typename upper_iterator::difference_type n);
-
     upper_container upper_;
     lower_container lower_;
     lower_iterator last_lower_;
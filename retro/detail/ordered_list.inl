@@ -4,9 +4,10 @@ namespace retro
 namespace detail
 {
 
-template <class T, class LabelType>
-  ordered_list<T, LabelType>
-    ::ordered_list(void)
+template <class T, class LabelType, class Allocator>
+  ordered_list<T, LabelType, Allocator>
+    ::ordered_list(const allocator_type &alloc)
+    : upper_(upper_allocator(alloc)), lower_(lower_allocator(alloc))
 {
   // The upper list has sentinel nodes at the beginning and end of the list.
   // Both containly solely the before-the-start and past-the-end lower nodes
@@ -26,65 +27,86 @@ template <class T, class LabelType>
                         lower_node(insert_upper(upper_.begin()), MSTART()));
 }
 
-template <class T, class LabelType>
-  typename ordered_list<T, LabelType>::size_type
-    ordered_list<T, LabelType>
+template <class T, class LabelType, class Allocator>
+  typename ordered_list<T, LabelType, Allocator>::allocator_type
+    ordered_list<T, LabelType, Allocator>
+      ::get_allocator(void) const
+{
+  return allocator_type(lower_.get_allocator());
+}
+
+template <class T, class LabelType, class Allocator>
+  typename ordered_list<T, LabelType, Allocator>::size_type
+    ordered_list<T, LabelType, Allocator>
       ::size(void) const
 {
   return lower_.size() - 3; // Don't count the sentinels and root.
 }
 
-template <class T, class LabelType>
-  bool ordered_list<T, LabelType>
+template <class T, class LabelType, class Allocator>
+  bool ordered_list<T, LabelType, Allocator>
     ::empty() const
 {
   return size() == 0;
 }
 
-template <class T, class LabelType>
-  typename ordered_list<T, LabelType>::size_type
-    ordered_list<T, LabelType>
+template <class T, class LabelType, class Allocator>
+  typename ordered_list<T, LabelType, Allocator>::size_type
+    ordered_list<T, LabelType, Allocator>
       ::max_size(void) const
 {
   return std::min((label_type)lower_.max_size(), // Size of linked list
                   (label_type)((M() - 1) * LOGM())); // Size of label universe 
 }
 
-template <class T, class LabelType>
-  typename ordered_list<T, LabelType>::iterator
-    ordered_list<T, LabelType>
+template <class T, class LabelType, class Allocator>
+  memory_report
+    ordered_list<T, LabelType, Allocator>
+      ::memory_usage(void) const
+{
+  memory_report report;
+  report.upper_labels = container_bytes(upper_);
+  // The sentinels and root store elements too.
+  report.payloads = lower_.size() * sizeof(value_type);
+  report.lower_labels = container_bytes(lower_) - report.payloads;
+  return report;
+}
+
+template <class T, class LabelType, class Allocator>
+  typename ordered_list<T, LabelType, Allocator>::iterator
+    ordered_list<T, LabelType, Allocator>
       ::begin(void)
 {
   return iterator(std::next(root_));
 }
 
-template <class T, class LabelType>
-  typename ordered_list<T, LabelType>::iterator
-    ordered_list<T, LabelType>
+template <class T, class LabelType, class Allocator>
+  typename ordered_list<T, LabelType, Allocator>::iterator
+    ordered_list<T, LabelType, Allocator>
       ::end(void)
 {
   return iterator(last_lower_);
 }
 
-template <class T, class LabelType>
-  typename ordered_list<T, LabelType>::reference
-    ordered_list<T, LabelType>
+template <class T, class LabelType, class Allocator>
+  typename ordered_list<T, LabelType, Allocator>::reference
+    ordered_list<T, LabelType, Allocator>
       ::front(void)
 {
   return *begin();
 }
 
-template <class T, class LabelType>
-  typename ordered_list<T, LabelType>::reference
-    ordered_list<T, LabelType>
+template <class T, class LabelType, class Allocator>
+  typename ordered_list<T, LabelType, Allocator>::reference
+    ordered_list<T, LabelType, Allocator>
       ::back(void)
 {
   return *std::prev(end());
 }
 
-template <class T, class LabelType>
-  typename ordered_list<T, LabelType>::iterator
-    ordered_list<T, LabelType>
+template <class T, class LabelType, class Allocator>
+  typename ordered_list<T, LabelType, Allocator>::iterator
+    ordered_list<T, LabelType, Allocator>
       ::insert(iterator it, const T &val)
 {
   // Get the iterators to the current node (the node we are inserting before)
@@ -139,63 +161,163 @@ template <class T, class LabelType>
   }
 }
 
-template <class T, class LabelType>
-  void ordered_list<T, LabelType>
+template <class T, class LabelType, class Allocator>
+  void ordered_list<T, LabelType, Allocator>
     ::push_back(const T &val)
 {
   insert(end(), val);
 }
 
-template <class T, class LabelType>
-  void ordered_list<T, LabelType>
+template <class T, class LabelType, class Allocator>
+  void ordered_list<T, LabelType, Allocator>
     ::push_front(const T &val)
 {
   insert(begin(), val);
 }
 
-template <class T, class LabelType>
-  typename ordered_list<T, LabelType>::upper_iterator
-    ordered_list<T, LabelType>
-      ::insert_upper(upper_iterator it)
+template <class T, class LabelType, class Allocator>
+  template <class ForwardIt>
+    void ordered_list<T, LabelType, Allocator>
+      ::assign(ForwardIt first, ForwardIt last)
 {
-  upper_iterator cur = std::next(it);
+  // Remove every element, keeping only the sentinels and the root.
+  lower_.erase(std::next(root_), last_lower_);
+  upper_.erase(std::next(root_->upper), last_lower_->upper);
 
-  // Find all the nodes that need to be relabelled.
-  label_type n = 1;
-  label_type start_label = it->label;
-  while (cur != last_lower_->upper && cur->label - start_label <= n * n)
+  // Each sublist holds as many nodes as a relabelled sublist would, and the
+  // upper labels are spread evenly between the root and the end.
+  label_type n = std::distance(first, last);
+  label_type sublists = (n + LOGM() - 1) / LOGM();
+  label_type gap = (last_lower_->upper->label - root_->upper->label)
+                   / (sublists + 1);
+  if (gap < 2)
   {
-    ++n; ++cur;
+    // Too many elements to spread out, so fall back to inserting them.
+    for (; first != last; ++first) push_back(*first);
+    return;
   }
 
-  // Relabel these nodes.
-  if (!relabel_upper(it, cur, n))
+  upper_iterator upper = root_->upper;
+  label_type upper_label = upper->label, label = 0, j = LOGM();
+  for (; first != last; ++first, ++j, label += MSTEP())
   {
-    // Relabeling was not successful, need to rebuild entire upper list.
-    relabel_upper(upper_.begin(), upper_.end(), upper_.size());
+    if (j == LOGM())
+    {
+      upper_label += gap;
+      upper = upper_.insert(last_lower_->upper, upper_node(upper_label));
+      label = MSTART();
+      j = 0;
+    }
+
+    lower_.insert(last_lower_, lower_node(upper, label, *first));
   }
+}
 
-  // The label of the new node is the mean of the two adjacent to it.
-  start_label = it->label;
-  ++it;
-  return upper_.insert(it, upper_node((start_label + it->label) / 2));
+template <class T, class LabelType, class Allocator>
+  bool ordered_list<T, LabelType, Allocator>
+    ::save(std::ostream &os) const
+{
+  std::vector<T> values;
+  values.reserve(size());
+  for (auto it = std::next(root_); it != last_lower_; ++it)
+    values.push_back(it->value);
+
+  frozen_header header =
+    make_frozen_header("RETROLST", 0, sizeof(T), 0, values.size());
+  write_section(os, &header, 1);
+  write_section(os, values.data(), values.size());
+  return static_cast<bool>(os);
 }
 
-template <class T, class LabelType>
-  bool ordered_list<T, LabelType>
-    ::relabel_upper(upper_iterator from, upper_iterator to,
-      typename upper_iterator::difference_type n)
+template <class T, class LabelType, class Allocator>
+  bool ordered_list<T, LabelType, Allocator>
+    ::load(std::istream &is)
 {
-  label_type gap = (to->label - from->label) / n;
-  if (gap == (label_type)1) return false;
+  frozen_header header;
+  if (!read_section(is, &header, 1)
+      || !check_frozen_header(header, "RETROLST", 0, sizeof(T)))
+    return false;
+
+  // A corrupt header could otherwise make the section huge.
+  std::uint64_t left = remaining_bytes(is);
+  if (!take_section(left, header.events, sizeof(T))) return false;
 
-  // Relabel the sequence as arithmetic sequence starting at the label of
-  // the first node and incrementing by 'gap' per node.
-  for (label_type label = from->label; n--; label += gap, ++from)
-    from->label = label;
+  std::vector<T> values(header.events);
+  if (!read_section(is, values.data(), values.size())) return false;
+
+  assign(values.begin(), values.end());
   return true;
 }
 
+template <class T, class LabelType, class Allocator>
+  typename ordered_list<T, LabelType, Allocator>::iterator
+    ordered_list<T, LabelType, Allocator>
+      ::erase(iterator it)
+{
+  lower_iterator cur = it.lower;
+  upper_iterator upper = cur->upper;
+
+  // Remove the upper node as well if this is the only node in its sublist.
+  // The start and end sentinels have upper nodes of their own. The root
+  // shares its upper node with the first sublist, but it always comes just
+  // before that sublist, so checking the previous node keeps that upper node
+  // for the root.
+  if (std::prev(cur)->upper != upper && std::next(cur)->upper != upper)
+    upper_.erase(upper);
+
+  return iterator(lower_.erase(cur));
+}
+
+template <class T, class LabelType, class Allocator>
+  typename ordered_list<T, LabelType, Allocator>::upper_iterator
+    ordered_list<T, LabelType, Allocator>
+      ::insert_upper(upper_iterator it)
+{
+  upper_iterator next = std::next(it);
+  if (next->label - it->label < 2)
+  {
+    // Find the smallest aligned range of labels around the node that is
+    // sparse enough, doubling its width each time, and spread the nodes in
+    // it out evenly. A range of width 2^i may hold at most (4/3)^i nodes, so
+    // a range that is relabelled was filled by many inserts since it was
+    // last spread out, even when every insert is at the end of the list.
+    // The sentinels keep their labels.
+    upper_iterator first = upper_.begin(), last = std::prev(upper_.end());
+    upper_iterator from = it, to = next;
+    label_type count = 1, width = 1, low, gap;
+    double limit = 1;
+    while (true)
+    {
+      width *= 2;
+      limit *= 4.0 / 3;
+      bool whole = width >= last->label;
+
+      low = whole ? 1 : std::max<label_type>(it->label & ~(width - 1), 1);
+      label_type high = whole ? last->label - 1
+                              : std::min(low | (width - 1), last->label - 1);
+      while (std::prev(from) != first && std::prev(from)->label >= low)
+      {
+        --from; ++count;
+      }
+      while (to != last && to->label <= high)
+      {
+        ++to; ++count;
+      }
+
+      gap = (high - low + 1) / (count + 1);
+      if (whole || (count + 1 <= limit && gap >= 2)) break;
+    }
+
+    for (label_type label = low; from != to; ++from, label += gap)
+      from->label = label;
+  }
+
+  // The label of the new node is the mean of the two adjacent to it.
+  label_type start_label = it->label;
+  ++it;
+  return upper_.insert(it, upper_node((start_label + it->label) / 2));
+}
+
 }
 
 }
@@ -0,0 +1,86 @@
+/*! \file parallel_sort.hpp
+ *  \brief Implementation of a stable sort that divides the work between
+ *         several threads.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <iterator>
+#include <thread>
+#include <vector>
+
+namespace retro
+{
+
+namespace detail
+{
+
+/*! Sort a range stably, using up to a given number of threads.
+ *  \p The range is split into one run per thread, the runs are sorted in
+ *     parallel, and then pairs of adjacent runs are merged in parallel until
+ *     one run remains.
+ *
+ *  \param first An iterator to the first element to sort.
+ *  \param last An iterator past the last element to sort.
+ *  \param comp The function object used to order elements.
+ *  \param threads The number of threads to use, or zero to use one per
+ *                 hardware thread.
+ */
+template <class RandomIt, class Compare>
+void parallel_stable_sort(RandomIt first, RandomIt last, Compare comp,
+                          std::size_t threads = 0)
+{
+  typedef typename std::iterator_traits<RandomIt>::difference_type
+    difference_type;
+
+  if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+
+  // Small ranges aren't worth the cost of starting threads.
+  difference_type n = last - first;
+  if (threads == 1 || n < 4096)
+  {
+    std::stable_sort(first, last, comp);
+    return;
+  }
+
+  // Split the range into runs of nearly equal length.
+  std::vector<RandomIt> bounds;
+  for (std::size_t i = 0; i <= threads; i++)
+    bounds.push_back(first + n * static_cast<difference_type>(i) / threads);
+
+  std::vector<std::thread> workers;
+  for (std::size_t i = 0; i < threads; i++)
+  {
+    workers.emplace_back([&bounds, &comp, i]()
+                         { std::stable_sort(bounds[i], bounds[i + 1], comp); });
+  }
+  for (auto &w : workers) w.join();
+
+  // Merge adjacent runs, halving the number of runs each round.
+  while (bounds.size() > 2)
+  {
+    std::vector<RandomIt> merged;
+    workers.clear();
+
+    std::size_t i = 0;
+    for (; i + 2 < bounds.size(); i += 2)
+    {
+      workers.emplace_back([&bounds, &comp, i]()
+      {
+        std::inplace_merge(bounds[i], bounds[i + 1], bounds[i + 2], comp);
+      });
+      merged.push_back(bounds[i]);
+    }
+
+    // An odd run out is carried over to the next round.
+    for (; i < bounds.size(); i++) merged.push_back(bounds[i]);
+
+    for (auto &w : workers) w.join();
+    bounds.swap(merged);
+  }
+}
+
+} // end detail
+
+} // end retro
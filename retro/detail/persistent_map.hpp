@@ -0,0 +1,463 @@
+/*! \file persistent_map.hpp
+ *  \brief Implementation of an ordered map whose copies share the nodes that
+ *         they have in common.
+ */
+
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <utility>
+#include <cstdint>
+#include <cstddef>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace retro
+{
+
+namespace detail
+{
+
+/*! \brief Represents an ordered map that is copied in constant time.
+ *  \p The map is a treap whose nodes are never changed once they are
+ *     shared. Changing a map copies the path to the changed key and shares
+ *     the rest with the copies it was made from, so a series of copies that
+ *     each differ from the one before in a few keys takes memory in
+ *     proportion to their differences rather than to their sizes. Nodes are
+ *     reference counted without synchronization, so a map and its copies
+ *     must only be used from one thread at a time.
+ *
+ *  \tparam Key The type of keys to store, which is copied into nodes.
+ *  \tparam Value The type of values to store, which is copied into nodes
+ *                and compared with operator==.
+ *  \tparam Compare The function object used to order keys.
+ *  \tparam Allocator The allocator that nodes are allocated from, after
+ *                    rebinding.
+ */
+template <class Key, class Value, class Compare, class Allocator>
+class persistent_map
+{
+  private:
+    struct node
+    {
+      Key key;
+      Value value;
+      std::uint32_t priority;
+      std::size_t size;
+      std::size_t refs;
+      node *left;
+      node *right;
+    };
+
+    typedef typename std::allocator_traits<Allocator>
+      ::template rebind_alloc<node> node_allocator;
+    typedef std::allocator_traits<node_allocator> node_traits;
+
+  public:
+    typedef Key key_type;
+    typedef Value mapped_type;
+    typedef Compare key_compare;
+    typedef Allocator allocator_type;
+    typedef std::size_t size_type;
+
+    /*! The nodes already copied by the converting constructor, so that maps
+     *  copied from maps that share nodes share the copies too.
+     */
+    typedef std::unordered_map<const void *, void *> copy_table;
+
+    /*! Construct an empty map.
+     */
+    persistent_map(const key_compare &comp, const allocator_type &alloc)
+      : comp_(comp), alloc_(alloc), root_(nullptr), random_(0x9e3779b9)
+    {
+    }
+
+    /*! Copy a map in constant time, sharing all of its nodes.
+     */
+    persistent_map(const persistent_map &other)
+      : comp_(other.comp_), alloc_(other.alloc_), root_(share(other.root_)),
+        random_(other.random_)
+    {
+    }
+
+    persistent_map(persistent_map &&other)
+      : comp_(other.comp_), alloc_(other.alloc_), root_(other.root_),
+        random_(other.random_)
+    {
+      other.root_ = nullptr;
+    }
+
+    /*! Copy a map with keys converted by a function, which must keep them in
+     *  the same order, into nodes of a new allocator. Nodes that the copies
+     *  in the table were made from are not copied again.
+     */
+    template <class Convert>
+    persistent_map(const persistent_map &other, Convert convert,
+                   copy_table &copies, const key_compare &comp,
+                   const allocator_type &alloc)
+      : comp_(comp), alloc_(alloc), root_(nullptr), random_(other.random_)
+    {
+      root_ = copy(other.root_, convert, copies);
+    }
+
+    persistent_map &operator=(persistent_map other)
+    {
+      swap(other);
+      return *this;
+    }
+
+    ~persistent_map(void)
+    {
+      release(root_);
+    }
+
+    void swap(persistent_map &other)
+    {
+      using std::swap;
+      swap(comp_, other.comp_);
+      swap(alloc_, other.alloc_);
+      swap(root_, other.root_);
+      swap(random_, other.random_);
+    }
+
+    /*! Return the number of keys in the map.
+     */
+    size_type size(void) const
+    {
+      return size_of(root_);
+    }
+
+    /*! Return the value of a key, or null if the key is not in the map.
+     */
+    const mapped_type *find(const key_type &key) const
+    {
+      for (const node *n = root_; n; )
+      {
+        if (comp_(key, n->key)) n = n->left;
+        else if (comp_(n->key, key)) n = n->right;
+        else return &n->value;
+      }
+      return nullptr;
+    }
+
+    /*! Set the value of a key, adding the key if it is not in the map. This
+     *  copies the path to the key, unless the key already has the value.
+     */
+    void set(const key_type &key, const mapped_type &val)
+    {
+      node *result = insert(root_, key, val);
+      release(root_);
+      root_ = result;
+    }
+
+    /*! Remove a key from the map, if it is there.
+     */
+    void erase(const key_type &key)
+    {
+      node *result = remove(root_, key);
+      release(root_);
+      root_ = result;
+    }
+
+    /*! Call a function with each key and its value in key order, until it
+     *  returns false.
+     */
+    template <class Function>
+    void visit(Function f) const
+    {
+      std::vector<const node *> path;
+      for (const node *n = root_; n || !path.empty(); n = n->right)
+      {
+        for (; n; n = n->left) path.push_back(n);
+        n = path.back();
+        path.pop_back();
+        if (!f(n->key, n->value)) return;
+      }
+    }
+
+    /*! Call a function with every key that is in only one of two maps, or
+     *  has a different value in each, in key order.
+     *  \p Both maps are walked in key order at once, and any subtree that
+     *     they share is skipped, so maps that were copied from each other
+     *     are compared in time proportional to the nodes that differ, times
+     *     their depth.
+     */
+    template <class Function>
+    void difference(const persistent_map &other, Function f) const
+    {
+      // The parts of each map left to walk, the next one last. A part is
+      // either a whole subtree or just the entry of its root.
+      typedef std::pair<const node *, bool> part;
+      std::vector<part> a, b;
+      if (root_) a.push_back(part(root_, true));
+      if (other.root_) b.push_back(part(other.root_, true));
+
+      while (!a.empty() || !b.empty())
+      {
+        bool a_whole = !a.empty() && a.back().second;
+        bool b_whole = !b.empty() && b.back().second;
+        if (a_whole && b_whole && a.back().first == b.back().first)
+        {
+          a.pop_back();
+          b.pop_back();
+          continue;
+        }
+
+        // Split the larger subtree, since it may contain the other one.
+        if (a_whole && (!b_whole || size_of(a.back().first)
+                                    >= size_of(b.back().first)))
+        {
+          split(a);
+          continue;
+        }
+        if (b_whole)
+        {
+          split(b);
+          continue;
+        }
+
+        if (b.empty() || (!a.empty() && comp_(a.back().first->key,
+                                              b.back().first->key)))
+        {
+          f(a.back().first->key);
+          a.pop_back();
+        }
+        else if (a.empty() || comp_(b.back().first->key,
+                                    a.back().first->key))
+        {
+          f(b.back().first->key);
+          b.pop_back();
+        }
+        else
+        {
+          if (!(a.back().first->value == b.back().first->value))
+            f(a.back().first->key);
+          a.pop_back();
+          b.pop_back();
+        }
+      }
+    }
+
+    /*! Return the number of bytes allocated for nodes that are not in a set
+     *  of nodes already counted, and add them to it. Counting a series of
+     *  copies with the same set counts each shared node once.
+     */
+    std::size_t bytes(std::unordered_set<const void *> &counted) const
+    {
+      std::size_t result = 0;
+      std::vector<const node *> pending;
+      if (root_) pending.push_back(root_);
+      while (!pending.empty())
+      {
+        const node *n = pending.back();
+        pending.pop_back();
+
+        // The subtree of a node that was counted was counted with it.
+        if (!counted.insert(n).second) continue;
+        result += sizeof(node);
+        if (n->left) pending.push_back(n->left);
+        if (n->right) pending.push_back(n->right);
+      }
+      return result;
+    }
+
+  private:
+    static size_type size_of(const node *n)
+    {
+      return n ? n->size : 0;
+    }
+
+    static node *share(node *n)
+    {
+      if (n) n->refs++;
+      return n;
+    }
+
+    // Replace a whole subtree at the end of a walk with its parts.
+    static void split(std::vector<std::pair<const node *, bool>> &parts)
+    {
+      const node *n = parts.back().first;
+      parts.pop_back();
+      if (n->right) parts.push_back(std::make_pair(n->right, true));
+      parts.push_back(std::make_pair(n, false));
+      if (n->left) parts.push_back(std::make_pair(n->left, true));
+    }
+
+    // Create a node that owns the references to its children.
+    node *make(const key_type &key, const mapped_type &val,
+               std::uint32_t priority, node *left, node *right)
+    {
+      node_allocator alloc(alloc_);
+      node *n = node_traits::allocate(alloc, 1);
+      try
+      {
+        node_traits::construct(alloc, n, node{ key, val, priority,
+                                               1 + size_of(left)
+                                                 + size_of(right),
+                                               1, left, right });
+      }
+      catch (...)
+      {
+        node_traits::deallocate(alloc, n, 1);
+        release(left);
+        release(right);
+        throw;
+      }
+      return n;
+    }
+
+    void release(node *n)
+    {
+      while (n && --n->refs == 0)
+      {
+        // Only one child needs a recursive call, whose depth is that of the
+        // tree.
+        release(n->left);
+        node *right = n->right;
+        node_allocator alloc(alloc_);
+        node_traits::destroy(alloc, n);
+        node_traits::deallocate(alloc, n, 1);
+        n = right;
+      }
+    }
+
+    std::uint32_t next_priority(void)
+    {
+      random_ ^= random_ << 13;
+      random_ ^= random_ >> 17;
+      random_ ^= random_ << 5;
+      return random_;
+    }
+
+    // Each of these returns a new reference to the root of the changed
+    // subtree, which is the same as the old one if nothing changed.
+    node *insert(node *n, const key_type &key, const mapped_type &val)
+    {
+      if (!n) return make(key, val, next_priority(), nullptr, nullptr);
+
+      if (comp_(key, n->key))
+      {
+        node *left = insert(n->left, key, val);
+        if (left == n->left)
+        {
+          release(left);
+          return share(n);
+        }
+
+        // Only a new node can have a higher priority than its parent, so
+        // nothing else refers to it and it can be rotated in place.
+        if (left->priority > n->priority)
+        {
+          node *right = make(n->key, n->value, n->priority, left->right,
+                             share(n->right));
+          left->right = right;
+          left->size = 1 + size_of(left->left) + right->size;
+          return left;
+        }
+        return make(n->key, n->value, n->priority, left, share(n->right));
+      }
+
+      if (comp_(n->key, key))
+      {
+        node *right = insert(n->right, key, val);
+        if (right == n->right)
+        {
+          release(right);
+          return share(n);
+        }
+
+        if (right->priority > n->priority)
+        {
+          node *left = make(n->key, n->value, n->priority, share(n->left),
+                            right->left);
+          right->left = left;
+          right->size = 1 + left->size + size_of(right->right);
+          return right;
+        }
+        return make(n->key, n->value, n->priority, share(n->left), right);
+      }
+
+      if (n->value == val) return share(n);
+      return make(n->key, val, n->priority, share(n->left), share(n->right));
+    }
+
+    node *remove(node *n, const key_type &key)
+    {
+      if (!n) return nullptr;
+
+      if (comp_(key, n->key))
+      {
+        node *left = remove(n->left, key);
+        if (left == n->left)
+        {
+          release(left);
+          return share(n);
+        }
+        return make(n->key, n->value, n->priority, left, share(n->right));
+      }
+
+      if (comp_(n->key, key))
+      {
+        node *right = remove(n->right, key);
+        if (right == n->right)
+        {
+          release(right);
+          return share(n);
+        }
+        return make(n->key, n->value, n->priority, share(n->left), right);
+      }
+
+      return merge(share(n->left), share(n->right));
+    }
+
+    // Join two subtrees whose keys are all in order, taking their
+    // references.
+    node *merge(node *a, node *b)
+    {
+      if (!a) return b;
+      if (!b) return a;
+
+      node *result;
+      if (a->priority > b->priority)
+      {
+        node *right = merge(share(a->right), b);
+        result = make(a->key, a->value, a->priority, share(a->left), right);
+        release(a);
+      }
+      else
+      {
+        node *left = merge(a, share(b->left));
+        result = make(b->key, b->value, b->priority, left, share(b->right));
+        release(b);
+      }
+      return result;
+    }
+
+    template <class Convert>
+    node *copy(const node *n, Convert &convert, copy_table &copies)
+    {
+      if (!n) return nullptr;
+
+      auto found = copies.find(n);
+      if (found != copies.end())
+        return share(static_cast<node *>(found->second));
+
+      node *left = copy(n->left, convert, copies);
+      node *right = copy(n->right, convert, copies);
+      node *result = make(convert(n->key), n->value, n->priority, left, right);
+      copies[n] = result;
+      return result;
+    }
+
+    key_compare comp_;
+    allocator_type alloc_;
+    node *root_;
+
+    // The state of the generator of priorities.
+    std::uint32_t random_;
+}; // end persistent_map
+
+} // end detail
+
+} // end retro
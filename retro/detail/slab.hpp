@@ -0,0 +1,234 @@
+/*! \file slab.hpp
+ *  \brief Implementation of a slab of values that are referred to by compact
+ *         integer handles, which are recycled when values are released.
+ */
+
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <utility>
+#include <climits>
+#include <cstddef>
+
+#include "retro/memory.hpp"
+
+namespace retro
+{
+
+namespace detail
+{
+
+/*! \brief Represents storage for values of a single type, allocated in
+ *  fixed-size blocks.
+ *  \p Values are addressed by handles. Blocks are never moved once they are
+ *     allocated, so a reference to a value stays valid until the value is
+ *     released, however much the slab grows. Released slots are reused by
+ *     later insertions.
+ *
+ *  \tparam T The type of values to store. Values are copy constructed into
+ *            their slots and destroyed when they are released, so T does not
+ *            need to be default constructible or assignable.
+ *  \tparam Allocator The allocator that the storage is allocated from.
+ */
+template <class T, class Allocator = std::allocator<T>>
+class slab
+{
+  private:
+    typedef std::allocator_traits<Allocator> traits;
+    typedef typename traits::pointer block_pointer;
+
+  public:
+    typedef T value_type;
+    typedef Allocator allocator_type;
+    typedef std::size_t size_type;
+    typedef size_type handle;
+
+    /*! Construct an empty slab.
+     *  \param alloc The allocator to allocate the storage from.
+     */
+    explicit slab(const allocator_type &alloc = allocator_type())
+      : alloc_(alloc), blocks_(block_allocator(alloc)),
+        live_(bool_allocator(alloc)), free_(handle_allocator(alloc))
+    {
+    }
+
+    /*! Copy every value of another slab into slots with the same handles.
+     */
+    slab(const slab &other)
+      : alloc_(traits::select_on_container_copy_construction(other.alloc_)),
+        blocks_(block_allocator(alloc_)), live_(other.live_),
+        free_(other.free_)
+    {
+      // Release what was copied so far if a copy throws.
+      size_type h = 0;
+      try
+      {
+        for (size_type b = 0; b < other.blocks_.size(); b++)
+          blocks_.push_back(traits::allocate(alloc_, block_size));
+        for (; h < live_.size(); h++)
+          if (live_[h]) traits::construct(alloc_, slot(h), other[h]);
+      }
+      catch (...)
+      {
+        while (h-- > 0)
+          if (live_[h]) traits::destroy(alloc_, slot(h));
+        release_blocks();
+        throw;
+      }
+    }
+
+    slab(slab &&other)
+      : alloc_(other.alloc_), blocks_(std::move(other.blocks_)),
+        live_(std::move(other.live_)), free_(std::move(other.free_))
+    {
+      other.blocks_.clear();
+      other.live_.clear();
+      other.free_.clear();
+    }
+
+    slab &operator=(slab other)
+    {
+      swap(other);
+      return *this;
+    }
+
+    ~slab(void)
+    {
+      for (size_type h = 0; h < live_.size(); h++)
+        if (live_[h]) traits::destroy(alloc_, slot(h));
+      release_blocks();
+    }
+
+    void swap(slab &other)
+    {
+      using std::swap;
+      swap(alloc_, other.alloc_);
+      blocks_.swap(other.blocks_);
+      live_.swap(other.live_);
+      free_.swap(other.free_);
+    }
+
+    /*! Return the number of values in use.
+     */
+    size_type size(void) const
+    {
+      return live_.size() - free_.size();
+    }
+
+    /*! Return the number of slots, including those that have been released.
+     */
+    size_type capacity(void) const
+    {
+      return live_.size();
+    }
+
+    /*! Return the number of bytes allocated for slots and their bookkeeping.
+     */
+    std::size_t bytes(void) const
+    {
+      return blocks_.size() * block_size * sizeof(T)
+             + container_bytes(blocks_) + live_.capacity() / CHAR_BIT
+             + container_bytes(free_);
+    }
+
+    /*! Store a copy of a value.
+     *  \param val The value to store.
+     *  \return The handle of the slot that stores the value.
+     */
+    handle insert(const T &val)
+    {
+      if (!free_.empty())
+      {
+        handle h = free_.back();
+        traits::construct(alloc_, slot(h), val);
+        free_.pop_back();
+        live_[h] = true;
+        return h;
+      }
+
+      // A block that is added before a copy throws stays for later values.
+      handle h = live_.size();
+      if (h == blocks_.size() * block_size)
+      {
+        block_pointer block = traits::allocate(alloc_, block_size);
+        try
+        {
+          blocks_.push_back(block);
+        }
+        catch (...)
+        {
+          traits::deallocate(alloc_, block, block_size);
+          throw;
+        }
+      }
+
+      traits::construct(alloc_, slot(h), val);
+      try
+      {
+        live_.push_back(true);
+      }
+      catch (...)
+      {
+        traits::destroy(alloc_, slot(h));
+        throw;
+      }
+      return h;
+    }
+
+    /*! Release the slot of a value so that it can be reused. The value is
+     *  destroyed now rather than when the slot is reused.
+     *  \param h The handle of the slot to release.
+     */
+    void erase(handle h)
+    {
+      free_.push_back(h);
+      traits::destroy(alloc_, slot(h));
+      live_[h] = false;
+    }
+
+    /*! Get the value stored in a slot.
+     */
+    T &operator[](handle h)
+    {
+      return *slot(h);
+    }
+
+    /*! Get the value stored in a slot.
+     */
+    const T &operator[](handle h) const
+    {
+      return *slot(h);
+    }
+
+  private:
+    typedef typename traits::template rebind_alloc<block_pointer>
+      block_allocator;
+    typedef typename traits::template rebind_alloc<bool> bool_allocator;
+    typedef typename traits::template rebind_alloc<handle> handle_allocator;
+
+    // The number of values in each block.
+    static const size_type block_size = 64;
+
+    T *slot(handle h) const
+    {
+      return std::addressof(blocks_[h / block_size][h % block_size]);
+    }
+
+    void release_blocks(void)
+    {
+      for (auto block : blocks_) traits::deallocate(alloc_, block, block_size);
+      blocks_.clear();
+    }
+
+    allocator_type alloc_;
+    std::vector<block_pointer, block_allocator> blocks_;
+
+    // Whether each slot holds a value, as opposed to having been released.
+    std::vector<bool, bool_allocator> live_;
+    std::vector<handle, handle_allocator> free_;
+}; // end slab
+
+} // end detail
+
+} // end retro
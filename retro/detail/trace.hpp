@@ -0,0 +1,91 @@
+/*! \file trace.hpp
+ *  \brief Definitions shared by the containers that record a trace of their
+ *         operations, and by the programs that replay traces.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "retro/detail/frozen.hpp"
+#include "retro/detail/log_file.hpp"
+
+namespace retro
+{
+
+namespace detail
+{
+
+/*! The code recorded for a revert, which is not an operation of a container.
+ */
+const std::uint8_t trace_revert = 0xff;
+
+/*! The code recorded for a search, or for reading the front of a queue.
+ */
+const std::uint8_t trace_find = 0xfe;
+
+/*! The code recorded for getting an iterator to the first element.
+ */
+const std::uint8_t trace_scan = 0xfd;
+
+/*! The magic of a trace of a fully retroactive map.
+ */
+const char trace_map_magic[] = "RETROTRM";
+
+/*! The magic of a trace of a partially retroactive queue.
+ */
+const char trace_queue_magic[] = "RETROTRQ";
+
+/*! Start a trace in the format of log_file, replacing any file at its path.
+ *  \param log The log to write the trace to.
+ *  \param path The path of the trace.
+ *  \param magic The eight characters that identify the kind of container.
+ *  \param payload The number of bytes in the payload of each record.
+ *  \return Whether the trace was created.
+ */
+inline bool create_trace(log_file &log, const char *path, const char *magic,
+                         std::size_t payload)
+{
+  std::remove(path);
+  return log.open(path, magic, payload, static_cast<std::uint32_t>(payload),
+                  0, [](std::uint8_t, std::uint64_t, const char *)
+                  { return true; });
+}
+
+/*! Read a trace without changing it.
+ *  \param path The path of the trace.
+ *  \param magic The eight characters that identify the kind of container.
+ *  \param payload The number of bytes in the payload of each record.
+ *  \param f The function called with the code, ordinal and payload of each
+ *           intact record in order. It returns whether the record is valid.
+ *  \return Whether the trace was read and every intact record was valid.
+ *          Reading stops at a record that was only partly written or whose
+ *          checksum does not match.
+ */
+template <class Function>
+bool read_trace(const char *path, const char *magic, std::size_t payload,
+                Function f)
+{
+  int fd = ::open(path, O_RDONLY);
+  if (fd < 0) return false;
+
+  std::vector<char> header(log_file::header_size());
+  std::size_t read, end;
+  bool valid = log_file::read_all(fd, &header[0], header.size(), read)
+               && log_file::check_header(&header[0], read, magic,
+                                         static_cast<std::uint32_t>(payload),
+                                         0)
+               && log_file::read_records(fd, payload, f, end);
+  ::close(fd);
+  return valid;
+}
+
+} // end detail
+
+} // end retro
@@ -0,0 +1,220 @@
+/*! \file logged_map.hpp
+ *  \brief Implementation of a fully retroactive map that records every
+ *         operation in a write-ahead log, from which it can be rebuilt.
+ */
+
+#pragma once
+
+#include <vector>
+#include <utility>
+#include <functional>
+#include <cstdint>
+#include <type_traits>
+
+#include "retro/map.hpp"
+#include "retro/detail/log_file.hpp"
+
+namespace retro
+{
+
+/*! \brief Represents a fully retroactive map whose operations are appended to
+ *  a log file before they are performed.
+ *  \p Each operation is logged with the ordinal of the time point it was
+ *     performed at, which is its position among every operation ever
+ *     performed on the map. Opening the log replays it, which rebuilds the
+ *     map exactly, including the ordinals, so that logging can carry on.
+ *     Records are written in batches, so operations since the last flush()
+ *     or sync() may be lost if the process stops. An operation that fills a
+ *     batch which cannot be written is not performed, and its time point
+ *     says so. Each record carries a checksum, and replay stops at the first
+ *     record that does not match it. Keys and values must be trivially
+ *     copyable.
+ *
+ *  \tparam Key The type of keys to store.
+ *  \tparam T The type of values to store.
+ *  \tparam Compare The function object used to order keys.
+ */
+template <class Key, class T, class Compare = std::less<Key>>
+class logged_full_map
+{
+  static_assert(std::is_trivially_copyable<Key>::value
+                && std::is_trivially_copyable<T>::value,
+                "logged_full_map requires trivially copyable types");
+
+  public:
+    typedef full_map<Key, T, Compare> map_type;
+    typedef typename map_type::key_type key_type;
+    typedef typename map_type::mapped_type mapped_type;
+    typedef typename map_type::value_type value_type;
+    typedef typename map_type::key_compare key_compare;
+    typedef typename map_type::size_type size_type;
+    typedef typename map_type::iterator iterator;
+    typedef typename map_type::retro_iterator retro_iterator;
+
+    /*! Represents an operation performed on the data structure at some point
+     *  in time.
+     */
+    class time_point
+    {
+      public:
+        /*! Get the operation that was performed.
+         */
+        map operation() const { return inner.operation(); }
+
+        /*! Get the position of the operation among every operation performed
+         *  on the map. This is the same after the map is rebuilt from its log.
+         */
+        std::uint64_t ordinal() const { return pos; }
+
+        /*! Return whether the operation was logged and performed. If not,
+         *  the map is unchanged and this time point must not be used. An
+         *  operation just before a time point that was reverted is never
+         *  performed.
+         */
+        bool logged() const { return ok; }
+
+      private:
+        time_point(const typename map_type::time_point &inner,
+                   std::uint64_t pos, bool ok = true)
+          : inner(inner), pos(pos), ok(ok)
+        {
+        }
+
+        typename map_type::time_point inner;
+        std::uint64_t pos;
+        bool ok;
+
+        friend class logged_full_map<Key, T, Compare>;
+    };
+
+    /*! Construct an empty map that does not log its operations.
+     *  \param batch The number of bytes of records to buffer before writing.
+     *  \param comp The function object used to order keys.
+     */
+    explicit logged_full_map(std::size_t batch = 1 << 16,
+                             const key_compare &comp = key_compare());
+
+    /*! Attach the map to a log, replaying the operations in it first.
+     *  \p The map must not have performed any operation, as the replayed
+     *     operations would then get other ordinals than they were logged
+     *     with. A record that was only partly written is discarded.
+     *  \param path The path of the log, which is created if it does not exist.
+     *  \return Whether the log was opened and replayed. If the map already
+     *          had operations, it is unchanged. Otherwise, if not, the map is
+     *          empty and does not log its operations.
+     */
+    bool open(const char *path);
+
+    /*! Write any buffered records and detach the map from its log.
+     *  \return Whether the records were written.
+     */
+    bool close(void);
+
+    /*! Write every buffered record to the log.
+     *  \return Whether the records were written.
+     */
+    bool flush(void);
+
+    /*! Write every buffered record and wait until the log is stored durably.
+     *  \return Whether the records were stored.
+     */
+    bool sync(void);
+
+    /*! Get the time point of an operation by its ordinal.
+     *  \return The time point, which is not logged() if no operation has
+     *          the ordinal.
+     */
+    time_point at(std::uint64_t ordinal) const;
+
+    /*! Get a time point after every operation.
+     */
+    time_point present(void);
+
+    /*! Insert a new element at present and log it.
+     */
+    time_point insert(const value_type &val);
+
+    /*! Insert a new element just before some time point and log it.
+     */
+    time_point insert(const time_point &t, const value_type &val);
+
+    /*! Erase an element at present and log it.
+     */
+    time_point erase(const key_type &key);
+
+    /*! Erase an element just before some time point and log it.
+     */
+    time_point erase(const time_point &t, const key_type &key);
+
+    /*! Set the value of a key at present and log it.
+     */
+    time_point assign(const key_type &key, const mapped_type &val);
+
+    /*! Set the value of a key just before some time point and log it.
+     */
+    time_point assign(const time_point &t, const key_type &key,
+                      const mapped_type &val);
+
+    /*! Revert a previous operation and log it. The ordinal of the operation
+     *  is not reused.
+     *  \return Whether the revert was logged and performed. Nothing is
+     *          logged for a time point at present, or for an operation that
+     *          was already reverted.
+     */
+    bool revert(const time_point &t);
+
+    /*! Get an iterator to the first element at present.
+     */
+    iterator begin(void) { return map_.begin(); }
+
+    /*! Get an iterator to the first element just before some time point.
+     */
+    retro_iterator begin(const time_point &t) { return map_.begin(t.inner); }
+
+    /*! Get an iterator past the last element at present.
+     */
+    iterator end(void) { return map_.end(); }
+
+    /*! Get an iterator past the last element just before some time point.
+     */
+    retro_iterator end(const time_point &t) { return map_.end(t.inner); }
+
+    /*! Search for an element at present.
+     */
+    iterator find(const key_type &key) { return map_.find(key); }
+
+    /*! Search for an element just before some time point.
+     */
+    retro_iterator find(const time_point &t, const key_type &key)
+    {
+      return map_.find(t.inner, key);
+    }
+
+  private:
+    // The code logged for a revert, which is not an operation of the map.
+    static const std::uint8_t revert_code = 0xff;
+
+    bool log(std::uint8_t code, std::uint64_t at, const key_type &key,
+             const mapped_type &val);
+
+    time_point record(const typename map_type::time_point &inner);
+
+    bool apply(std::uint8_t code, std::uint64_t at, const char *payload);
+
+    // Return whether operations can refer to an ordinal, which is either the
+    // present or an operation that has not been reverted.
+    bool live(std::uint64_t at) const;
+
+    map_type map_;
+    detail::log_file log_;
+
+    // The time point of every operation by ordinal, including reverted ones.
+    std::vector<typename map_type::time_point> times_;
+
+    // Whether the operation of each ordinal has been reverted.
+    std::vector<bool> reverted_;
+}; // end logged_full_map
+
+} // end retro
+
+#include "retro/logged_map.inl"
@@ -0,0 +1,196 @@
+namespace retro
+{
+
+template <class Key, class T, class Compare>
+  logged_full_map<Key, T, Compare>::logged_full_map(std::size_t batch,
+                                                    const key_compare &comp)
+    : map_(comp), log_(batch)
+{
+}
+
+template <class Key, class T, class Compare>
+  bool logged_full_map<Key, T, Compare>::open(const char *path)
+{
+  // Replayed operations would not get the ordinals they were logged with.
+  if (!times_.empty()) return false;
+
+  bool opened = log_.open(path, "RETROWAL",
+                          sizeof(key_type) + sizeof(mapped_type),
+                          sizeof(key_type), sizeof(mapped_type),
+                          [this](std::uint8_t code, std::uint64_t at,
+                                 const char *payload)
+                          { return apply(code, at, payload); });
+  if (!opened)
+  {
+    map_ = map_type(map_.key_comp());
+    times_.clear();
+    reverted_.clear();
+  }
+  return opened;
+}
+
+template <class Key, class T, class Compare>
+  bool logged_full_map<Key, T, Compare>::close(void)
+{
+  return log_.close();
+}
+
+template <class Key, class T, class Compare>
+  bool logged_full_map<Key, T, Compare>::flush(void)
+{
+  return log_.flush();
+}
+
+template <class Key, class T, class Compare>
+  bool logged_full_map<Key, T, Compare>::sync(void)
+{
+  return log_.sync();
+}
+
+template <class Key, class T, class Compare>
+  typename logged_full_map<Key, T, Compare>::time_point
+    logged_full_map<Key, T, Compare>::at(std::uint64_t ordinal) const
+{
+  // An ordinal from elsewhere may not refer to any operation of this map.
+  if (ordinal >= times_.size())
+    return time_point(map_.present(), ordinal, false);
+  return time_point(times_[ordinal], ordinal);
+}
+
+template <class Key, class T, class Compare>
+  typename logged_full_map<Key, T, Compare>::time_point
+    logged_full_map<Key, T, Compare>::present(void)
+{
+  return time_point(map_.present(), detail::log_file::present);
+}
+
+template <class Key, class T, class Compare>
+  typename logged_full_map<Key, T, Compare>::time_point
+    logged_full_map<Key, T, Compare>::insert(const value_type &val)
+{
+  return insert(present(), val);
+}
+
+template <class Key, class T, class Compare>
+  typename logged_full_map<Key, T, Compare>::time_point
+    logged_full_map<Key, T, Compare>::insert(const time_point &t,
+                                             const value_type &val)
+{
+  if (!live(t.pos)
+      || !log(static_cast<std::uint8_t>(map::insert), t.pos, val.first,
+              val.second))
+    return time_point(t.inner, t.pos, false);
+  return record(map_.insert(t.inner, val));
+}
+
+template <class Key, class T, class Compare>
+  typename logged_full_map<Key, T, Compare>::time_point
+    logged_full_map<Key, T, Compare>::erase(const key_type &key)
+{
+  return erase(present(), key);
+}
+
+template <class Key, class T, class Compare>
+  typename logged_full_map<Key, T, Compare>::time_point
+    logged_full_map<Key, T, Compare>::erase(const time_point &t,
+                                            const key_type &key)
+{
+  if (!live(t.pos)
+      || !log(static_cast<std::uint8_t>(map::erase), t.pos, key,
+              mapped_type()))
+    return time_point(t.inner, t.pos, false);
+  return record(map_.erase(t.inner, key));
+}
+
+template <class Key, class T, class Compare>
+  typename logged_full_map<Key, T, Compare>::time_point
+    logged_full_map<Key, T, Compare>::assign(const key_type &key,
+                                             const mapped_type &val)
+{
+  return assign(present(), key, val);
+}
+
+template <class Key, class T, class Compare>
+  typename logged_full_map<Key, T, Compare>::time_point
+    logged_full_map<Key, T, Compare>::assign(const time_point &t,
+                                             const key_type &key,
+                                             const mapped_type &val)
+{
+  if (!live(t.pos)
+      || !log(static_cast<std::uint8_t>(map::assign), t.pos, key, val))
+    return time_point(t.inner, t.pos, false);
+  return record(map_.assign(t.inner, key, val));
+}
+
+template <class Key, class T, class Compare>
+  bool logged_full_map<Key, T, Compare>::revert(const time_point &t)
+{
+  // Reverting the present would change nothing, but its record would not
+  // replay.
+  if (t.pos == detail::log_file::present || !live(t.pos)
+      || !log(revert_code, t.pos, key_type(), mapped_type()))
+    return false;
+  map_.revert(t.inner);
+  reverted_[t.pos] = true;
+  return true;
+}
+
+template <class Key, class T, class Compare>
+  bool logged_full_map<Key, T, Compare>::log(std::uint8_t code,
+                                             std::uint64_t at,
+                                             const key_type &key,
+                                             const mapped_type &val)
+{
+  // The record goes in the log before the operation is performed.
+  char payload[sizeof(key_type) + sizeof(mapped_type)];
+  std::memcpy(payload, &key, sizeof(key_type));
+  std::memcpy(payload + sizeof(key_type), &val, sizeof(mapped_type));
+  return log_.append(code, at, payload);
+}
+
+template <class Key, class T, class Compare>
+  typename logged_full_map<Key, T, Compare>::time_point
+    logged_full_map<Key, T, Compare>::record(
+        const typename map_type::time_point &inner)
+{
+  times_.push_back(inner);
+  reverted_.push_back(false);
+  return time_point(inner, times_.size() - 1);
+}
+
+template <class Key, class T, class Compare>
+  bool logged_full_map<Key, T, Compare>::apply(std::uint8_t code,
+                                               std::uint64_t at,
+                                               const char *payload)
+{
+  // Operations refer to earlier ones that have not been reverted, or to the
+  // present. Anything else, such as a second revert of an operation, could
+  // only come from a damaged log.
+  bool now = at == detail::log_file::present;
+  if (!live(at)) return false;
+  time_point t = now ? present() : this->at(at);
+
+  if (code == revert_code) return revert(t);
+
+  key_type key;
+  mapped_type val;
+  std::memcpy(&key, payload, sizeof(key_type));
+  std::memcpy(&val, payload + sizeof(key_type), sizeof(mapped_type));
+
+  switch (static_cast<map>(code))
+  {
+    case map::insert: return insert(t, value_type(key, val)).logged();
+    case map::erase: return erase(t, key).logged();
+    case map::assign: return assign(t, key, val).logged();
+  }
+  return false;
+}
+
+template <class Key, class T, class Compare>
+  bool logged_full_map<Key, T, Compare>::live(std::uint64_t at) const
+{
+  return at == detail::log_file::present
+         || (at < times_.size() && !reverted_[at]);
+}
+
+} // end retro
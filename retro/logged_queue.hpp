@@ -0,0 +1,289 @@
+/*! \file logged_queue.hpp
+ *  \brief Implementation of a partially retroactive queue that records every
+ *         operation in a write-ahead log, from which it can be rebuilt.
+ */
+
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+#include "retro/queue.hpp"
+#include "retro/detail/log_file.hpp"
+
+namespace retro
+{
+
+/*! \brief Represents a partially retroactive queue whose operations are
+ *  appended to a log file before they are performed.
+ *  \p This logs operations in the same way as logged_full_map. Elements must
+ *     be trivially copyable.
+ *
+ *  \tparam T The type of elements to store in the container.
+ */
+template <class T>
+class logged_partial_queue
+{
+  static_assert(std::is_trivially_copyable<T>::value,
+                "logged_partial_queue requires a trivially copyable type");
+
+  public:
+    typedef partial_queue<T> queue_type;
+    typedef typename queue_type::value_type value_type;
+    typedef typename queue_type::reference reference;
+    typedef typename queue_type::size_type size_type;
+
+    /*! Represents an operation performed on the data structure at some point
+     *  in time.
+     */
+    class time_point
+    {
+      public:
+        /*! Get the operation that was performed.
+         */
+        queue operation() const { return op; }
+
+        /*! Get the position of the operation among every operation performed
+         *  on the queue. This is the same after the queue is rebuilt from its
+         *  log.
+         */
+        std::uint64_t ordinal() const { return pos; }
+
+        /*! Return whether the operation was logged and performed. If not,
+         *  the queue is unchanged and this time point must not be used. An
+         *  operation just before a time point that was reverted is never
+         *  performed.
+         */
+        bool logged() const { return ok; }
+
+      private:
+        // The time point of the queue is found by ordinal, as there is none
+        // for an operation that was not performed.
+        time_point(queue op, std::uint64_t pos, bool ok = true)
+          : op(op), pos(pos), ok(ok)
+        {
+        }
+
+        queue op;
+        std::uint64_t pos;
+        bool ok;
+
+        friend class logged_partial_queue<T>;
+    };
+
+    /*! Construct an empty queue that does not log its operations.
+     *  \param batch The number of bytes of records to buffer before writing.
+     */
+    explicit logged_partial_queue(std::size_t batch = 1 << 16)
+      : log_(batch)
+    {
+    }
+
+    /*! Attach the queue to a log, replaying the operations in it first.
+     *  \p The queue must not have performed any operation, as the replayed
+     *     operations would then get other ordinals than they were logged
+     *     with. A record that was only partly written is discarded.
+     *  \param path The path of the log, which is created if it does not exist.
+     *  \return Whether the log was opened and replayed. If the queue already
+     *          had operations, it is unchanged. Otherwise, if not, the queue
+     *          is empty and does not log its operations.
+     */
+    bool open(const char *path)
+    {
+      if (!times_.empty()) return false;
+
+      bool opened = log_.open(path, "RETROQWL", sizeof(value_type), 0,
+                              sizeof(value_type),
+                              [this](std::uint8_t code, std::uint64_t at,
+                                     const char *payload)
+                              { return apply(code, at, payload); });
+      if (!opened)
+      {
+        queue_type().swap(queue_);
+        times_.clear();
+        reverted_.clear();
+      }
+      return opened;
+    }
+
+    /*! Write any buffered records and detach the queue from its log.
+     *  \return Whether the records were written.
+     */
+    bool close(void)
+    {
+      return log_.close();
+    }
+
+    /*! Write every buffered record to the log.
+     *  \return Whether the records were written.
+     */
+    bool flush(void)
+    {
+      return log_.flush();
+    }
+
+    /*! Write every buffered record and wait until the log is stored durably.
+     *  \return Whether the records were stored.
+     */
+    bool sync(void)
+    {
+      return log_.sync();
+    }
+
+    /*! Get the time point of an operation by its ordinal.
+     *  \return The time point, which is not logged() if no operation has
+     *          the ordinal.
+     */
+    time_point at(std::uint64_t ordinal) const
+    {
+      if (ordinal >= times_.size())
+        return time_point(queue::push, ordinal, false);
+      return time_point(times_[ordinal].operation(), ordinal);
+    }
+
+    /*! Return the number of elements in the container at present.
+     */
+    size_type size(void) const
+    {
+      return queue_.size();
+    }
+
+    /*! Return whether the container is empty at present.
+     */
+    bool empty(void) const
+    {
+      return queue_.empty();
+    }
+
+    /*! Return the element at the front of the container at present.
+     */
+    reference front(void)
+    {
+      return queue_.front();
+    }
+
+    /*! Return the element at the back of the container at present.
+     */
+    reference back(void)
+    {
+      return queue_.back();
+    }
+
+    /*! Push an element at present and log it.
+     */
+    time_point push(const T &val)
+    {
+      if (!log(static_cast<std::uint8_t>(queue::push),
+               detail::log_file::present, val))
+        return time_point(queue::push, detail::log_file::present, false);
+      return record(queue_.push(T(val)));
+    }
+
+    /*! Push an element just before some time point and log it.
+     */
+    time_point push(const time_point &t, const T &val)
+    {
+      if (!live(t.pos)
+          || !log(static_cast<std::uint8_t>(queue::push), t.pos, val))
+        return time_point(queue::push, detail::log_file::present, false);
+      return record(queue_.push(times_[t.pos], T(val)));
+    }
+
+    /*! Pop an element at present and log it.
+     */
+    time_point pop(void)
+    {
+      if (!log(static_cast<std::uint8_t>(queue::pop),
+               detail::log_file::present, T()))
+        return time_point(queue::pop, detail::log_file::present, false);
+      return record(queue_.pop());
+    }
+
+    /*! Pop an element just before some time point and log it.
+     */
+    time_point pop(const time_point &t)
+    {
+      if (!live(t.pos)
+          || !log(static_cast<std::uint8_t>(queue::pop), t.pos, T()))
+        return time_point(queue::pop, detail::log_file::present, false);
+      return record(queue_.pop(times_[t.pos]));
+    }
+
+    /*! Revert a previous operation and log it. The ordinal of the operation
+     *  is not reused.
+     *  \return Whether the revert was logged and performed. Nothing is
+     *          logged for an operation that was already reverted.
+     */
+    bool revert(const time_point &t)
+    {
+      if (!live(t.pos) || !log(revert_code, t.pos, T())) return false;
+      queue_.revert(times_[t.pos]);
+      reverted_[t.pos] = true;
+      return true;
+    }
+
+  private:
+    // The code logged for a revert, which is not an operation of the queue.
+    static const std::uint8_t revert_code = 0xff;
+
+    bool log(std::uint8_t code, std::uint64_t at, const T &val)
+    {
+      // The record goes in the log before the operation is performed.
+      char payload[sizeof(value_type)];
+      std::memcpy(payload, &val, sizeof(value_type));
+      return log_.append(code, at, payload);
+    }
+
+    time_point record(const typename queue_type::time_point &inner)
+    {
+      times_.push_back(inner);
+      reverted_.push_back(false);
+      return time_point(inner.operation(), times_.size() - 1);
+    }
+
+    bool apply(std::uint8_t code, std::uint64_t at, const char *payload)
+    {
+      // Operations refer to earlier ones that have not been reverted, or to
+      // the present. Anything else, such as a second revert of an
+      // operation, could only come from a damaged log.
+      bool now = at == detail::log_file::present;
+      if (!now && !live(at)) return false;
+
+      if (code == revert_code)
+      {
+        if (now) return false;
+        return revert(this->at(at));
+      }
+
+      T val;
+      std::memcpy(&val, payload, sizeof(value_type));
+
+      switch (static_cast<queue>(code))
+      {
+        case queue::push:
+          return (now ? push(val) : push(this->at(at), val)).logged();
+        case queue::pop:
+          return (now ? pop() : pop(this->at(at))).logged();
+      }
+      return false;
+    }
+
+    // Return whether an ordinal is of an operation that has not been reverted.
+    bool live(std::uint64_t at) const
+    {
+      return at < times_.size() && !reverted_[at];
+    }
+
+    queue_type queue_;
+    detail::log_file log_;
+
+    // The time point of every operation by ordinal, including reverted ones.
+    std::vector<typename queue_type::time_point> times_;
+
+    // Whether the operation of each ordinal has been reverted.
+    std::vector<bool> reverted_;
+}; // end logged_partial_queue
+
+} // end retro
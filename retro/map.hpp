@@ -4,11 +4,31 @@
 
 #pragma once
 
-#include <list>
 #include <map>
+#include <memory>
+#include <atomic>
+#include <algorithm>
 #include <set>
-
+#include <unordered_set>
+#include <vector>
+#include <utility>
+#include <functional>
+#include <type_traits>
+#include <tuple>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <istream>
+#include <ostream>
+#include <stdexcept>
+
+#include "retro/memory.hpp"
 #include "retro/detail/ordered_list.hpp"
+#include "retro/detail/dense_index.hpp"
+#include "retro/detail/slab.hpp"
+#include "retro/detail/persistent_map.hpp"
+#include "retro/detail/parallel_sort.hpp"
+#include "retro/detail/frozen.hpp"
 
 namespace retro
 {
@@ -17,13 +37,19 @@ namespace retro
  */
 enum class map
 {
-  /*! \brief Represents inserting an element into the map.
+  /*! \brief Represents inserting an element into the map, which has no
+   *  effect if its key already exists.
    */
   insert,
 
   /*! \brief Represents deleting an element from the map.
    */
-  erase
+  erase,
+
+  /*! \brief Represents setting the value of an element in the map, whether or
+   *  not it already exists.
+   */
+  assign
 };
 
 namespace detail
@@ -36,38 +62,122 @@ namespace detail
   template <class MapIterator, class EventIterator>
   bool key_exists(MapIterator map_it, EventIterator event_it);
 
-  template <class Compare, class T>
-  struct comp_wrapper
+  //! Finds the operation that set the value of a key, given the position in
+  //! its history just after the last operation, which must not be an erase.
+  template <class HistoryIterator>
+  typename std::iterator_traits<HistoryIterator>::value_type
+    value_event(HistoryIterator pos);
+
+  //! Updates the operation that sets the value of each key from a position
+  //! in its history on, after an event there was added or removed.
+  template <class History>
+  void relink(History &history, typename History::iterator pos);
+
+  //! Gives iterators that dereference to a temporary an operator->.
+  template <class Reference>
+  struct arrow_proxy
   {
-    comp_wrapper(const Compare &comp)
-      : comp(comp) { }
+    arrow_proxy(const Reference &ref)
+      : ref(ref) { }
 
-    bool operator()(const T &a, const T &b) const
+    const Reference *operator->() const
     {
-      return comp(a, b);
+      return &ref;
     }
 
-    Compare comp;
+    Reference ref;
+  };
+} // end detail
+
+/*! \brief Compares dense integer keys.
+ *  \p Using this as the comparison of a full_map indexes keys by a
+ *     direct-address array instead of a balanced tree. This is only efficient
+ *     when keys are small, so that few slots in the array are unused. Keys
+ *     must be non-negative: queries never find a negative key, and an
+ *     operation on one throws std::out_of_range.
+ */
+template <class Key>
+struct dense_less : std::less<Key>
+{
+  static_assert(std::is_integral<Key>::value,
+                "dense_less requires an integer key type");
+};
+
+namespace detail
+{
+  //! Selects the container that indexes the history of each key of a map.
+  template <class Key, class Value, class Compare, class Allocator>
+  struct key_index
+  {
+    typedef std::map<Key, Value, Compare, Allocator> type;
   };
+
+  template <class Key, class Value, class Allocator>
+  struct key_index<Key, Value, dense_less<Key>, Allocator>
+  {
+    typedef dense_index<Key, Value, Allocator> type;
+  };
+
+  //! Checks whether an index of keys can store a key. Only a dense index
+  //! rejects any, which are the negative ones.
+  template <class Index, class Key>
+  bool key_storable(const Index &, const Key &)
+  {
+    return true;
+  }
+
+  template <class Key, class Value, class Allocator>
+  bool key_storable(const dense_index<Key, Value, Allocator> &,
+                    const Key &key)
+  {
+    return dense_index<Key, Value, Allocator>::storable(key);
+  }
 } // end detail
 
 /*! \brief Represents a fully retroactive ordered associative map.
+ *  \p Each distinct key is stored once, in the index of key histories. Values
+ *     are stored in a slab and referred to from events by handle, and both are
+ *     released when the operation that introduced them is reverted. The slab
+ *     never moves a value, so a reference to a value obtained through an
+ *     iterator stays valid until its operation is reverted or compacted away.
+ *     Values only need to be copy constructible.
+ *
+ *     An insert on a key that already exists has no effect, while an assign
+ *     replaces its value. Each event records the operation whose value the
+ *     key has just after it, so finding a value takes constant time. Whether
+ *     an insert takes effect is decided again whenever an earlier operation
+ *     on its key is made or reverted, which updates the run of inserts that
+ *     follows that operation in the history of the key.
+ *
+ *  \tparam Allocator The allocator that every internal container allocates
+ *                    from, after rebinding to the type of its nodes: the
+ *                    events, the index of keys, the history of each key and
+ *                    the slab of values.
  */
-template <class Key, class T, class Compare = std::less<Key>>
+template <class Key, class T, class Compare = std::less<Key>,
+          class Allocator = std::allocator<std::pair<const Key, T>>>
 class full_map
 {
   private:
     struct event;
 
-    typedef std::list<std::pair<Key, T>> data_container;
-    typedef typename data_container::iterator data_iterator;
+    template <class U>
+    using rebind_alloc = typename std::allocator_traits<Allocator>
+                           ::template rebind_alloc<U>;
 
-    typedef detail::ordered_list<event> event_container;
+    typedef detail::slab<T, rebind_alloc<T>> value_container;
+    typedef typename value_container::handle value_handle;
+
+    typedef detail::ordered_list<event, unsigned long long int,
+                                 rebind_alloc<event>> event_container;
     typedef typename event_container::iterator event_iterator;
 
-    typedef std::map<std::reference_wrapper<const Key>,
-                     std::set<event_iterator>,
-                     detail::comp_wrapper<Compare, Key>> map_container;
+    typedef std::set<event_iterator, std::less<event_iterator>,
+                     rebind_alloc<event_iterator>> history_type;
+
+    typedef typename detail::key_index<
+        Key, history_type, Compare,
+        rebind_alloc<std::pair<const Key, history_type>>>::type map_container;
     typedef typename map_container::iterator map_iterator;
 
   public:
@@ -75,10 +185,14 @@ class full_map
     typedef T mapped_type;
     typedef std::pair<const key_type, mapped_type> value_type;
     typedef Compare key_compare;
+    typedef Allocator allocator_type;
     typedef typename map_container::size_type size_type;
+    typedef std::pair<const key_type &, const mapped_type &> reference;
 
     /*! Represents an operation performed on the data structure at some point
-     *  in time.
+     *  in time. It is accepted by the map that returned it and by copies of
+     *  that map made later. Other maps throw std::invalid_argument when
+     *  given it, except for time points at present, which every map accepts.
      */
     class time_point
     {
@@ -87,38 +201,63 @@ class full_map
          */
         map operation() const { return op; }
 
+        bool operator==(const time_point &other) const
+        {
+          return id == other.id && tag == other.tag;
+        }
+
+        bool operator!=(const time_point &other) const
+        {
+          return !(*this == other);
+        }
+
       private:
+        // The identifier of every time point at present, which has no event.
+        static const std::size_t present_id = static_cast<std::size_t>(-1);
+
         time_point(event_iterator event)
-          : event(event)
+          : op(), event(event), id(present_id), tag(0)
         {
         }
 
-        time_point(map op, event_iterator event)
-          : op(op), event(event)
+        time_point(map op, event_iterator event, std::uint64_t tag)
+          : op(op), event(event), id(event->id), tag(tag)
         {
         }
 
         map op;
         event_iterator event;
 
-        friend class full_map<Key, T, Compare>;
+        // Identifies the event in every copy of the map, as the iterator only
+        // refers to it in the map that created this time point.
+        std::size_t id;
+
+        // The state that created this time point. Copies of a map issue the
+        // same identifiers after they are made, so an identifier alone does
+        // not say which map an event belongs to.
+        std::uint64_t tag;
+
+        friend class full_map<Key, T, Compare, Allocator>;
     };
 
     class iterator
-      : public std::iterator<std::bidirectional_iterator_tag, value_type>
+      : public std::iterator<std::bidirectional_iterator_tag, value_type,
+                             std::ptrdiff_t, detail::arrow_proxy<reference>,
+                             reference>
     {
       public:
-        typedef value_type& reference;
-        typedef data_iterator pointer;
+        typedef full_map<Key, T, Compare, Allocator>::reference reference;
+        typedef detail::arrow_proxy<reference> pointer;
 
-        reference operator*()
+        reference operator*() const
         {
-          return (*std::prev(base->second.end()))->data;
+          auto setter = value_event(base->second.end());
+          return reference(base->first, (*values)[setter->value]);
         }
 
-        pointer operator->()
+        pointer operator->() const
         {
-          return (*std::prev(base->second.end()))->data;
+          return pointer(**this);
         }
 
         iterator &operator++()
@@ -173,34 +312,38 @@ class full_map
         }
 
       private:
-        iterator(map_iterator last, map_iterator base)
-          : last(last), base(base)
+        iterator(const value_container *values, map_iterator last,
+            map_iterator base)
+          : values(values), last(last), base(base)
         {
           // Make sure that this iterator points to a valid element.
           if (base != last && !key_exists(base)) ++(*this);
         }
 
+        const value_container *values;
         map_iterator last;
         map_iterator base;
 
-        friend class full_map<Key, T, Compare>;
+        friend class full_map<Key, T, Compare, Allocator>;
     };
 
     class retro_iterator
-      : public std::iterator<std::bidirectional_iterator_tag, value_type>
+      : public std::iterator<std::bidirectional_iterator_tag, value_type,
+                             std::ptrdiff_t, detail::arrow_proxy<reference>,
+                             reference>
     {
       public:
-        typedef value_type& reference;
-        typedef data_iterator pointer;
+        typedef full_map<Key, T, Compare, Allocator>::reference reference;
+        typedef detail::arrow_proxy<reference> pointer;
 
-        reference operator*()
+        reference operator*() const
         {
-          return cur->data;
+          return reference(base->first, (*values)[cur->value]);
         }
 
-        pointer operator->()
+        pointer operator->() const
         {
-          return cur->data;
+          return pointer(**this);
         }
 
         retro_iterator operator++()
@@ -208,7 +351,8 @@ class full_map
           // Find the next key that has not been erased.
           do { ++base; }
           while (base != last && !key_exists(base, event));
-          if (base != last) cur = *std::prev(base->second.lower_bound(event));
+          if (base != last)
+            cur = value_event(base->second.lower_bound(event));
           return *this;
         }
 
@@ -217,7 +361,8 @@ class full_map
           // Find the next key that has not been erased.
           do { --base; }
           while (!key_exists(base, event));
-          if (base != last) cur = *std::prev(base->second.lower_bound(event));
+          if (base != last)
+            cur = value_event(base->second.lower_bound(event));
           return *this;
         }
 
@@ -242,37 +387,98 @@ class full_map
         }
 
       private:
-        retro_iterator(map_iterator last, map_iterator base,
-            event_iterator event)
-          : last(last), base(base), event(event), cur(event)
+        retro_iterator(const value_container *values, map_iterator last,
+            map_iterator base, event_iterator event)
+          : values(values), last(last), base(base), event(event), cur(event)
         {
           if (base != last)
           {
-            // Iterate to the first valid key
+            // Iterate to the first valid key, which may be the end.
             if (!key_exists(base, event)) ++(*this);
-            cur = *std::prev(base->second.lower_bound(event));
+            else
+              cur = value_event(base->second.lower_bound(event));
           }
         }
 
+        retro_iterator(const value_container *values, map_iterator last,
+            map_iterator base, event_iterator event, event_iterator cur)
+          : values(values), last(last), base(base), event(event), cur(cur)
+        {
+        }
+
+        const value_container *values;
         map_iterator last;
         map_iterator base;
         event_iterator event;
         event_iterator cur;
 
-        friend class full_map<Key, T, Compare>;
+        friend class full_map<Key, T, Compare, Allocator>;
     };
 
+    /*! Represents an interval of time [first, second) between two time points.
+     */
+    typedef std::pair<time_point, time_point> interval;
+
+    /*! Represents an operation in a log of operations performed at present,
+     *  with its key and value. The value of an erase is ignored.
+     */
+    typedef std::tuple<map, key_type, mapped_type> log_entry;
+
     /*! Construct an empty fully retroactive map.
+     *  \param comp The function object used to order keys.
+     *  \param alloc The allocator to allocate the map from.
+     */
+    explicit full_map(const key_compare &comp = key_compare(),
+                      const allocator_type &alloc = allocator_type());
+
+    /*! Copy an existing map, with every event, key and value, in O(n) time.
+     *  Time points of the other map remain valid for the copy. Time points
+     *  that either map creates after the copy belong only to that map, and
+     *  passing one to the other throws std::invalid_argument rather than
+     *  acting at another point in time.
      */
-    explicit full_map(const key_compare &comp = key_compare());
+    full_map(const full_map &other);
 
-    /*! Copy an existing map.
+    /*! Construct a map by acquiring the state of an existing map, which is
+     *  left empty. Nothing is allocated until the other map is used again.
      */
-    full_map(const full_map &other) = default;
+    full_map(full_map &&other)
+      noexcept(std::is_nothrow_copy_constructible<key_compare>::value
+               && std::is_nothrow_copy_constructible<allocator_type>::value);
 
-    /*! Construct a map by acquiring the state of an existing map.
+    /*! Replace the contents of this map with a copy of those of another.
      */
-    full_map(full_map&& other);
+    full_map &operator=(const full_map &other);
+
+    /*! Replace the contents of this map by acquiring the state of another,
+     *  which is left empty. Nothing is allocated until the other map is used
+     *  again.
+     */
+    full_map &operator=(full_map &&other)
+      noexcept(std::is_nothrow_copy_assignable<key_compare>::value
+               && std::is_nothrow_copy_assignable<allocator_type>::value);
+
+    /*! Construct a map by replaying a log of operations.
+     *  \p The result is the same as performing each operation at present in
+     *     order, but the events are appended without searching the index and
+     *     then grouped by key with a parallel sort, rather than inserted one
+     *     at a time. The log is read once, and only a copy of each key and
+     *     a reference to its event are held aside until the index is built.
+     *  \param first An iterator to the first log_entry, in time order.
+     *  \param last An iterator past the last log_entry.
+     *  \param comp The function object used to order keys.
+     *  \param threads The number of threads to sort with, or zero to use one
+     *                 per hardware thread.
+     *  \param alloc The allocator to allocate the map from.
+     */
+    template <class InputIt>
+    full_map(InputIt first, InputIt last,
+             const key_compare &comp = key_compare(), std::size_t threads = 0,
+             const allocator_type &alloc = allocator_type());
+
+    /*! Return a copy of the allocator of the map.
+     */
+    allocator_type get_allocator(void) const;
 
     /*! Return the number of elements in the container at present.
      */
@@ -288,6 +494,10 @@ class full_map
      */
     size_type max_size(void) const;
 
+    /*! Return the function object that orders keys.
+     */
+    key_compare key_comp(void) const;
+
     /*! Return whether the container is empty at present.
      */
     bool empty(void) const;
@@ -297,6 +507,18 @@ class full_map
      */
     bool empty(const time_point &t) const;
 
+    /*! Return a time point that comes after every operation. Querying just
+     *  before it is equivalent to querying the present state, and performing
+     *  an operation just before it is equivalent to performing it at present.
+     */
+    time_point present(void) const;
+
+    /*! Return the time point of the earliest operation, or present() if
+     *  there is none. An operation performed just before it becomes the
+     *  earliest.
+     */
+    time_point earliest(void);
+
     /*! Return an iterator referring to the first element in the container at
      *  present.
      */
@@ -304,6 +526,10 @@ class full_map
 
     /*! Return an iterator referring to the first element in the container just
      *  before some time point.
+     *  \p With checkpoints, only the k operations since the nearest
+     *     checkpoint before t and the first entries of that checkpoint are
+     *     inspected, taking O(k log n) time. Without them, keys are inspected
+     *     from the first until one exists.
      *  \param t The time point to query.
      */
     retro_iterator begin(const time_point &t);
@@ -337,6 +563,111 @@ class full_map
      */
     time_point insert(const time_point &t, const value_type &val);
 
+    /*! Erase the element with a specific key from the container in its
+     *  present state.
+     *  \param key The key of the element to erase.
+     *  \return A new time point representing this operation.
+     */
+    time_point erase(const key_type &key);
+
+    /*! Retroactively erase the element with a specific key from the container
+     *  just before some time point.
+     *  \param t The time point of the operation just before this new one.
+     *  \param key The key of the element to erase.
+     *  \return A new time point representing this retroactive operation.
+     */
+    time_point erase(const time_point &t, const key_type &key);
+
+    /*! Set the value of an element in the container in its present state,
+     *  inserting the element if its key does not exist.
+     *  \param key The key of the element to set.
+     *  \param val The new value of the element.
+     *  \return A new time point representing this operation.
+     */
+    time_point assign(const key_type &key, const mapped_type &val);
+
+    /*! Retroactively set the value of an element in the container just before
+     *  some time point, inserting the element if its key did not exist.
+     *
+     *  Later queries see this value until the next operation on the same key.
+     *
+     *  \param t The time point of the operation just before this new one.
+     *  \param key The key of the element to set.
+     *  \param val The new value of the element.
+     *  \return A new time point representing this retroactive operation.
+     */
+    time_point assign(const time_point &t, const key_type &key,
+                      const mapped_type &val);
+
+    /*! Retroactively revert a previous operation, releasing the storage that
+     *  the operation used. Nothing happens if the time point is at present.
+     *  \param t The time point of the operation to revert.
+     */
+    void revert(const time_point &t);
+
+    /*! Fold every operation before a horizon into the state it left behind.
+     *  \p Each key that exists just before the horizon keeps only the last
+     *     operation on it, which becomes an insert of its value. Every other
+     *     operation before the horizon is removed and its storage released,
+     *     along with keys that no longer have any operations. Queries at or
+     *     after the horizon are unaffected. Time points before the horizon,
+     *     other than those of the remaining inserts, become invalid, as do
+     *     checkpoints before it.
+     *  \param horizon The time point of the earliest operation to keep.
+     *  \return The number of operations removed.
+     */
+    size_type compact(const time_point &horizon);
+
+    /*! Return the memory allocated by the map. Values are reported as
+     *  payloads.
+     */
+    memory_report memory_usage(void) const;
+
+    /*! Get the time point just after every operation whose timestamp is not
+     *  after a given one.
+     *  \p Operations performed by insert_at(), erase_at() and assign_at()
+     *     are ordered by their timestamps, with operations of equal
+     *     timestamps in the order they were performed. Operations performed
+     *     without a timestamp are not in the index, so a timestamped
+     *     operation goes before the next timestamped operation, or at present
+     *     if there is none.
+     *  \param ts The timestamp to search for.
+     */
+    time_point at_timestamp(std::int64_t ts);
+
+    /*! Retroactively insert a new element into the container at a timestamp.
+     *  This finds the position with a single search of the timestamp index.
+     *  \param ts The timestamp of the new operation.
+     *  \param val The new value to insert.
+     *  \return A new time point representing this operation.
+     */
+    time_point insert_at(std::int64_t ts, const value_type &val);
+
+    /*! Retroactively erase an element from the container at a timestamp.
+     *  \param ts The timestamp of the new operation.
+     *  \param key The key of the element to erase.
+     *  \return A new time point representing this operation.
+     */
+    time_point erase_at(std::int64_t ts, const key_type &key);
+
+    /*! Retroactively set the value of an element at a timestamp.
+     *  \param ts The timestamp of the new operation.
+     *  \param key The key of the element to set.
+     *  \param val The new value of the element.
+     *  \return A new time point representing this operation.
+     */
+    time_point assign_at(std::int64_t ts, const key_type &key,
+                         const mapped_type &val);
+
+    /*! Search for an element as it was at a timestamp, after every
+     *  operation with that timestamp.
+     *  \param ts The timestamp to query.
+     *  \param key The key to search for.
+     *  \return An iterator to the element, or end(at_timestamp(ts)) if it
+     *          did not exist.
+     */
+    retro_iterator find_at(std::int64_t ts, const key_type &key);
+
     /*! Search the container for a specific element in its present state.
      *  \param key The key of the element to search for.
      *  \return An iterator to the element if it is found, or full_map::end()
@@ -351,7 +682,188 @@ class full_map
      *          otherwise.
      */
     retro_iterator find(const time_point &t, const key_type &key);
-  
+
+    /*! Return the intervals of time during which a key was in the container.
+     *  \p Each interval starts at the operation that made the key exist and
+     *     ends at the erase that removed it, or at present() if it still
+     *     exists. This takes time linear in the number of operations
+     *     performed on the key.
+     *  \param key The key to search for.
+     *  \return The intervals in chronological order.
+     */
+    std::vector<interval> lifetimes(const key_type &key);
+
+    /*! Search the container for several elements just before the same time
+     *  point.
+     *  \p When the keys are sorted, each key is found by walking forward from
+     *     the previous one rather than searching the whole container, and the
+     *     time point is compared against each key's history using labels that
+     *     are read once. Unsorted keys are also found correctly.
+     *  \param t The time point to query.
+     *  \param first An iterator to the first key to search for.
+     *  \param last An iterator past the last key to search for.
+     *  \param out The output iterator to write, for each key, the result that
+     *             find(t, key) would return.
+     *  \return The output iterator past the last result written.
+     */
+    template <class InputIterator, class OutputIterator>
+    OutputIterator find_many(const time_point &t, InputIterator first,
+                             InputIterator last, OutputIterator out);
+
+    /*! Search the container for the same element just before several time
+     *  points.
+     *  \p When the time points are in chronological order, they are merged
+     *     with the history of the key in a single pass, which takes time linear
+     *     in the number of time points plus operations on the key. Time points
+     *     out of order are also handled correctly.
+     *  \param key The key of the element to search for.
+     *  \param first An iterator to the first time point to query.
+     *  \param last An iterator past the last time point to query.
+     *  \param out The output iterator to write, for each time point t, the
+     *             result that find(t, key) would return.
+     *  \return The output iterator past the last result written.
+     */
+    template <class InputIterator, class OutputIterator>
+    OutputIterator sweep(const key_type &key, InputIterator first,
+                         InputIterator last, OutputIterator out);
+
+    /*! Find the keys whose elements differ between two time points.
+     *  \p Only the operations performed between the two time points are
+     *     inspected, so this takes O(k log n) time for k such operations.
+     *     Where checkpoints fall between the time points, the operations
+     *     between the first and the last of them are not walked; the keys
+     *     they touched are those whose entries differ in the two checkpoints,
+     *     which are found by skipping the parts of the trees they share.
+     *
+     *     Each differing key is written once, in key order, as a
+     *     std::pair<key_type, map>. The operation is map::insert if the key
+     *     exists just before t2 but not t1, map::erase if it exists just before
+     *     t1 but not t2, and map::assign if it exists at both but its value was
+     *     set by a different operation.
+     *
+     *  \param t1 The time point to compare from.
+     *  \param t2 The time point to compare to.
+     *  \param out The output iterator to write the differing keys to.
+     *  \return The output iterator past the last key written.
+     */
+    template <class OutputIterator>
+    OutputIterator diff(const time_point &t1, const time_point &t2,
+                        OutputIterator out);
+
+    /*! Materialize the contents of the map at regular intervals, so that
+     *  snapshot() only replays the operations since the nearest checkpoint.
+     *  \p A checkpoint is taken after every \p interval operations performed
+     *     at present. Each checkpoint is a balanced tree of elements that
+     *     shares every subtree the operations since the checkpoint before it
+     *     left unchanged, so a checkpoint takes O(i log n) memory for an
+     *     interval of i operations rather than a copy of every element. An
+     *     operation performed or reverted before a checkpoint updates its key
+     *     there in O(log n) time, or O(c log n) time for c later checkpoints.
+     *     Operations made in the past are not counted towards the interval.
+     *     The checkpoints also speed up begin(t) and diff().
+     *  \param interval The number of operations between checkpoints, or zero
+     *                  to drop every checkpoint.
+     */
+    void set_checkpoint_interval(size_type interval);
+
+    /*! Return the number of operations between checkpoints, or zero if the
+     *  map does not take checkpoints.
+     */
+    size_type checkpoint_interval(void) const;
+
+    /*! Return the number of checkpoints currently materialized.
+     */
+    size_type checkpoint_count(void) const;
+
+    /*! Copy every element in the container just before some time point.
+     *  \p The elements are rebuilt from the nearest checkpoint before t and
+     *     the k operations between them, taking O(c + k log n) time for c
+     *     elements in the checkpoint. Without checkpoints, every key is
+     *     inspected as by begin(t).
+     *
+     *     Each element is written once, in key order, as a value_type.
+     *
+     *  \param t The time point to query.
+     *  \param out The output iterator to write the elements to.
+     *  \return The output iterator past the last element written.
+     */
+    template <class OutputIterator>
+    OutputIterator snapshot(const time_point &t, OutputIterator out);
+
+    /*! Return an iterator to the first element in the container at present
+     *  whose key is not less than a given key.
+     *  \param key The key to compare against.
+     */
+    iterator lower_bound(const key_type &key);
+
+    /*! Return an iterator to the first element in the container just before
+     *  some time point whose key is not less than a given key.
+     *  \param t The time point to query.
+     *  \param key The key to compare against.
+     */
+    retro_iterator lower_bound(const time_point &t, const key_type &key);
+
+    /*! Return an iterator to the first element in the container at present
+     *  whose key is greater than a given key.
+     *  \param key The key to compare against.
+     */
+    iterator upper_bound(const key_type &key);
+
+    /*! Return an iterator to the first element in the container just before
+     *  some time point whose key is greater than a given key.
+     *  \param t The time point to query.
+     *  \param key The key to compare against.
+     */
+    retro_iterator upper_bound(const time_point &t, const key_type &key);
+
+    /*! Return the range of elements in the container at present that have
+     *  a given key.
+     *  \param key The key to search for.
+     *  \return A pair of iterators equivalent to lower_bound(key) and
+     *          upper_bound(key).
+     */
+    std::pair<iterator, iterator> equal_range(const key_type &key);
+
+    /*! Return the range of elements in the container just before some time
+     *  point that have a given key.
+     *  \param t The time point to query.
+     *  \param key The key to search for.
+     *  \return A pair of iterators equivalent to lower_bound(t, key) and
+     *          upper_bound(t, key).
+     */
+    std::pair<retro_iterator, retro_iterator>
+      equal_range(const time_point &t, const key_type &key);
+
+    /*! Write every operation in the map to a stream in a binary format.
+     *  \p The keys are written in order, each followed by the positions of
+     *     its operations in time order, and then the operations, their
+     *     values and their timestamps in time order, so that a loaded map
+     *     places timestamped operations as this one does. The file can be
+     *     read back by load() or mapped into memory by full_map_view. Keys
+     *     and values must be trivially copyable.
+     *  \param os The stream to write to, opened in binary mode.
+     *  \return Whether the map was written successfully.
+     */
+    bool save(std::ostream &os) const;
+
+    /*! Write every operation just before a time point to a stream, in the
+     *  format of save(), as if the map had no later operations.
+     *  \param os The stream to write to, opened in binary mode.
+     *  \param until The time point of the first operation not to write.
+     *  \return Whether the operations were written successfully.
+     */
+    bool save(std::ostream &os, const time_point &until) const;
+
+    /*! Replace the contents of the map with a map written by save().
+     *  \p Time points of the map are invalidated. The operations of the
+     *     loaded map are labelled evenly in a single pass.
+     *  \param is The stream to read from, opened in binary mode.
+     *  \return Whether a valid map was read, which it is not if it holds a
+     *          key that this map cannot store, such as a negative key of a
+     *          full_dense_map. If not, the map is unchanged.
+     */
+    bool load(std::istream &is);
+
   private:
     struct event
     {
@@ -359,20 +871,171 @@ class full_map
       {
       }
 
-      event(map op, data_iterator data)
-        : op(op), data(data)
+      event(map op, map_iterator key, std::size_t id,
+            value_handle value = value_handle())
+        : op(op), key(key), id(id), value(value), stamp(0)
       {
       }
 
       map op;
-      data_iterator data;
+
+      // The entry for the key in the index, which stores the key itself.
+      map_iterator key;
+
+      // Numbers the events in the order they were created, never reused.
+      std::size_t id;
+
+      // The value set by this operation, unless it is an erase.
+      value_handle value;
+
+      // The operation whose value the key has just after this one: this one
+      // unless it is an insert on a key that already exists. Erases refer to
+      // themselves.
+      event_iterator setter;
+
+      // The timestamp of the operation, if it was performed at one. Only
+      // events that are in the timestamp index have one.
+      std::int64_t stamp;
     };
 
-    data_container data_;
-    event_container events_;
-    map_container map_;
+    // Orders timestamped events by timestamp, and then by the order they
+    // were performed in.
+    typedef std::pair<std::int64_t, std::size_t> stamp_key;
+    typedef std::map<stamp_key, event_iterator, std::less<stamp_key>,
+                     rebind_alloc<std::pair<const stamp_key, event_iterator>>>
+      stamp_index;
+
+    map_iterator find_or_create(const key_type &key);
+
+    time_point record(const time_point &t, map op, const key_type &key,
+                      const mapped_type &val);
+
+    time_point stamp(const time_point &t, std::int64_t ts);
+
+    // Orders entries of the index by their keys.
+    struct entry_less
+    {
+      explicit entry_less(const key_compare &comp)
+        : comp(comp)
+      {
+      }
+
+      bool operator()(const map_iterator &a, const map_iterator &b) const
+      {
+        return comp(a->first, b->first);
+      }
+
+      key_compare comp;
+    };
+
+    // The elements that exist just before an event, in key order. Each
+    // refers to its key in the index and to the value it had then. Each
+    // checkpoint starts as a copy of the one before it, and shares every
+    // part of its tree that the operations between them left unchanged.
+    typedef detail::persistent_map<map_iterator, value_handle, entry_less,
+                                   allocator_type>
+      materialized;
+
+    struct checkpoint
+    {
+      checkpoint(event_iterator anchor, materialized entries)
+        : anchor(anchor), entries(std::move(entries))
+      {
+      }
+
+      // The contents are those just before this event.
+      event_iterator anchor;
+      materialized entries;
+    };
+
+    // Everything a map owns.
+    struct state
+    {
+      state(const key_compare &comp, const allocator_type &alloc)
+        : comp(comp), alloc(alloc), values(alloc), events(alloc),
+          keys(comp, alloc), stamps(alloc), next_id(0), tag(new_tag()),
+          lineage(alloc), origin(alloc), checkpoints(alloc),
+          checkpoint_interval(0), since_checkpoint(0)
+      {
+      }
+
+      // Return a tag that no other state has, in any thread.
+      static std::uint64_t new_tag(void)
+      {
+        static std::atomic<std::uint64_t> last(0);
+        return ++last;
+      }
+
+      // An empty history for a key, allocated like the rest of the state.
+      history_type empty_history(void) const
+      {
+        return history_type(rebind_alloc<event_iterator>(alloc));
+      }
+
+      key_compare comp;
+      allocator_type alloc;
+      value_container values;
+      event_container events;
+      map_container keys;
+      stamp_index stamps;
+      std::size_t next_id;
+      std::uint64_t tag;
+
+      // The tag of each state this one was copied from, oldest first, and
+      // the number of identifiers it had issued when it was copied. Only
+      // time points below that number belong to the history of this state.
+      std::vector<std::pair<std::uint64_t, std::size_t>,
+                  rebind_alloc<std::pair<std::uint64_t, std::size_t>>>
+        lineage;
+
+      // The event of this state that corresponds to each identifier, for
+      // time points made before this state was copied from another.
+      std::vector<event_iterator, rebind_alloc<event_iterator>> origin;
+
+      // Checkpoints in time order, and the operations at present since the
+      // last one was taken.
+      std::vector<checkpoint, rebind_alloc<checkpoint>> checkpoints;
+      size_type checkpoint_interval;
+      size_type since_checkpoint;
+    };
+
+    state &current_state(void) const;
+
+    bool save_before(std::ostream &os, event_iterator last) const;
+
+    event_iterator resolve(const time_point &t) const;
+
+    void after_insert(event_iterator event_it);
+
+    void take_checkpoint(event_iterator anchor);
+
+    materialized materialize(const checkpoint *from,
+                             event_iterator until) const;
+
+    const checkpoint *nearest_checkpoint(event_iterator event_it) const;
+
+    void refresh(checkpoint &cp, map_iterator map_it);
+
+    void refresh(materialized &entries, map_iterator map_it,
+                 event_iterator until) const;
+
+    static bool exists_before(map_iterator map_it, event_iterator until);
+
+    static std::shared_ptr<state> clone(state &other);
+
+    key_compare comp_;
+    allocator_type alloc_;
+
+    // Null once the map has been moved from, until it is used again.
+    mutable std::shared_ptr<state> state_;
 }; // end full_map
 
+/*! \brief Represents a fully retroactive map whose keys are dense
+ *  non-negative integers, such as identifiers handed out by a counter.
+ */
+template <class Key, class T>
+using full_dense_map = full_map<Key, T, dense_less<Key>>;
+
 } // end retro
 
 #include "retro/map.inl"
@@ -1,101 +1,1172 @@
 namespace retro
 {
 
-template <class Key, class T, class Compare>
-  full_map<Key, T, Compare>::full_map(const key_compare &comp)
-    : map_(detail::comp_wrapper<key_compare, Key>(comp))
+template <class Key, class T, class Compare, class Allocator>
+  full_map<Key, T, Compare, Allocator>::full_map(const key_compare &comp,
+                                                 const allocator_type &alloc)
+    : comp_(comp), alloc_(alloc),
+      state_(std::allocate_shared<state>(alloc, comp, alloc))
 {
 }
 
-template <class Key, class T, class Compare>
-  typename full_map<Key, T, Compare>::iterator
-    full_map<Key, T, Compare>::begin(void)
+template <class Key, class T, class Compare, class Allocator>
+  full_map<Key, T, Compare, Allocator>::full_map(const full_map &other)
+    : comp_(other.comp_), alloc_(other.alloc_),
+      state_(clone(other.current_state()))
 {
-  return iterator(map_.end(), map_.begin());
 }
 
-template <class Key, class T, class Compare>
-  typename full_map<Key, T, Compare>::retro_iterator
-    full_map<Key, T, Compare>::begin(const time_point &t)
+template <class Key, class T, class Compare, class Allocator>
+  full_map<Key, T, Compare, Allocator> &
+    full_map<Key, T, Compare, Allocator>::operator=(const full_map &other)
 {
-  return retro_iterator(map_.end(), map_.begin(), t.event);
+  if (this != &other)
+  {
+    state_ = clone(other.current_state());
+    comp_ = other.comp_;
+    alloc_ = other.alloc_;
+  }
+  return *this;
+}
+
+template <class Key, class T, class Compare, class Allocator>
+  full_map<Key, T, Compare, Allocator>::full_map(full_map &&other)
+    noexcept(std::is_nothrow_copy_constructible<key_compare>::value
+             && std::is_nothrow_copy_constructible<allocator_type>::value)
+    : comp_(other.comp_), alloc_(other.alloc_),
+      state_(std::move(other.state_))
+{
+  // Other is left without a state, and allocates an empty one when it is
+  // next used.
+}
+
+template <class Key, class T, class Compare, class Allocator>
+  full_map<Key, T, Compare, Allocator> &
+    full_map<Key, T, Compare, Allocator>::operator=(full_map &&other)
+      noexcept(std::is_nothrow_copy_assignable<key_compare>::value
+               && std::is_nothrow_copy_assignable<allocator_type>::value)
+{
+  if (this != &other)
+  {
+    comp_ = other.comp_;
+    alloc_ = other.alloc_;
+    state_ = std::move(other.state_);
+  }
+  return *this;
+}
+
+template <class Key, class T, class Compare, class Allocator>
+  template <class InputIt>
+    full_map<Key, T, Compare, Allocator>::full_map(InputIt first, InputIt last,
+                                                   const key_compare &comp,
+                                                   std::size_t threads,
+                                                   const allocator_type &alloc)
+    : comp_(comp), alloc_(alloc),
+      state_(std::allocate_shared<state>(alloc, comp, alloc))
+{
+  state &s = current_state();
+
+  // Append each event as it is read, keeping only its key beside it until
+  // the index is built. Nothing else of the log is copied.
+  typedef std::pair<key_type, event_iterator> keyed_event;
+  std::vector<keyed_event> order;
+  for (; first != last; ++first)
+  {
+    const log_entry &entry = *first;
+    map op = std::get<0>(entry);
+    s.events.push_back(event(op, map_iterator(), s.next_id++,
+                             op == map::erase
+                               ? value_handle()
+                               : s.values.insert(std::get<2>(entry))));
+    order.push_back(keyed_event(std::get<1>(entry),
+                                std::prev(s.events.end())));
+  }
+
+  // Group the events by key. The sort is stable, so the events of each key
+  // stay in time order.
+  detail::parallel_stable_sort(order.begin(), order.end(),
+                               [&comp](const keyed_event &a,
+                                       const keyed_event &b)
+                               { return comp(a.first, b.first); },
+                               threads);
+
+  // Keys and events are visited in order, so each goes at the end.
+  typedef typename map_container::value_type entry;
+  map_iterator map_it = s.keys.end();
+  for (std::size_t i = 0; i < order.size(); i++)
+  {
+    const key_type &key = order[i].first;
+    if (i == 0 || comp(order[i - 1].first, key))
+    {
+      map_it = s.keys.insert(s.keys.end(), entry(key, s.empty_history()));
+    }
+
+    auto event_it = order[i].second;
+    event_it->key = map_it;
+    detail::relink(map_it->second,
+                   map_it->second.insert(map_it->second.end(), event_it));
+  }
+}
+
+template <class Key, class T, class Compare, class Allocator>
+  typename full_map<Key, T, Compare, Allocator>::allocator_type
+    full_map<Key, T, Compare, Allocator>::get_allocator(void) const
+{
+  return alloc_;
+}
+
+template <class Key, class T, class Compare, class Allocator>
+  typename full_map<Key, T, Compare, Allocator>::key_compare
+    full_map<Key, T, Compare, Allocator>::key_comp(void) const
+{
+  return comp_;
+}
+
+template <class Key, class T, class Compare, class Allocator>
+  typename full_map<Key, T, Compare, Allocator>::time_point
+    full_map<Key, T, Compare, Allocator>::present(void) const
+{
+  return time_point(current_state().events.end());
+}
+
+template <class Key, class T, class Compare, class Allocator>
+  typename full_map<Key, T, Compare, Allocator>::time_point
+    full_map<Key, T, Compare, Allocator>::earliest(void)
+{
+  state &s = current_state();
+  if (s.events.begin() == s.events.end()) return present();
+  return time_point(s.events.begin()->op, s.events.begin(), s.tag);
+}
+
+template <class Key, class T, class Compare, class Allocator>
+  typename full_map<Key, T, Compare, Allocator>::iterator
+    full_map<Key, T, Compare, Allocator>::begin(void)
+{
+  state &s = current_state();
+  return iterator(&s.values, s.keys.end(), s.keys.begin());
 }
 
-template <class Key, class T, class Compare>
-  typename full_map<Key, T, Compare>::iterator
-    full_map<Key, T, Compare>::end(void)
+template <class Key, class T, class Compare, class Allocator>
+  typename full_map<Key, T, Compare, Allocator>::retro_iterator
+    full_map<Key, T, Compare, Allocator>::begin(const time_point &t)
 {
-  return iterator(map_.end(), map_.end());
+  state &s = current_state();
+  event_iterator until = resolve(t);
+  const checkpoint *cp = nearest_checkpoint(until);
+  if (!cp)
+    return retro_iterator(&s.values, s.keys.end(), s.keys.begin(), until);
+
+  // The first key is either one that the checkpoint holds and that still
+  // exists, or one touched since the checkpoint. Only touched keys can have
+  // left the checkpoint, so few of its entries are visited.
+  auto first = s.keys.end();
+  entry_less less(s.comp);
+  for (auto it = cp->anchor; it != until; ++it)
+    if ((first == s.keys.end() || less(it->key, first))
+        && exists_before(it->key, until))
+      first = it->key;
+
+  cp->entries.visit([&](const map_iterator &key, const value_handle &)
+                    {
+                      if (first != s.keys.end() && !less(key, first))
+                        return false;
+                      if (!exists_before(key, until)) return true;
+                      first = key;
+                      return false;
+                    });
+
+  return retro_iterator(&s.values, s.keys.end(), first, until);
+}
+
+template <class Key, class T, class Compare, class Allocator>
+  typename full_map<Key, T, Compare, Allocator>::iterator
+    full_map<Key, T, Compare, Allocator>::end(void)
+{
+  state &s = current_state();
+  return iterator(&s.values, s.keys.end(), s.keys.end());
+}
+
+template <class Key, class T, class Compare, class Allocator>
+  typename full_map<Key, T, Compare, Allocator>::retro_iterator
+    full_map<Key, T, Compare, Allocator>::end(const time_point &t)
+{
+  state &s = current_state();
+  return retro_iterator(&s.values, s.keys.end(), s.keys.end(), resolve(t));
+}
+
+template <class Key, class T, class Compare, class Allocator>
+  typename full_map<Key, T, Compare, Allocator>::time_point
+    full_map<Key, T, Compare, Allocator>::insert(const value_type &val)
+{
+  return insert(present(), val);
+}
+
+template <class Key, class T, class Compare, class Allocator>
+  typename full_map<Key, T, Compare, Allocator>::time_point
+    full_map<Key, T, Compare, Allocator>
+      ::insert(const time_point &t, const value_type &val)
+{
+  return record(t, map::insert, val.first, val.second);
+}
+
+template <class Key, class T, class Compare, class Allocator>
+  typename full_map<Key, T, Compare, Allocator>::time_point
+    full_map<Key, T, Compare, Allocator>::erase(const key_type &key)
+{
+  return erase(present(), key);
 }
 
-template <class Key, class T, class Compare>
-  typename full_map<Key, T, Compare>::retro_iterator
-    full_map<Key, T, Compare>::end(const time_point &t)
+template <class Key, class T, class Compare, class Allocator>
+  typename full_map<Key, T, Compare, Allocator>::time_point
+    full_map<Key, T, Compare, Allocator>
+      ::erase(const time_point &t, const key_type &key)
 {
-  return retro_iterator(map_.end(), map_.end(), t.event);
+  // Check the time point before the key is stored.
+  state &s = current_state();
+  auto before = resolve(t);
+  auto map_it = find_or_create(key);
+
+  // An erase has no value of its own.
+  auto event_it = s.events.insert(before,
+                                  event(map::erase, map_it, s.next_id++));
+  detail::relink(map_it->second, map_it->second.insert(event_it).first);
+  after_insert(event_it);
+
+  return time_point(map::erase, event_it, s.tag);
+}
+
+template <class Key, class T, class Compare, class Allocator>
+  typename full_map<Key, T, Compare, Allocator>::time_point
+    full_map<Key, T, Compare, Allocator>::assign(const key_type &key,
+                                                 const mapped_type &val)
+{
+  return assign(present(), key, val);
 }
 
-template <class Key, class T, class Compare>
-  typename full_map<Key, T, Compare>::time_point
-    full_map<Key, T, Compare>::insert(const value_type &val)
+template <class Key, class T, class Compare, class Allocator>
+  typename full_map<Key, T, Compare, Allocator>::time_point
+    full_map<Key, T, Compare, Allocator>::assign(const time_point &t,
+                                                 const key_type &key,
+                                                 const mapped_type &val)
 {
-  // Insert this value into the data map because even if this key already
-  // exists, it may be used if the previous insert for this key is revoked.
-  auto data_it = data_.insert(data_.end(), val);
+  return record(t, map::assign, key, val);
+}
+
+template <class Key, class T, class Compare, class Allocator>
+  void full_map<Key, T, Compare, Allocator>::revert(const time_point &t)
+{
+  state &s = current_state();
+  auto event_it = resolve(t);
+  if (event_it == s.events.end()) return;
+
+  auto map_it = event_it->key;
+  if (event_it->op != map::erase) s.values.erase(event_it->value);
+  auto &history = map_it->second;
+  detail::relink(history, history.erase(history.find(event_it)));
+  s.stamps.erase(stamp_key(event_it->stamp, event_it->id));
 
-  // Insert this event in the ordered list
-  auto event_it = events_.insert(events_.end(), event(map::insert, data_it));
+  // A checkpoint just before this event is dropped, and every later one no
+  // longer sees it.
+  auto cp = std::lower_bound(s.checkpoints.begin(), s.checkpoints.end(),
+                             event_it,
+                             [](const checkpoint &c, const event_iterator &e)
+                             { return c.anchor < e; });
+  if (cp != s.checkpoints.end() && cp->anchor == event_it)
+    cp = s.checkpoints.erase(cp);
+  for (; cp != s.checkpoints.end(); ++cp) refresh(*cp, map_it);
 
-  // Reference this event in the event map (insert to the end of the set).
-  map_[val.first].insert(event_it);
+  // Forget the key entirely once nothing has ever happened to it.
+  if (map_it->second.empty()) s.keys.erase(map_it);
 
-  return time_point(map::insert, event_it);
+  s.events.erase(event_it);
 }
 
-template <class Key, class T, class Compare>
-  typename full_map<Key, T, Compare>::time_point
-    full_map<Key, T, Compare>::insert(const time_point &t, const value_type &val)
+template <class Key, class T, class Compare, class Allocator>
+  typename full_map<Key, T, Compare, Allocator>::size_type
+    full_map<Key, T, Compare, Allocator>::compact(const time_point &horizon)
 {
-  // Insert this value into the data map because even if this key already
-  // exists, it may be used if the previous insert for this key is revoked.
-  auto data_it = data_.insert(data_.end(), val);
+  state &s = current_state();
+  auto last = resolve(horizon);
 
-  // Insert this event in the ordered list
-  auto event_it = events_.insert(t.event, event(map::insert, data_it));
+  // Checkpoints before the horizon may refer to events that are removed.
+  // Later ones only see the last operation on each key, which is kept.
+  s.checkpoints.erase(s.checkpoints.begin(),
+                      std::lower_bound(s.checkpoints.begin(),
+                                       s.checkpoints.end(), last,
+                                       [](const checkpoint &c,
+                                          const event_iterator &e)
+                                       { return c.anchor < e; }));
 
-  // Reference this event in the event map. 
-  map_[val.first].insert(event_it);
+  // The last operation on a key that exists at the horizon takes the value
+  // the key has there, which an earlier assign or insert may have set.
+  for (auto event_it = s.events.begin(); event_it != last; ++event_it)
+  {
+    auto &history = event_it->key->second;
+    auto next_in_key = std::next(history.find(event_it));
+    if (next_in_key != history.end() && *next_in_key < last) continue;
+    if (event_it->op == map::erase) continue;
+
+    auto setter = detail::value_event(next_in_key);
+    if (setter != event_it) std::swap(setter->value, event_it->value);
+  }
+
+  size_type removed = 0;
+  for (auto event_it = s.events.begin(); event_it != last; )
+  {
+    auto map_it = event_it->key;
+    auto &history = map_it->second;
+    auto next_in_key = std::next(history.find(event_it));
 
-  return time_point(map::insert, event_it);
+    // The last operation on a key that exists at the horizon stands for all
+    // of the operations before it.
+    bool is_last = next_in_key == history.end() || !(*next_in_key < last);
+    if (is_last && event_it->op != map::erase)
+    {
+      // The operations before it are gone, so it now sets the value itself
+      // and the run of inserts after it takes its value from it.
+      event_it->op = map::insert;
+      detail::relink(history, std::prev(next_in_key));
+      ++event_it;
+      continue;
+    }
+
+    if (event_it->op != map::erase) s.values.erase(event_it->value);
+    history.erase(event_it);
+    if (history.empty()) s.keys.erase(map_it);
+    s.stamps.erase(stamp_key(event_it->stamp, event_it->id));
+    event_it = s.events.erase(event_it);
+    removed++;
+  }
+
+  return removed;
 }
 
-template <class Key, class T, class Compare>
-  typename full_map<Key, T, Compare>::iterator
-    full_map<Key, T, Compare>::find(const key_type &key)
+template <class Key, class T, class Compare, class Allocator>
+  memory_report full_map<Key, T, Compare, Allocator>::memory_usage(void) const
 {
-  auto it = map_.find(key);
-  if (it != map_.end() && detail::key_exists(it))
-    return iterator(map_.end(), it);
+  state &s = current_state();
+
+  // The events are the payloads of the list that orders them.
+  memory_report report = s.events.memory_usage();
+  report.events = report.payloads;
+  report.payloads = s.values.bytes();
+
+  report.keys = detail::container_bytes(s.keys);
+  for (auto &entry : s.keys)
+    report.histories += detail::container_bytes(entry.second);
+
+  // Nodes that checkpoints share are counted once.
+  std::unordered_set<const void *> counted;
+  report.checkpoints = detail::container_bytes(s.checkpoints);
+  for (auto &cp : s.checkpoints)
+    report.checkpoints += cp.entries.bytes(counted);
+
+  report.other = sizeof(state) + detail::container_bytes(s.stamps)
+                 + detail::container_bytes(s.lineage)
+                 + detail::container_bytes(s.origin);
+  return report;
+}
+
+template <class Key, class T, class Compare, class Allocator>
+  typename full_map<Key, T, Compare, Allocator>::time_point
+    full_map<Key, T, Compare, Allocator>::at_timestamp(std::int64_t ts)
+{
+  // The first event with a later timestamp, whatever order it was made in.
+  state &s = current_state();
+  auto it = s.stamps.upper_bound(
+      stamp_key(ts, std::numeric_limits<std::size_t>::max()));
+  if (it == s.stamps.end()) return present();
+  return time_point(it->second->op, it->second, s.tag);
+}
+
+template <class Key, class T, class Compare, class Allocator>
+  typename full_map<Key, T, Compare, Allocator>::time_point
+    full_map<Key, T, Compare, Allocator>::insert_at(std::int64_t ts,
+                                                    const value_type &val)
+{
+  return stamp(insert(at_timestamp(ts), val), ts);
+}
+
+template <class Key, class T, class Compare, class Allocator>
+  typename full_map<Key, T, Compare, Allocator>::time_point
+    full_map<Key, T, Compare, Allocator>::erase_at(std::int64_t ts,
+                                                   const key_type &key)
+{
+  return stamp(erase(at_timestamp(ts), key), ts);
+}
+
+template <class Key, class T, class Compare, class Allocator>
+  typename full_map<Key, T, Compare, Allocator>::time_point
+    full_map<Key, T, Compare, Allocator>::assign_at(std::int64_t ts,
+                                                    const key_type &key,
+                                                    const mapped_type &val)
+{
+  return stamp(assign(at_timestamp(ts), key, val), ts);
+}
+
+template <class Key, class T, class Compare, class Allocator>
+  typename full_map<Key, T, Compare, Allocator>::retro_iterator
+    full_map<Key, T, Compare, Allocator>::find_at(std::int64_t ts,
+                                                  const key_type &key)
+{
+  return find(at_timestamp(ts), key);
+}
+
+template <class Key, class T, class Compare, class Allocator>
+  typename full_map<Key, T, Compare, Allocator>::iterator
+    full_map<Key, T, Compare, Allocator>::find(const key_type &key)
+{
+  state &s = current_state();
+  auto it = s.keys.find(key);
+  if (it != s.keys.end() && detail::key_exists(it))
+    return iterator(&s.values, s.keys.end(), it);
   return end();
 }
 
-template <class Key, class T, class Compare>
-  typename full_map<Key, T, Compare>::retro_iterator
-    full_map<Key, T, Compare>::find(const time_point &t, const key_type &key)
+template <class Key, class T, class Compare, class Allocator>
+  typename full_map<Key, T, Compare, Allocator>::retro_iterator
+    full_map<Key, T, Compare, Allocator>
+      ::find(const time_point &t, const key_type &key)
 {
-  auto it = map_.find(key);
-  if (it != map_.end() && key_exists(it, t.event))
-    return retro_iterator(map_.end(), it, t.event);
+  state &s = current_state();
+  auto event_it = resolve(t);
+
+  auto it = s.keys.find(key);
+  if (it != s.keys.end() && key_exists(it, event_it))
+    return retro_iterator(&s.values, s.keys.end(), it, event_it);
   return end(t);
 }
 
+template <class Key, class T, class Compare, class Allocator>
+  template <class InputIterator, class OutputIterator>
+    OutputIterator full_map<Key, T, Compare, Allocator>
+      ::find_many(const time_point &t,
+                  InputIterator first,
+                  InputIterator last,
+                  OutputIterator out)
+{
+  state &s = current_state();
+  auto event_it = resolve(t);
+
+  auto comp = s.keys.key_comp();
+  auto when = event_it.rank();
+  map_iterator cur = s.keys.begin();
+
+  for (; first != last; ++first)
+  {
+    const key_type &key = *first;
+
+    // Keep cur at the first key not less than this one. If the keys are
+    // sorted, that is usually a few steps forward from the previous key.
+    if (cur != s.keys.begin() && !comp(std::prev(cur)->first, key))
+      cur = s.keys.lower_bound(key);
+
+    for (int steps = 0; cur != s.keys.end() && comp(cur->first, key); ++steps)
+    {
+      if (steps == 8)
+      {
+        cur = s.keys.lower_bound(key);
+        break;
+      }
+      ++cur;
+    }
+
+    if (cur == s.keys.end() || comp(key, cur->first) || cur->second.empty())
+    {
+      *out++ = end(t);
+      continue;
+    }
+
+    // Most queries are either before or after every operation on the key, so
+    // check both ends of its history before searching it.
+    auto &history = cur->second;
+    auto pos = history.begin();
+    if (std::prev(history.end())->rank() < when)
+      pos = history.end();
+    else if (history.begin()->rank() < when)
+      pos = history.lower_bound(event_it);
+
+    if (pos == history.begin() || (*std::prev(pos))->op == map::erase)
+      *out++ = end(t);
+    else
+      *out++ = retro_iterator(&s.values, s.keys.end(), cur, event_it,
+                              detail::value_event(pos));
+  }
+
+  return out;
+}
+
+template <class Key, class T, class Compare, class Allocator>
+  template <class InputIterator, class OutputIterator>
+    OutputIterator full_map<Key, T, Compare, Allocator>
+      ::sweep(const key_type &key,
+              InputIterator first,
+              InputIterator last,
+              OutputIterator out)
+{
+  state &s = current_state();
+
+  auto it = s.keys.find(key);
+  if (it == s.keys.end())
+  {
+    for (; first != last; ++first) *out++ = end(*first);
+    return out;
+  }
+
+  // cur is the first operation on the key that is not before the time point.
+  auto &history = it->second;
+  auto cur = history.begin();
+
+  for (; first != last; ++first)
+  {
+    const time_point &t = *first;
+    auto event_it = resolve(t);
+    auto when = event_it.rank();
+
+    // Search the history again if this time point is out of order.
+    if (cur != history.begin() && !(std::prev(cur)->rank() < when))
+      cur = history.lower_bound(event_it);
+
+    while (cur != history.end() && cur->rank() < when) ++cur;
+
+    if (cur == history.begin() || (*std::prev(cur))->op == map::erase)
+      *out++ = end(t);
+    else
+      *out++ = retro_iterator(&s.values, s.keys.end(), it, event_it,
+                              detail::value_event(cur));
+  }
+
+  return out;
+}
+
+template <class Key, class T, class Compare, class Allocator>
+  std::vector<typename full_map<Key, T, Compare, Allocator>::interval>
+    full_map<Key, T, Compare, Allocator>::lifetimes(const key_type &key)
+{
+  state &s = current_state();
+  std::vector<interval> result;
+
+  auto it = s.keys.find(key);
+  if (it == s.keys.end()) return result;
+
+  // Walk through the history of the key, opening an interval at the first
+  // operation after an erase and closing it at the next erase.
+  bool exists = false;
+  for (auto event_it : it->second)
+  {
+    if (exists == (event_it->op != map::erase)) continue;
+
+    exists = !exists;
+    if (exists)
+      result.push_back(interval(time_point(event_it->op, event_it, s.tag),
+                                  present()));
+    else
+      result.back().second = time_point(map::erase, event_it, s.tag);
+  }
+
+  return result;
+}
+
+template <class Key, class T, class Compare, class Allocator>
+  template <class OutputIterator>
+    OutputIterator full_map<Key, T, Compare, Allocator>
+      ::diff(const time_point &t1, const time_point &t2, OutputIterator out)
+{
+  // Collect the keys of every operation between the two time points, in
+  // whichever order they come.
+  state &s = current_state();
+  event_iterator from = resolve(t1), to = resolve(t2);
+
+  event_iterator first = from, last = to;
+  if (last < first) std::swap(first, last);
+
+  // Keys touched between two checkpoints are those whose entries differ in
+  // them, so only the operations outside the checkpoints are walked.
+  std::vector<map_iterator> touched;
+  auto lo = std::lower_bound(s.checkpoints.begin(), s.checkpoints.end(),
+                             first,
+                             [](const checkpoint &c, const event_iterator &e)
+                             { return c.anchor < e; });
+  const checkpoint *hi = nearest_checkpoint(last);
+  if (lo != s.checkpoints.end() && hi && !(hi->anchor < lo->anchor))
+  {
+    for (; first != lo->anchor; ++first) touched.push_back(first->key);
+    lo->entries.difference(hi->entries,
+                           [&touched](const map_iterator &key)
+                           { touched.push_back(key); });
+    first = hi->anchor;
+  }
+  for (; first != last; ++first) touched.push_back(first->key);
+
+  // Each key is only compared once, in key order.
+  auto comp = s.keys.key_comp();
+  std::sort(touched.begin(), touched.end(),
+            [&comp](const map_iterator &a, const map_iterator &b)
+            { return comp(a->first, b->first); });
+  touched.erase(std::unique(touched.begin(), touched.end()), touched.end());
+
+  for (auto key : touched)
+  {
+    auto &history = key->second;
+    auto before = history.lower_bound(from);
+    auto after = history.lower_bound(to);
+    bool existed = before != history.begin() &&
+                   (*std::prev(before))->op != map::erase;
+    bool exists = after != history.begin() &&
+                  (*std::prev(after))->op != map::erase;
+
+    if (existed && exists)
+    {
+      if (detail::value_event(before)
+          != detail::value_event(after))
+        *out++ = std::make_pair(key->first, map::assign);
+    }
+    else if (exists)
+      *out++ = std::make_pair(key->first, map::insert);
+    else if (existed)
+      *out++ = std::make_pair(key->first, map::erase);
+  }
+
+  return out;
+}
+
+template <class Key, class T, class Compare, class Allocator>
+  void full_map<Key, T, Compare, Allocator>
+    ::set_checkpoint_interval(size_type interval)
+{
+  state &s = current_state();
+  s.checkpoints.clear();
+  s.checkpoint_interval = interval;
+  s.since_checkpoint = 0;
+  if (interval == 0) return;
+
+  // Each checkpoint is built from the one before it in a single pass.
+  for (auto it = s.events.begin(); it != s.events.end(); ++it)
+    if (++s.since_checkpoint >= interval) take_checkpoint(it);
+}
+
+template <class Key, class T, class Compare, class Allocator>
+  typename full_map<Key, T, Compare, Allocator>::size_type
+    full_map<Key, T, Compare, Allocator>::checkpoint_interval(void) const
+{
+  return current_state().checkpoint_interval;
+}
+
+template <class Key, class T, class Compare, class Allocator>
+  typename full_map<Key, T, Compare, Allocator>::size_type
+    full_map<Key, T, Compare, Allocator>::checkpoint_count(void) const
+{
+  return current_state().checkpoints.size();
+}
+
+template <class Key, class T, class Compare, class Allocator>
+  template <class OutputIterator>
+    OutputIterator full_map<Key, T, Compare, Allocator>
+      ::snapshot(const time_point &t, OutputIterator out)
+{
+  state &s = current_state();
+  if (s.checkpoints.empty())
+  {
+    for (auto it = begin(t); it != end(t); ++it)
+      *out++ = value_type(it->first, it->second);
+    return out;
+  }
+
+  event_iterator until = resolve(t);
+  materialize(nearest_checkpoint(until), until)
+    .visit([&](const map_iterator &key, const value_handle &h)
+           {
+             *out++ = value_type(key->first, s.values[h]);
+             return true;
+           });
+  return out;
+}
+
+template <class Key, class T, class Compare, class Allocator>
+  typename full_map<Key, T, Compare, Allocator>::iterator
+    full_map<Key, T, Compare, Allocator>::lower_bound(const key_type &key)
+{
+  // The iterator skips over keys that do not exist at present.
+  state &s = current_state();
+  return iterator(&s.values, s.keys.end(), s.keys.lower_bound(key));
+}
+
+template <class Key, class T, class Compare, class Allocator>
+  typename full_map<Key, T, Compare, Allocator>::retro_iterator
+    full_map<Key, T, Compare, Allocator>::lower_bound(const time_point &t,
+                                                      const key_type &key)
+{
+  // The iterator skips over keys that did not exist just before t.
+  state &s = current_state();
+  return retro_iterator(&s.values, s.keys.end(), s.keys.lower_bound(key),
+                        resolve(t));
+}
+
+template <class Key, class T, class Compare, class Allocator>
+  typename full_map<Key, T, Compare, Allocator>::iterator
+    full_map<Key, T, Compare, Allocator>::upper_bound(const key_type &key)
+{
+  state &s = current_state();
+  return iterator(&s.values, s.keys.end(), s.keys.upper_bound(key));
+}
+
+template <class Key, class T, class Compare, class Allocator>
+  typename full_map<Key, T, Compare, Allocator>::retro_iterator
+    full_map<Key, T, Compare, Allocator>::upper_bound(const time_point &t,
+                                                      const key_type &key)
+{
+  state &s = current_state();
+  return retro_iterator(&s.values, s.keys.end(), s.keys.upper_bound(key),
+                        resolve(t));
+}
+
+template <class Key, class T, class Compare, class Allocator>
+  std::pair<typename full_map<Key, T, Compare, Allocator>::iterator,
+            typename full_map<Key, T, Compare, Allocator>::iterator>
+    full_map<Key, T, Compare, Allocator>::equal_range(const key_type &key)
+{
+  state &s = current_state();
+  auto range = s.keys.equal_range(key);
+  return std::make_pair(iterator(&s.values, s.keys.end(), range.first),
+                        iterator(&s.values, s.keys.end(), range.second));
+}
+
+template <class Key, class T, class Compare, class Allocator>
+  std::pair<typename full_map<Key, T, Compare, Allocator>::retro_iterator,
+            typename full_map<Key, T, Compare, Allocator>::retro_iterator>
+    full_map<Key, T, Compare, Allocator>::equal_range(const time_point &t,
+                                                      const key_type &key)
+{
+  state &s = current_state();
+  auto event_it = resolve(t);
+
+  auto range = s.keys.equal_range(key);
+  return std::make_pair(
+      retro_iterator(&s.values, s.keys.end(), range.first, event_it),
+      retro_iterator(&s.values, s.keys.end(), range.second, event_it));
+}
+
+template <class Key, class T, class Compare, class Allocator>
+  bool full_map<Key, T, Compare, Allocator>::save(std::ostream &os) const
+{
+  return save_before(os, current_state().events.end());
+}
+
+template <class Key, class T, class Compare, class Allocator>
+  bool full_map<Key, T, Compare, Allocator>::save(std::ostream &os,
+                                                  const time_point &until)
+    const
+{
+  return save_before(os, resolve(until));
+}
+
+template <class Key, class T, class Compare, class Allocator>
+  bool full_map<Key, T, Compare, Allocator>::save_before(
+      std::ostream &os, event_iterator last) const
+{
+  state &s = current_state();
+
+  // Number the events in time order, which is how the file refers to them.
+  std::vector<std::uint64_t> ordinal(s.next_id);
+  // Erases have no value, so zeros are written in its place.
+  std::vector<std::uint8_t> ops;
+  std::vector<detail::frozen_slot<mapped_type>> values;
+  for (auto it = s.events.begin(); it != last; ++it)
+  {
+    ordinal[it->id] = ops.size();
+    ops.push_back(static_cast<std::uint8_t>(it->op));
+    values.emplace_back();
+    if (it->op != map::erase)
+      std::memcpy(&values.back(), &s.values[it->value], sizeof(mapped_type));
+  }
+
+  // Timestamps are written for every operation, with a flag for those that
+  // are in the timestamp index.
+  std::vector<std::int64_t> stamps(ops.size(), 0);
+  std::vector<std::uint8_t> stamped(ops.size(), 0);
+  for (auto &entry : s.stamps)
+  {
+    if (!(entry.second < last)) continue;
+    stamps[ordinal[entry.second->id]] = entry.first.first;
+    stamped[ordinal[entry.second->id]] = 1;
+  }
+
+  std::vector<key_type> keys;
+  std::vector<std::uint64_t> offsets(1, 0), history;
+  for (auto &entry : s.keys)
+  {
+    auto &events = entry.second;
+    if (events.empty() || !(*events.begin() < last)) continue;
+
+    keys.push_back(entry.first);
+    for (auto it = events.begin(); it != events.end() && *it < last; ++it)
+      history.push_back(ordinal[(*it)->id]);
+    offsets.push_back(history.size());
+  }
+
+  detail::frozen_header header =
+    detail::make_frozen_header("RETROMAP", sizeof(key_type),
+                               sizeof(mapped_type), keys.size(), ops.size());
+  detail::write_section(os, &header, 1);
+  detail::write_section(os, keys.data(), keys.size());
+  detail::write_section(os, offsets.data(), offsets.size());
+  detail::write_section(os, history.data(), history.size());
+  detail::write_section(os, ops.data(), ops.size());
+  detail::write_section(os, values.data(), values.size());
+  detail::write_section(os, stamps.data(), stamps.size());
+  detail::write_section(os, stamped.data(), stamped.size());
+  return static_cast<bool>(os);
+}
+
+template <class Key, class T, class Compare, class Allocator>
+  bool full_map<Key, T, Compare, Allocator>::load(std::istream &is)
+{
+  detail::frozen_header header;
+  if (!detail::read_section(is, &header, 1)
+      || !detail::check_frozen_header(header, "RETROMAP", sizeof(key_type),
+                                      sizeof(mapped_type)))
+    return false;
+
+  // A corrupt header could otherwise make the sections below huge.
+  std::uint64_t left = detail::remaining_bytes(is);
+  if (!detail::take_section(left, header.keys, sizeof(key_type))
+      || !detail::take_section(left, header.keys + 1, sizeof(std::uint64_t))
+      || !detail::take_section(left, header.events, sizeof(std::uint64_t))
+      || !detail::take_section(left, header.events, sizeof(std::uint8_t))
+      || !detail::take_section(left, header.events, sizeof(mapped_type))
+      || !detail::take_section(left, header.events, sizeof(std::int64_t))
+      || !detail::take_section(left, header.events, sizeof(std::uint8_t)))
+    return false;
+
+  std::vector<detail::frozen_slot<key_type>> keys(header.keys);
+  std::vector<std::uint64_t> offsets(header.keys + 1), history(header.events);
+  std::vector<std::uint8_t> ops(header.events), stamped(header.events);
+  std::vector<detail::frozen_slot<mapped_type>> values(header.events);
+  std::vector<std::int64_t> stamps(header.events);
+  if (!detail::read_section(is, keys.data(), keys.size())
+      || !detail::read_section(is, offsets.data(), offsets.size())
+      || !detail::read_section(is, history.data(), history.size())
+      || !detail::read_section(is, ops.data(), ops.size())
+      || !detail::read_section(is, values.data(), values.size())
+      || !detail::read_section(is, stamps.data(), stamps.size())
+      || !detail::read_section(is, stamped.data(), stamped.size()))
+    return false;
+
+  // Build the new state aside so that this map is unchanged on failure.
+  auto result = std::allocate_shared<state>(alloc_, comp_, alloc_);
+  state &s = *result;
+  // The sections hold the bytes of keys and values, which are trivially
+  // copyable.
+  auto key_at = [&keys](std::size_t k) -> const key_type &
+                { return reinterpret_cast<const key_type &>(keys[k]); };
+  auto value_at = [&values](std::size_t i) -> const mapped_type &
+                  { return reinterpret_cast<const mapped_type &>(values[i]); };
+
+  std::vector<event> events;
+  events.reserve(ops.size());
+  for (std::size_t i = 0; i < ops.size(); i++)
+  {
+    map op = static_cast<map>(ops[i]);
+    if (op != map::insert && op != map::erase && op != map::assign)
+      return false;
+
+    events.push_back(event(op, map_iterator(), s.next_id++,
+                           op == map::erase ? value_handle()
+                                            : s.values.insert(value_at(i))));
+  }
+  s.events.assign(events.begin(), events.end());
+
+  std::vector<event_iterator> event_its;
+  event_its.reserve(ops.size());
+  for (auto it = s.events.begin(); it != s.events.end(); ++it)
+    event_its.push_back(it);
+
+  // Timestamped operations are in time order by their timestamps, and the
+  // events are numbered in time order, so the index is built from the end.
+  const std::int64_t *previous = 0;
+  for (std::size_t i = 0; i < ops.size(); i++)
+  {
+    if (stamped[i] > 1) return false;
+    if (!stamped[i]) continue;
+    if (previous && stamps[i] < *previous) return false;
+    previous = &stamps[i];
+
+    event_its[i]->stamp = stamps[i];
+    s.stamps.insert(s.stamps.end(),
+                    std::make_pair(stamp_key(stamps[i], event_its[i]->id),
+                                   event_its[i]));
+  }
+
+  // Every event belongs to exactly one key, in time order.
+  typedef typename map_container::value_type entry;
+  std::vector<bool> seen(ops.size());
+  if (offsets[0] != 0 || offsets.back() != ops.size()) return false;
+  for (std::size_t k = 0; k < keys.size(); k++)
+  {
+    if (offsets[k + 1] <= offsets[k]) return false;
+    if (k > 0 && !s.comp(key_at(k - 1), key_at(k))) return false;
+    if (!detail::key_storable(s.keys, key_at(k))) return false;
+
+    auto map_it = s.keys.insert(s.keys.end(),
+                                entry(key_at(k), s.empty_history()));
+    for (auto i = offsets[k]; i < offsets[k + 1]; i++)
+    {
+      std::uint64_t pos = history[i];
+      if (pos >= ops.size() || seen[pos]) return false;
+      if (i > offsets[k] && pos <= history[i - 1]) return false;
+      seen[pos] = true;
+
+      event_its[pos]->key = map_it;
+      detail::relink(map_it->second,
+                     map_it->second.insert(map_it->second.end(),
+                                           event_its[pos]));
+    }
+  }
+
+  // Checkpoints are taken again at the same interval as before.
+  size_type interval = current_state().checkpoint_interval;
+  state_ = std::move(result);
+  set_checkpoint_interval(interval);
+  return true;
+}
+
+template <class Key, class T, class Compare, class Allocator>
+  typename full_map<Key, T, Compare, Allocator>::map_iterator
+    full_map<Key, T, Compare, Allocator>::find_or_create(const key_type &key)
+{
+  // The key is stored in the index the first time it is seen, even by an
+  // erase, since an insert may later be made before that erase.
+  typedef typename map_container::value_type entry;
+  state &s = current_state();
+  return s.keys.insert(entry(key, s.empty_history())).first;
+}
+
+template <class Key, class T, class Compare, class Allocator>
+  typename full_map<Key, T, Compare, Allocator>::time_point
+    full_map<Key, T, Compare, Allocator>::record(const time_point &t, map op,
+                                                 const key_type &key,
+                                                 const mapped_type &val)
+{
+  // Check the time point before the key is stored.
+  state &s = current_state();
+  auto before = resolve(t);
+  auto map_it = find_or_create(key);
+
+  // Store this value even if this key already exists, because it may be used
+  // if the previous operation on this key is reverted.
+  auto event_it = s.events.insert(before,
+                                  event(op, map_it, s.next_id++,
+                                        s.values.insert(val)));
+
+  // Reference this event in the history of its key.
+  detail::relink(map_it->second, map_it->second.insert(event_it).first);
+  after_insert(event_it);
+
+  return time_point(op, event_it, s.tag);
+}
+
+template <class Key, class T, class Compare, class Allocator>
+  void full_map<Key, T, Compare, Allocator>
+    ::after_insert(event_iterator event_it)
+{
+  state &s = current_state();
+
+  // Every checkpoint after the new event now sees it.
+  auto cp = std::upper_bound(s.checkpoints.begin(), s.checkpoints.end(),
+                             event_it,
+                             [](const event_iterator &e, const checkpoint &c)
+                             { return e < c.anchor; });
+  for (; cp != s.checkpoints.end(); ++cp) refresh(*cp, event_it->key);
+
+  // Only operations at present count towards the next checkpoint.
+  if (s.checkpoint_interval == 0 || std::next(event_it) != s.events.end())
+    return;
+  if (++s.since_checkpoint >= s.checkpoint_interval) take_checkpoint(event_it);
+}
+
+template <class Key, class T, class Compare, class Allocator>
+  void full_map<Key, T, Compare, Allocator>
+    ::take_checkpoint(event_iterator anchor)
+{
+  // The anchor comes after every other checkpoint.
+  state &s = current_state();
+  auto entries = materialize(s.checkpoints.empty() ? 0
+                                                   : &s.checkpoints.back(),
+                             anchor);
+  s.checkpoints.push_back(checkpoint(anchor, std::move(entries)));
+  s.since_checkpoint = 0;
+}
+
+template <class Key, class T, class Compare, class Allocator>
+  typename full_map<Key, T, Compare, Allocator>::materialized
+    full_map<Key, T, Compare, Allocator>
+      ::materialize(const checkpoint *from, event_iterator until) const
+{
+  // Start from the checkpoint and update each key touched since it.
+  state &s = current_state();
+  materialized result = from ? from->entries
+                             : materialized(entry_less(s.comp), s.alloc);
+
+  std::vector<map_iterator> touched;
+  for (auto it = from ? from->anchor : s.events.begin(); it != until; ++it)
+    touched.push_back(it->key);
+  std::sort(touched.begin(), touched.end(), entry_less(s.comp));
+  touched.erase(std::unique(touched.begin(), touched.end()), touched.end());
+
+  for (auto key : touched) refresh(result, key, until);
+  return result;
+}
+
+template <class Key, class T, class Compare, class Allocator>
+  const typename full_map<Key, T, Compare, Allocator>::checkpoint *
+    full_map<Key, T, Compare, Allocator>
+      ::nearest_checkpoint(event_iterator event_it) const
+{
+  // Find the last checkpoint that is not after the event.
+  const state &s = current_state();
+  auto cp = std::upper_bound(s.checkpoints.begin(), s.checkpoints.end(),
+                             event_it,
+                             [](const event_iterator &e, const checkpoint &c)
+                             { return e < c.anchor; });
+  return cp == s.checkpoints.begin() ? 0 : &*std::prev(cp);
+}
+
+template <class Key, class T, class Compare, class Allocator>
+  void full_map<Key, T, Compare, Allocator>
+    ::refresh(checkpoint &cp, map_iterator map_it)
+{
+  refresh(cp.entries, map_it, cp.anchor);
+}
+
+template <class Key, class T, class Compare, class Allocator>
+  void full_map<Key, T, Compare, Allocator>
+    ::refresh(materialized &entries, map_iterator map_it,
+              event_iterator until) const
+{
+  // Find the value of the key just before the event.
+  if (exists_before(map_it, until))
+    entries.set(map_it, detail::value_event(map_it->second
+                                              .lower_bound(until))->value);
+  else
+    entries.erase(map_it);
+}
+
+template <class Key, class T, class Compare, class Allocator>
+  bool full_map<Key, T, Compare, Allocator>
+    ::exists_before(map_iterator map_it, event_iterator until)
+{
+  auto &history = map_it->second;
+  auto last = history.lower_bound(until);
+  return last != history.begin() && (*std::prev(last))->op != map::erase;
+}
+
+template <class Key, class T, class Compare, class Allocator>
+  typename full_map<Key, T, Compare, Allocator>::time_point
+    full_map<Key, T, Compare, Allocator>::stamp(const time_point &t,
+                                                std::int64_t ts)
+{
+  // The operation was just performed, so its event belongs to this state.
+  state &s = current_state();
+  t.event->stamp = ts;
+  s.stamps.insert(std::make_pair(stamp_key(ts, t.id), t.event));
+  return t;
+}
+
+template <class Key, class T, class Compare, class Allocator>
+  typename full_map<Key, T, Compare, Allocator>::state &
+    full_map<Key, T, Compare, Allocator>::current_state(void) const
+{
+  // A map that was moved from allocates a new state when it is next used.
+  if (!state_) state_ = std::allocate_shared<state>(alloc_, comp_, alloc_);
+  return *state_;
+}
+
+template <class Key, class T, class Compare, class Allocator>
+  typename full_map<Key, T, Compare, Allocator>::event_iterator
+    full_map<Key, T, Compare, Allocator>::resolve(const time_point &t) const
+{
+  state &s = current_state();
+  if (t.id == time_point::present_id) return s.events.end();
+  if (t.tag == s.tag) return t.event;
+
+  // Time points that a state this one was copied from made before the copy
+  // refer to the copies of their events. Any other time point belongs to a
+  // history this state does not share, such as that of a map copied from
+  // the same state, and has no place in this one.
+  for (auto &ancestor : s.lineage)
+    if (ancestor.first == t.tag && t.id < ancestor.second)
+      return s.origin[t.id];
+  throw std::invalid_argument("full_map: time point of another map");
+}
+
+template <class Key, class T, class Compare, class Allocator>
+  std::shared_ptr<typename full_map<Key, T, Compare, Allocator>::state>
+    full_map<Key, T, Compare, Allocator>::clone(state &other)
+{
+  auto result = std::allocate_shared<state>(other.alloc, other.comp,
+                                            other.alloc);
+  state &s = *result;
+  s.values = other.values;
+  s.next_id = other.next_id;
+  s.lineage = other.lineage;
+  s.lineage.push_back(std::make_pair(other.tag, other.next_id));
+  s.origin.assign(s.next_id, s.events.end());
+
+  // Copy the events in order, recording where each one went by identifier.
+  for (auto it = other.events.begin(); it != other.events.end(); ++it)
+    s.origin[it->id] = s.events.insert(s.events.end(), *it);
+
+  // Rebuild the index, pointing each copied event at its copied key. The
+  // histories are already sorted, so each event goes at the end of its set.
+  typedef typename map_container::value_type entry;
+  for (auto &old_entry : other.keys)
+  {
+    if (old_entry.second.empty()) continue;
+
+    auto map_it = s.keys.insert(entry(old_entry.first,
+                                      s.empty_history())).first;
+    for (auto old_event : old_entry.second)
+    {
+      auto event_it = s.origin[old_event->id];
+      event_it->key = map_it;
+      event_it->setter = s.origin[old_event->setter->id];
+      map_it->second.insert(map_it->second.end(), event_it);
+    }
+  }
+
+  for (auto &old_stamp : other.stamps)
+  {
+    s.stamps.insert(s.stamps.end(),
+                    std::make_pair(old_stamp.first,
+                                   s.origin[old_stamp.second->id]));
+  }
+
+  // Point the copied checkpoints at the copied events and keys.
+  s.checkpoint_interval = other.checkpoint_interval;
+  s.since_checkpoint = other.since_checkpoint;
+  // The copies share nodes wherever the originals do.
+  s.checkpoints.reserve(other.checkpoints.size());
+  typename materialized::copy_table copies;
+  auto convert = [&s](const map_iterator &old_key)
+                 { return s.keys.find(old_key->first); };
+  for (auto &old_cp : other.checkpoints)
+  {
+    materialized entries(old_cp.entries, convert, copies, entry_less(s.comp),
+                         s.alloc);
+    s.checkpoints.push_back(checkpoint(s.origin[old_cp.anchor->id],
+                                       std::move(entries)));
+  }
+
+  return result;
+}
+
 namespace detail
 {
   template <class MapIterator>
   bool key_exists(MapIterator map_it)
   {
     return map_it->second.size() > 0 &&
-           (*std::prev(map_it->second.end()))->op == map::insert;
+           (*std::prev(map_it->second.end()))->op != map::erase;
   }
 
   template <class MapIterator, class EventIterator>
@@ -103,7 +1174,32 @@ namespace detail
   {
     auto it = map_it->second.lower_bound(event_it);
     return it != map_it->second.begin() && // There exists a predecessor
-           (*std::prev(it))->op == map::insert; // Predecessor is an insert
+           (*std::prev(it))->op != map::erase; // Predecessor is not an erase
+  }
+
+  template <class HistoryIterator>
+  typename std::iterator_traits<HistoryIterator>::value_type
+    value_event(HistoryIterator pos)
+  {
+    return (*std::prev(pos))->setter;
+  }
+
+  template <class History>
+  void relink(History &history, typename History::iterator pos)
+  {
+    // Each event takes its setter from the one before it, so a change only
+    // travels along the run of inserts that follows, and stops at the first
+    // event whose setter is already right.
+    for (auto first = pos; pos != history.end(); ++pos)
+    {
+      auto event_it = *pos, setter = event_it;
+      if (event_it->op == map::insert && pos != history.begin()
+          && (*std::prev(pos))->op != map::erase)
+        setter = (*std::prev(pos))->setter;
+
+      if (pos != first && event_it->setter == setter) break;
+      event_it->setter = setter;
+    }
   }
 } // end detail
 
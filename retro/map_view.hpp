@@ -0,0 +1,202 @@
+/*! \file map_view.hpp
+ *  \brief Implementation of a read-only view of a fully retroactive map that
+ *         was saved to a file, which is queried without loading it.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <functional>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "retro/map.hpp"
+#include "retro/detail/frozen.hpp"
+
+namespace retro
+{
+
+/*! \brief Represents a read-only fully retroactive map stored in the format
+ *  written by full_map::save().
+ *  \p The file is mapped into memory and queried in place, so opening a view
+ *     takes constant time however large the map is. Keys are found by binary
+ *     search and the operations on a key by a second binary search, so every
+ *     query takes time logarithmic in the size of the map.
+ *
+ *     Operations are identified by their position in time order, from zero
+ *     for the earliest.
+ *
+ *  \tparam Key The type of keys stored in the file.
+ *  \tparam T The type of values stored in the file.
+ *  \tparam Compare The function object that the keys were ordered by.
+ */
+template <class Key, class T, class Compare = std::less<Key>>
+class full_map_view
+{
+  public:
+    typedef Key key_type;
+    typedef T mapped_type;
+    typedef Compare key_compare;
+    typedef std::size_t size_type;
+
+    /*! Represents an operation performed on the data structure at some point
+     *  in time.
+     */
+    class time_point
+    {
+      public:
+        /*! Get the operation that was performed.
+         */
+        map operation() const { return op; }
+
+        /*! Get the position of the operation in time order.
+         */
+        size_type ordinal() const { return pos; }
+
+        bool operator==(const time_point &other) const
+        {
+          return pos == other.pos;
+        }
+
+        bool operator!=(const time_point &other) const
+        {
+          return !(*this == other);
+        }
+
+        bool operator<(const time_point &other) const
+        {
+          return pos < other.pos;
+        }
+
+      private:
+        time_point(map op, size_type pos)
+          : op(op), pos(pos)
+        {
+        }
+
+        map op;
+        size_type pos;
+
+        friend class full_map_view<Key, T, Compare>;
+    };
+
+    /*! Construct a view that is not attached to any map.
+     */
+    explicit full_map_view(const key_compare &comp = key_compare());
+
+    full_map_view(const full_map_view &other) = delete;
+
+    /*! Construct a view by taking over the mapping of another view.
+     */
+    full_map_view(full_map_view &&other);
+
+    ~full_map_view();
+
+    full_map_view &operator=(const full_map_view &other) = delete;
+
+    full_map_view &operator=(full_map_view &&other);
+
+    /*! Map a saved map into memory.
+     *  \param path The path of the file written by full_map::save().
+     *  \return Whether the file was mapped and has a valid layout.
+     */
+    bool open(const char *path);
+
+    /*! View a saved map that is already in memory. The memory is not owned
+     *  by the view and must outlive it. It must be suitably aligned.
+     *  \param data The bytes written by full_map::save().
+     *  \param size The number of bytes.
+     *  \return Whether the bytes have a valid layout.
+     */
+    bool open(const void *data, size_type size);
+
+    /*! Detach the view, unmapping its file if it has one.
+     */
+    void close(void);
+
+    /*! Return whether the view is attached to a map.
+     */
+    bool is_open(void) const;
+
+    /*! Return the number of keys that have ever been in the map.
+     */
+    size_type key_count(void) const;
+
+    /*! Return the number of operations performed on the map.
+     */
+    size_type event_count(void) const;
+
+    /*! Get a time point after every operation in the map.
+     */
+    time_point present(void) const;
+
+    /*! Get the time point of an operation.
+     *  \param ordinal The position of the operation in time order, which must
+     *                 be less than event_count().
+     */
+    time_point at(size_type ordinal) const;
+
+    /*! Search for an element at present.
+     *  \param key The key to search for.
+     *  \return A pointer to the value of the key in the mapping, or a null
+     *          pointer if the key does not exist.
+     */
+    const mapped_type *find(const key_type &key) const;
+
+    /*! Search for an element just before some time point.
+     *  \param t The time point to query.
+     *  \param key The key to search for.
+     *  \return A pointer to the value of the key in the mapping, or a null
+     *          pointer if the key did not exist.
+     */
+    const mapped_type *find(const time_point &t, const key_type &key) const;
+
+    /*! Visit every operation in time order.
+     *  \p This takes time and memory linear in the number of operations, to
+     *     find the key of each.
+     *  \param f The function to call with the operation, its key, and the
+     *           value it stored, which is meaningless for an erase.
+     */
+    template <class Function>
+    void for_each_event(Function f) const;
+
+    /*! Visit every element that existed just before some time point, in key
+     *  order.
+     *  \param t The time point to query.
+     *  \param f The function to call with each key and value.
+     */
+    template <class Function>
+    void for_each(const time_point &t, Function f) const;
+
+  private:
+    bool attach(const void *data, size_type size);
+
+    const mapped_type *find_at(size_type k, std::uint64_t before) const;
+
+    const std::uint64_t *last_before(size_type k, std::uint64_t before) const;
+
+    size_type key_index(const key_type &key) const;
+
+    key_compare comp_;
+
+    // The mapping owned by this view, if it was opened from a file.
+    void *mapping_;
+    size_type mapping_size_;
+
+    const detail::frozen_header *header_;
+    const key_type *keys_;
+    const std::uint64_t *offsets_;
+    const std::uint64_t *history_;
+    const std::uint8_t *ops_;
+    const mapped_type *values_;
+}; // end full_map_view
+
+} // end retro
+
+#include "retro/map_view.inl"
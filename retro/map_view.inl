@@ -0,0 +1,270 @@
+namespace retro
+{
+
+template <class Key, class T, class Compare>
+  full_map_view<Key, T, Compare>::full_map_view(const key_compare &comp)
+    : comp_(comp), mapping_(0), mapping_size_(0), header_(0)
+{
+}
+
+template <class Key, class T, class Compare>
+  full_map_view<Key, T, Compare>::full_map_view(full_map_view &&other)
+    : comp_(other.comp_), mapping_(0), mapping_size_(0), header_(0)
+{
+  *this = std::move(other);
+}
+
+template <class Key, class T, class Compare>
+  full_map_view<Key, T, Compare>::~full_map_view()
+{
+  close();
+}
+
+template <class Key, class T, class Compare>
+  full_map_view<Key, T, Compare> &
+    full_map_view<Key, T, Compare>::operator=(full_map_view &&other)
+{
+  if (this == &other) return *this;
+  close();
+
+  comp_ = other.comp_;
+  mapping_ = other.mapping_;
+  mapping_size_ = other.mapping_size_;
+  header_ = other.header_;
+  keys_ = other.keys_;
+  offsets_ = other.offsets_;
+  history_ = other.history_;
+  ops_ = other.ops_;
+  values_ = other.values_;
+
+  // The other view no longer owns the mapping.
+  other.mapping_ = 0;
+  other.mapping_size_ = 0;
+  other.header_ = 0;
+  return *this;
+}
+
+template <class Key, class T, class Compare>
+  bool full_map_view<Key, T, Compare>::open(const char *path)
+{
+  close();
+
+  int fd = ::open(path, O_RDONLY);
+  if (fd < 0) return false;
+
+  struct stat st;
+  if (::fstat(fd, &st) != 0 || st.st_size == 0)
+  {
+    ::close(fd);
+    return false;
+  }
+
+  // The mapping stays valid after the file is closed.
+  size_type size = static_cast<size_type>(st.st_size);
+  void *data = ::mmap(0, size, PROT_READ, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (data == MAP_FAILED) return false;
+
+  mapping_ = data;
+  mapping_size_ = size;
+  if (!attach(data, size))
+  {
+    close();
+    return false;
+  }
+  return true;
+}
+
+template <class Key, class T, class Compare>
+  bool full_map_view<Key, T, Compare>::open(const void *data, size_type size)
+{
+  close();
+  return attach(data, size);
+}
+
+template <class Key, class T, class Compare>
+  void full_map_view<Key, T, Compare>::close(void)
+{
+  if (mapping_) ::munmap(mapping_, mapping_size_);
+  mapping_ = 0;
+  mapping_size_ = 0;
+  header_ = 0;
+}
+
+template <class Key, class T, class Compare>
+  bool full_map_view<Key, T, Compare>::is_open(void) const
+{
+  return header_ != 0;
+}
+
+template <class Key, class T, class Compare>
+  typename full_map_view<Key, T, Compare>::size_type
+    full_map_view<Key, T, Compare>::key_count(void) const
+{
+  return header_->keys;
+}
+
+template <class Key, class T, class Compare>
+  typename full_map_view<Key, T, Compare>::size_type
+    full_map_view<Key, T, Compare>::event_count(void) const
+{
+  return header_->events;
+}
+
+template <class Key, class T, class Compare>
+  typename full_map_view<Key, T, Compare>::time_point
+    full_map_view<Key, T, Compare>::present(void) const
+{
+  return time_point(map(), event_count());
+}
+
+template <class Key, class T, class Compare>
+  typename full_map_view<Key, T, Compare>::time_point
+    full_map_view<Key, T, Compare>::at(size_type ordinal) const
+{
+  return time_point(static_cast<map>(ops_[ordinal]), ordinal);
+}
+
+template <class Key, class T, class Compare>
+  const typename full_map_view<Key, T, Compare>::mapped_type *
+    full_map_view<Key, T, Compare>::find(const key_type &key) const
+{
+  return find(present(), key);
+}
+
+template <class Key, class T, class Compare>
+  const typename full_map_view<Key, T, Compare>::mapped_type *
+    full_map_view<Key, T, Compare>::find(const time_point &t,
+                                         const key_type &key) const
+{
+  size_type k = key_index(key);
+  return k == key_count() ? 0 : find_at(k, t.pos);
+}
+
+template <class Key, class T, class Compare>
+  template <class Function>
+    void full_map_view<Key, T, Compare>::for_each(const time_point &t,
+                                                  Function f) const
+{
+  for (size_type k = 0; k < key_count(); k++)
+  {
+    const mapped_type *val = find_at(k, t.pos);
+    if (val) f(keys_[k], *val);
+  }
+}
+
+template <class Key, class T, class Compare>
+  template <class Function>
+    void full_map_view<Key, T, Compare>::for_each_event(Function f) const
+{
+  // Operations are stored in the history of their key, so find the key of
+  // each first. Positions outside the map, as in a damaged file, are
+  // skipped.
+  std::vector<size_type> keys(event_count(), key_count());
+  for (size_type k = 0; k < key_count(); k++)
+    for (auto pos = offsets_[k]; pos < offsets_[k + 1]
+                                 && pos < event_count(); pos++)
+      if (history_[pos] < event_count()) keys[history_[pos]] = k;
+
+  for (size_type i = 0; i < event_count(); i++)
+    if (keys[i] != key_count())
+      f(static_cast<map>(ops_[i]), keys_[keys[i]], values_[i]);
+}
+
+template <class Key, class T, class Compare>
+  bool full_map_view<Key, T, Compare>::attach(const void *data,
+                                              size_type size)
+{
+  typedef detail::frozen_header header_type;
+
+  // Each section starts at an aligned offset, and must fit in the data.
+  const char *base = static_cast<const char *>(data);
+  size_type offset = 0;
+  auto section = [&](size_type bytes) -> const char *
+  {
+    if (offset > size || bytes > size - offset) return 0;
+    const char *result = base + offset;
+    offset += bytes + detail::frozen_padding(bytes);
+    return result;
+  };
+
+  if (reinterpret_cast<std::uintptr_t>(base) % detail::frozen_alignment != 0)
+    return false;
+
+  auto header = reinterpret_cast<const header_type *>(
+      section(sizeof(header_type)));
+  if (!header || !detail::check_frozen_header(*header, "RETROMAP",
+                                              sizeof(key_type),
+                                              sizeof(mapped_type)))
+    return false;
+
+  // Reject counts so large that the section sizes would overflow.
+  if (header->keys > size || header->events > size) return false;
+
+  auto keys = section(header->keys * sizeof(key_type));
+  auto offsets = section((header->keys + 1) * sizeof(std::uint64_t));
+  auto history = section(header->events * sizeof(std::uint64_t));
+  auto ops = section(header->events * sizeof(std::uint8_t));
+  auto values = section(header->events * sizeof(mapped_type));
+
+  // The timestamps follow, which a view does not use.
+  auto stamps = section(header->events * sizeof(std::int64_t));
+  auto stamped = section(header->events * sizeof(std::uint8_t));
+  if (!keys || !offsets || !history || !ops || !values || !stamps
+      || !stamped)
+    return false;
+
+  header_ = header;
+  keys_ = reinterpret_cast<const key_type *>(keys);
+  offsets_ = reinterpret_cast<const std::uint64_t *>(offsets);
+  history_ = reinterpret_cast<const std::uint64_t *>(history);
+  ops_ = reinterpret_cast<const std::uint8_t *>(ops);
+  values_ = reinterpret_cast<const mapped_type *>(values);
+  return true;
+}
+
+template <class Key, class T, class Compare>
+  const typename full_map_view<Key, T, Compare>::mapped_type *
+    full_map_view<Key, T, Compare>::find_at(size_type k,
+                                            std::uint64_t before) const
+{
+  const std::uint64_t *pos = last_before(k, before);
+  if (!pos || *pos >= event_count()
+      || static_cast<map>(ops_[*pos]) == map::erase)
+    return 0;
+
+  // As in full_map, an insert on a key that already exists has no effect.
+  const std::uint64_t *first = history_ + offsets_[k];
+  while (pos != first && static_cast<map>(ops_[*pos]) == map::insert
+         && *std::prev(pos) < event_count()
+         && static_cast<map>(ops_[*std::prev(pos)]) != map::erase)
+    --pos;
+  return values_ + *pos;
+}
+
+template <class Key, class T, class Compare>
+  const std::uint64_t *
+    full_map_view<Key, T, Compare>::last_before(size_type k,
+                                                std::uint64_t before) const
+{
+  // Find the last operation on this key before the time point.
+  if (offsets_[k] > offsets_[k + 1] || offsets_[k + 1] > event_count())
+    return 0;
+  const std::uint64_t *first = history_ + offsets_[k];
+  const std::uint64_t *last = history_ + offsets_[k + 1];
+
+  const std::uint64_t *it = std::lower_bound(first, last, before);
+  return it == first ? 0 : std::prev(it);
+}
+
+template <class Key, class T, class Compare>
+  typename full_map_view<Key, T, Compare>::size_type
+    full_map_view<Key, T, Compare>::key_index(const key_type &key) const
+{
+  const key_type *last = keys_ + key_count();
+  const key_type *it = std::lower_bound(keys_, last, key, comp_);
+  if (it == last || comp_(key, *it)) return key_count();
+  return it - keys_;
+}
+
+} // end retro
@@ -0,0 +1,143 @@
+/*! \file memory.hpp
+ *  \brief Definitions used by the containers to report the memory they have
+ *         allocated.
+ */
+
+#pragma once
+
+#include <list>
+#include <map>
+#include <set>
+#include <vector>
+#include <cstddef>
+
+namespace retro
+{
+
+/*! \brief Represents the memory allocated by a container, in bytes, split by
+ *  what it is used for.
+ *  \p Nodes of the standard containers are counted at the size they are
+ *     requested from the allocator, which includes their links, as laid out
+ *     by common standard libraries. The bookkeeping that a general purpose
+ *     allocator adds to each block is not counted, nor is any memory that the
+ *     elements themselves own, such as the characters of a string.
+ */
+struct memory_report
+{
+  memory_report(void)
+    : events(0), upper_labels(0), lower_labels(0), keys(0), histories(0),
+      payloads(0), checkpoints(0), other(0)
+  {
+  }
+
+  /*! The records of operations, without the labels that order them.
+   */
+  std::size_t events;
+
+  /*! The nodes of the upper level of labels that order operations.
+   */
+  std::size_t upper_labels;
+
+  /*! The links and labels of the lower level of labels that order
+   *  operations, without the elements that they store.
+   */
+  std::size_t lower_labels;
+
+  /*! The index of distinct keys.
+   */
+  std::size_t keys;
+
+  /*! The nodes that list the operations performed on each key.
+   */
+  std::size_t histories;
+
+  /*! The copies of elements or values stored by the container.
+   */
+  std::size_t payloads;
+
+  /*! The contents materialized at checkpoints.
+   */
+  std::size_t checkpoints;
+
+  /*! Everything else, such as the timestamp index and the container's own
+   *  state.
+   */
+  std::size_t other;
+
+  /*! Return the sum of every component.
+   */
+  std::size_t total(void) const
+  {
+    return events + upper_labels + lower_labels + keys + histories + payloads
+           + checkpoints + other;
+  }
+};
+
+namespace detail
+{
+
+// The layouts of the nodes of std::list, and of std::set and std::map.
+template <class T>
+struct list_node_layout
+{
+  void *next;
+  void *prev;
+  T value;
+};
+
+template <class T>
+struct tree_node_layout
+{
+  int color;
+  void *parent;
+  void *left;
+  void *right;
+  T value;
+};
+
+/*! Return the size of the node that a std::list allocates for an element.
+ */
+template <class T>
+constexpr std::size_t list_node_bytes(void)
+{
+  return sizeof(list_node_layout<T>);
+}
+
+/*! Return the size of the node that a std::set or std::map allocates for an
+ *  element.
+ */
+template <class T>
+constexpr std::size_t tree_node_bytes(void)
+{
+  return sizeof(tree_node_layout<T>);
+}
+
+/*! Return the number of bytes allocated by a container.
+ */
+template <class T, class Allocator>
+std::size_t container_bytes(const std::list<T, Allocator> &l)
+{
+  return l.size() * list_node_bytes<T>();
+}
+
+template <class T, class Compare, class Allocator>
+std::size_t container_bytes(const std::set<T, Compare, Allocator> &s)
+{
+  return s.size() * tree_node_bytes<T>();
+}
+
+template <class Key, class T, class Compare, class Allocator>
+std::size_t container_bytes(const std::map<Key, T, Compare, Allocator> &m)
+{
+  return m.size() * tree_node_bytes<std::pair<const Key, T>>();
+}
+
+template <class T, class Allocator>
+std::size_t container_bytes(const std::vector<T, Allocator> &v)
+{
+  return v.capacity() * sizeof(T);
+}
+
+} // end detail
+
+} // end retro
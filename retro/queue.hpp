@@ -5,7 +5,15 @@
 #pragma once
 
 #include <list>
+#include <vector>
+#include <memory>
 #include <utility>
+#include <cstdint>
+#include <istream>
+#include <ostream>
+
+#include "retro/memory.hpp"
+#include "retro/detail/frozen.hpp"
 
 namespace retro
 {
@@ -30,17 +38,23 @@ enum class queue
  *     performed on the current state of the queue.
  *
  *  \tparam The type of elements to store in the container.
+ *  \tparam Allocator The allocator that the elements are allocated from,
+ *                    after rebinding to the type of the list nodes.
  */
-template <class T>
+template <class T, class Allocator = std::allocator<T>>
 class partial_queue
 {
   public:
     typedef T value_type;
-    typedef std::list<value_type> container_type;
+    typedef Allocator allocator_type;
+    typedef std::list<value_type, Allocator> container_type;
     typedef typename container_type::reference reference;
     typedef typename container_type::const_reference const_reference;
     typedef typename container_type::size_type size_type;
-    typedef std::list<std::pair<value_type, bool>> inner_container_type;
+    typedef std::list<std::pair<value_type, bool>,
+                      typename std::allocator_traits<Allocator>
+                        ::template rebind_alloc<std::pair<value_type, bool>>>
+      inner_container_type;
     typedef typename inner_container_type::iterator inner_iterator;
 
     /*! Represents an operation performed on the data structure at some point
@@ -71,13 +85,14 @@ class partial_queue
         // The operation that was performed.
         queue op;
 
-        friend class partial_queue<T>;
+        friend class partial_queue<T, Allocator>;
     };
 
     /*! Construct an empty partially retroactive queue.
+     *  \param alloc The allocator to allocate the elements from.
      */
-    partial_queue(void)
-      : size_(0), front_(data_.begin())
+    explicit partial_queue(const allocator_type &alloc = allocator_type())
+      : size_(0), data_(alloc), front_(data_.begin())
     {
     }
 
@@ -92,6 +107,13 @@ class partial_queue
     {
     }
 
+    /*! Return a copy of the allocator of the queue.
+     */
+    allocator_type get_allocator(void) const
+    {
+      return allocator_type(data_.get_allocator());
+    }
+
     /*! Return the number of elements in the container at present.
      */
     size_type size(void) const
@@ -113,6 +135,18 @@ class partial_queue
       return size() == 0;
     }
 
+    /*! Return the memory allocated by the queue. Every element ever pushed
+     *  is kept, including those popped since, as a payload with a node that
+     *  is reported as an event.
+     */
+    memory_report memory_usage(void) const
+    {
+      memory_report report;
+      report.payloads = data_.size() * sizeof(value_type);
+      report.events = detail::container_bytes(data_) - report.payloads;
+      return report;
+    }
+
     /*! Return the element at the front of the container at present.
      *  \return A reference to the first (oldest) element.
      */
@@ -126,7 +160,7 @@ class partial_queue
      */
     const_reference front() const
     {
-      return front();
+      return front_->first;
     }
 
     /*! Return the element at the back of the queue at present.
@@ -142,7 +176,7 @@ class partial_queue
      */
     const_reference back() const
     {
-      return back();
+      return data_.back().first;
     }
 
     /*! Insert an element to the end of the queue in its present state
@@ -171,7 +205,7 @@ class partial_queue
      */
     time_point push(const T &val)
     {
-      return push(val);
+      return push(T(val));
     }
 
     /*! Retroactively insert an element to the end of the queue just before
@@ -185,9 +219,9 @@ class partial_queue
       inner_iterator it = t.it;
       if (it == data_.begin())
       {
-        // Inserting before the first element is a special case
-        data_.push_front(std::make_pair(std::move(val), true)); 
-        move_front_pred();
+        // Inserting before the first element is a special case. It counts as
+        // before the front, so the front is moved back below.
+        data_.push_front(std::make_pair(std::move(val), true));
       }
       else if (it == front_)
       {
@@ -221,7 +255,7 @@ class partial_queue
      */
     time_point push(const time_point &t, const T &val)
     {
-      return push(t, val);
+      return push(t, T(val));
     }
 
     /*! Pop an element from the front of the queue in its present state.
@@ -289,6 +323,84 @@ class partial_queue
       }
     }
 
+    /*! Write every element ever pushed to a stream in a binary format, with
+     *  the position of the front. Elements must be trivially copyable.
+     *  \param os The stream to write to, opened in binary mode.
+     *  \return Whether the queue was written successfully.
+     */
+    bool save(std::ostream &os) const
+    {
+      std::vector<value_type> values;
+      std::vector<std::uint8_t> popped;
+      std::uint64_t counts[2] = { size_, 0 };
+      for (auto it = data_.begin(); it != data_.end(); ++it)
+      {
+        if (it == front_) counts[1] = values.size();
+        values.push_back(it->first);
+        popped.push_back(it->second);
+      }
+      if (front_ == data_.end()) counts[1] = values.size();
+
+      detail::frozen_header header =
+        detail::make_frozen_header("RETROQUE", 0, sizeof(value_type), 0,
+                                   values.size());
+      detail::write_section(os, &header, 1);
+      detail::write_section(os, counts, 2);
+      detail::write_section(os, values.data(), values.size());
+      detail::write_section(os, popped.data(), popped.size());
+      return static_cast<bool>(os);
+    }
+
+    /*! Replace the contents of the queue with a queue written by save().
+     *  Time points of the queue are invalidated.
+     *  \param is The stream to read from, opened in binary mode.
+     *  \return Whether a valid queue was read. If not, the queue is
+     *          unchanged.
+     */
+    bool load(std::istream &is)
+    {
+      detail::frozen_header header;
+      if (!detail::read_section(is, &header, 1)
+          || !detail::check_frozen_header(header, "RETROQUE", 0,
+                                          sizeof(value_type)))
+        return false;
+
+      // A corrupt header could otherwise make the sections below huge.
+      std::uint64_t left = detail::remaining_bytes(is);
+      if (!detail::take_section(left, 2, sizeof(std::uint64_t))
+          || !detail::take_section(left, header.events, sizeof(value_type))
+          || !detail::take_section(left, header.events, sizeof(std::uint8_t)))
+        return false;
+
+      std::uint64_t counts[2];
+      std::vector<value_type> values(header.events);
+      std::vector<std::uint8_t> popped(header.events);
+      if (!detail::read_section(is, counts, 2)
+          || !detail::read_section(is, values.data(), values.size())
+          || !detail::read_section(is, popped.data(), popped.size())
+          || counts[1] > values.size() || counts[0] > values.size())
+        return false;
+
+      // Every element before the front has been popped, and the size counts
+      // the elements from the front on that have not.
+      std::uint64_t waiting = 0;
+      for (std::size_t i = 0; i < popped.size(); i++)
+      {
+        if (i < counts[1] && !popped[i]) return false;
+        if (i >= counts[1] && !popped[i]) waiting++;
+      }
+      if (waiting != counts[0]) return false;
+
+      inner_container_type data(data_.get_allocator());
+      for (std::size_t i = 0; i < values.size(); i++)
+        data.emplace_back(values[i], popped[i] != 0);
+
+      data_.swap(data);
+      size_ = counts[0];
+      front_ = std::next(data_.begin(), counts[1]);
+      return true;
+    }
+
   private:
     void move_front_succ(void)
     {
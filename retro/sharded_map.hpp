@@ -0,0 +1,176 @@
+/*! \file sharded_map.hpp
+ *  \brief Implementation of an associative map that is partitioned into
+ *         independently locked shards and can be queried at past time points.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <memory>
+#include <vector>
+#include <utility>
+#include <functional>
+#include <stdexcept>
+#include <cstdint>
+
+#include "retro/map.hpp"
+
+namespace retro
+{
+
+/*! \brief Represents a map that may be changed by many threads at once and
+ *  queried just before any of its operations.
+ *  \p Keys are partitioned by hash across a fixed number of full_map shards,
+ *     each guarded by its own lock, so operations on keys in different
+ *     shards proceed in parallel. Every operation takes a ticket from a
+ *     global counter while it holds the lock of its shard, which orders the
+ *     operations of all shards consistently. Operations are performed at
+ *     present, and the map can be queried just before any of them. There are
+ *     no retroactive operations and no revert, since those would need
+ *     tickets between existing ones.
+ *
+ *  \tparam Key The type of keys to store.
+ *  \tparam T The type of values to store.
+ *  \tparam Hash The function object used to choose the shard of a key.
+ *  \tparam Compare The function object used to order keys within a shard.
+ */
+template <class Key, class T, class Hash = std::hash<Key>,
+          class Compare = std::less<Key>>
+class sharded_full_map
+{
+  private:
+    typedef full_map<Key, T, Compare> shard_map;
+    typedef std::uint64_t ticket_type;
+
+  public:
+    typedef Key key_type;
+    typedef T mapped_type;
+    typedef std::pair<const key_type, mapped_type> value_type;
+    typedef Hash hasher;
+    typedef Compare key_compare;
+    typedef std::size_t size_type;
+
+    /*! Represents an operation performed on the data structure at some point
+     *  in time. Time points of every shard are totally ordered.
+     */
+    class time_point
+    {
+      public:
+        /*! Get the operation that was performed.
+         */
+        map operation() const { return op; }
+
+        bool operator==(const time_point &other) const
+        {
+          return ticket == other.ticket;
+        }
+
+        bool operator!=(const time_point &other) const
+        {
+          return !(*this == other);
+        }
+
+        bool operator<(const time_point &other) const
+        {
+          return ticket < other.ticket;
+        }
+
+      private:
+        time_point(map op, ticket_type ticket)
+          : op(op), ticket(ticket)
+        {
+        }
+
+        map op;
+        ticket_type ticket;
+
+        friend class sharded_full_map<Key, T, Hash, Compare>;
+    };
+
+    /*! Construct an empty map.
+     *  \param shards The number of shards to partition keys across, which
+     *                must be at least one.
+     *  \throw std::invalid_argument If there are no shards.
+     */
+    explicit sharded_full_map(size_type shards, const hasher &hash = hasher(),
+                              const key_compare &comp = key_compare());
+
+    /*! Return the number of shards that keys are partitioned across.
+     */
+    size_type shard_count(void) const;
+
+    /*! Get a time point after every operation that has been performed so
+     *  far. Operations that are performed later are not visible at it.
+     */
+    time_point present(void) const;
+
+    /*! Insert a new element into the container at present if the key does
+     *  not already exist. This is safe to call from several threads at once.
+     *  \param val The key and the value to insert.
+     *  \return The time point of the insertion.
+     */
+    time_point insert(const value_type &val);
+
+    /*! Erase an element from the container at present.
+     *  \param key The key to erase.
+     *  \return The time point of the erase.
+     */
+    time_point erase(const key_type &key);
+
+    /*! Set the value of a key at present, whether or not it exists.
+     *  \param key The key to assign.
+     *  \param val The value to assign.
+     *  \return The time point of the assignment.
+     */
+    time_point assign(const key_type &key, const mapped_type &val);
+
+    /*! Search for an element in the container at present.
+     *  \param key The key to search for.
+     *  \param val Receives a copy of the value if the key exists.
+     *  \return Whether the key exists.
+     */
+    bool find(const key_type &key, mapped_type &val) const;
+
+    /*! Search for an element in the container just before some time point.
+     *  \param t The time point to query.
+     *  \param key The key to search for.
+     *  \param val Receives a copy of the value if the key existed.
+     *  \return Whether the key existed.
+     */
+    bool find(const time_point &t, const key_type &key,
+              mapped_type &val) const;
+
+  private:
+    struct shard
+    {
+      explicit shard(const key_compare &comp)
+        : data(comp)
+      {
+      }
+
+      std::mutex lock;
+      shard_map data;
+
+      // The time points of this shard by ticket. Tickets are taken while
+      // the lock is held, so they are appended in increasing order.
+      std::vector<std::pair<ticket_type, typename shard_map::time_point>>
+        history;
+    };
+
+    shard &shard_of(const key_type &key) const;
+
+    template <class Operation>
+    time_point record(const key_type &key, Operation op);
+
+    bool find_in(shard &s, ticket_type ticket, const key_type &key,
+                 mapped_type &val) const;
+
+    hasher hash_;
+    std::vector<std::unique_ptr<shard>> shards_;
+    std::atomic<ticket_type> next_ticket_;
+}; // end sharded_full_map
+
+} // end retro
+
+#include "retro/sharded_map.inl"
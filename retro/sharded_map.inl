@@ -0,0 +1,130 @@
+namespace retro
+{
+
+template <class Key, class T, class Hash, class Compare>
+  sharded_full_map<Key, T, Hash, Compare>
+    ::sharded_full_map(size_type shards, const hasher &hash,
+                       const key_compare &comp)
+    : hash_(hash), next_ticket_(0)
+{
+  if (shards == 0)
+    throw std::invalid_argument("sharded_full_map: there must be a shard");
+
+  shards_.reserve(shards);
+  for (size_type i = 0; i < shards; i++)
+    shards_.emplace_back(new shard(comp));
+}
+
+template <class Key, class T, class Hash, class Compare>
+  typename sharded_full_map<Key, T, Hash, Compare>::size_type
+    sharded_full_map<Key, T, Hash, Compare>::shard_count(void) const
+{
+  return shards_.size();
+}
+
+template <class Key, class T, class Hash, class Compare>
+  typename sharded_full_map<Key, T, Hash, Compare>::time_point
+    sharded_full_map<Key, T, Hash, Compare>::present(void) const
+{
+  // An operation that has not yet taken a ticket will take a later one.
+  return time_point(map(), next_ticket_.load());
+}
+
+template <class Key, class T, class Hash, class Compare>
+  typename sharded_full_map<Key, T, Hash, Compare>::time_point
+    sharded_full_map<Key, T, Hash, Compare>::insert(const value_type &val)
+{
+  return record(val.first, [&val](shard_map &m)
+                { return m.insert(val); });
+}
+
+template <class Key, class T, class Hash, class Compare>
+  typename sharded_full_map<Key, T, Hash, Compare>::time_point
+    sharded_full_map<Key, T, Hash, Compare>::erase(const key_type &key)
+{
+  return record(key, [&key](shard_map &m)
+                { return m.erase(key); });
+}
+
+template <class Key, class T, class Hash, class Compare>
+  typename sharded_full_map<Key, T, Hash, Compare>::time_point
+    sharded_full_map<Key, T, Hash, Compare>::assign(const key_type &key,
+                                                    const mapped_type &val)
+{
+  return record(key, [&key, &val](shard_map &m)
+                { return m.assign(key, val); });
+}
+
+template <class Key, class T, class Hash, class Compare>
+  bool sharded_full_map<Key, T, Hash, Compare>::find(const key_type &key,
+                                                     mapped_type &val) const
+{
+  shard &s = shard_of(key);
+  std::lock_guard<std::mutex> guard(s.lock);
+
+  auto it = s.data.find(key);
+  if (it == s.data.end()) return false;
+
+  val = it->second;
+  return true;
+}
+
+template <class Key, class T, class Hash, class Compare>
+  bool sharded_full_map<Key, T, Hash, Compare>::find(const time_point &t,
+                                                     const key_type &key,
+                                                     mapped_type &val) const
+{
+  return find_in(shard_of(key), t.ticket, key, val);
+}
+
+template <class Key, class T, class Hash, class Compare>
+  typename sharded_full_map<Key, T, Hash, Compare>::shard &
+    sharded_full_map<Key, T, Hash, Compare>::shard_of(const key_type &key) const
+{
+  return *shards_[hash_(key) % shards_.size()];
+}
+
+template <class Key, class T, class Hash, class Compare>
+  template <class Operation>
+    typename sharded_full_map<Key, T, Hash, Compare>::time_point
+      sharded_full_map<Key, T, Hash, Compare>::record(const key_type &key,
+                                                      Operation op)
+{
+  shard &s = shard_of(key);
+  std::lock_guard<std::mutex> guard(s.lock);
+
+  // Take the ticket under the lock so that the events of this shard are in
+  // the same order as their tickets.
+  ticket_type ticket = next_ticket_.fetch_add(1);
+  auto inner = op(s.data);
+  s.history.push_back(std::make_pair(ticket, inner));
+
+  return time_point(inner.operation(), ticket);
+}
+
+template <class Key, class T, class Hash, class Compare>
+  bool sharded_full_map<Key, T, Hash, Compare>::find_in(shard &s,
+                                                        ticket_type ticket,
+                                                        const key_type &key,
+                                                        mapped_type &val) const
+{
+  std::lock_guard<std::mutex> guard(s.lock);
+
+  // Find the first operation on this shard that is not before the ticket.
+  auto pos = std::lower_bound(
+      s.history.begin(), s.history.end(), ticket,
+      [](const std::pair<ticket_type, typename shard_map::time_point> &entry,
+         ticket_type ticket)
+      { return entry.first < ticket; });
+
+  typename shard_map::time_point when =
+    pos == s.history.end() ? s.data.present() : pos->second;
+
+  auto it = s.data.find(when, key);
+  if (it == s.data.end(when)) return false;
+
+  val = it->second;
+  return true;
+}
+
+} // end retro
@@ -0,0 +1,245 @@
+/*! \file tiered_map.hpp
+ *  \brief Implementation of a fully retroactive map whose older history is
+ *         kept in memory-mapped segment files rather than in memory.
+ */
+
+#pragma once
+
+#include <vector>
+#include <fstream>
+#include <algorithm>
+#include <memory>
+#include <utility>
+#include <functional>
+#include <cstdint>
+
+#include "retro/map.hpp"
+#include "retro/map_view.hpp"
+
+namespace retro
+{
+
+/*! \brief Represents a fully retroactive map split into a hot tier in memory
+ *  and cold segments on disk.
+ *  \p Operations are performed on the hot tier, which is an ordinary
+ *     full_map. spill() writes the hot operations before a horizon to a
+ *     segment file in the format of full_map::save(), maps it with a
+ *     full_map_view, and compacts them out of the hot tier. Compacting
+ *     leaves an insert of each key that exists at the horizon, so the hot
+ *     tier always holds the whole state from its oldest operation on, and
+ *     answers queries at its time points without reading any segment.
+ *     Those inserts are also the first operations of the next segment, so a
+ *     query before a cold operation only reads the segment of that
+ *     operation. The operating system pages in only the parts of a segment
+ *     that a query reads.
+ *
+ *     Cold history is read-only: an operation just before a time point of a
+ *     segment, or a revert of one, is rejected. To change it, thaw() loads
+ *     the newest segment back into the hot tier, after which the time points
+ *     of its operations refer to the hot tier until the next spill. Time
+ *     points of the hot tier before a horizon that has been spilled become
+ *     invalid; the time points of cold operations are obtained with at(),
+ *     and stay valid.
+ *
+ *  \tparam Key The type of keys to store, which must be trivially copyable.
+ *  \tparam T The type of values to store, which must be trivially copyable.
+ *  \tparam Compare The function object used to order keys.
+ */
+template <class Key, class T, class Compare = std::less<Key>>
+class tiered_full_map
+{
+  private:
+    typedef full_map<Key, T, Compare> hot_type;
+    typedef full_map_view<Key, T, Compare> segment_type;
+
+  public:
+    typedef Key key_type;
+    typedef T mapped_type;
+    typedef std::pair<const key_type, mapped_type> value_type;
+    typedef Compare key_compare;
+    typedef std::size_t size_type;
+
+    /*! Represents an operation performed on the data structure at some point
+     *  in time.
+     */
+    class time_point
+    {
+      public:
+        /*! Get the operation that was performed.
+         */
+        map operation() const { return op; }
+
+        /*! Return whether the operation was performed. An operation just
+         *  before a time point of a segment is not, and this time point must
+         *  not be used.
+         */
+        bool performed() const { return ok; }
+
+      private:
+        time_point(map op, bool cold, std::uint64_t ordinal,
+                   const typename hot_type::time_point &hot, bool ok = true)
+          : op(op), cold(cold), ordinal(ordinal), hot(hot), ok(ok)
+        {
+        }
+
+        map op;
+
+        // Whether the operation is in a segment.
+        bool cold;
+
+        // The position of a cold operation among all cold operations.
+        std::uint64_t ordinal;
+
+        // The operation in the hot tier.
+        typename hot_type::time_point hot;
+
+        bool ok;
+
+        friend class tiered_full_map<Key, T, Compare>;
+    };
+
+    /*! Construct an empty map with no segments.
+     */
+    explicit tiered_full_map(const key_compare &comp = key_compare());
+
+    /*! Return the number of segments on disk.
+     */
+    size_type segment_count(void) const;
+
+    /*! Return the number of operations in all segments.
+     */
+    std::uint64_t cold_events(void) const;
+
+    /*! Write the hot tier to a new segment file and map it, leaving only
+     *  the present state in memory.
+     *  \param path The path of the new segment file.
+     *  \return Whether the segment was written and mapped. If not, the hot
+     *          tier is unchanged.
+     */
+    bool spill(const char *path);
+
+    /*! Write the operations of the hot tier before a horizon to a new
+     *  segment file and map it. Later operations stay in memory.
+     *  \param path The path of the new segment file.
+     *  \param horizon A time point of the hot tier.
+     *  \return Whether the segment was written and mapped. If not, the hot
+     *          tier is unchanged.
+     */
+    bool spill(const char *path, const time_point &horizon);
+
+    /*! Map an existing segment file after every other segment, as when
+     *  reopening a map, and load its present state into the hot tier.
+     *  \param path The path of a segment written by spill().
+     *  \return Whether the segment was mapped. It is not if any operation
+     *          has been performed on the hot tier since it was last spilled
+     *          or loaded.
+     */
+    bool attach(const char *path);
+
+    /*! Load the operations of the newest segment back into the hot tier, in
+     *  front of its own, and unmap the segment, whose file is left as it is.
+     *  \p Operations just before the time points of the segment, and
+     *     reverts of them, are then performed on the hot tier, which keeps
+     *     its time points. Calling this repeatedly brings back older segments
+     *     too. This takes time and memory linear in the number of operations
+     *     in the segment.
+     *  \return Whether there was a segment to load.
+     */
+    bool thaw(void);
+
+    /*! Get the time point of an operation in a segment.
+     *  \param ordinal The position of the operation among all operations in
+     *                 segments, which must be less than cold_events().
+     */
+    time_point at(std::uint64_t ordinal);
+
+    /*! Get a time point after every operation.
+     */
+    time_point present(void);
+
+    /*! Insert a new element at present.
+     */
+    time_point insert(const value_type &val);
+
+    /*! Insert a new element just before a time point of the hot tier.
+     *  \return The time point of the insertion, which was not performed if t
+     *          is a time point of a segment.
+     */
+    time_point insert(const time_point &t, const value_type &val);
+
+    /*! Erase an element at present.
+     */
+    time_point erase(const key_type &key);
+
+    /*! Erase an element just before a time point of the hot tier.
+     *  \return The time point of the erase, which was not performed if t is
+     *          a time point of a segment.
+     */
+    time_point erase(const time_point &t, const key_type &key);
+
+    /*! Set the value of a key at present.
+     */
+    time_point assign(const key_type &key, const mapped_type &val);
+
+    /*! Set the value of a key just before a time point of the hot tier.
+     *  \return The time point of the assignment, which was not performed if
+     *          t is a time point of a segment.
+     */
+    time_point assign(const time_point &t, const key_type &key,
+                      const mapped_type &val);
+
+    /*! Revert an operation of the hot tier.
+     *  \return Whether the operation was reverted, which it is not if it is
+     *          in a segment.
+     */
+    bool revert(const time_point &t);
+
+    /*! Search for an element at present.
+     *  \param key The key to search for.
+     *  \return A pointer to the value of the key, or a null pointer if the key
+     *          does not exist. The pointer is valid until the map changes.
+     */
+    const mapped_type *find(const key_type &key);
+
+    /*! Search for an element just before some time point.
+     *  \param t The time point to query.
+     *  \param key The key to search for.
+     *  \return A pointer to the value of the key, or a null pointer if the key
+     *          did not exist. The pointer is valid until the map changes.
+     */
+    const mapped_type *find(const time_point &t, const key_type &key);
+
+  private:
+    time_point wrap(const typename hot_type::time_point &t);
+
+    time_point record(const typename hot_type::time_point &t);
+
+    time_point reject(map op);
+
+    time_point warm(const time_point &t) const;
+
+    void add_segment(std::unique_ptr<segment_type> segment);
+
+    key_compare comp_;
+    hot_type hot_;
+
+    // The number of inserts at the start of the hot tier that stand for the
+    // state it was compacted to, and whether anything was performed since.
+    std::uint64_t carried_;
+    bool changed_;
+
+    // Segments in time order, with the ordinal among all cold operations of
+    // the first operation of each that is not carried over from the segment
+    // before it, and the number that are.
+    std::vector<std::unique_ptr<segment_type>> segments_;
+    std::vector<std::uint64_t> bases_;
+    std::vector<std::uint64_t> carried_counts_;
+
+    // The operations of segments loaded back into the hot tier since the
+    // last spill, by ordinal from cold_events() on.
+    std::vector<typename hot_type::time_point> thawed_;
+}; // end tiered_full_map
+
+} // end retro
+
+#include "retro/tiered_map.inl"
@@ -0,0 +1,289 @@
+namespace retro
+{
+
+template <class Key, class T, class Compare>
+  tiered_full_map<Key, T, Compare>::tiered_full_map(const key_compare &comp)
+    : comp_(comp), hot_(comp), carried_(0), changed_(false)
+{
+}
+
+template <class Key, class T, class Compare>
+  typename tiered_full_map<Key, T, Compare>::size_type
+    tiered_full_map<Key, T, Compare>::segment_count(void) const
+{
+  return segments_.size();
+}
+
+template <class Key, class T, class Compare>
+  std::uint64_t tiered_full_map<Key, T, Compare>::cold_events(void) const
+{
+  if (segments_.empty()) return 0;
+  return bases_.back() + segments_.back()->event_count()
+         - carried_counts_.back();
+}
+
+template <class Key, class T, class Compare>
+  bool tiered_full_map<Key, T, Compare>::spill(const char *path)
+{
+  return spill(path, present());
+}
+
+template <class Key, class T, class Compare>
+  bool tiered_full_map<Key, T, Compare>::spill(const char *path,
+                                               const time_point &horizon)
+{
+  if (horizon.cold) return false;
+
+  {
+    std::ofstream os(path, std::ios::binary | std::ios::trunc);
+    if (!hot_.save(os, horizon.hot)) return false;
+    os.close();
+    if (!os) return false;
+  }
+
+  std::unique_ptr<segment_type> segment(new segment_type(comp_));
+  if (!segment->open(path)) return false;
+
+  // Compacting leaves an insert of each key in the segment's present state.
+  std::uint64_t carried = 0;
+  segment->for_each(segment->present(),
+                    [&carried](const key_type &, const mapped_type &)
+                    { carried++; });
+  add_segment(std::move(segment));
+
+  hot_.compact(horizon.hot);
+  carried_ = carried;
+  changed_ = horizon.hot != hot_.present();
+
+  // The operations that were thawed are now in the segment, or gone.
+  thawed_.clear();
+  return true;
+}
+
+template <class Key, class T, class Compare>
+  bool tiered_full_map<Key, T, Compare>::attach(const char *path)
+{
+  if (changed_) return false;
+
+  std::unique_ptr<segment_type> segment(new segment_type(comp_));
+  if (!segment->open(path)) return false;
+
+  // The segment starts with the state that the hot tier holds, and its
+  // present state is the next one.
+  hot_type hot(comp_);
+  std::uint64_t carried = 0;
+  segment->for_each(segment->present(),
+                    [&](const key_type &key, const mapped_type &val)
+                    {
+                      hot.insert(std::make_pair(key, val));
+                      carried++;
+                    });
+
+  add_segment(std::move(segment));
+  hot_ = std::move(hot);
+  carried_ = carried;
+  return true;
+}
+
+template <class Key, class T, class Compare>
+  bool tiered_full_map<Key, T, Compare>::thaw(void)
+{
+  if (segments_.empty()) return false;
+
+  // The hot tier starts with inserts of the state the segment left behind,
+  // which its operations rebuild once they are in front of the rest.
+  for (std::uint64_t i = 0; i < carried_; i++)
+    hot_.revert(hot_.earliest());
+
+  // The segment starts with the inserts carried over from the one before,
+  // which stay cold, followed by its own operations.
+  auto first = hot_.earliest();
+  std::uint64_t carried = carried_counts_.back();
+  std::uint64_t count = 0;
+  std::vector<typename hot_type::time_point> thawed;
+  segments_.back()->for_each_event(
+      [&](map op, const key_type &key, const mapped_type &val)
+      {
+        typename hot_type::time_point t = hot_.present();
+        switch (op)
+        {
+          case map::insert:
+            t = hot_.insert(first, value_type(key, val));
+            break;
+          case map::erase:
+            t = hot_.erase(first, key);
+            break;
+          case map::assign:
+            t = hot_.assign(first, key, val);
+            break;
+        }
+        if (count++ >= carried) thawed.push_back(t);
+      });
+
+  // Ordinals of the thawed operations carry on from the cold ones, in front
+  // of those of any segment thawed before.
+  thawed.insert(thawed.end(), thawed_.begin(), thawed_.end());
+  thawed_.swap(thawed);
+
+  segments_.pop_back();
+  bases_.pop_back();
+  carried_counts_.pop_back();
+  carried_ = carried;
+  changed_ = true;
+  return true;
+}
+
+template <class Key, class T, class Compare>
+  typename tiered_full_map<Key, T, Compare>::time_point
+    tiered_full_map<Key, T, Compare>::at(std::uint64_t ordinal)
+{
+  if (ordinal >= cold_events())
+    return wrap(thawed_[ordinal - cold_events()]);
+
+  size_type tier = std::upper_bound(bases_.begin(), bases_.end(), ordinal)
+                   - bases_.begin() - 1;
+  auto local = ordinal - bases_[tier] + carried_counts_[tier];
+  return time_point(segments_[tier]->at(local).operation(), true, ordinal,
+                    hot_.present());
+}
+
+template <class Key, class T, class Compare>
+  typename tiered_full_map<Key, T, Compare>::time_point
+    tiered_full_map<Key, T, Compare>::present(void)
+{
+  return wrap(hot_.present());
+}
+
+template <class Key, class T, class Compare>
+  typename tiered_full_map<Key, T, Compare>::time_point
+    tiered_full_map<Key, T, Compare>::insert(const value_type &val)
+{
+  return record(hot_.insert(val));
+}
+
+template <class Key, class T, class Compare>
+  typename tiered_full_map<Key, T, Compare>::time_point
+    tiered_full_map<Key, T, Compare>::insert(const time_point &t,
+                                             const value_type &val)
+{
+  time_point warmed = warm(t);
+  if (warmed.cold) return reject(map::insert);
+  return record(hot_.insert(warmed.hot, val));
+}
+
+template <class Key, class T, class Compare>
+  typename tiered_full_map<Key, T, Compare>::time_point
+    tiered_full_map<Key, T, Compare>::erase(const key_type &key)
+{
+  return record(hot_.erase(key));
+}
+
+template <class Key, class T, class Compare>
+  typename tiered_full_map<Key, T, Compare>::time_point
+    tiered_full_map<Key, T, Compare>::erase(const time_point &t,
+                                            const key_type &key)
+{
+  time_point warmed = warm(t);
+  if (warmed.cold) return reject(map::erase);
+  return record(hot_.erase(warmed.hot, key));
+}
+
+template <class Key, class T, class Compare>
+  typename tiered_full_map<Key, T, Compare>::time_point
+    tiered_full_map<Key, T, Compare>::assign(const key_type &key,
+                                             const mapped_type &val)
+{
+  return record(hot_.assign(key, val));
+}
+
+template <class Key, class T, class Compare>
+  typename tiered_full_map<Key, T, Compare>::time_point
+    tiered_full_map<Key, T, Compare>::assign(const time_point &t,
+                                             const key_type &key,
+                                             const mapped_type &val)
+{
+  time_point warmed = warm(t);
+  if (warmed.cold) return reject(map::assign);
+  return record(hot_.assign(warmed.hot, key, val));
+}
+
+template <class Key, class T, class Compare>
+  bool tiered_full_map<Key, T, Compare>::revert(const time_point &t)
+{
+  time_point warmed = warm(t);
+  if (warmed.cold) return false;
+  hot_.revert(warmed.hot);
+  changed_ = true;
+  return true;
+}
+
+template <class Key, class T, class Compare>
+  const typename tiered_full_map<Key, T, Compare>::mapped_type *
+    tiered_full_map<Key, T, Compare>::find(const key_type &key)
+{
+  return find(present(), key);
+}
+
+template <class Key, class T, class Compare>
+  const typename tiered_full_map<Key, T, Compare>::mapped_type *
+    tiered_full_map<Key, T, Compare>::find(const time_point &t,
+                                           const key_type &key)
+{
+  time_point warmed = warm(t);
+  if (!warmed.cold)
+  {
+    auto it = hot_.find(warmed.hot, key);
+    return it == hot_.end(warmed.hot) ? 0 : &(*it).second;
+  }
+
+  // The segment of the operation starts with the state before it.
+  size_type tier = std::upper_bound(bases_.begin(), bases_.end(), t.ordinal)
+                   - bases_.begin() - 1;
+  const segment_type &segment = *segments_[tier];
+  return segment.find(segment.at(t.ordinal - bases_[tier]
+                                 + carried_counts_[tier]), key);
+}
+
+template <class Key, class T, class Compare>
+  typename tiered_full_map<Key, T, Compare>::time_point
+    tiered_full_map<Key, T, Compare>::wrap(
+        const typename hot_type::time_point &t)
+{
+  return time_point(t.operation(), false, 0, t);
+}
+
+template <class Key, class T, class Compare>
+  typename tiered_full_map<Key, T, Compare>::time_point
+    tiered_full_map<Key, T, Compare>::record(
+        const typename hot_type::time_point &t)
+{
+  changed_ = true;
+  return wrap(t);
+}
+
+template <class Key, class T, class Compare>
+  typename tiered_full_map<Key, T, Compare>::time_point
+    tiered_full_map<Key, T, Compare>::reject(map op)
+{
+  return time_point(op, false, 0, hot_.present(), false);
+}
+
+template <class Key, class T, class Compare>
+  typename tiered_full_map<Key, T, Compare>::time_point
+    tiered_full_map<Key, T, Compare>::warm(const time_point &t) const
+{
+  // A cold time point may be of a segment that was thawed since.
+  if (!t.cold || t.ordinal < cold_events()) return t;
+  return time_point(t.op, false, 0, thawed_[t.ordinal - cold_events()]);
+}
+
+template <class Key, class T, class Compare>
+  void tiered_full_map<Key, T, Compare>::add_segment(
+      std::unique_ptr<segment_type> segment)
+{
+  bases_.push_back(cold_events());
+  carried_counts_.push_back(carried_);
+  segments_.push_back(std::move(segment));
+}
+
+} // end retro
@@ -0,0 +1,196 @@
+/*! \file traced_map.hpp
+ *  \brief Implementation of a fully retroactive map that records a trace of
+ *         its operations, without their data, for replaying in benchmarks.
+ */
+
+#pragma once
+
+#include <map>
+#include <vector>
+#include <utility>
+#include <functional>
+#include <cstdint>
+
+#include "retro/map.hpp"
+#include "retro/detail/log_file.hpp"
+#include "retro/detail/trace.hpp"
+
+namespace retro
+{
+
+/*! \brief Represents a fully retroactive map that records every operation
+ *  and every time point it is queried at in a trace file.
+ *  \p Each record holds the code of the operation, the ordinal of the time
+ *     point it refers to, and the identifier of its key. Keys are numbered in
+ *     the order they are first used and values are not recorded, so a trace
+ *     shows the shape of a workload without any of its data. The order of
+ *     keys is not kept. Ordinals are positions among every operation
+ *     performed on the map, as in logged_full_map. Searches and iterators at
+ *     a time point are recorded, but not how far the iterators are advanced.
+ *     The format is read by detail::read_trace().
+ *
+ *  \tparam Key The type of keys to store.
+ *  \tparam T The type of values to store.
+ *  \tparam Compare The function object used to order keys.
+ */
+template <class Key, class T, class Compare = std::less<Key>>
+class traced_full_map
+{
+  public:
+    typedef full_map<Key, T, Compare> map_type;
+    typedef typename map_type::key_type key_type;
+    typedef typename map_type::mapped_type mapped_type;
+    typedef typename map_type::value_type value_type;
+    typedef typename map_type::key_compare key_compare;
+    typedef typename map_type::size_type size_type;
+    typedef typename map_type::iterator iterator;
+    typedef typename map_type::retro_iterator retro_iterator;
+
+    /*! Represents an operation performed on the data structure at some point
+     *  in time.
+     */
+    class time_point
+    {
+      public:
+        /*! Get the operation that was performed.
+         */
+        map operation() const { return inner.operation(); }
+
+        /*! Get the position of the operation among every operation performed
+         *  on the map.
+         */
+        std::uint64_t ordinal() const { return pos; }
+
+      private:
+        time_point(const typename map_type::time_point &inner,
+                   std::uint64_t pos)
+          : inner(inner), pos(pos)
+        {
+        }
+
+        typename map_type::time_point inner;
+        std::uint64_t pos;
+
+        friend class traced_full_map<Key, T, Compare>;
+    };
+
+    /*! Construct an empty map that does not record a trace.
+     *  \param batch The number of bytes of records to buffer before writing.
+     *  \param comp The function object used to order keys.
+     */
+    explicit traced_full_map(std::size_t batch = 1 << 16,
+                             const key_compare &comp = key_compare());
+
+    /*! Start recording a trace, replacing any file at the path.
+     *  \param path The path of the trace.
+     *  \return Whether the trace was created. It is not if an operation was
+     *          already performed on the map, since later records could not
+     *          refer to it.
+     */
+    bool open(const char *path);
+
+    /*! Write any buffered records and stop recording.
+     *  \return Whether every record was written. It is not if recording
+     *          failed, even though the records before the failure are kept.
+     */
+    bool close(void);
+
+    /*! Write every buffered record to the trace.
+     *  \return Whether the records were written.
+     */
+    bool flush(void);
+
+    /*! Return whether a record could not be written. Nothing is recorded
+     *  after that, since later records could refer to the missing one, but
+     *  the map still works.
+     */
+    bool failed(void) const;
+
+    /*! Get the time point of an operation by its ordinal.
+     */
+    time_point at(std::uint64_t ordinal) const;
+
+    /*! Get a time point after every operation.
+     */
+    time_point present(void);
+
+    /*! Insert a new element at present and record it.
+     */
+    time_point insert(const value_type &val);
+
+    /*! Insert a new element just before some time point and record it.
+     */
+    time_point insert(const time_point &t, const value_type &val);
+
+    /*! Erase an element at present and record it.
+     */
+    time_point erase(const key_type &key);
+
+    /*! Erase an element just before some time point and record it.
+     */
+    time_point erase(const time_point &t, const key_type &key);
+
+    /*! Set the value of a key at present and record it.
+     */
+    time_point assign(const key_type &key, const mapped_type &val);
+
+    /*! Set the value of a key just before some time point and record it.
+     */
+    time_point assign(const time_point &t, const key_type &key,
+                      const mapped_type &val);
+
+    /*! Revert a previous operation and record it. The ordinal of the
+     *  operation is not reused. Nothing happens if the time point is at
+     *  present, and nothing is recorded.
+     */
+    void revert(const time_point &t);
+
+    /*! Get an iterator to the first element at present and record it.
+     */
+    iterator begin(void);
+
+    /*! Get an iterator to the first element just before some time point and
+     *  record it.
+     */
+    retro_iterator begin(const time_point &t);
+
+    /*! Get an iterator past the last element at present.
+     */
+    iterator end(void) { return map_.end(); }
+
+    /*! Get an iterator past the last element just before some time point.
+     */
+    retro_iterator end(const time_point &t) { return map_.end(t.inner); }
+
+    /*! Search for an element at present and record it.
+     */
+    iterator find(const key_type &key);
+
+    /*! Search for an element just before some time point and record it.
+     */
+    retro_iterator find(const time_point &t, const key_type &key);
+
+  private:
+    time_point record(map op, std::uint64_t at, const key_type &key,
+                      const typename map_type::time_point &inner);
+
+    void append(std::uint8_t code, std::uint64_t at, std::uint64_t key);
+
+    std::uint64_t key_id(const key_type &key);
+
+    map_type map_;
+    detail::log_file log_;
+
+    // The time point of every operation by ordinal, including reverted ones.
+    std::vector<typename map_type::time_point> times_;
+
+    // The identifier of every key in the trace.
+    std::map<key_type, std::uint64_t, key_compare> keys_;
+
+    // Whether a record was dropped since the trace was opened.
+    bool failed_;
+}; // end traced_full_map
+
+} // end retro
+
+#include "retro/traced_map.inl"
@@ -0,0 +1,173 @@
+namespace retro
+{
+
+template <class Key, class T, class Compare>
+  traced_full_map<Key, T, Compare>::traced_full_map(std::size_t batch,
+                                                    const key_compare &comp)
+    : map_(comp), log_(batch), keys_(comp), failed_(false)
+{
+}
+
+template <class Key, class T, class Compare>
+  bool traced_full_map<Key, T, Compare>::open(const char *path)
+{
+  if (!times_.empty()) return false;
+  keys_.clear();
+  failed_ = false;
+  return detail::create_trace(log_, path, detail::trace_map_magic,
+                              sizeof(std::uint64_t));
+}
+
+template <class Key, class T, class Compare>
+  bool traced_full_map<Key, T, Compare>::close(void)
+{
+  return log_.close() && !failed_;
+}
+
+template <class Key, class T, class Compare>
+  bool traced_full_map<Key, T, Compare>::flush(void)
+{
+  return log_.flush() && !failed_;
+}
+
+template <class Key, class T, class Compare>
+  bool traced_full_map<Key, T, Compare>::failed(void) const
+{
+  return failed_;
+}
+
+template <class Key, class T, class Compare>
+  typename traced_full_map<Key, T, Compare>::time_point
+    traced_full_map<Key, T, Compare>::at(std::uint64_t ordinal) const
+{
+  return time_point(times_[ordinal], ordinal);
+}
+
+template <class Key, class T, class Compare>
+  typename traced_full_map<Key, T, Compare>::time_point
+    traced_full_map<Key, T, Compare>::present(void)
+{
+  return time_point(map_.present(), detail::log_file::present);
+}
+
+template <class Key, class T, class Compare>
+  typename traced_full_map<Key, T, Compare>::time_point
+    traced_full_map<Key, T, Compare>::insert(const value_type &val)
+{
+  return insert(present(), val);
+}
+
+template <class Key, class T, class Compare>
+  typename traced_full_map<Key, T, Compare>::time_point
+    traced_full_map<Key, T, Compare>::insert(const time_point &t,
+                                             const value_type &val)
+{
+  return record(map::insert, t.pos, val.first, map_.insert(t.inner, val));
+}
+
+template <class Key, class T, class Compare>
+  typename traced_full_map<Key, T, Compare>::time_point
+    traced_full_map<Key, T, Compare>::erase(const key_type &key)
+{
+  return erase(present(), key);
+}
+
+template <class Key, class T, class Compare>
+  typename traced_full_map<Key, T, Compare>::time_point
+    traced_full_map<Key, T, Compare>::erase(const time_point &t,
+                                            const key_type &key)
+{
+  return record(map::erase, t.pos, key, map_.erase(t.inner, key));
+}
+
+template <class Key, class T, class Compare>
+  typename traced_full_map<Key, T, Compare>::time_point
+    traced_full_map<Key, T, Compare>::assign(const key_type &key,
+                                             const mapped_type &val)
+{
+  return assign(present(), key, val);
+}
+
+template <class Key, class T, class Compare>
+  typename traced_full_map<Key, T, Compare>::time_point
+    traced_full_map<Key, T, Compare>::assign(const time_point &t,
+                                             const key_type &key,
+                                             const mapped_type &val)
+{
+  return record(map::assign, t.pos, key, map_.assign(t.inner, key, val));
+}
+
+template <class Key, class T, class Compare>
+  void traced_full_map<Key, T, Compare>::revert(const time_point &t)
+{
+  // Reverting the present changes nothing, and its record would not replay.
+  if (t.pos == detail::log_file::present) return;
+  map_.revert(t.inner);
+  append(detail::trace_revert, t.pos, 0);
+}
+
+template <class Key, class T, class Compare>
+  typename traced_full_map<Key, T, Compare>::iterator
+    traced_full_map<Key, T, Compare>::begin(void)
+{
+  append(detail::trace_scan, detail::log_file::present, 0);
+  return map_.begin();
+}
+
+template <class Key, class T, class Compare>
+  typename traced_full_map<Key, T, Compare>::retro_iterator
+    traced_full_map<Key, T, Compare>::begin(const time_point &t)
+{
+  append(detail::trace_scan, t.pos, 0);
+  return map_.begin(t.inner);
+}
+
+template <class Key, class T, class Compare>
+  typename traced_full_map<Key, T, Compare>::iterator
+    traced_full_map<Key, T, Compare>::find(const key_type &key)
+{
+  append(detail::trace_find, detail::log_file::present, key_id(key));
+  return map_.find(key);
+}
+
+template <class Key, class T, class Compare>
+  typename traced_full_map<Key, T, Compare>::retro_iterator
+    traced_full_map<Key, T, Compare>::find(const time_point &t,
+                                           const key_type &key)
+{
+  append(detail::trace_find, t.pos, key_id(key));
+  return map_.find(t.inner, key);
+}
+
+template <class Key, class T, class Compare>
+  typename traced_full_map<Key, T, Compare>::time_point
+    traced_full_map<Key, T, Compare>::record(
+        map op, std::uint64_t at, const key_type &key,
+        const typename map_type::time_point &inner)
+{
+  append(static_cast<std::uint8_t>(op), at, key_id(key));
+
+  times_.push_back(inner);
+  return time_point(inner, times_.size() - 1);
+}
+
+template <class Key, class T, class Compare>
+  void traced_full_map<Key, T, Compare>::append(std::uint8_t code,
+                                                std::uint64_t at,
+                                                std::uint64_t key)
+{
+  // A trace with a record missing would replay the wrong operations, so it
+  // is cut short at the first one that fails.
+  if (!failed_ && !log_.append(code, at, &key)) failed_ = true;
+}
+
+template <class Key, class T, class Compare>
+  std::uint64_t traced_full_map<Key, T, Compare>::key_id(const key_type &key)
+{
+  // Keys are only numbered while recording, so that the identifiers in a
+  // trace start from zero.
+  if (!log_.is_open()) return 0;
+  return keys_.insert(std::make_pair(key, keys_.size())).first->second;
+}
+
+} // end retro
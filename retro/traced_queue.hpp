@@ -0,0 +1,209 @@
+/*! \file traced_queue.hpp
+ *  \brief Implementation of a partially retroactive queue that records a
+ *         trace of its operations, without their data, for replaying in
+ *         benchmarks.
+ */
+
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+#include "retro/queue.hpp"
+#include "retro/detail/log_file.hpp"
+#include "retro/detail/trace.hpp"
+
+namespace retro
+{
+
+/*! \brief Represents a partially retroactive queue that records every
+ *  operation in a trace file.
+ *  \p This records operations in the same way as traced_full_map. Records
+ *     have no payload, since elements are not recorded. Reading the front of
+ *     the queue is recorded as a search.
+ *
+ *  \tparam T The type of elements to store in the container.
+ */
+template <class T>
+class traced_partial_queue
+{
+  public:
+    typedef partial_queue<T> queue_type;
+    typedef typename queue_type::value_type value_type;
+    typedef typename queue_type::reference reference;
+    typedef typename queue_type::size_type size_type;
+
+    /*! Represents an operation performed on the data structure at some point
+     *  in time.
+     */
+    class time_point
+    {
+      public:
+        /*! Get the operation that was performed.
+         */
+        queue operation() const { return inner.operation(); }
+
+        /*! Get the position of the operation among every operation performed
+         *  on the queue.
+         */
+        std::uint64_t ordinal() const { return pos; }
+
+      private:
+        time_point(const typename queue_type::time_point &inner,
+                   std::uint64_t pos)
+          : inner(inner), pos(pos)
+        {
+        }
+
+        typename queue_type::time_point inner;
+        std::uint64_t pos;
+
+        friend class traced_partial_queue<T>;
+    };
+
+    /*! Construct an empty queue that does not record a trace.
+     *  \param batch The number of bytes of records to buffer before writing.
+     */
+    explicit traced_partial_queue(std::size_t batch = 1 << 16)
+      : log_(batch), failed_(false)
+    {
+    }
+
+    /*! Start recording a trace, replacing any file at the path.
+     *  \return Whether the trace was created. It is not if an operation was
+     *          already performed on the queue.
+     */
+    bool open(const char *path)
+    {
+      if (!times_.empty()) return false;
+      failed_ = false;
+      return detail::create_trace(log_, path, detail::trace_queue_magic, 0);
+    }
+
+    /*! Write any buffered records and stop recording.
+     *  \return Whether every record was written, as in traced_full_map.
+     */
+    bool close(void)
+    {
+      return log_.close() && !failed_;
+    }
+
+    /*! Write every buffered record to the trace.
+     *  \return Whether the records were written.
+     */
+    bool flush(void)
+    {
+      return log_.flush() && !failed_;
+    }
+
+    /*! Return whether a record could not be written, after which nothing
+     *  is recorded.
+     */
+    bool failed(void) const
+    {
+      return failed_;
+    }
+
+    /*! Get the time point of an operation by its ordinal.
+     */
+    time_point at(std::uint64_t ordinal) const
+    {
+      return time_point(times_[ordinal], ordinal);
+    }
+
+    /*! Return the number of elements in the container at present.
+     */
+    size_type size(void) const
+    {
+      return queue_.size();
+    }
+
+    /*! Return whether the container is empty at present.
+     */
+    bool empty(void) const
+    {
+      return queue_.empty();
+    }
+
+    /*! Return the element at the front of the container at present and
+     *  record it.
+     */
+    reference front(void)
+    {
+      append(detail::trace_find, detail::log_file::present);
+      return queue_.front();
+    }
+
+    /*! Return the element at the back of the container at present.
+     */
+    reference back(void)
+    {
+      return queue_.back();
+    }
+
+    /*! Push an element at present and record it.
+     */
+    time_point push(const T &val)
+    {
+      return record(queue::push, detail::log_file::present,
+                    queue_.push(T(val)));
+    }
+
+    /*! Push an element just before some time point and record it.
+     */
+    time_point push(const time_point &t, const T &val)
+    {
+      return record(queue::push, t.pos, queue_.push(t.inner, T(val)));
+    }
+
+    /*! Pop an element at present and record it.
+     */
+    time_point pop(void)
+    {
+      return record(queue::pop, detail::log_file::present, queue_.pop());
+    }
+
+    /*! Pop an element just before some time point and record it.
+     */
+    time_point pop(const time_point &t)
+    {
+      return record(queue::pop, t.pos, queue_.pop(t.inner));
+    }
+
+    /*! Revert a previous operation and record it. The ordinal of the
+     *  operation is not reused. As in traced_full_map, a time point at
+     *  present is neither reverted nor recorded.
+     */
+    void revert(const time_point &t)
+    {
+      if (t.pos == detail::log_file::present) return;
+      queue_.revert(t.inner);
+      append(detail::trace_revert, t.pos);
+    }
+
+  private:
+    time_point record(queue op, std::uint64_t at,
+                      const typename queue_type::time_point &inner)
+    {
+      append(static_cast<std::uint8_t>(op), at);
+
+      times_.push_back(inner);
+      return time_point(inner, times_.size() - 1);
+    }
+
+    void append(std::uint8_t code, std::uint64_t at)
+    {
+      if (!failed_ && !log_.append(code, at, 0)) failed_ = true;
+    }
+
+    queue_type queue_;
+    detail::log_file log_;
+
+    // The time point of every operation by ordinal, including reverted ones.
+    std::vector<typename queue_type::time_point> times_;
+
+    // Whether a record was dropped since the trace was opened.
+    bool failed_;
+}; // end traced_partial_queue
+
+} // end retro
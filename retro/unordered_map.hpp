@@ -0,0 +1,395 @@
+/*! \file unordered_map.hpp
+ *  \brief Implementation of a fully retroactive unordered associative map.
+ */
+
+#pragma once
+
+#include <set>
+#include <functional>
+
+#include "retro/map.hpp"
+#include "retro/detail/ordered_list.hpp"
+#include "retro/detail/hash_table.hpp"
+#include "retro/detail/slab.hpp"
+
+namespace retro
+{
+
+/*! \brief Represents a fully retroactive unordered associative map.
+ *  \p Keys are indexed by an open-addressing hash table, so finding the
+ *     history of a key takes expected constant time. Present lookups are then
+ *     constant time, while lookups just before some time point take time
+ *     logarithmic in the number of operations performed on that key.
+ *
+ *     Operations behave as they do in full_map: values are stored in a slab
+ *     and released when their operation is reverted, an insert on a key that
+ *     already exists has no effect while an assign replaces its value, and
+ *     each event records the operation whose value the key has just after
+ *     it, so finding a value takes constant time once the position in the
+ *     history of the key is known.
+ *
+ *  \tparam Key The type of keys to store.
+ *  \tparam T The type of values to store.
+ *  \tparam Hash The function object used to hash keys.
+ *  \tparam KeyEqual The function object used to compare keys for equality.
+ */
+template <class Key, class T, class Hash = std::hash<Key>,
+          class KeyEqual = std::equal_to<Key>>
+class full_unordered_map
+{
+  private:
+    struct event;
+
+    typedef detail::slab<T> value_container;
+    typedef typename value_container::handle value_handle;
+
+    typedef detail::ordered_list<event> event_container;
+    typedef typename event_container::iterator event_iterator;
+
+    typedef std::set<event_iterator> history_type;
+
+    typedef detail::hash_table<Key, history_type, Hash, KeyEqual>
+      map_container;
+    typedef typename map_container::iterator map_iterator;
+
+  public:
+    typedef Key key_type;
+    typedef T mapped_type;
+    typedef std::pair<const key_type, mapped_type> value_type;
+    typedef Hash hasher;
+    typedef KeyEqual key_equal;
+    typedef typename map_container::size_type size_type;
+    typedef std::pair<const key_type &, const mapped_type &> reference;
+
+    /*! Represents an operation performed on the data structure at some point
+     *  in time.
+     */
+    class time_point
+    {
+      public:
+        /*! Get the operation that was performed.
+         */
+        map operation() const { return op; }
+
+        bool operator==(const time_point &other) const
+        {
+          return event == other.event;
+        }
+
+        bool operator!=(const time_point &other) const
+        {
+          return !(*this == other);
+        }
+
+      private:
+        time_point(event_iterator event)
+          : op(), event(event)
+        {
+        }
+
+        time_point(map op, event_iterator event)
+          : op(op), event(event)
+        {
+        }
+
+        map op;
+        event_iterator event;
+
+        friend class full_unordered_map<Key, T, Hash, KeyEqual>;
+    };
+
+    class iterator
+      : public std::iterator<std::forward_iterator_tag, value_type,
+                             std::ptrdiff_t, detail::arrow_proxy<reference>,
+                             reference>
+    {
+      public:
+        typedef full_unordered_map<Key, T, Hash, KeyEqual>::reference
+          reference;
+        typedef detail::arrow_proxy<reference> pointer;
+
+        reference operator*() const
+        {
+          auto setter = value_event(base->second.end());
+          return reference(base->first, (*values)[setter->value]);
+        }
+
+        pointer operator->() const
+        {
+          return pointer(**this);
+        }
+
+        iterator &operator++()
+        {
+          // Find the next key that has not been erased.
+          do { ++base; }
+          while (base != last && !key_exists(base));
+
+          return *this;
+        }
+
+        iterator operator++(int)
+        {
+          iterator old = *this;
+          ++(*this);
+          return old;
+        }
+
+        bool operator==(const iterator &other) const
+        {
+          return base == other.base;
+        }
+
+        bool operator!=(const iterator &other) const
+        {
+          return !(*this == other);
+        }
+
+      private:
+        iterator(const value_container *values, map_iterator last,
+            map_iterator base)
+          : values(values), last(last), base(base)
+        {
+          // Make sure that this iterator points to a valid element.
+          if (base != last && !key_exists(base)) ++(*this);
+        }
+
+        const value_container *values;
+        map_iterator last;
+        map_iterator base;
+
+        friend class full_unordered_map<Key, T, Hash, KeyEqual>;
+    };
+
+    class retro_iterator
+      : public std::iterator<std::forward_iterator_tag, value_type,
+                             std::ptrdiff_t, detail::arrow_proxy<reference>,
+                             reference>
+    {
+      public:
+        typedef full_unordered_map<Key, T, Hash, KeyEqual>::reference
+          reference;
+        typedef detail::arrow_proxy<reference> pointer;
+
+        reference operator*() const
+        {
+          return reference(base->first, (*values)[cur->value]);
+        }
+
+        pointer operator->() const
+        {
+          return pointer(**this);
+        }
+
+        retro_iterator &operator++()
+        {
+          // Find the next key that had not been erased.
+          do { ++base; }
+          while (base != last && !key_exists(base, event));
+          if (base != last)
+            cur = value_event(base->second.lower_bound(event));
+          return *this;
+        }
+
+        retro_iterator operator++(int)
+        {
+          retro_iterator old = *this;
+          ++(*this);
+          return old;
+        }
+
+        bool operator==(const retro_iterator &other) const
+        {
+          return base == other.base && event == other.event;
+        }
+
+        bool operator!=(const retro_iterator &other) const
+        {
+          return !(*this == other);
+        }
+
+      private:
+        retro_iterator(const value_container *values, map_iterator last,
+            map_iterator base, event_iterator event)
+          : values(values), last(last), base(base), event(event), cur(event)
+        {
+          if (base != last)
+          {
+            // Iterate to the first valid key, which may be the end.
+            if (!key_exists(base, event)) ++(*this);
+            else
+              cur = value_event(base->second.lower_bound(event));
+          }
+        }
+
+        const value_container *values;
+        map_iterator last;
+        map_iterator base;
+        event_iterator event;
+        event_iterator cur;
+
+        friend class full_unordered_map<Key, T, Hash, KeyEqual>;
+    };
+
+    /*! Construct an empty fully retroactive unordered map.
+     *  \param n The number of distinct keys to reserve space for.
+     *  \param hash The hash function to use.
+     *  \param equal The key equality function to use.
+     */
+    explicit full_unordered_map(size_type n = 0,
+                                const hasher &hash = hasher(),
+                                const key_equal &equal = key_equal());
+
+    // Events refer to each other and to the slab by position, so a copy
+    // could not share them.
+    full_unordered_map(const full_unordered_map &other) = delete;
+    full_unordered_map &operator=(const full_unordered_map &other) = delete;
+
+    /*! Construct a map by acquiring the state of an existing map, which is
+     *  left empty. Time points of the existing map refer to this one.
+     */
+    full_unordered_map(full_unordered_map &&other);
+
+    /*! Replace the contents of this map by acquiring the state of another,
+     *  which is left empty. Time points of the other map refer to this one.
+     */
+    full_unordered_map &operator=(full_unordered_map &&other);
+
+    /*! Get the time point at present, which is after every operation.
+     */
+    time_point present(void);
+
+    /*! Return an iterator referring to the first element in the container at
+     *  present.
+     */
+    iterator begin(void);
+
+    /*! Return an iterator referring to the first element in the container just
+     *  before some time point.
+     *  \param t The time point to query.
+     */
+    retro_iterator begin(const time_point &t);
+
+    /*! Return an iterator referring to the past-the-end element in the
+     *  container at present.
+     */
+    iterator end(void);
+
+    /*! Return an iterator referring to the past-the-end element in the
+     *  container just before some time point.
+     *  \param t The time point to query.
+     */
+    retro_iterator end(const time_point &t);
+
+    /*! Insert a new element into the container in its present state. This
+     *  has no effect if the key already exists. Inserting a key that has
+     *  never been seen invalidates all iterators.
+     *  \param val The new value to insert.
+     *  \return A new time point representing this operation.
+     */
+    time_point insert(const value_type &val);
+
+    /*! Retroactively insert a new element into the container just before
+     *  some time point.
+     *  \param t The time point of the operation just before this new one.
+     *  \param val The new value to insert.
+     *  \return A new time point representing this retroactive operation.
+     */
+    time_point insert(const time_point &t, const value_type &val);
+
+    /*! Erase the element with a specific key from the container in its
+     *  present state.
+     *  \param key The key of the element to erase.
+     *  \return A new time point representing this operation.
+     */
+    time_point erase(const key_type &key);
+
+    /*! Retroactively erase the element with a specific key from the container
+     *  just before some time point.
+     *  \param t The time point of the operation just before this new one.
+     *  \param key The key of the element to erase.
+     *  \return A new time point representing this retroactive operation.
+     */
+    time_point erase(const time_point &t, const key_type &key);
+
+    /*! Set the value of a key in the container in its present state, whether
+     *  or not it exists.
+     *  \param key The key of the element to assign.
+     *  \param val The value to assign.
+     *  \return A new time point representing this operation.
+     */
+    time_point assign(const key_type &key, const mapped_type &val);
+
+    /*! Retroactively set the value of a key just before some time point.
+     *  \param t The time point of the operation just before this new one.
+     *  \param key The key of the element to assign.
+     *  \param val The value to assign.
+     *  \return A new time point representing this retroactive operation.
+     */
+    time_point assign(const time_point &t, const key_type &key,
+                      const mapped_type &val);
+
+    /*! Retroactively revert a previous operation, releasing the storage that
+     *  the operation used. Nothing happens if the time point is at present.
+     *  \param t The time point of the operation to revert.
+     */
+    void revert(const time_point &t);
+
+    /*! Search the container for a specific element in its present state.
+     *  \param key The key of the element to search for.
+     *  \return An iterator to the element if it is found, or
+     *          full_unordered_map::end() otherwise.
+     */
+    iterator find(const key_type &key);
+
+    /*! Search the container for a specific element just before some time point.
+     *  \param t The time point to query.
+     *  \param key The key of the element to search for.
+     *  \return An iterator to the element if it is found, or
+     *          full_unordered_map::end(t) otherwise.
+     */
+    retro_iterator find(const time_point &t, const key_type &key);
+
+    /*! Make sure that the container can hold at least n distinct keys without
+     *  rehashing.
+     *  \param n The number of distinct keys to reserve space for.
+     */
+    void reserve(size_type n);
+
+  private:
+    struct event
+    {
+      event()
+      {
+      }
+
+      event(map op, size_type key, value_handle value = value_handle())
+        : op(op), key(key), value(value)
+      {
+      }
+
+      map op;
+
+      // The position of the key in the hash table, which entries keep when
+      // the table grows.
+      size_type key;
+
+      // The value set by this operation, unless it is an erase.
+      value_handle value;
+
+      // The operation whose value the key has just after this one, as in
+      // full_map.
+      event_iterator setter;
+    };
+
+    time_point record(const time_point &t, map op, const key_type &key,
+                      const value_handle &value);
+
+    value_container values_;
+    event_container events_;
+    map_container map_;
+}; // end full_unordered_map
+
+} // end retro
+
+#include "retro/unordered_map.inl"
@@ -0,0 +1,185 @@
+namespace retro
+{
+
+template <class Key, class T, class Hash, class KeyEqual>
+  full_unordered_map<Key, T, Hash, KeyEqual>
+    ::full_unordered_map(size_type n, const hasher &hash,
+                         const key_equal &equal)
+      : map_(n, hash, equal)
+{
+}
+
+template <class Key, class T, class Hash, class KeyEqual>
+  full_unordered_map<Key, T, Hash, KeyEqual>
+    ::full_unordered_map(full_unordered_map &&other)
+      : values_(std::move(other.values_)), events_(std::move(other.events_)),
+        map_(std::move(other.map_))
+{
+  // The containers keep their nodes and entries when moved, so the time
+  // points and histories still refer to them. The moved-from containers
+  // have lost their sentinels and slots, so start other afresh.
+  other.values_ = value_container();
+  other.events_ = event_container();
+  other.map_ = map_container(0, map_.hash_function(), map_.key_eq());
+}
+
+template <class Key, class T, class Hash, class KeyEqual>
+  full_unordered_map<Key, T, Hash, KeyEqual> &
+    full_unordered_map<Key, T, Hash, KeyEqual>
+      ::operator=(full_unordered_map &&other)
+{
+  if (this != &other)
+  {
+    values_ = std::move(other.values_);
+    events_ = std::move(other.events_);
+    map_ = std::move(other.map_);
+
+    other.values_ = value_container();
+    other.events_ = event_container();
+    other.map_ = map_container(0, map_.hash_function(), map_.key_eq());
+  }
+  return *this;
+}
+
+template <class Key, class T, class Hash, class KeyEqual>
+  typename full_unordered_map<Key, T, Hash, KeyEqual>::time_point
+    full_unordered_map<Key, T, Hash, KeyEqual>::present(void)
+{
+  return time_point(events_.end());
+}
+
+template <class Key, class T, class Hash, class KeyEqual>
+  typename full_unordered_map<Key, T, Hash, KeyEqual>::iterator
+    full_unordered_map<Key, T, Hash, KeyEqual>::begin(void)
+{
+  return iterator(&values_, map_.end(), map_.begin());
+}
+
+template <class Key, class T, class Hash, class KeyEqual>
+  typename full_unordered_map<Key, T, Hash, KeyEqual>::retro_iterator
+    full_unordered_map<Key, T, Hash, KeyEqual>::begin(const time_point &t)
+{
+  return retro_iterator(&values_, map_.end(), map_.begin(), t.event);
+}
+
+template <class Key, class T, class Hash, class KeyEqual>
+  typename full_unordered_map<Key, T, Hash, KeyEqual>::iterator
+    full_unordered_map<Key, T, Hash, KeyEqual>::end(void)
+{
+  return iterator(&values_, map_.end(), map_.end());
+}
+
+template <class Key, class T, class Hash, class KeyEqual>
+  typename full_unordered_map<Key, T, Hash, KeyEqual>::retro_iterator
+    full_unordered_map<Key, T, Hash, KeyEqual>::end(const time_point &t)
+{
+  return retro_iterator(&values_, map_.end(), map_.end(), t.event);
+}
+
+template <class Key, class T, class Hash, class KeyEqual>
+  typename full_unordered_map<Key, T, Hash, KeyEqual>::time_point
+    full_unordered_map<Key, T, Hash, KeyEqual>::insert(const value_type &val)
+{
+  return insert(present(), val);
+}
+
+template <class Key, class T, class Hash, class KeyEqual>
+  typename full_unordered_map<Key, T, Hash, KeyEqual>::time_point
+    full_unordered_map<Key, T, Hash, KeyEqual>::insert(const time_point &t,
+                                                       const value_type &val)
+{
+  // Store this value even if this key already exists, because it may be used
+  // if the previous operation on this key is reverted.
+  return record(t, map::insert, val.first, values_.insert(val.second));
+}
+
+template <class Key, class T, class Hash, class KeyEqual>
+  typename full_unordered_map<Key, T, Hash, KeyEqual>::time_point
+    full_unordered_map<Key, T, Hash, KeyEqual>::erase(const key_type &key)
+{
+  return erase(present(), key);
+}
+
+template <class Key, class T, class Hash, class KeyEqual>
+  typename full_unordered_map<Key, T, Hash, KeyEqual>::time_point
+    full_unordered_map<Key, T, Hash, KeyEqual>::erase(const time_point &t,
+                                                      const key_type &key)
+{
+  // An erase has no value of its own.
+  return record(t, map::erase, key, value_handle());
+}
+
+template <class Key, class T, class Hash, class KeyEqual>
+  typename full_unordered_map<Key, T, Hash, KeyEqual>::time_point
+    full_unordered_map<Key, T, Hash, KeyEqual>::assign(const key_type &key,
+                                                       const mapped_type &val)
+{
+  return assign(present(), key, val);
+}
+
+template <class Key, class T, class Hash, class KeyEqual>
+  typename full_unordered_map<Key, T, Hash, KeyEqual>::time_point
+    full_unordered_map<Key, T, Hash, KeyEqual>::assign(const time_point &t,
+                                                       const key_type &key,
+                                                       const mapped_type &val)
+{
+  return record(t, map::assign, key, values_.insert(val));
+}
+
+template <class Key, class T, class Hash, class KeyEqual>
+  void full_unordered_map<Key, T, Hash, KeyEqual>::revert(const time_point &t)
+{
+  if (t.event == events_.end()) return;
+
+  // The key stays in the table, as entries are never removed, but with no
+  // history it is skipped like an erased key.
+  auto event_it = t.event;
+  auto &history = (map_.begin() + event_it->key)->second;
+  if (event_it->op != map::erase) values_.erase(event_it->value);
+  detail::relink(history, history.erase(history.find(event_it)));
+  events_.erase(event_it);
+}
+
+template <class Key, class T, class Hash, class KeyEqual>
+  typename full_unordered_map<Key, T, Hash, KeyEqual>::iterator
+    full_unordered_map<Key, T, Hash, KeyEqual>::find(const key_type &key)
+{
+  auto it = map_.find(key);
+  if (it != map_.end() && detail::key_exists(it))
+    return iterator(&values_, map_.end(), it);
+  return end();
+}
+
+template <class Key, class T, class Hash, class KeyEqual>
+  typename full_unordered_map<Key, T, Hash, KeyEqual>::retro_iterator
+    full_unordered_map<Key, T, Hash, KeyEqual>::find(const time_point &t,
+                                                     const key_type &key)
+{
+  auto it = map_.find(key);
+  if (it != map_.end() && detail::key_exists(it, t.event))
+    return retro_iterator(&values_, map_.end(), it, t.event);
+  return end(t);
+}
+
+template <class Key, class T, class Hash, class KeyEqual>
+  void full_unordered_map<Key, T, Hash, KeyEqual>::reserve(size_type n)
+{
+  map_.reserve(n);
+}
+
+template <class Key, class T, class Hash, class KeyEqual>
+  typename full_unordered_map<Key, T, Hash, KeyEqual>::time_point
+    full_unordered_map<Key, T, Hash, KeyEqual>::record(const time_point &t,
+        map op, const key_type &key, const value_handle &value)
+{
+  // Insert this event in the ordered list, then reference it in the history
+  // of its key.
+  auto map_it = map_.find_or_insert(key);
+  auto event_it = events_.insert(t.event,
+                                 event(op, map_it - map_.begin(), value));
+  detail::relink(map_it->second, map_it->second.insert(event_it).first);
+
+  return time_point(op, event_it);
+}
+
+} // end retro
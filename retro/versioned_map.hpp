@@ -0,0 +1,556 @@
+/*! \file versioned_map.hpp
+ *  \brief Implementation of an append-only versioned map that publishes
+ *         read-only snapshots to concurrent readers.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "retro/map.hpp"
+
+namespace retro
+{
+
+/*! \brief Represents an append-only versioned map that is changed by
+ *  writers at present and read at any past version through snapshots that
+ *  need no locks.
+ *  \p Every operation is numbered in the order it is performed, and nothing
+ *     that has been published is changed in place: keys are linked into a
+ *     skip list and each key's operations are appended to its own history,
+ *     in blocks that are never reallocated. A snapshot is the storage
+ *     together with the number of operations that had been published when
+ *     it was taken, so publishing only stores that number and writers never
+ *     copy the map. Readers see nothing past the bound of their snapshot,
+ *     and so never observe a change in progress.
+ *
+ *     Writers only change the map at present, so an insert of a key that
+ *     exists and an erase of a key that does not are not stored, although
+ *     each still gets a time point. Unlike full_map, nothing can be changed
+ *     or reverted in the past.
+ *
+ *     Old versions are kept until they are forgotten. forget() moves a
+ *     horizon forward, before which new snapshots see the map as it was at
+ *     the horizon, and reclaim() then releases every operation that is
+ *     superseded before the horizon. Reclamation is epoch based: each
+ *     snapshot registers in the current epoch while it exists, and the
+ *     writer only frees a history it replaced once no snapshot of an epoch
+ *     that could have seen it remains, so readers never wait or retry.
+ *
+ *     Time points returned by the writer are valid for every snapshot. A
+ *     time point that is newer than a snapshot is after every event of that
+ *     snapshot, and one older than the snapshot's horizon is at the horizon.
+ *
+ *  \tparam Key The type of keys to store.
+ *  \tparam T The type of values to store. Values are copy constructed and
+ *            never assigned.
+ *  \tparam Compare The function object used to order keys.
+ */
+template <class Key, class T, class Compare = std::less<Key>>
+class versioned_full_map
+{
+  public:
+    typedef Key key_type;
+    typedef T mapped_type;
+    typedef std::pair<const key_type, mapped_type> value_type;
+    typedef Compare key_compare;
+    typedef std::pair<const key_type &, const mapped_type &> reference;
+
+  private:
+    // The most levels of the skip list, which suits up to about 4^16 keys.
+    static const int max_height = 16;
+
+    // A key and the operations performed on it, in the order they were
+    // performed. The writer publishes each change with a release store, and
+    // readers load links and counts with acquire loads.
+    struct node
+    {
+      struct event
+      {
+        std::uint64_t seq;
+        bool live;
+        typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+
+        const T &value(void) const
+        {
+          return *reinterpret_cast<const T *>(&storage);
+        }
+      };
+
+      // A block of events, which is never moved. Each block holds twice as
+      // many events as the one before it, and the blocks of a history are
+      // freed together once it is replaced and no reader can still see it.
+      struct chunk
+      {
+        explicit chunk(std::size_t capacity)
+          : capacity(capacity), events(new event[capacity]), count(0),
+            next(nullptr)
+        {
+        }
+
+        std::size_t capacity;
+        std::unique_ptr<event[]> events;
+        std::atomic<std::size_t> count;
+        std::atomic<chunk *> next;
+      };
+
+      node(const key_type &key, int height)
+        : key(key), next(new std::atomic<node *>[height]),
+          head(new chunk(2))
+      {
+        for (int i = 0; i < height; i++)
+          next[i].store(nullptr, std::memory_order_relaxed);
+        last = head.load(std::memory_order_relaxed);
+      }
+
+      ~node(void)
+      {
+        release(head.load(std::memory_order_relaxed));
+      }
+
+      // Destroy the values of a history and free its blocks.
+      static void release(chunk *c)
+      {
+        while (c)
+        {
+          std::size_t n = c->count.load(std::memory_order_relaxed);
+          for (std::size_t i = 0; i < n; i++)
+            if (c->events[i].live)
+              reinterpret_cast<T *>(&c->events[i].storage)->~T();
+
+          chunk *later = c->next.load(std::memory_order_relaxed);
+          delete c;
+          c = later;
+        }
+      }
+
+      // Return the last event before the limit, or null if there is none.
+      // This takes O(log^2 h) time for a key with h events. Events before
+      // the limit were all appended before it was published, so a block
+      // that is not full has no later block that matters.
+      const event *visible(std::uint64_t limit) const
+      {
+        const event *found = nullptr;
+        for (const chunk *c = head.load(std::memory_order_acquire); c;
+             c = c->next.load(std::memory_order_acquire))
+        {
+          std::size_t count = c->count.load(std::memory_order_acquire);
+          const event *begin = c->events.get(), *end = begin + count;
+          const event *it = std::lower_bound(begin, end, limit,
+            [](const event &e, std::uint64_t l) { return e.seq < l; });
+
+          if (it != begin) found = it - 1;
+          if (it != end || count < c->capacity) break;
+        }
+        return found;
+      }
+
+      // Return the last event, for the writer.
+      const event *latest(void) const
+      {
+        std::size_t n = last->count.load(std::memory_order_relaxed);
+        return n ? &last->events[n - 1] : nullptr;
+      }
+
+      // Append an event, for the writer. A null value erases the key.
+      void append(std::uint64_t seq, const T *val)
+      {
+        std::size_t n = last->count.load(std::memory_order_relaxed);
+        if (n == last->capacity)
+        {
+          chunk *c = new chunk(2 * last->capacity);
+          last->next.store(c, std::memory_order_release);
+          last = c;
+          n = 0;
+        }
+
+        event &e = last->events[n];
+        if (val) ::new (static_cast<void *>(&e.storage)) T(*val);
+        e.seq = seq;
+        e.live = val != nullptr;
+        last->count.store(n + 1, std::memory_order_release);
+      }
+
+      // Replace the history with the events from the last one before the
+      // horizon on, for the writer. A leading erase is dropped as well,
+      // since no event at all means the same. Return the old history, which
+      // readers may still be using, or null if nothing would be dropped.
+      chunk *prune(std::uint64_t horizon, std::size_t &dropped);
+
+      const key_type key;
+      std::unique_ptr<std::atomic<node *>[]> next;
+      std::atomic<chunk *> head;
+
+      // The last block, for the writer.
+      chunk *last;
+    };
+
+  public:
+    /*! Represents an operation performed on the map at some point in time.
+     */
+    class time_point
+    {
+      public:
+        /*! Get the operation that was performed.
+         */
+        map operation() const { return op; }
+
+        bool operator==(const time_point &other) const
+        {
+          return seq == other.seq;
+        }
+
+        bool operator!=(const time_point &other) const
+        {
+          return !(*this == other);
+        }
+
+      private:
+        time_point(map op, std::uint64_t seq) : op(op), seq(seq)
+        {
+        }
+
+        map op;
+
+        // The number of operations performed before this one.
+        std::uint64_t seq;
+
+        friend class versioned_full_map<Key, T, Compare>;
+    };
+
+    /*! Iterates over the elements of a snapshot, in the order of their keys,
+     *  as they were just before some time point.
+     */
+    class iterator
+      : public std::iterator<std::forward_iterator_tag, value_type,
+                             std::ptrdiff_t, detail::arrow_proxy<reference>,
+                             reference>
+    {
+      public:
+        typedef versioned_full_map<Key, T, Compare>::reference reference;
+        typedef detail::arrow_proxy<reference> pointer;
+
+        reference operator*() const
+        {
+          return reference(base->key, cur->value());
+        }
+
+        pointer operator->() const
+        {
+          return pointer(**this);
+        }
+
+        iterator &operator++()
+        {
+          advance(base->next[0].load(std::memory_order_acquire));
+          return *this;
+        }
+
+        iterator operator++(int)
+        {
+          iterator old = *this;
+          ++(*this);
+          return old;
+        }
+
+        bool operator==(const iterator &other) const
+        {
+          return base == other.base;
+        }
+
+        bool operator!=(const iterator &other) const
+        {
+          return !(*this == other);
+        }
+
+      private:
+        iterator(const node *base, std::uint64_t limit)
+          : base(nullptr), cur(nullptr), limit(limit)
+        {
+          advance(base);
+        }
+
+        // Find the first key from a node on that exists before the limit.
+        void advance(const node *n)
+        {
+          for (; n; n = n->next[0].load(std::memory_order_acquire))
+          {
+            cur = n->visible(limit);
+            if (cur && cur->live) break;
+          }
+          base = n;
+        }
+
+        const node *base;
+        const typename node::event *cur;
+        std::uint64_t limit;
+
+        friend class versioned_full_map<Key, T, Compare>;
+    };
+
+    typedef iterator retro_iterator;
+
+  private:
+    struct storage;
+
+  public:
+    /*! Represents a read-only view of the map as it was when it was
+     *  published. Iterators obtained from a snapshot are valid while the
+     *  snapshot exists. A snapshot may be used by several threads at once.
+     */
+    class snapshot
+    {
+      public:
+        /*! Get a time point after every operation in this snapshot.
+         */
+        time_point present(void) const { return time_point(map(), bound_); }
+
+        /*! Get an iterator to the first element at present.
+         */
+        iterator begin(void) const { return iterator(first(), bound_); }
+
+        /*! Get an iterator to the first element just before some time point.
+         */
+        retro_iterator begin(const time_point &t) const
+        {
+          return iterator(first(), before(t));
+        }
+
+        /*! Get an iterator past the last element at present.
+         */
+        iterator end(void) const { return iterator(nullptr, bound_); }
+
+        /*! Get an iterator past the last element just before some time
+         *  point.
+         */
+        retro_iterator end(const time_point &t) const
+        {
+          return iterator(nullptr, before(t));
+        }
+
+        /*! Search for an element at present.
+         */
+        iterator find(const key_type &key) const
+        {
+          return find_before(bound_, key);
+        }
+
+        /*! Search for an element just before some time point.
+         */
+        retro_iterator find(const time_point &t, const key_type &key) const
+        {
+          return find_before(before(t), key);
+        }
+
+        snapshot(const snapshot &other)
+          : storage_(other.storage_), epoch_(other.epoch_),
+            floor_(other.floor_), bound_(other.bound_)
+        {
+          // The epoch cannot end while the other snapshot holds it.
+          if (storage_) storage_->readers[epoch_ & 1]++;
+        }
+
+        snapshot(snapshot &&other)
+          : storage_(std::move(other.storage_)), epoch_(other.epoch_),
+            floor_(other.floor_), bound_(other.bound_)
+        {
+          other.storage_.reset();
+        }
+
+        snapshot &operator=(snapshot other)
+        {
+          std::swap(storage_, other.storage_);
+          std::swap(epoch_, other.epoch_);
+          std::swap(floor_, other.floor_);
+          std::swap(bound_, other.bound_);
+          return *this;
+        }
+
+        ~snapshot(void)
+        {
+          if (storage_) storage_->readers[epoch_ & 1]--;
+        }
+
+      private:
+        explicit snapshot(std::shared_ptr<const storage> storage);
+
+        const node *first(void) const
+        {
+          return storage_->heads[0].load(std::memory_order_acquire);
+        }
+
+        std::uint64_t before(const time_point &t) const
+        {
+          return std::max(std::min(t.seq, bound_), floor_);
+        }
+
+        iterator find_before(std::uint64_t limit, const key_type &key) const
+        {
+          const node *n = storage_->find(key);
+          iterator it(nullptr, limit);
+          if (n && (it.cur = n->visible(limit)) && it.cur->live) it.base = n;
+          return it;
+        }
+
+        std::shared_ptr<const storage> storage_;
+
+        // The epoch the snapshot is registered in.
+        std::uint64_t epoch_;
+
+        // The horizon when the snapshot was taken, and the number of
+        // operations that had been published.
+        std::uint64_t floor_;
+        std::uint64_t bound_;
+
+        friend class versioned_full_map<Key, T, Compare>;
+    };
+
+    /*! Construct an empty map and publish it.
+     */
+    explicit versioned_full_map(const key_compare &comp = key_compare());
+
+    /*! Insert a new element at present if the key does not already exist.
+     *  The element is visible to readers once the map is next published.
+     *  \param val The key and the value to insert.
+     *  \return The time point of the insertion.
+     */
+    time_point insert(const value_type &val);
+
+    /*! Erase an element at present.
+     *  \param key The key to erase.
+     *  \return The time point of the erase.
+     */
+    time_point erase(const key_type &key);
+
+    /*! Set the value of a key at present, whether or not it exists.
+     *  \param key The key to assign.
+     *  \param val The value to assign.
+     *  \return The time point of the assignment.
+     */
+    time_point assign(const key_type &key, const mapped_type &val);
+
+    /*! Make every operation performed so far visible to new snapshots. This
+     *  takes constant time and copies nothing.
+     */
+    void publish(void);
+
+    /*! Get the most recently published snapshot of the map. This never
+     *  waits for a writer.
+     */
+    snapshot read(void) const;
+
+    /*! Move the horizon of new snapshots forward to a time point, so that
+     *  they treat every earlier time point as this one. The horizon never
+     *  moves back, nor past the operations that have been published.
+     *  \param horizon The earliest time point that must stay exact.
+     */
+    void forget(const time_point &horizon);
+
+    /*! Release the operations that no snapshot can see any more.
+     *  \p Histories are pruned to the horizon once every snapshot taken
+     *     before the horizon was last moved is gone, and each replaced
+     *     history is freed once every snapshot that could be reading it is
+     *     gone. Until then this releases what it can and leaves the rest to
+     *     a later call. It takes O(n + k) time for n keys and k operations
+     *     kept, and never blocks readers.
+     *  \return The number of operations removed from histories.
+     */
+    std::size_t reclaim(void);
+
+  private:
+    // Everything the map has stored, which snapshots keep alive.
+    struct storage
+    {
+      explicit storage(const key_compare &comp)
+        : comp(comp), next(0), published(0), random(0x9e3779b9), epoch(1),
+          horizon(0), pending(0), pending_epoch(0), pruned(0)
+      {
+        for (auto &head : heads) head.store(nullptr, std::memory_order_relaxed);
+        for (auto &count : readers) count.store(0, std::memory_order_relaxed);
+      }
+
+      ~storage(void)
+      {
+        for (auto &chunks : retired)
+          for (auto c : chunks) node::release(c);
+
+        node *n = heads[0].load(std::memory_order_relaxed);
+        while (n)
+        {
+          node *later = n->next[0].load(std::memory_order_relaxed);
+          delete n;
+          n = later;
+        }
+      }
+
+      // Search for the node of a key, from any thread.
+      const node *find(const key_type &key) const
+      {
+        const std::atomic<node *> *links = heads;
+        for (int level = max_height - 1; level >= 0; level--)
+        {
+          const node *n;
+          while ((n = links[level].load(std::memory_order_acquire))
+                 && comp(n->key, key))
+            links = n->next.get();
+        }
+
+        const node *n = links[0].load(std::memory_order_acquire);
+        return n && !comp(key, n->key) ? n : nullptr;
+      }
+
+      // Get the node of a key, linking a new one in if it has none, for the
+      // writer.
+      node *find_or_insert(const key_type &key);
+
+      key_compare comp;
+      std::atomic<node *> heads[max_height];
+
+      // The number of operations performed, and the number published.
+      std::uint64_t next;
+      std::atomic<std::uint64_t> published;
+
+      // The state of the generator of node heights.
+      std::uint32_t random;
+
+      // The current epoch, and the number of snapshots registered in each
+      // epoch of the same parity. Epochs only advance while the writer holds
+      // the lock, once no snapshot of the epoch before remains.
+      std::atomic<std::uint64_t> epoch;
+      mutable std::atomic<std::size_t> readers[2];
+
+      // Histories replaced in each epoch of the same parity, for the writer.
+      std::vector<typename node::chunk *> retired[2];
+
+      // The horizon of new snapshots. The writer keeps the last horizon set
+      // and the epoch from which every snapshot has it, and prunes to the
+      // latest horizon that every snapshot has.
+      std::atomic<std::uint64_t> horizon;
+      std::uint64_t pending;
+      std::uint64_t pending_epoch;
+      std::uint64_t pruned;
+    };
+
+    // Free the histories retired in the epoch before the current one and
+    // start a new epoch, if no snapshot of that epoch remains. Return
+    // whether it did.
+    bool advance(void);
+
+    std::mutex write_lock_;
+    std::shared_ptr<storage> storage_;
+}; // end versioned_full_map
+
+} // end retro
+
+#include "retro/versioned_map.inl"
@@ -0,0 +1,257 @@
+namespace retro
+{
+
+template <class Key, class T, class Compare>
+  versioned_full_map<Key, T, Compare>
+    ::versioned_full_map(const key_compare &comp)
+    : storage_(std::make_shared<storage>(comp))
+{
+}
+
+template <class Key, class T, class Compare>
+  typename versioned_full_map<Key, T, Compare>::time_point
+    versioned_full_map<Key, T, Compare>::insert(const value_type &val)
+{
+  std::lock_guard<std::mutex> guard(write_lock_);
+  storage &s = *storage_;
+
+  // An insert has no effect on a key that exists.
+  node *n = s.find_or_insert(val.first);
+  auto latest = n->latest();
+  if (!latest || !latest->live) n->append(s.next, &val.second);
+  return time_point(map::insert, s.next++);
+}
+
+template <class Key, class T, class Compare>
+  typename versioned_full_map<Key, T, Compare>::time_point
+    versioned_full_map<Key, T, Compare>::erase(const key_type &key)
+{
+  std::lock_guard<std::mutex> guard(write_lock_);
+  storage &s = *storage_;
+
+  // Only the writer changes nodes, so it may change the one it finds.
+  node *n = const_cast<node *>(s.find(key));
+  auto latest = n ? n->latest() : nullptr;
+  if (latest && latest->live) n->append(s.next, nullptr);
+  return time_point(map::erase, s.next++);
+}
+
+template <class Key, class T, class Compare>
+  typename versioned_full_map<Key, T, Compare>::time_point
+    versioned_full_map<Key, T, Compare>::assign(const key_type &key,
+                                                const mapped_type &val)
+{
+  std::lock_guard<std::mutex> guard(write_lock_);
+  storage &s = *storage_;
+
+  s.find_or_insert(key)->append(s.next, &val);
+  return time_point(map::assign, s.next++);
+}
+
+template <class Key, class T, class Compare>
+  void versioned_full_map<Key, T, Compare>::publish(void)
+{
+  std::lock_guard<std::mutex> guard(write_lock_);
+  storage_->published.store(storage_->next, std::memory_order_release);
+}
+
+template <class Key, class T, class Compare>
+  typename versioned_full_map<Key, T, Compare>::snapshot
+    versioned_full_map<Key, T, Compare>::read(void) const
+{
+  // The storage is never replaced, so copying the pointer needs no lock.
+  return snapshot(storage_);
+}
+
+template <class Key, class T, class Compare>
+  void versioned_full_map<Key, T, Compare>::forget(const time_point &horizon)
+{
+  std::lock_guard<std::mutex> guard(write_lock_);
+  storage &s = *storage_;
+
+  std::uint64_t seq = std::min(horizon.seq,
+                               s.published.load(std::memory_order_relaxed));
+  if (seq <= s.horizon.load()) return;
+
+  // Snapshots registered in the current epoch may not have the new horizon,
+  // so it is only pruned to once that epoch and the next are over. A
+  // horizon that every snapshot already has is kept in the meantime.
+  if (s.epoch.load() >= s.pending_epoch) s.pruned = s.pending;
+  s.horizon.store(seq);
+  s.pending = seq;
+  s.pending_epoch = s.epoch.load() + 2;
+}
+
+template <class Key, class T, class Compare>
+  std::size_t versioned_full_map<Key, T, Compare>::reclaim(void)
+{
+  std::lock_guard<std::mutex> guard(write_lock_);
+  storage &s = *storage_;
+
+  // Free what was retired before, which also lets a new horizon mature.
+  advance();
+  advance();
+  if (s.epoch.load() >= s.pending_epoch) s.pruned = s.pending;
+
+  std::size_t dropped = 0;
+  for (node *n = s.heads[0].load(std::memory_order_relaxed); n;
+       n = n->next[0].load(std::memory_order_relaxed))
+  {
+    auto &retired = s.retired[s.epoch.load() & 1];
+    retired.reserve(retired.size() + 1);
+    if (auto old = n->prune(s.pruned, dropped)) retired.push_back(old);
+  }
+
+  // Free the old histories at once if no snapshot is using them.
+  advance();
+  advance();
+  return dropped;
+}
+
+template <class Key, class T, class Compare>
+  bool versioned_full_map<Key, T, Compare>::advance(void)
+{
+  storage &s = *storage_;
+  std::uint64_t epoch = s.epoch.load();
+  if (s.readers[(epoch - 1) & 1].load() != 0) return false;
+
+  // Snapshots of the current epoch started after these were replaced.
+  auto &retired = s.retired[(epoch - 1) & 1];
+  for (auto c : retired) node::release(c);
+  retired.clear();
+  s.epoch.store(epoch + 1);
+  return true;
+}
+
+template <class Key, class T, class Compare>
+  versioned_full_map<Key, T, Compare>::snapshot
+    ::snapshot(std::shared_ptr<const storage> storage)
+      : storage_(std::move(storage))
+{
+  // Register in the current epoch, and again if it ended in the meantime,
+  // as the writer may then have missed the registration.
+  for (;;)
+  {
+    epoch_ = storage_->epoch.load();
+    storage_->readers[epoch_ & 1]++;
+    if (storage_->epoch.load() == epoch_) break;
+    storage_->readers[epoch_ & 1]--;
+  }
+
+  // The horizon never passes what was published, so it is read first.
+  floor_ = storage_->horizon.load();
+  bound_ = storage_->published.load(std::memory_order_acquire);
+}
+
+template <class Key, class T, class Compare>
+  typename versioned_full_map<Key, T, Compare>::node::chunk *
+    versioned_full_map<Key, T, Compare>::node
+      ::prune(std::uint64_t horizon, std::size_t &dropped)
+{
+  // Find the last event before the horizon, and count the events before it.
+  chunk *first = head.load(std::memory_order_relaxed), *from = nullptr;
+  std::size_t index = 0, skipped = 0, total = 0;
+  for (chunk *c = first; c; c = c->next.load(std::memory_order_relaxed))
+  {
+    std::size_t count = c->count.load(std::memory_order_relaxed);
+    const event *begin = c->events.get(), *end = begin + count;
+    const event *it = std::lower_bound(begin, end, horizon,
+      [](const event &e, std::uint64_t h) { return e.seq < h; });
+
+    if (it != begin)
+    {
+      from = c;
+      index = it - begin - 1;
+      skipped = total + index;
+    }
+    total += count;
+  }
+  if (!from) return nullptr;
+
+  // An erase is the same as no event before it.
+  if (!from->events[index].live)
+  {
+    skipped++;
+    if (++index == from->count.load(std::memory_order_relaxed))
+    {
+      from = from->next.load(std::memory_order_relaxed);
+      index = 0;
+    }
+  }
+  if (skipped == 0) return nullptr;
+
+  std::size_t kept = total - skipped, capacity = 2;
+  while (capacity < kept) capacity *= 2;
+
+  // Copy the rest into one block, which readers only see once it is full.
+  std::unique_ptr<chunk> fresh(new chunk(capacity));
+  try
+  {
+    for (std::size_t n = 0; from; from = from->next.load(
+                                     std::memory_order_relaxed), index = 0)
+    {
+      std::size_t count = from->count.load(std::memory_order_relaxed);
+      for (; index < count; index++, n++)
+      {
+        const event &e = from->events[index];
+        event &copy = fresh->events[n];
+        if (e.live) ::new (static_cast<void *>(&copy.storage)) T(e.value());
+        copy.seq = e.seq;
+        copy.live = e.live;
+        fresh->count.store(n + 1, std::memory_order_relaxed);
+      }
+    }
+  }
+  catch (...)
+  {
+    release(fresh.release());
+    throw;
+  }
+
+  last = fresh.get();
+  head.store(fresh.release(), std::memory_order_release);
+  dropped += skipped;
+  return first;
+}
+
+template <class Key, class T, class Compare>
+  typename versioned_full_map<Key, T, Compare>::node *
+    versioned_full_map<Key, T, Compare>::storage
+      ::find_or_insert(const key_type &key)
+{
+  // Find the link before the key on every level.
+  std::atomic<node *> *links[max_height];
+  std::atomic<node *> *level_links = heads;
+  for (int level = max_height - 1; level >= 0; level--)
+  {
+    node *n;
+    while ((n = level_links[level].load(std::memory_order_relaxed))
+           && comp(n->key, key))
+      level_links = n->next.get();
+    links[level] = &level_links[level];
+  }
+
+  node *n = links[0]->load(std::memory_order_relaxed);
+  if (n && !comp(key, n->key)) return n;
+
+  // Each level above the first holds a quarter of the nodes below it.
+  random ^= random << 13;
+  random ^= random >> 17;
+  random ^= random << 5;
+  int height = 1;
+  for (std::uint32_t bits = random; height < max_height && !(bits & 3);
+       bits >>= 2)
+    height++;
+
+  // Link the node in from the bottom up once it is complete, so that a
+  // reader that reaches it on any level can follow it down.
+  n = new node(key, height);
+  for (int level = 0; level < height; level++)
+    n->next[level].store(links[level]->load(std::memory_order_relaxed),
+                         std::memory_order_relaxed);
+  for (int level = 0; level < height; level++)
+    links[level]->store(n, std::memory_order_release);
+  return n;
+}
+
+} // end retro
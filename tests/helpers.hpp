@@ -2,8 +2,15 @@
 
 #include "retro/queue.hpp"
 #include "retro/map.hpp"
+#include "retro/detail/frozen.hpp"
 #include "retro/detail/ordered_list.hpp"
 
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+
 void insert_dummy(retro::detail::ordered_list<int> &v)
 {
   v.push_back(0);
@@ -27,3 +34,67 @@ void insert_data(Container &v, int n)
     insert_dummy(v);
 }
 
+// Change the number of events in the header of a saved container
+inline std::string with_event_count(std::string bytes, std::uint64_t events)
+{
+  std::memcpy(&bytes[offsetof(retro::detail::frozen_header, events)], &events,
+              sizeof(events));
+  return bytes;
+}
+
+// The allocations made through every copy of a counting_allocator.
+struct allocation_counts
+{
+  std::size_t allocations = 0;
+  std::size_t live = 0;
+  std::size_t live_bytes = 0;
+};
+
+// An allocator that counts its allocations. It has no default constructor,
+// so a container that makes its own allocator instead of copying the one it
+// was given fails to compile.
+template <class T>
+struct counting_allocator
+{
+  typedef T value_type;
+
+  explicit counting_allocator(allocation_counts *counts)
+    : counts(counts)
+  {
+  }
+
+  template <class U>
+  counting_allocator(const counting_allocator<U> &other)
+    : counts(other.counts)
+  {
+  }
+
+  T *allocate(std::size_t n)
+  {
+    counts->allocations++;
+    counts->live++;
+    counts->live_bytes += n * sizeof(T);
+    return std::allocator<T>().allocate(n);
+  }
+
+  void deallocate(T *p, std::size_t n)
+  {
+    counts->live--;
+    counts->live_bytes -= n * sizeof(T);
+    std::allocator<T>().deallocate(p, n);
+  }
+
+  template <class U>
+  bool operator==(const counting_allocator<U> &other) const
+  {
+    return counts == other.counts;
+  }
+
+  template <class U>
+  bool operator!=(const counting_allocator<U> &other) const
+  {
+    return counts != other.counts;
+  }
+
+  allocation_counts *counts;
+};
@@ -0,0 +1,324 @@
+#include <gtest/gtest.h>
+
+#include "retro/logged_map.hpp"
+
+#include <csignal>
+#include <cstdio>
+#include <fstream>
+
+#include <sys/resource.h>
+#include <sys/stat.h>
+
+namespace
+{
+
+const char *path = "logged_map_test.wal";
+
+// The size of a record of a logged_full_map<int, int>: its code, ordinal,
+// key, value and checksum.
+const int record_size = 1 + 8 + 4 + 4 + 4;
+
+// Append a copy of a record of one log to the end of another, keeping its
+// checksum.
+void copy_record(const char *from, int index, const char *to)
+{
+  std::ifstream is(from, std::ios::binary);
+  is.seekg(index < 0 ? index * record_size : 0, std::ios::end);
+  char bytes[record_size];
+  is.read(bytes, record_size);
+
+  std::ofstream os(to, std::ios::binary | std::ios::app);
+  os.write(bytes, record_size);
+}
+
+} // end namespace
+
+TEST(logged_full_map, replayRebuildsTheMap)
+{
+  std::remove(path);
+  {
+    retro::logged_full_map<int, int> m(64);
+    ASSERT_TRUE(m.open(path));
+
+    auto t1 = m.insert(std::make_pair(1, 10));
+    m.insert(std::make_pair(2, 20));
+    auto t3 = m.assign(1, 11);
+    m.erase(t3, 2);
+    m.insert(t1, std::make_pair(3, 30));
+    auto t6 = m.insert(std::make_pair(4, 40));
+    m.revert(t6);
+    EXPECT_EQ(5U, t6.ordinal());
+    ASSERT_TRUE(m.sync());
+  }
+
+  retro::logged_full_map<int, int> m;
+  ASSERT_TRUE(m.open(path));
+
+  EXPECT_EQ(11, m.find(1)->second);
+  EXPECT_EQ(m.end(), m.find(2));
+  EXPECT_EQ(30, m.find(3)->second);
+  EXPECT_EQ(m.end(), m.find(4));
+
+  // Time points keep their ordinals
+  auto t3 = m.at(2);
+  EXPECT_EQ(retro::map::assign, t3.operation());
+  EXPECT_EQ(10, m.find(t3, 1)->second);
+  EXPECT_EQ(m.end(t3), m.find(t3, 2));
+  EXPECT_EQ(30, m.find(m.at(0), 3)->second);
+
+  // Logging carries on after a replay
+  m.insert(std::make_pair(5, 50));
+  m.close();
+
+  retro::logged_full_map<int, int> again;
+  ASSERT_TRUE(again.open(path));
+  EXPECT_EQ(50, again.find(5)->second);
+  std::remove(path);
+}
+
+TEST(logged_full_map, partialRecordIsDiscarded)
+{
+  std::remove(path);
+  {
+    retro::logged_full_map<int, int> m;
+    ASSERT_TRUE(m.open(path));
+    m.insert(std::make_pair(1, 10));
+    m.insert(std::make_pair(2, 20));
+  }
+  {
+    // Simulate a crash part of the way through writing a record
+    std::ofstream os(path, std::ios::binary | std::ios::app);
+    os.write("\x00\x01\x02", 3);
+  }
+
+  {
+    retro::logged_full_map<int, int> m;
+    ASSERT_TRUE(m.open(path));
+    EXPECT_EQ(10, m.find(1)->second);
+    EXPECT_EQ(20, m.find(2)->second);
+    m.insert(std::make_pair(3, 30));
+  }
+
+  retro::logged_full_map<int, int> m;
+  ASSERT_TRUE(m.open(path));
+  EXPECT_EQ(30, m.find(3)->second);
+  std::remove(path);
+}
+
+TEST(logged_full_map, rejectsLogOfAnotherType)
+{
+  std::remove(path);
+  {
+    retro::logged_full_map<int, int> m;
+    ASSERT_TRUE(m.open(path));
+    m.insert(std::make_pair(1, 10));
+  }
+
+  retro::logged_full_map<int, double> m;
+  EXPECT_FALSE(m.open(path));
+  EXPECT_EQ(m.end(), m.find(1));
+  std::remove(path);
+}
+
+TEST(logged_full_map, damagedRecordsEndTheReplay)
+{
+  std::remove(path);
+  {
+    retro::logged_full_map<int, int> m;
+    ASSERT_TRUE(m.open(path));
+    m.insert(std::make_pair(1, 10));
+    m.insert(std::make_pair(2, 20));
+    m.insert(std::make_pair(3, 30));
+    ASSERT_TRUE(m.close());
+  }
+  {
+    // A file system may leave zeros at the end of a file after a crash
+    std::ofstream os(path, std::ios::binary | std::ios::app);
+    const char zeros[4 * record_size] = {};
+    os.write(zeros, sizeof(zeros));
+  }
+  {
+    retro::logged_full_map<int, int> m;
+    ASSERT_TRUE(m.open(path));
+    EXPECT_EQ(30, m.find(3)->second);
+    EXPECT_EQ(m.end(), m.find(0));
+  }
+  {
+    // Change the value in the second record
+    std::fstream fs(path, std::ios::binary | std::ios::in | std::ios::out);
+    fs.seekp(-2 * record_size + 1 + 8 + 4, std::ios::end);
+    fs.put('\x7f');
+  }
+
+  // Nothing from the damaged record onwards is replayed
+  retro::logged_full_map<int, int> m;
+  ASSERT_TRUE(m.open(path));
+  EXPECT_EQ(10, m.find(1)->second);
+  EXPECT_EQ(m.end(), m.find(2));
+  EXPECT_EQ(m.end(), m.find(3));
+  std::remove(path);
+}
+
+TEST(logged_full_map, operationsThatCannotBeLoggedAreNotPerformed)
+{
+  std::remove(path);
+  retro::logged_full_map<int, int> m(1);
+  ASSERT_TRUE(m.open(path));
+  auto t1 = m.insert(std::make_pair(1, 10));
+  ASSERT_TRUE(t1.logged());
+
+  // Only let the log grow by part of a record
+  struct stat st;
+  ASSERT_EQ(0, ::stat(path, &st));
+  rlimit old, limited;
+  ASSERT_EQ(0, ::getrlimit(RLIMIT_FSIZE, &old));
+  limited = old;
+  limited.rlim_cur = st.st_size + record_size / 2;
+  auto handler = std::signal(SIGXFSZ, SIG_IGN);
+  ASSERT_EQ(0, ::setrlimit(RLIMIT_FSIZE, &limited));
+
+  auto t2 = m.insert(std::make_pair(2, 20));
+  bool reverted = m.revert(t1);
+
+  ::setrlimit(RLIMIT_FSIZE, &old);
+  std::signal(SIGXFSZ, handler);
+
+  EXPECT_FALSE(t2.logged());
+  EXPECT_FALSE(reverted);
+  EXPECT_EQ(m.end(), m.find(2));
+  EXPECT_EQ(10, m.find(1)->second);
+
+  // The part of a record that was written is not left in the log
+  auto t3 = m.insert(std::make_pair(3, 30));
+  EXPECT_TRUE(t3.logged());
+  EXPECT_EQ(1U, t3.ordinal());
+  ASSERT_TRUE(m.close());
+
+  retro::logged_full_map<int, int> again;
+  ASSERT_TRUE(again.open(path));
+  EXPECT_EQ(10, again.find(1)->second);
+  EXPECT_EQ(again.end(), again.find(2));
+  EXPECT_EQ(30, again.find(3)->second);
+  std::remove(path);
+}
+
+TEST(logged_full_map, replaysLogsLongerThanABatch)
+{
+  std::remove(path);
+  const int n = 10000;
+  {
+    retro::logged_full_map<int, int> m;
+    ASSERT_TRUE(m.open(path));
+    for (int i = 0; i < n; i++) m.insert(std::make_pair(i, i * 2));
+    ASSERT_TRUE(m.close());
+  }
+  {
+    // Damage a record near the end, well past the first batch that is read
+    std::fstream fs(path, std::ios::binary | std::ios::in | std::ios::out);
+    fs.seekp(-10 * record_size + 1 + 8, std::ios::end);
+    fs.put('\x7f');
+  }
+
+  retro::logged_full_map<int, int> m;
+  ASSERT_TRUE(m.open(path));
+  for (int i = 0; i < n - 10; i++) ASSERT_EQ(i * 2, m.find(i)->second);
+  EXPECT_EQ(m.end(), m.find(n - 10));
+
+  // The damaged record and those after it were cut off the log
+  m.insert(std::make_pair(n, 0));
+  ASSERT_TRUE(m.close());
+  struct stat st;
+  ASSERT_EQ(0, ::stat(path, &st));
+  EXPECT_EQ(0U, (st.st_size - retro::detail::log_file::header_size())
+                % record_size);
+  std::remove(path);
+}
+
+TEST(logged_full_map, revertedOperationsCannotBeUsed)
+{
+  const char *other = "logged_map_test_other.wal";
+  std::remove(path);
+  std::remove(other);
+  {
+    retro::logged_full_map<int, int> m;
+    ASSERT_TRUE(m.open(path));
+    m.insert(std::make_pair(1, 10));
+    auto t2 = m.insert(std::make_pair(2, 20));
+    EXPECT_TRUE(m.revert(t2));
+
+    // Neither is logged, so the log still replays
+    EXPECT_FALSE(m.revert(t2));
+    EXPECT_FALSE(m.insert(t2, std::make_pair(3, 30)).logged());
+    EXPECT_FALSE(m.revert(m.present()));
+    EXPECT_EQ(m.end(), m.find(3));
+    ASSERT_TRUE(m.close());
+  }
+  {
+    // The same operations, with one more just before the second
+    retro::logged_full_map<int, int> m;
+    ASSERT_TRUE(m.open(other));
+    m.insert(std::make_pair(1, 10));
+    auto t2 = m.insert(std::make_pair(2, 20));
+    m.insert(t2, std::make_pair(3, 30));
+    ASSERT_TRUE(m.close());
+  }
+  {
+    retro::logged_full_map<int, int> m;
+    ASSERT_TRUE(m.open(path));
+    EXPECT_EQ(m.end(), m.find(2));
+  }
+
+  // A log that uses the reverted operation is damaged
+  copy_record(other, -1, path);
+  {
+    retro::logged_full_map<int, int> m;
+    EXPECT_FALSE(m.open(path));
+    EXPECT_EQ(m.end(), m.find(1));
+  }
+
+  // So is a log that reverts it again
+  std::remove(other);
+  {
+    retro::logged_full_map<int, int> m;
+    ASSERT_TRUE(m.open(other));
+    m.insert(std::make_pair(1, 10));
+    m.revert(m.insert(std::make_pair(2, 20)));
+    ASSERT_TRUE(m.close());
+  }
+  copy_record(other, -1, other);
+  {
+    retro::logged_full_map<int, int> m;
+    EXPECT_FALSE(m.open(other));
+  }
+  std::remove(path);
+  std::remove(other);
+}
+
+TEST(logged_full_map, unknownOrdinalsAndLateOpensAreRejected)
+{
+  std::remove(path);
+  {
+    retro::logged_full_map<int, int> m;
+    ASSERT_TRUE(m.open(path));
+    m.insert(std::make_pair(1, 10));
+    ASSERT_TRUE(m.close());
+  }
+
+  // A map that already has operations would replay the log at the wrong
+  // ordinals, so it is left as it is.
+  retro::logged_full_map<int, int> m;
+  m.insert(std::make_pair(2, 20));
+  EXPECT_FALSE(m.open(path));
+  EXPECT_EQ(20, m.find(2)->second);
+  EXPECT_EQ(m.end(), m.find(1));
+
+  // An ordinal past the last operation gives a time point that cannot be
+  // used.
+  EXPECT_TRUE(m.at(0).logged());
+  auto t = m.at(5);
+  EXPECT_FALSE(t.logged());
+  EXPECT_FALSE(m.insert(t, std::make_pair(3, 30)).logged());
+  EXPECT_FALSE(m.revert(t));
+  EXPECT_EQ(m.end(), m.find(3));
+  std::remove(path);
+}
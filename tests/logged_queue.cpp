@@ -0,0 +1,129 @@
+#include <gtest/gtest.h>
+
+#include "retro/logged_queue.hpp"
+
+#include <cstdio>
+#include <fstream>
+
+TEST(logged_partial_queue, replayRebuildsTheQueue)
+{
+  const char *path = "logged_queue_test.wal";
+  std::remove(path);
+  {
+    retro::logged_partial_queue<int> q(16);
+    ASSERT_TRUE(q.open(path));
+
+    auto t1 = q.push(1);
+    q.push(2);
+    q.push(3);
+    q.pop();
+    q.push(t1, 0);
+    auto t6 = q.push(4);
+    q.revert(t6);
+  }
+
+  retro::logged_partial_queue<int> q;
+  ASSERT_TRUE(q.open(path));
+  ASSERT_EQ(3U, q.size());
+  EXPECT_EQ(1, q.front());
+  EXPECT_EQ(3, q.back());
+  EXPECT_EQ(retro::queue::pop, q.at(3).operation());
+
+  q.pop();
+  q.close();
+
+  retro::logged_partial_queue<int> again;
+  ASSERT_TRUE(again.open(path));
+  ASSERT_EQ(2U, again.size());
+  EXPECT_EQ(2, again.front());
+  std::remove(path);
+}
+
+TEST(logged_partial_queue, damagedTailIsNotReplayed)
+{
+  const char *path = "logged_queue_test.wal";
+  std::remove(path);
+  {
+    retro::logged_partial_queue<int> q;
+    ASSERT_TRUE(q.open(path));
+    EXPECT_TRUE(q.push(1).logged());
+    EXPECT_TRUE(q.push(2).logged());
+    EXPECT_TRUE(q.close());
+  }
+  {
+    std::ofstream os(path, std::ios::binary | std::ios::app);
+    const char zeros[64] = {};
+    os.write(zeros, sizeof(zeros));
+  }
+
+  retro::logged_partial_queue<int> q;
+  ASSERT_TRUE(q.open(path));
+  ASSERT_EQ(2U, q.size());
+  EXPECT_EQ(1, q.front());
+  EXPECT_EQ(2, q.back());
+  EXPECT_TRUE(q.revert(q.at(1)));
+  EXPECT_EQ(1U, q.size());
+  std::remove(path);
+}
+
+TEST(logged_partial_queue, secondRevertIsRejected)
+{
+  const char *path = "logged_queue_test.wal";
+  std::remove(path);
+  {
+    retro::logged_partial_queue<int> q;
+    ASSERT_TRUE(q.open(path));
+    q.push(1);
+    auto t2 = q.push(2);
+    EXPECT_TRUE(q.revert(t2));
+    EXPECT_FALSE(q.revert(t2));
+    EXPECT_FALSE(q.push(t2, 3).logged());
+    EXPECT_EQ(1U, q.size());
+    EXPECT_TRUE(q.close());
+  }
+  {
+    retro::logged_partial_queue<int> q;
+    ASSERT_TRUE(q.open(path));
+    EXPECT_EQ(1U, q.size());
+  }
+  {
+    // Log the revert a second time, with an intact checksum
+    const int record_size = 1 + 8 + 4 + 4;
+    char bytes[record_size];
+    std::ifstream is(path, std::ios::binary);
+    is.seekg(-record_size, std::ios::end);
+    is.read(bytes, record_size);
+    std::ofstream os(path, std::ios::binary | std::ios::app);
+    os.write(bytes, record_size);
+  }
+
+  retro::logged_partial_queue<int> q;
+  EXPECT_FALSE(q.open(path));
+  EXPECT_TRUE(q.empty());
+  std::remove(path);
+}
+
+TEST(logged_partial_queue, unknownOrdinalsAndLateOpensAreRejected)
+{
+  const char *path = "logged_queue_test.wal";
+  std::remove(path);
+  {
+    retro::logged_partial_queue<int> q;
+    ASSERT_TRUE(q.open(path));
+    q.push(1);
+    ASSERT_TRUE(q.close());
+  }
+
+  retro::logged_partial_queue<int> q;
+  q.push(2);
+  EXPECT_FALSE(q.open(path));
+  ASSERT_EQ(1U, q.size());
+  EXPECT_EQ(2, q.front());
+
+  auto t = q.at(5);
+  EXPECT_FALSE(t.logged());
+  EXPECT_FALSE(q.push(t, 3).logged());
+  EXPECT_FALSE(q.revert(t));
+  EXPECT_EQ(1U, q.size());
+  std::remove(path);
+}
@@ -1,6 +1,18 @@
 #include <gtest/gtest.h>
 
 #include "retro/map.hpp"
+#include "helpers.hpp"
+
+#include <string>
+#include <vector>
+#include <sstream>
+#include <iterator>
+#include <map>
+#include <stdexcept>
+#include <algorithm>
+#include <cstdint>
+#include <random>
+#include <type_traits>
 
 TEST(full_map, canFindInsertedElements)
 {
@@ -135,3 +147,1258 @@ TEST(full_map, retroactiveInsertionsCanBeRetroactivelyFound)
   EXPECT_EQ(2, m.find(t3, 2)->second);
   EXPECT_EQ(m.end(t3), m.find(t3, 3));
 }
+
+TEST(full_map, boundsSkipKeysThatDoNotExistAtPresent)
+{
+  retro::full_map<int, int> m;
+  auto t3 = m.insert(std::make_pair(3, 3));
+  m.insert(std::make_pair(1, 1));
+  m.insert(std::make_pair(5, 5));
+  m.insert(t3, std::make_pair(7, 7));
+
+  EXPECT_EQ(1, m.lower_bound(0)->first);
+  EXPECT_EQ(3, m.lower_bound(2)->first);
+  EXPECT_EQ(3, m.lower_bound(3)->first);
+  EXPECT_EQ(5, m.upper_bound(3)->first);
+  EXPECT_EQ(m.end(), m.lower_bound(8));
+  EXPECT_EQ(m.end(), m.upper_bound(7));
+
+  auto range = m.equal_range(5);
+  EXPECT_EQ(5, range.first->first);
+  EXPECT_EQ(7, range.second->first);
+
+  range = m.equal_range(4);
+  EXPECT_EQ(range.first, range.second);
+}
+
+TEST(full_map, boundsCanBeRetroactivelyFound)
+{
+  retro::full_map<int, int> m;
+  auto t1 = m.insert(std::make_pair(1, 1));
+  auto t4 = m.insert(std::make_pair(4, 4));
+  auto t2 = m.insert(t4, std::make_pair(2, 2));
+  auto t3 = m.insert(std::make_pair(3, 3));
+
+  // Before t1, the map is empty
+  EXPECT_EQ(m.end(t1), m.lower_bound(t1, 0));
+  EXPECT_EQ(m.end(t1), m.upper_bound(t1, 0));
+
+  // Before t2, the map contains '1'
+  EXPECT_EQ(1, m.lower_bound(t2, 1)->first);
+  EXPECT_EQ(m.end(t2), m.upper_bound(t2, 1));
+
+  // Before t4, the map contains '1', '2'
+  EXPECT_EQ(2, m.lower_bound(t4, 2)->first);
+  EXPECT_EQ(m.end(t4), m.lower_bound(t4, 3));
+
+  // Before t3, the map contains '1', '2', '4'
+  EXPECT_EQ(4, m.lower_bound(t3, 3)->first);
+  EXPECT_EQ(4, m.upper_bound(t3, 2)->first);
+
+  auto range = m.equal_range(t3, 2);
+  EXPECT_EQ(2, range.first->first);
+  EXPECT_EQ(4, range.second->first);
+
+  range = m.equal_range(t3, 3);
+  EXPECT_EQ(range.first, range.second);
+  EXPECT_EQ(4, range.first->first);
+}
+
+TEST(full_map, erasedElementsCannotBeFound)
+{
+  retro::full_map<int, int> m;
+  m.insert(std::make_pair(1, 1));
+  m.insert(std::make_pair(2, 2));
+  m.erase(1);
+  m.erase(3);
+
+  EXPECT_EQ(m.end(), m.find(1));
+  EXPECT_EQ(2, m.find(2)->second);
+  EXPECT_EQ(m.end(), m.find(3));
+  EXPECT_EQ(2, m.begin()->first);
+}
+
+TEST(full_map, retroactiveEraseOnlyAffectsLaterTimePoints)
+{
+  retro::full_map<int, int> m;
+  auto t1 = m.insert(std::make_pair(1, 1));
+  auto t2 = m.insert(std::make_pair(2, 2));
+  auto t3 = m.insert(std::make_pair(3, 3));
+  auto e1 = m.erase(t3, 1);
+
+  // Before the erase, '1' still exists
+  EXPECT_EQ(1, m.find(e1, 1)->second);
+  EXPECT_EQ(1, m.find(t2, 1)->second);
+
+  // After the erase, '1' is gone
+  EXPECT_EQ(m.end(t3), m.find(t3, 1));
+  EXPECT_EQ(m.end(), m.find(1));
+  EXPECT_EQ(2, m.begin(t3)->first);
+
+  // Erasing a key before it is inserted has no effect
+  m.erase(t1, 2);
+  EXPECT_EQ(2, m.find(2)->second);
+
+  // A key that is erased can be inserted again
+  auto t4 = m.insert(std::make_pair(1, 4));
+  EXPECT_EQ(m.end(t4), m.find(t4, 1));
+  EXPECT_EQ(4, m.find(1)->second);
+}
+
+TEST(full_dense_map, canFindInsertedElements)
+{
+  retro::full_dense_map<unsigned, int> m;
+
+  m.insert(std::make_pair(5U, 5));
+  m.insert(std::make_pair(1U, 1));
+  m.insert(std::make_pair(3U, 3));
+  m.erase(3U);
+
+  EXPECT_EQ(1, m.find(1U)->second);
+  EXPECT_EQ(5, m.find(5U)->second);
+  EXPECT_EQ(m.end(), m.find(0U));
+  EXPECT_EQ(m.end(), m.find(3U));
+  EXPECT_EQ(m.end(), m.find(100U));
+
+  auto it = m.begin();
+  EXPECT_EQ(1U, it->first);
+  ++it;
+  EXPECT_EQ(5U, it->first);
+  ++it;
+  EXPECT_EQ(m.end(), it);
+}
+
+TEST(full_dense_map, retroactiveOperationsCanBeRetroactivelyFound)
+{
+  retro::full_dense_map<int, int> m;
+  auto t3 = m.insert(std::make_pair(3, 3));
+  auto t1 = m.insert(t3, std::make_pair(1, 1));
+  auto t2 = m.erase(t3, 1);
+
+  // Before t1, the map is empty
+  EXPECT_EQ(m.end(t1), m.begin(t1));
+  EXPECT_EQ(m.end(t1), m.find(t1, 1));
+
+  // Before t2, the map contains '1'
+  EXPECT_EQ(1, m.find(t2, 1)->second);
+  EXPECT_EQ(1, m.lower_bound(t2, 0)->first);
+  EXPECT_EQ(m.end(t2), m.upper_bound(t2, 1));
+
+  // Before t3, '1' has been erased
+  EXPECT_EQ(m.end(t3), m.find(t3, 1));
+  EXPECT_EQ(m.end(t3), m.begin(t3));
+
+  // At present, only '3' exists
+  EXPECT_EQ(3, m.begin()->first);
+  EXPECT_EQ(3, m.lower_bound(2)->first);
+  EXPECT_EQ(m.end(), m.upper_bound(3));
+}
+
+TEST(full_dense_map, loadRejectsNegativeKeys)
+{
+  retro::full_map<int, int> m;
+  m.insert(std::make_pair(-1, 1));
+  m.insert(std::make_pair(3, 3));
+
+  std::stringstream ss;
+  ASSERT_TRUE(m.save(ss));
+
+  // The file is well formed, but a dense map cannot hold its first key.
+  retro::full_dense_map<int, int> loaded;
+  loaded.insert(std::make_pair(2, 2));
+  EXPECT_FALSE(loaded.load(ss));
+  EXPECT_EQ(2, loaded.find(2)->second);
+}
+
+TEST(full_dense_map, negativeKeysAreRejected)
+{
+  retro::full_dense_map<int, int> m;
+  auto t = m.insert(std::make_pair(2, 2));
+
+  EXPECT_THROW(m.insert(std::make_pair(-1, 1)), std::out_of_range);
+  EXPECT_THROW(m.assign(t, -5, 5), std::out_of_range);
+
+  // Queries treat negative keys as absent rather than as huge slots
+  EXPECT_EQ(m.end(), m.find(-1));
+  EXPECT_EQ(2, m.lower_bound(-1)->first);
+  EXPECT_EQ(2, m.upper_bound(-1)->first);
+  EXPECT_EQ(2, m.begin()->first);
+  EXPECT_EQ(m.end(t), m.find(t, -1));
+}
+
+TEST(full_map, revertingOperationsUndoesThem)
+{
+  retro::full_map<int, std::string> m;
+  auto t1 = m.insert(std::make_pair(1, "a"));
+  auto t2 = m.insert(std::make_pair(2, "b"));
+  auto e1 = m.erase(1);
+  auto t3 = m.insert(std::make_pair(1, "c"));
+
+  EXPECT_EQ("c", m.find(1)->second);
+
+  // Without the second insert, '1' stays erased
+  m.revert(t3);
+  EXPECT_EQ(m.end(), m.find(1));
+
+  // Without the erase, the first insert of '1' is visible again
+  m.revert(e1);
+  EXPECT_EQ("a", m.find(1)->second);
+  EXPECT_EQ("a", m.find(t2, 1)->second);
+
+  // Without any operations on '1', it is gone from every time point
+  m.revert(t1);
+  EXPECT_EQ(m.end(), m.find(1));
+  EXPECT_EQ(m.end(t2), m.find(t2, 1));
+  EXPECT_EQ(2, m.begin()->first);
+  EXPECT_EQ(m.end(t2), m.begin(t2));
+}
+
+TEST(full_map, revertedStorageIsReused)
+{
+  retro::full_map<int, int> m;
+
+  for (int i = 0; i < 100; i++)
+    m.revert(m.insert(std::make_pair(i, i)));
+
+  EXPECT_EQ(m.end(), m.begin());
+
+  auto t = m.insert(std::make_pair(1, 1));
+  EXPECT_EQ(1, m.find(1)->second);
+  EXPECT_EQ(m.end(t), m.begin(t));
+}
+
+TEST(full_map, valuesDoNotMoveAsTheMapGrows)
+{
+  // Values need not be default constructible.
+  struct value
+  {
+    explicit value(int n) : n(n) { }
+    int n;
+  };
+
+  retro::full_map<int, value> m;
+  m.insert(std::make_pair(0, value(0)));
+  const value *first = &m.find(0)->second;
+  auto t = m.insert(std::make_pair(1, value(1)));
+
+  for (int i = 2; i < 1000; i++)
+  {
+    m.insert(std::make_pair(i, value(i)));
+    if (i % 3 == 0) m.revert(m.assign(i, value(-i)));
+  }
+
+  EXPECT_EQ(first, &m.find(0)->second);
+  EXPECT_EQ(first, &m.find(t, 0)->second);
+  EXPECT_EQ(999, m.find(999)->second.n);
+  EXPECT_EQ(3, m.find(3)->second.n);
+}
+
+TEST(full_map, assignOverwritesFromItsTimePointOnwards)
+{
+  retro::full_map<int, int> m;
+  auto t1 = m.insert(std::make_pair(1, 1));
+  auto a2 = m.assign(1, 2);
+  auto a3 = m.assign(1, 3);
+
+  EXPECT_EQ(3, m.find(1)->second);
+  EXPECT_EQ(2, m.find(a3, 1)->second);
+  EXPECT_EQ(1, m.find(a2, 1)->second);
+  EXPECT_EQ(m.end(t1), m.find(t1, 1));
+
+  // A retroactive assign only lasts until the next operation on the key
+  auto a4 = m.assign(a3, 1, 4);
+  EXPECT_EQ(4, m.find(a3, 1)->second);
+  EXPECT_EQ(2, m.find(a4, 1)->second);
+  EXPECT_EQ(3, m.find(1)->second);
+
+  // Reverting an assign exposes the previous value
+  m.revert(a3);
+  EXPECT_EQ(4, m.find(1)->second);
+}
+
+TEST(full_map, assignInsertsMissingKeys)
+{
+  retro::full_map<int, int> m;
+  auto a1 = m.assign(1, 1);
+  auto e1 = m.erase(1);
+  m.assign(2, 2);
+
+  EXPECT_EQ(m.end(), m.find(1));
+  EXPECT_EQ(1, m.find(e1, 1)->second);
+  EXPECT_EQ(m.end(a1), m.find(a1, 1));
+  EXPECT_EQ(2, m.begin()->first);
+
+  m.assign(e1, 1, 5);
+  EXPECT_EQ(m.end(), m.find(1));
+  EXPECT_EQ(5, m.find(e1, 1)->second);
+}
+
+TEST(full_map, insertIgnoresKeysThatExistButAssignDoesNot)
+{
+  retro::full_map<int, int> m;
+  auto t1 = m.insert(std::make_pair(1, 1));
+  auto t2 = m.insert(std::make_pair(2, 2));
+  auto e1 = m.erase(1);
+
+  // Key 1 exists just before t2, so only the assign changes it there
+  m.insert(t2, std::make_pair(1, 3));
+  EXPECT_EQ(1, m.find(t2, 1)->second);
+  EXPECT_EQ(1, m.find(e1, 1)->second);
+  auto a4 = m.assign(e1, 1, 4);
+  EXPECT_EQ(4, m.find(e1, 1)->second);
+  EXPECT_EQ(1, m.find(t2, 1)->second);
+
+  // Present inserts behave the same way
+  m.insert(std::make_pair(2, 5));
+  EXPECT_EQ(2, m.find(2)->second);
+  m.assign(2, 6);
+  EXPECT_EQ(6, m.find(2)->second);
+
+  // Without the first insert, the next one takes effect
+  m.revert(t1);
+  EXPECT_EQ(3, m.find(t2, 1)->second);
+  EXPECT_EQ(4, m.find(e1, 1)->second);
+  m.revert(a4);
+  EXPECT_EQ(3, m.find(e1, 1)->second);
+
+  // Every other query agrees with find
+  std::vector<int> keys = { 1, 2 };
+  std::vector<retro::full_map<int, int>::retro_iterator> found;
+  m.find_many(e1, keys.begin(), keys.end(), std::back_inserter(found));
+  EXPECT_EQ(3, found[0]->second);
+  auto first = m.begin(e1);
+  EXPECT_EQ(3, first->second);
+  EXPECT_EQ(1, first->first);
+
+  // Compacting keeps the value that the ignored inserts did not change
+  m.assign(1, 7);
+  m.insert(std::make_pair(1, 8));
+  m.compact(m.present());
+  EXPECT_EQ(7, m.find(1)->second);
+  EXPECT_EQ(6, m.find(2)->second);
+}
+
+TEST(full_map, valuesMatchAReplayOfRandomRetroactiveOperations)
+{
+  typedef retro::full_map<int, int> map_type;
+  struct operation
+  {
+    map_type::time_point t;
+    retro::map op;
+    int key, val;
+  };
+
+  // The operations in time order, replayed to find the value of a key just
+  // before a position.
+  std::vector<operation> ops;
+  auto replay = [&ops](std::size_t before, int key)
+  {
+    int val = -1;
+    for (std::size_t i = 0; i < before; i++)
+    {
+      if (ops[i].key != key) continue;
+      if (ops[i].op == retro::map::erase) val = -1;
+      else if (ops[i].op == retro::map::assign || val == -1) val = ops[i].val;
+    }
+    return val;
+  };
+
+  map_type m;
+  std::mt19937 rng(7);
+  for (int step = 0; step < 2000; step++)
+  {
+    std::size_t pos = rng() % (ops.size() + 1);
+    int key = rng() % 3, val = step;
+    if (!ops.empty() && rng() % 4 == 0)
+    {
+      pos = rng() % ops.size();
+      m.revert(ops[pos].t);
+      ops.erase(ops.begin() + pos);
+    }
+    else
+    {
+      auto t = pos == ops.size() ? m.present() : ops[pos].t;
+      operation o = { t, retro::map(rng() % 3), key, val };
+      if (o.op == retro::map::insert)
+        o.t = m.insert(t, std::make_pair(key, val));
+      else if (o.op == retro::map::erase)
+        o.t = m.erase(t, key);
+      else
+        o.t = m.assign(t, key, val);
+      ops.insert(ops.begin() + pos, o);
+    }
+
+    // Check a few time points after every change, and all of them at times.
+    std::size_t checks = step % 100 == 0 ? ops.size() : 3;
+    for (std::size_t c = 0; c < checks && !ops.empty(); c++)
+    {
+      std::size_t at = checks == 3 ? rng() % ops.size() : c;
+      for (int k = 0; k < 3; k++)
+      {
+        auto it = m.find(ops[at].t, k);
+        int expected = replay(at, k);
+        ASSERT_EQ(expected == -1, it == m.end(ops[at].t));
+        if (expected != -1)
+        {
+          ASSERT_EQ(expected, it->second);
+        }
+      }
+    }
+  }
+
+  for (int k = 0; k < 3; k++)
+  {
+    int expected = replay(ops.size(), k);
+    if (expected == -1)
+    {
+      EXPECT_EQ(m.end(), m.find(k));
+    }
+    else
+    {
+      EXPECT_EQ(expected, m.find(k)->second);
+    }
+  }
+}
+
+TEST(full_map, lifetimesSpanInsertsToErases)
+{
+  retro::full_map<int, int> m;
+  EXPECT_TRUE(m.lifetimes(1).empty());
+
+  auto t1 = m.insert(std::make_pair(1, 1));
+  m.assign(1, 2);
+  auto e1 = m.erase(1);
+  m.erase(1);
+  auto t2 = m.assign(1, 3);
+  m.insert(std::make_pair(1, 4));
+
+  auto lifetimes = m.lifetimes(1);
+  ASSERT_EQ(2U, lifetimes.size());
+  EXPECT_TRUE(lifetimes[0].first == t1);
+  EXPECT_TRUE(lifetimes[0].second == e1);
+  EXPECT_TRUE(lifetimes[1].first == t2);
+  EXPECT_TRUE(lifetimes[1].second == m.present());
+
+  // A retroactive insert inside an interval doesn't split it, but one inside
+  // a gap starts a new interval.
+  m.insert(e1, std::make_pair(1, 5));
+  auto t3 = m.insert(t2, std::make_pair(1, 6));
+  lifetimes = m.lifetimes(1);
+  ASSERT_EQ(2U, lifetimes.size());
+  EXPECT_TRUE(lifetimes[0].first == t1);
+  EXPECT_TRUE(lifetimes[1].first == t3);
+}
+
+TEST(full_map, presentTimePointQueriesThePresent)
+{
+  retro::full_map<int, int> m;
+  m.insert(std::make_pair(1, 1));
+  m.insert(m.present(), std::make_pair(2, 2));
+  m.erase(m.present(), 1);
+
+  EXPECT_EQ(m.end(m.present()), m.find(m.present(), 1));
+  EXPECT_EQ(2, m.find(m.present(), 2)->second);
+  EXPECT_EQ(2, m.begin(m.present())->first);
+}
+
+TEST(full_map, diffListsKeysThatChangedBetweenTimePoints)
+{
+  typedef std::vector<std::pair<int, retro::map>> changes;
+
+  retro::full_map<int, int> m;
+  auto t1 = m.insert(std::make_pair(1, 1));
+  m.insert(std::make_pair(2, 2));
+  m.insert(std::make_pair(3, 3));
+  auto t2 = m.erase(2);
+  m.assign(3, 4);
+  m.insert(std::make_pair(4, 4));
+  m.erase(4);
+  auto t3 = m.insert(std::make_pair(5, 5));
+
+  changes result;
+  m.diff(t2, t3, std::back_inserter(result));
+  EXPECT_EQ(changes({ { 2, retro::map::erase }, { 3, retro::map::assign } }),
+            result);
+
+  // The reverse diff undoes those changes
+  result.clear();
+  m.diff(t3, t2, std::back_inserter(result));
+  EXPECT_EQ(changes({ { 2, retro::map::insert }, { 3, retro::map::assign } }),
+            result);
+
+  result.clear();
+  m.diff(t1, m.present(), std::back_inserter(result));
+  EXPECT_EQ(changes({ { 1, retro::map::insert }, { 3, retro::map::insert },
+                      { 5, retro::map::insert } }), result);
+
+  result.clear();
+  m.diff(t2, t2, std::back_inserter(result));
+  EXPECT_TRUE(result.empty());
+}
+
+TEST(full_map, findManyIsEquivalentToFind)
+{
+  retro::full_map<int, int> m;
+  std::vector<retro::full_map<int, int>::time_point> times;
+
+  for (int i = 0; i < 100; i++)
+    times.push_back(m.insert(std::make_pair(i * 2, i)));
+  for (int i = 0; i < 100; i += 3)
+    times.push_back(m.erase(times[i + 1], i * 2));
+  for (int i = 0; i < 100; i += 5)
+    times.push_back(m.assign(times[i / 2], i * 2, -i));
+
+  // Sorted keys, unsorted keys and missing keys
+  std::vector<int> keys;
+  for (int i = -10; i < 210; i++) keys.push_back(i);
+  for (int i = 210; i > -10; i -= 7) keys.push_back(i);
+
+  times.push_back(m.present());
+  for (auto t : times)
+  {
+    std::vector<retro::full_map<int, int>::retro_iterator> found;
+    m.find_many(t, keys.begin(), keys.end(), std::back_inserter(found));
+
+    ASSERT_EQ(keys.size(), found.size());
+    for (std::size_t i = 0; i < keys.size(); i++)
+    {
+      auto expected = m.find(t, keys[i]);
+      ASSERT_EQ(expected, found[i]);
+      if (expected != m.end(t))
+      {
+        EXPECT_EQ(expected->second, found[i]->second);
+      }
+    }
+  }
+}
+
+TEST(full_map, sweepIsEquivalentToFind)
+{
+  retro::full_map<int, int> m;
+  std::vector<retro::full_map<int, int>::time_point> times;
+
+  for (int i = 0; i < 100; i++)
+  {
+    if (i % 7 == 0)
+      times.push_back(m.erase(1));
+    else if (i % 3 == 0)
+      times.push_back(m.assign(1, i));
+    else
+      times.push_back(m.insert(std::make_pair(i % 5, i)));
+  }
+  times.push_back(m.present());
+
+  // Time points in order, followed by some out of order
+  std::vector<retro::full_map<int, int>::time_point> queries(times);
+  for (int i = 100; i >= 0; i -= 9) queries.push_back(times[i]);
+
+  for (int key = 0; key < 6; key++)
+  {
+    std::vector<retro::full_map<int, int>::retro_iterator> found;
+    m.sweep(key, queries.begin(), queries.end(), std::back_inserter(found));
+
+    ASSERT_EQ(queries.size(), found.size());
+    for (std::size_t i = 0; i < queries.size(); i++)
+    {
+      auto expected = m.find(queries[i], key);
+      ASSERT_EQ(expected, found[i]);
+      if (expected != m.end(queries[i]))
+      {
+        EXPECT_EQ(expected->second, found[i]->second);
+      }
+    }
+  }
+}
+
+TEST(full_map, copyIsIndependent)
+{
+  retro::full_map<int, std::string> m;
+  auto t1 = m.insert(std::make_pair(1, std::string("one")));
+  auto t2 = m.insert(std::make_pair(2, std::string("two")));
+
+  auto f = m;
+  auto copy = m;
+
+  f.erase(1);
+  m.assign(2, "deux");
+  m.insert(t2, std::make_pair(3, std::string("three")));
+
+  // Each map only sees its own changes
+  EXPECT_EQ("three", m.find(3)->second);
+  EXPECT_NE(m.end(), m.find(1));
+  EXPECT_EQ("deux", m.find(2)->second);
+  EXPECT_EQ(f.end(), f.find(1));
+  EXPECT_EQ("two", f.find(2)->second);
+  EXPECT_EQ(f.end(), f.find(3));
+  EXPECT_NE(copy.end(), copy.find(1));
+  EXPECT_EQ("two", copy.find(2)->second);
+
+  // Time points from before the copy are valid in both maps
+  EXPECT_EQ("one", m.find(t2, 1)->second);
+  EXPECT_EQ("one", f.find(t2, 1)->second);
+  EXPECT_EQ(m.end(t1), m.find(t1, 1));
+  EXPECT_EQ(f.end(t1), f.find(t1, 1));
+
+  f.revert(t1);
+  EXPECT_EQ(f.end(), f.find(1));
+  EXPECT_NE(m.end(), m.find(1));
+  EXPECT_EQ("one", m.find(t2, 1)->second);
+}
+
+TEST(full_map, copiesAreMadeAtOnce)
+{
+  typedef counting_allocator<std::pair<const int, int>> allocator_type;
+  allocation_counts counts;
+  retro::full_map<int, int, std::less<int>, allocator_type>
+    m{std::less<int>(), allocator_type(&counts)};
+  auto t = m.insert(std::make_pair(0, 0));
+  for (int i = 1; i < 100; i++)
+    m.insert(std::make_pair(i, i));
+
+  // A copy allocates its own events up front, so changing either map later
+  // only allocates for that change.
+  std::size_t before = counts.allocations;
+  auto copy = m;
+  EXPECT_LT(before + 100, counts.allocations);
+  before = counts.allocations;
+  copy.erase(5);
+  m.erase(6);
+  EXPECT_GT(before + 20, counts.allocations);
+
+  EXPECT_EQ(copy.end(), copy.find(5));
+  EXPECT_EQ(6, copy.find(6)->second);
+  EXPECT_EQ(5, m.find(5)->second);
+  EXPECT_EQ(m.end(), m.find(6));
+  EXPECT_EQ(m.end(t), m.find(t, 0));
+  EXPECT_EQ(copy.end(t), copy.find(t, 0));
+
+  copy = m;
+  EXPECT_EQ(copy.end(), copy.find(6));
+  EXPECT_EQ(5, copy.find(5)->second);
+}
+
+TEST(full_map, timePointsAfterACopyOnlyReferToTheirOwnMap)
+{
+  retro::full_map<int, int> a;
+  auto t0 = a.insert(std::make_pair(1, 1));
+
+  auto b = a;
+  auto ta = a.insert(std::make_pair(2, 2));
+  auto tb = b.insert(std::make_pair(3, 3));
+  EXPECT_NE(ta, tb);
+
+  // Neither map accepts the other's new time points, rather than acting at
+  // present, and a rejected operation changes nothing.
+  EXPECT_THROW(b.insert(ta, std::make_pair(4, 4)), std::invalid_argument);
+  EXPECT_THROW(a.erase(tb, 1), std::invalid_argument);
+  EXPECT_THROW(b.find(ta, 2), std::invalid_argument);
+  EXPECT_THROW(a.begin(tb), std::invalid_argument);
+  EXPECT_THROW(b.revert(ta), std::invalid_argument);
+  EXPECT_THROW(a.compact(tb), std::invalid_argument);
+  EXPECT_EQ(2, a.find(2)->second);
+  EXPECT_EQ(1, a.find(1)->second);
+  EXPECT_EQ(b.end(), b.find(2));
+  EXPECT_EQ(b.end(), b.find(4));
+
+  // Nor does a map accept those of a map it was never copied from.
+  retro::full_map<int, int> c;
+  auto tc = c.insert(std::make_pair(1, 1));
+  EXPECT_THROW(a.find(tc, 1), std::invalid_argument);
+  EXPECT_EQ(1, a.find(c.present(), 1)->second);
+
+  // Time points from before the copy still work in both, and so do their
+  // own ones after either of them copies its state.
+  a.insert(t0, std::make_pair(6, 6));
+  b.insert(t0, std::make_pair(7, 7));
+  a.insert(ta, std::make_pair(8, 8));
+  b.insert(tb, std::make_pair(9, 9));
+  EXPECT_EQ(a.end(t0), a.find(t0, 1));
+  EXPECT_EQ(6, a.find(t0, 6)->second);
+  EXPECT_EQ(7, b.find(t0, 7)->second);
+  EXPECT_EQ(8, a.find(ta, 8)->second);
+  EXPECT_EQ(a.end(ta), a.find(ta, 2));
+  EXPECT_EQ(9, b.find(tb, 9)->second);
+  EXPECT_EQ(b.end(tb), b.find(tb, 3));
+
+  std::ostringstream as, bs;
+  EXPECT_TRUE(a.save(as));
+  EXPECT_TRUE(b.save(bs));
+}
+
+TEST(full_map, movingLeavesTheSourceEmpty)
+{
+  typedef counting_allocator<std::pair<const int, int>> allocator_type;
+  allocation_counts counts;
+  retro::full_map<int, int, std::less<int>, allocator_type>
+    m{std::less<int>(), allocator_type(&counts)};
+  for (int i = 0; i < 100; i++)
+    m.insert(std::make_pair(i, i));
+
+  auto taken = std::move(m);
+  EXPECT_EQ(m.end(), m.begin());
+  EXPECT_EQ(50, taken.find(50)->second);
+
+  // Changing the source does not copy the state it gave away.
+  std::size_t before = counts.allocations;
+  m.insert(std::make_pair(1, 2));
+  EXPECT_GT(before + 10, counts.allocations);
+  EXPECT_EQ(2, m.find(1)->second);
+  EXPECT_EQ(1, taken.find(1)->second);
+
+  m = std::move(taken);
+  EXPECT_EQ(taken.end(), taken.begin());
+  EXPECT_EQ(50, m.find(50)->second);
+  before = counts.allocations;
+  taken.insert(std::make_pair(1, 3));
+  EXPECT_GT(before + 10, counts.allocations);
+  EXPECT_EQ(1, m.find(1)->second);
+}
+
+TEST(full_map, movesAllocateNothingAndCannotThrow)
+{
+  typedef retro::full_map<int, int> map_type;
+  static_assert(std::is_nothrow_move_constructible<map_type>::value,
+                "moving a map must not throw");
+  static_assert(std::is_nothrow_move_assignable<map_type>::value,
+                "moving a map must not throw");
+
+  typedef counting_allocator<std::pair<const int, int>> allocator_type;
+  allocation_counts counts;
+  retro::full_map<int, int, std::less<int>, allocator_type>
+    m{std::less<int>(), allocator_type(&counts)};
+  m.insert(std::make_pair(1, 1));
+
+  std::size_t before = counts.allocations;
+  auto taken = std::move(m);
+  m = std::move(taken);
+  taken = std::move(m);
+  EXPECT_EQ(before, counts.allocations);
+  EXPECT_EQ(1, taken.find(1)->second);
+
+  // A vector of maps moves them as it grows, so values are not copied.
+  std::vector<map_type> maps(1);
+  maps[0].insert(std::make_pair(1, 1));
+  const int *value = &maps[0].find(1)->second;
+  for (int i = 0; i < 100; i++) maps.emplace_back();
+  EXPECT_EQ(value, &maps[0].find(1)->second);
+}
+
+TEST(full_map, logConstructionMatchesReplay)
+{
+  typedef retro::full_map<int, int> map_type;
+  std::vector<map_type::log_entry> log;
+  for (int i = 0; i < 20000; i++)
+  {
+    retro::map op = i % 7 == 0 ? retro::map::erase
+                  : i % 3 == 0 ? retro::map::assign : retro::map::insert;
+    log.push_back(map_type::log_entry(op, (i * 7919) % 1000, i));
+  }
+
+  map_type replayed;
+  for (auto &entry : log)
+  {
+    if (std::get<0>(entry) == retro::map::erase)
+      replayed.erase(std::get<1>(entry));
+    else if (std::get<0>(entry) == retro::map::assign)
+      replayed.assign(std::get<1>(entry), std::get<2>(entry));
+    else
+      replayed.insert(std::make_pair(std::get<1>(entry), std::get<2>(entry)));
+  }
+
+  map_type built(log.begin(), log.end(), map_type::key_compare(), 4);
+
+  auto it = built.begin();
+  for (auto expected = replayed.begin(); expected != replayed.end();
+       ++expected, ++it)
+  {
+    ASSERT_NE(built.end(), it);
+    EXPECT_EQ(expected->first, it->first);
+    EXPECT_EQ(expected->second, it->second);
+  }
+  EXPECT_EQ(built.end(), it);
+
+  for (int key = 0; key < 1000; key += 37)
+    EXPECT_EQ(replayed.lifetimes(key).size(), built.lifetimes(key).size());
+
+  // The built map can still be changed retroactively
+  auto t = built.lifetimes(0).front().first;
+  built.erase(t, 5000);
+  built.insert(std::make_pair(5000, 1));
+  EXPECT_EQ(1, built.find(5000)->second);
+}
+
+TEST(full_map, saveAndLoadKeepsHistory)
+{
+  retro::full_map<int, double> m;
+  std::vector<retro::full_map<int, double>::time_point> times;
+  for (int i = 0; i < 300; i++)
+  {
+    if (i % 5 == 0)
+      times.push_back(m.erase(i % 13));
+    else
+      times.push_back(m.assign(i % 13, i * 0.5));
+  }
+  m.insert(times[10], std::make_pair(100, 1.0));
+
+  std::stringstream ss;
+  ASSERT_TRUE(m.save(ss));
+
+  retro::full_map<int, double> loaded;
+  ASSERT_TRUE(loaded.load(ss));
+
+  for (int key = 0; key <= 100; key++)
+  {
+    auto expected = m.lifetimes(key), actual = loaded.lifetimes(key);
+    ASSERT_EQ(expected.size(), actual.size());
+
+    auto it = loaded.find(key);
+    ASSERT_EQ(m.find(key) == m.end(), it == loaded.end());
+    if (it != loaded.end())
+    {
+      EXPECT_EQ(m.find(key)->second, it->second);
+    }
+  }
+
+  std::stringstream bad("RETROMAP but not really");
+  EXPECT_FALSE(loaded.load(bad));
+  EXPECT_NE(loaded.end(), loaded.find(100));
+}
+
+namespace
+{
+
+// A value that can be saved but not default constructed.
+struct point
+{
+  point(int x, int y) : x(x), y(y) { }
+
+  int x;
+  int y;
+};
+
+} // end namespace
+
+TEST(full_map, saveAndLoadValuesWithoutDefaultConstructors)
+{
+  retro::full_map<int, point> m;
+  auto t = m.insert(std::make_pair(1, point(1, 2)));
+  m.erase(1);
+  m.assign(t, 2, point(3, 4));
+
+  std::stringstream ss;
+  ASSERT_TRUE(m.save(ss));
+  retro::full_map<int, point> loaded;
+  ASSERT_TRUE(loaded.load(ss));
+
+  EXPECT_EQ(loaded.end(), loaded.find(1));
+  EXPECT_EQ(3, loaded.find(2)->second.x);
+  EXPECT_EQ(4, loaded.find(2)->second.y);
+  auto lifetimes = loaded.lifetimes(1);
+  ASSERT_EQ(1u, lifetimes.size());
+  EXPECT_EQ(2, loaded.find(lifetimes[0].second, 1)->second.y);
+}
+
+TEST(full_map, loadRejectsCountsTheFileCannotHold)
+{
+  retro::full_map<int, int> m;
+  for (int i = 0; i < 100; i++) m.assign(i % 7, i);
+
+  std::stringstream ss;
+  ASSERT_TRUE(m.save(ss));
+  std::string bytes = ss.str();
+
+  // These fail before anything is allocated for the counts
+  retro::full_map<int, int> loaded;
+  std::stringstream huge(with_event_count(bytes, std::uint64_t(1) << 60));
+  EXPECT_FALSE(loaded.load(huge));
+  std::stringstream longer(with_event_count(bytes, 101));
+  EXPECT_FALSE(loaded.load(longer));
+  std::stringstream truncated(bytes.substr(0, bytes.size() - 1));
+  EXPECT_FALSE(loaded.load(truncated));
+  EXPECT_EQ(loaded.end(), loaded.begin());
+
+  std::stringstream good(bytes);
+  EXPECT_TRUE(loaded.load(good));
+  EXPECT_EQ(99, loaded.find(1)->second);
+}
+
+TEST(full_map, loadAllocatesNoMoreThanACopy)
+{
+  typedef counting_allocator<std::pair<const int, int>> allocator_type;
+  typedef retro::full_map<int, int, std::less<int>, allocator_type> map_type;
+  allocation_counts counts;
+  map_type m{std::less<int>(), allocator_type(&counts)};
+  for (int i = 0; i < 1000; i++) m.assign(i % 97, i);
+
+  std::stringstream ss;
+  ASSERT_TRUE(m.save(ss));
+
+  // Loading builds the state once and keeps it, rather than copying it.
+  map_type loaded{std::less<int>(), allocator_type(&counts)};
+  std::size_t before = counts.allocations;
+  ASSERT_TRUE(loaded.load(ss));
+  std::size_t loading = counts.allocations - before;
+
+  before = counts.allocations;
+  map_type copy = loaded;
+  std::size_t copying = counts.allocations - before;
+  EXPECT_GE(copying + copying / 4, loading);
+  EXPECT_EQ(999, copy.find(29)->second);
+}
+
+TEST(full_map, loadKeepsTimestamps)
+{
+  retro::full_map<int, int> m;
+  for (int i = 0; i < 50; i++)
+    m.assign_at((i * 37) % 50 * 10, i % 7, i);
+  m.assign(3, 1000);
+
+  std::stringstream ss;
+  ASSERT_TRUE(m.save(ss));
+  retro::full_map<int, int> loaded;
+  ASSERT_TRUE(loaded.load(ss));
+
+  // Operations at a timestamp go where they would have in the saved map.
+  m.insert_at(255, std::make_pair(100, 1));
+  loaded.insert_at(255, std::make_pair(100, 1));
+  m.assign_at(120, 2, -1);
+  loaded.assign_at(120, 2, -1);
+  for (std::int64_t ts = -10; ts <= 510; ts += 5)
+  {
+    for (int key = 0; key <= 100; key++)
+    {
+      auto expected = m.find_at(ts, key);
+      auto actual = loaded.find_at(ts, key);
+      ASSERT_EQ(expected == m.end(m.at_timestamp(ts)),
+                actual == loaded.end(loaded.at_timestamp(ts)));
+      if (actual != loaded.end(loaded.at_timestamp(ts)))
+      {
+        EXPECT_EQ(expected->second, actual->second);
+      }
+    }
+  }
+  EXPECT_EQ(1000, loaded.find(3)->second);
+}
+
+TEST(full_map, snapshotFromCheckpointsMatchesIteration)
+{
+  typedef retro::full_map<int, int> map_type;
+  map_type m;
+  m.set_checkpoint_interval(7);
+  std::vector<map_type::time_point> times;
+
+  for (int i = 0; i < 200; i++)
+  {
+    if (i % 6 == 5)
+      times.push_back(m.erase(i % 17));
+    else
+      times.push_back(m.assign(i % 17, i));
+  }
+  EXPECT_EQ(200u / 7, m.checkpoint_count());
+
+  // Operations in the past repair every later checkpoint.
+  for (int i = 0; i < 200; i += 9)
+    times.push_back(m.insert(times[i], std::make_pair(100 + i, -i)));
+  for (int i = 3; i < 200; i += 11)
+    times.push_back(m.erase(times[i], i % 17));
+  for (int i = 1; i < 200; i += 13)
+    m.revert(times[i]);
+  for (int i = 1; i < 200; i += 13)
+    times[i] = m.present();
+
+  auto check = [](map_type &m, const std::vector<map_type::time_point> &times)
+  {
+    for (auto t : times)
+    {
+      std::vector<std::pair<int, int>> expected, actual;
+      for (auto it = m.begin(t); it != m.end(t); ++it)
+        expected.push_back(std::make_pair(it->first, it->second));
+      m.snapshot(t, std::back_inserter(actual));
+      ASSERT_EQ(expected, actual);
+    }
+  };
+  check(m, times);
+
+  // A copy keeps its own checkpoints.
+  map_type copy = m;
+  copy.insert(times[50], std::make_pair(1000, 1));
+  copy.revert(times[7]);
+  times[7] = copy.present();
+  check(copy, times);
+
+  m.set_checkpoint_interval(0);
+  EXPECT_EQ(0u, m.checkpoint_count());
+  check(m, times);
+}
+
+TEST(full_map, beginAndDiffFromCheckpointsMatchAMapWithout)
+{
+  typedef retro::full_map<int, int> map_type;
+  map_type m, plain;
+  m.set_checkpoint_interval(5);
+  std::vector<map_type::time_point> times, plain_times;
+
+  std::mt19937 random(7);
+  for (int i = 0; i < 300; i++)
+  {
+    int key = random() % 40, op = random() % 4;
+    if (op == 0)
+    {
+      times.push_back(m.erase(key));
+      plain_times.push_back(plain.erase(key));
+    }
+    else if (op == 1 && i > 10)
+    {
+      std::size_t at = random() % times.size();
+      times.push_back(m.insert(times[at], std::make_pair(key, i)));
+      plain_times.push_back(plain.insert(plain_times[at],
+                                         std::make_pair(key, i)));
+    }
+    else
+    {
+      times.push_back(m.assign(key, i));
+      plain_times.push_back(plain.assign(key, i));
+    }
+  }
+  times.push_back(m.present());
+  plain_times.push_back(plain.present());
+
+  auto check = [&](map_type &m, map_type &plain)
+  {
+    for (std::size_t i = 0; i < times.size(); i++)
+    {
+      auto it = m.begin(times[i]);
+      auto expected = plain.begin(plain_times[i]);
+      ASSERT_EQ(expected == plain.end(plain_times[i]), it == m.end(times[i]));
+      if (it != m.end(times[i]))
+      {
+        ASSERT_EQ(expected->first, it->first);
+        ASSERT_EQ(expected->second, it->second);
+      }
+    }
+
+    for (std::size_t i = 0; i < times.size(); i += 7)
+    {
+      for (std::size_t j = 0; j < times.size(); j += 11)
+      {
+        std::vector<std::pair<int, retro::map>> expected, actual;
+        plain.diff(plain_times[i], plain_times[j],
+                   std::back_inserter(expected));
+        m.diff(times[i], times[j], std::back_inserter(actual));
+        ASSERT_EQ(expected, actual);
+      }
+    }
+  };
+  check(m, plain);
+
+  // Copies keep checkpoints that share nodes with each other.
+  map_type copy(m);
+  check(copy, plain);
+}
+
+TEST(full_map, checkpointsShareWhatTheyHaveInCommon)
+{
+  typedef counting_allocator<std::pair<const int, int>> allocator_type;
+  typedef retro::full_map<int, int, std::less<int>, allocator_type> map_type;
+
+  auto checkpoint_bytes = [](int keys)
+  {
+    allocation_counts counts;
+    map_type m{std::less<int>(), allocator_type(&counts)};
+    m.set_checkpoint_interval(50);
+    for (int i = 0; i < keys; i++) m.assign(i, i);
+    return m.memory_usage().checkpoints;
+  };
+
+  // Four times the keys and checkpoints would take sixteen times the memory
+  // if each checkpoint copied every element.
+  std::size_t small = checkpoint_bytes(4000), large = checkpoint_bytes(16000);
+  EXPECT_LT(large, 8 * small);
+}
+
+TEST(full_map, compactKeepsStateAfterHorizon)
+{
+  typedef retro::full_map<int, int> map_type;
+  map_type m;
+  m.set_checkpoint_interval(16);
+  std::vector<map_type::time_point> times;
+  for (int i = 0; i < 300; i++)
+  {
+    if (i % 4 == 3)
+      times.push_back(m.erase(i % 23));
+    else
+      times.push_back(m.assign(i % 23, i));
+  }
+  m.insert(times[50], std::make_pair(500, 5));
+  m.erase(times[60], 500);
+
+  map_type original = m;
+  EXPECT_LT(0u, m.compact(times[200]));
+
+  // Every query at or after the horizon is unchanged.
+  std::vector<map_type::time_point> after(times.begin() + 200, times.end());
+  after.push_back(m.present());
+  for (auto t : after)
+  {
+    for (int key = 0; key <= 500; key++)
+    {
+      auto expected = original.find(t, key);
+      auto actual = m.find(t, key);
+      ASSERT_EQ(expected == original.end(t), actual == m.end(t));
+      if (actual != m.end(t))
+      {
+        EXPECT_EQ(expected->second, actual->second);
+      }
+    }
+
+    std::vector<std::pair<int, int>> expected, actual;
+    original.snapshot(t, std::back_inserter(expected));
+    m.snapshot(t, std::back_inserter(actual));
+    ASSERT_EQ(expected, actual);
+  }
+
+  // Keys that were gone by the horizon are forgotten, and each live key has
+  // a single operation left before it.
+  EXPECT_TRUE(m.lifetimes(500).empty());
+  EXPECT_EQ(0u, m.compact(times[200]));
+
+  // Changes are still possible at and after the horizon.
+  m.insert(times[200], std::make_pair(600, 6));
+  EXPECT_EQ(6, m.find(600)->second);
+}
+
+TEST(full_map, allocatesFromGivenAllocator)
+{
+  typedef counting_allocator<std::pair<const int, int>> allocator_type;
+  allocation_counts counts;
+  {
+    retro::full_map<int, int, std::less<int>, allocator_type>
+      m{std::less<int>(), allocator_type(&counts)};
+    auto t = m.insert(std::make_pair(1, 1));
+    m.assign(2, 2);
+    m.erase(t, 2);
+    m.set_checkpoint_interval(1);
+
+    auto copy = m;
+    copy.insert(std::make_pair(3, 3));
+    EXPECT_EQ(allocator_type(&counts), copy.get_allocator());
+    EXPECT_EQ(3, copy.find(3)->second);
+    EXPECT_LT(0u, counts.allocations);
+  }
+  EXPECT_EQ(0u, counts.live);
+
+  typedef counting_allocator<std::pair<const unsigned, int>> dense_allocator;
+  {
+    retro::full_map<unsigned, int, retro::dense_less<unsigned>,
+                    dense_allocator>
+      m{retro::dense_less<unsigned>(), dense_allocator(&counts)};
+    for (unsigned i = 0; i < 100; i++)
+      m.insert(std::make_pair(i, 1));
+    m.revert(m.erase(5));
+    EXPECT_EQ(1, m.find(5)->second);
+  }
+  EXPECT_EQ(0u, counts.live);
+}
+
+TEST(full_map, timestampedOperationsAreOrderedByTimestamp)
+{
+  retro::full_map<int, int> m;
+
+  // Timestamps arrive out of order, with some repeated.
+  struct operation { std::int64_t ts; bool erase; int key; int val; };
+  std::vector<operation> ops;
+  for (int i = 0; i < 200; i++)
+  {
+    std::int64_t ts = (i * 7919) % 101 * 1000;
+    operation op = { ts, i % 5 == 4, i % 11, i };
+    if (op.erase)
+      m.erase_at(op.ts, op.key);
+    else
+      m.assign_at(op.ts, op.key, op.val);
+    ops.push_back(op);
+  }
+  auto t = m.insert_at(-5, std::make_pair(100, 1));
+
+  for (std::int64_t ts = -10000; ts <= 110000; ts += 500)
+  {
+    // Replay the operations up to the timestamp, in timestamp order.
+    std::map<int, int> expected;
+    if (ts >= -5) expected[100] = 1;
+    std::vector<operation> sorted(ops);
+    std::stable_sort(sorted.begin(), sorted.end(),
+                     [](const operation &a, const operation &b)
+                     { return a.ts < b.ts; });
+    for (auto &op : sorted)
+    {
+      if (op.ts > ts) break;
+      if (op.erase)
+        expected.erase(op.key);
+      else
+        expected[op.key] = op.val;
+    }
+
+    for (int key = 0; key <= 100; key++)
+    {
+      auto it = m.find_at(ts, key);
+      auto end = m.end(m.at_timestamp(ts));
+      ASSERT_EQ(expected.count(key) == 0, it == end);
+      if (it != end)
+      {
+        EXPECT_EQ(expected[key], it->second);
+      }
+    }
+  }
+
+  // Reverting an operation removes it from the timestamp index.
+  m.revert(t);
+  EXPECT_EQ(m.end(m.at_timestamp(-5)), m.find_at(-5, 100));
+  m.insert_at(-5, std::make_pair(100, 2));
+  EXPECT_EQ(2, m.find_at(0, 100)->second);
+
+  // An operation without a timestamp stays where it was performed, before
+  // any later timestamped operation.
+  m.assign(100, 3);
+  m.assign_at(1000000, 100, 4);
+  EXPECT_EQ(4, m.find(100)->second);
+  EXPECT_EQ(3, m.find_at(999999, 100)->second);
+
+  // A copy has its own index.
+  auto copy = m;
+  copy.assign_at(999999, 100, 5);
+  EXPECT_EQ(5, copy.find_at(999999, 100)->second);
+  EXPECT_EQ(3, m.find_at(999999, 100)->second);
+}
+
+TEST(full_map, memoryUsageMatchesAllocations)
+{
+  typedef counting_allocator<std::pair<const int, int>> allocator_type;
+  allocation_counts counts;
+  retro::full_map<int, int, std::less<int>, allocator_type>
+    m{std::less<int>(), allocator_type(&counts)};
+  m.set_checkpoint_interval(100);
+
+  for (int i = 0; i < 1000; i++)
+  {
+    m.assign(i % 50, i);
+    m.assign_at(i, i % 70, i);
+  }
+  auto before = m.memory_usage();
+  EXPECT_LT(0u, before.events);
+  EXPECT_LT(0u, before.upper_labels);
+  EXPECT_LT(0u, before.lower_labels);
+  EXPECT_LT(0u, before.keys);
+  EXPECT_LT(0u, before.histories);
+  EXPECT_LE(2000 * sizeof(int), before.payloads);
+  EXPECT_LT(0u, before.checkpoints);
+
+  // Only the block shared with the reference counts is not reported
+  EXPECT_LE(before.total(), counts.live_bytes);
+  EXPECT_GE(before.total() + 64, counts.live_bytes);
+
+  m.compact(m.at_timestamp(900));
+  auto after = m.memory_usage();
+  EXPECT_GT(before.histories, after.histories);
+  EXPECT_GT(before.events, after.events);
+  EXPECT_LE(after.total(), counts.live_bytes);
+  EXPECT_GE(after.total() + 64, counts.live_bytes);
+}
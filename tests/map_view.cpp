@@ -0,0 +1,134 @@
+#include <gtest/gtest.h>
+
+#include "retro/map_view.hpp"
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+// Copy the saved bytes into memory aligned for the view.
+std::vector<long double> aligned_copy(const std::string &bytes)
+{
+  std::vector<long double> buffer(bytes.size() / sizeof(long double) + 1);
+  std::copy(bytes.begin(), bytes.end(), reinterpret_cast<char *>(&buffer[0]));
+  return buffer;
+}
+
+} // end namespace
+
+TEST(full_map_view, answersTheSameQueriesAsTheMap)
+{
+  retro::full_map<int, int> m;
+  for (int i = 0; i < 500; i++)
+  {
+    if (i % 4 == 0)
+      m.erase(i % 17);
+    else if (i % 4 == 1)
+      m.insert(std::make_pair(i % 17, i));
+    else
+      m.assign(i % 17, i);
+  }
+
+  std::stringstream ss;
+  ASSERT_TRUE(m.save(ss));
+  std::string bytes = ss.str();
+  auto buffer = aligned_copy(bytes);
+
+  retro::full_map_view<int, int> view;
+  ASSERT_TRUE(view.open(&buffer[0], bytes.size()));
+  EXPECT_EQ(17U, view.key_count());
+  EXPECT_EQ(500U, view.event_count());
+
+  for (int key = 0; key < 18; key++)
+  {
+    auto it = m.find(key);
+    const int *val = view.find(key);
+    ASSERT_EQ(it == m.end(), val == 0);
+    if (val)
+    {
+      EXPECT_EQ(it->second, *val);
+    }
+  }
+
+  // Just before the operation at position i, every earlier one has happened
+  retro::full_map<int, int> replay;
+  for (std::size_t i = 0; i < view.event_count(); i++)
+  {
+    auto t = view.at(i);
+    for (int key = 0; key < 17; key++)
+    {
+      auto it = replay.find(key);
+      const int *val = view.find(t, key);
+      ASSERT_EQ(it == replay.end(), val == 0);
+      if (val)
+    {
+      EXPECT_EQ(it->second, *val);
+    }
+    }
+
+    int key = static_cast<int>(i % 17);
+    if (t.operation() == retro::map::erase)
+      replay.erase(key);
+    else
+      replay.assign(key, static_cast<int>(i));
+  }
+
+  int count = 0;
+  view.for_each(view.present(), [&](int key, int val)
+  {
+    EXPECT_EQ(m.find(key)->second, val);
+    count++;
+  });
+  EXPECT_EQ(std::distance(m.begin(), m.end()), count);
+}
+
+TEST(full_map_view, canMapAFile)
+{
+  retro::full_map<int, int> m;
+  m.insert(std::make_pair(1, 10));
+  m.insert(std::make_pair(2, 20));
+  m.erase(1);
+
+  const char *path = "full_map_view_test.bin";
+  {
+    std::ofstream os(path, std::ios::binary);
+    ASSERT_TRUE(m.save(os));
+  }
+
+  retro::full_map_view<int, int> view;
+  ASSERT_TRUE(view.open(path));
+  std::remove(path);
+
+  EXPECT_EQ(0, view.find(1));
+  ASSERT_NE(static_cast<const int *>(0), view.find(2));
+  EXPECT_EQ(20, *view.find(2));
+  ASSERT_NE(static_cast<const int *>(0), view.find(view.at(2), 1));
+  EXPECT_EQ(10, *view.find(view.at(2), 1));
+
+  // Moving the view moves the mapping
+  retro::full_map_view<int, int> moved(std::move(view));
+  EXPECT_FALSE(view.is_open());
+  EXPECT_EQ(20, *moved.find(2));
+}
+
+TEST(full_map_view, rejectsMismatchedData)
+{
+  retro::full_map<int, int> m;
+  m.insert(std::make_pair(1, 10));
+
+  std::stringstream ss;
+  ASSERT_TRUE(m.save(ss));
+  std::string bytes = ss.str();
+  auto buffer = aligned_copy(bytes);
+
+  retro::full_map_view<int, double> wrong_type;
+  EXPECT_FALSE(wrong_type.open(&buffer[0], bytes.size()));
+
+  retro::full_map_view<int, int> truncated;
+  EXPECT_FALSE(truncated.open(&buffer[0], bytes.size() - 16));
+}
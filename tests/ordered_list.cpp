@@ -1,6 +1,13 @@
 #include <gtest/gtest.h>
 
 #include "retro/detail/ordered_list.hpp"
+#include "helpers.hpp"
+
+#include <cstdint>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
 
 template <class T>
 bool is_correct_order(T &ol)
@@ -116,3 +123,204 @@ TEST(ordered_list, canReachMaximumSize)
 
   EXPECT_TRUE(is_correct_order(ol));
 }
+
+// Check that each element comes before the next, which is enough to show
+// that a long list is in order.
+template <class T>
+bool is_correct_adjacent_order(T &ol)
+{
+  bool correct = true;
+  for (auto it = ol.begin(); it != ol.end() && std::next(it) != ol.end(); ++it)
+    correct &= (it < std::next(it)) && (std::next(it) > it);
+  return correct;
+}
+
+TEST(ordered_list, longRunsOfAppendsMaintainOrder)
+{
+  retro::detail::ordered_list<int, std::uint32_t> ol;
+
+  // Appends only relabel a range around the end, so the labels of the front
+  // stay put rather than the whole list being rebuilt every so often.
+  ol.push_back(0);
+  auto front = ol.begin();
+  auto rank = front.rank();
+  int relabelled = 0;
+  for (int i = 1; i < 200000; i++)
+  {
+    ol.push_back(i);
+    if (rank < front.rank() || front.rank() < rank) relabelled++;
+    rank = front.rank();
+  }
+  EXPECT_GT(10, relabelled);
+
+  ASSERT_EQ(200000U, ol.size());
+  EXPECT_TRUE(is_correct_adjacent_order(ol));
+  EXPECT_EQ(199999, ol.back());
+}
+
+TEST(ordered_list, repeatedInsertsAtOnePlaceMaintainOrder)
+{
+  retro::detail::ordered_list<int, std::uint32_t> ol;
+
+  ol.push_back(-1);
+  ol.push_back(-2);
+
+  // Every insert goes just before the same element, so the labels around it
+  // run out over and over.
+  auto last = std::prev(ol.end());
+  for (int i = 0; i < 100000; i++)
+    ol.insert(last, i);
+
+  ASSERT_EQ(100002U, ol.size());
+  EXPECT_TRUE(is_correct_adjacent_order(ol));
+
+  int expected = -1;
+  for (auto it = std::next(ol.begin()); it != last; ++it)
+    EXPECT_EQ(++expected, *it);
+}
+
+TEST(ordered_list, randomInsertsWithSmallLabelsMaintainOrder)
+{
+  retro::detail::ordered_list<int, unsigned short> ol;
+  std::vector<retro::detail::ordered_list<int, unsigned short>::iterator> its;
+  std::mt19937 rng(7);
+
+  ol.push_back(0);
+  its.push_back(ol.begin());
+  for (int i = 1; i < 20000; i++)
+  {
+    auto pos = its[std::uniform_int_distribution<std::size_t>(
+                     0, its.size() - 1)(rng)];
+    its.push_back(ol.insert(pos, i));
+  }
+
+  ASSERT_EQ(20000U, ol.size());
+  EXPECT_TRUE(is_correct_adjacent_order(ol));
+}
+
+TEST(ordered_list, eraseMaintainsOrder)
+{
+  retro::detail::ordered_list<int> ol;
+
+  for (int i = 0; i < 100; i++)
+  {
+    ol.push_back(i);
+  }
+
+  // Erase every other element.
+  for (auto it = ol.begin(); it != ol.end(); ++it)
+  {
+    it = ol.erase(it);
+  }
+
+  ASSERT_EQ(50U, ol.size());
+  EXPECT_EQ(1, ol.front());
+  EXPECT_EQ(99, ol.back());
+  EXPECT_TRUE(is_correct_order(ol));
+
+  // Elements can still be inserted around the gaps.
+  auto middle = std::next(ol.begin(), 25);
+  for (int i = 0; i < 100; i++)
+  {
+    ol.insert(middle, i);
+  }
+
+  ASSERT_EQ(150U, ol.size());
+  EXPECT_TRUE(is_correct_order(ol));
+
+  while (!ol.empty())
+  {
+    ol.erase(ol.begin());
+  }
+
+  ol.push_back(1);
+  EXPECT_EQ(1, ol.front());
+  EXPECT_EQ(1, ol.back());
+}
+
+TEST(ordered_list, assignMaintainsOrder)
+{
+  retro::detail::ordered_list<int> ol;
+  ol.push_back(-1);
+
+  std::vector<int> values;
+  for (int i = 0; i < 1000; i++) values.push_back(i);
+  ol.assign(values.begin(), values.end());
+
+  ASSERT_EQ(1000U, ol.size());
+  EXPECT_EQ(0, ol.front());
+  EXPECT_EQ(999, ol.back());
+
+  // Insertions after a bulk assignment still keep the order
+  auto middle = std::next(ol.begin(), 500);
+  for (int i = 0; i < 200; i++) ol.insert(middle, i);
+  ol.push_back(1000);
+  ol.push_front(-1);
+
+  EXPECT_TRUE(is_correct_order(ol));
+}
+
+TEST(ordered_list, saveAndLoadKeepsElementsInOrder)
+{
+  retro::detail::ordered_list<int> ol;
+  for (int i = 0; i < 100; i++) ol.push_back(i);
+  ol.insert(std::next(ol.begin(), 50), -1);
+
+  std::stringstream ss;
+  ASSERT_TRUE(ol.save(ss));
+
+  retro::detail::ordered_list<int> loaded;
+  ASSERT_TRUE(loaded.load(ss));
+  ASSERT_EQ(ol.size(), loaded.size());
+  EXPECT_TRUE(std::equal(ol.begin(), ol.end(), loaded.begin()));
+  EXPECT_TRUE(is_correct_order(loaded));
+}
+
+TEST(ordered_list, loadRejectsCountsTheFileCannotHold)
+{
+  retro::detail::ordered_list<int> ol;
+  for (int i = 0; i < 100; i++) ol.push_back(i);
+
+  std::stringstream ss;
+  ASSERT_TRUE(ol.save(ss));
+  std::string bytes = ss.str();
+
+  retro::detail::ordered_list<int> loaded;
+  std::stringstream huge(with_event_count(bytes, std::uint64_t(1) << 60));
+  EXPECT_FALSE(loaded.load(huge));
+  std::stringstream truncated(bytes.substr(0, bytes.size() - 1));
+  EXPECT_FALSE(loaded.load(truncated));
+  EXPECT_EQ(0U, loaded.size());
+}
+
+TEST(ordered_list, allocatesFromGivenAllocator)
+{
+  allocation_counts counts;
+  {
+    retro::detail::ordered_list<int, unsigned long long int,
+                                counting_allocator<int>>
+      ol{counting_allocator<int>(&counts)};
+    for (int i = 0; i < 1000; i++)
+      ol.push_back(i);
+    ol.erase(ol.begin());
+    EXPECT_LT(1000u, counts.allocations);
+    EXPECT_TRUE(is_correct_order(ol));
+  }
+  EXPECT_EQ(0u, counts.live);
+}
+
+TEST(ordered_list, memoryUsageMatchesAllocations)
+{
+  allocation_counts counts;
+  retro::detail::ordered_list<int, unsigned long long int,
+                              counting_allocator<int>>
+    ol{counting_allocator<int>(&counts)};
+  for (int i = 0; i < 1000; i++)
+    ol.insert(ol.begin(), i);
+
+  auto report = ol.memory_usage();
+  EXPECT_EQ(counts.live_bytes, report.total());
+  EXPECT_LT(0u, report.upper_labels);
+  EXPECT_LE(1000 * sizeof(int), report.payloads);
+  EXPECT_LT(report.payloads, report.lower_labels);
+}
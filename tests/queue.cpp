@@ -1,6 +1,11 @@
 #include <gtest/gtest.h>
 
 #include "retro/queue.hpp"
+#include "helpers.hpp"
+
+#include <cstdint>
+#include <sstream>
+#include <string>
 
 TEST(partial_queue, pushingElementsDoesNotChangeFrontButChangeBack)
 {
@@ -128,3 +133,162 @@ TEST(partial_queue, moveIsEquivalentToPush)
   EXPECT_EQ(3, q.back().first);
   EXPECT_EQ(4, q.back().second);
 }
+
+TEST(partial_queue, saveAndLoadRestoresQueue)
+{
+  retro::partial_queue<int> q;
+
+  q.push(1);
+  q.push(2);
+  q.push(3);
+  q.pop();
+
+  std::stringstream ss;
+  ASSERT_TRUE(q.save(ss));
+
+  retro::partial_queue<int> loaded;
+  ASSERT_TRUE(loaded.load(ss));
+  ASSERT_EQ(2U, loaded.size());
+  EXPECT_EQ(2, loaded.front());
+  EXPECT_EQ(3, loaded.back());
+
+  // The loaded queue can still be changed
+  auto t = loaded.push(4);
+  loaded.pop();
+  EXPECT_EQ(3, loaded.front());
+  loaded.revert(t);
+  EXPECT_EQ(3, loaded.back());
+
+  std::stringstream bad("not a queue");
+  EXPECT_FALSE(loaded.load(bad));
+  EXPECT_EQ(3, loaded.front());
+}
+
+TEST(partial_queue, loadRejectsCountsTheFileCannotHold)
+{
+  retro::partial_queue<int> q;
+  for (int i = 0; i < 10; i++) q.push(i);
+
+  std::stringstream ss;
+  ASSERT_TRUE(q.save(ss));
+  std::string bytes = ss.str();
+
+  retro::partial_queue<int> loaded;
+  std::stringstream huge(with_event_count(bytes, std::uint64_t(1) << 60));
+  EXPECT_FALSE(loaded.load(huge));
+  std::stringstream truncated(bytes.substr(0, bytes.size() - 1));
+  EXPECT_FALSE(loaded.load(truncated));
+  EXPECT_TRUE(loaded.empty());
+}
+
+TEST(partial_queue, loadRejectsFlagsThatDisagreeWithTheFront)
+{
+  retro::partial_queue<int> q;
+  for (int i = 0; i < 4; i++) q.push(i);
+  q.pop();
+
+  std::stringstream ss;
+  ASSERT_TRUE(q.save(ss));
+  const std::string bytes = ss.str();
+
+  // The counts follow the padded header, and the popped flags follow the
+  // padded values.
+  const std::size_t counts = 48, popped = 80;
+  ASSERT_EQ(popped + 4 + 12, bytes.size());
+
+  retro::partial_queue<int> loaded;
+  std::string small_size = bytes;
+  small_size[counts] = 2;
+  std::stringstream small_ss(small_size);
+  EXPECT_FALSE(loaded.load(small_ss));
+
+  std::string unpopped = bytes;
+  unpopped[popped] = 0;
+  std::stringstream unpopped_ss(unpopped);
+  EXPECT_FALSE(loaded.load(unpopped_ss));
+
+  std::string popped_late = bytes;
+  popped_late[popped + 2] = 1;
+  std::stringstream popped_late_ss(popped_late);
+  EXPECT_FALSE(loaded.load(popped_late_ss));
+  EXPECT_TRUE(loaded.empty());
+
+  std::stringstream good(bytes);
+  ASSERT_TRUE(loaded.load(good));
+  EXPECT_EQ(3U, loaded.size());
+  EXPECT_EQ(1, loaded.front());
+}
+
+TEST(partial_queue, pushBeforeFirstElementMovesFrontBackOnce)
+{
+  retro::partial_queue<int> q;
+
+  auto t = q.push(1);
+  q.push(2);
+  q.push(3);
+  q.pop();
+  q.push(t, 0);
+
+  // 0 was popped instead of 1, so the front is 1 rather than 3
+  ASSERT_EQ(3U, q.size());
+  EXPECT_EQ(1, q.front());
+  EXPECT_EQ(3, q.back());
+
+  q.pop();
+  EXPECT_EQ(2, q.front());
+}
+
+TEST(partial_queue, pushCopiesLvalues)
+{
+  retro::partial_queue<int> q;
+
+  const int one = 1, two = 2;
+  auto t = q.push(two);
+  q.push(t, one);
+
+  ASSERT_EQ(2U, q.size());
+  EXPECT_EQ(1, q.front());
+  EXPECT_EQ(2, q.back());
+}
+
+TEST(partial_queue, frontAndBackOfConstQueue)
+{
+  retro::partial_queue<int> q;
+  q.push(1);
+  q.push(2);
+
+  const retro::partial_queue<int> &cq = q;
+  EXPECT_EQ(1, cq.front());
+  EXPECT_EQ(2, cq.back());
+}
+
+TEST(partial_queue, allocatesFromGivenAllocator)
+{
+  allocation_counts counts;
+  {
+    retro::partial_queue<int, counting_allocator<int>>
+      q{counting_allocator<int>(&counts)};
+    auto t = q.push(1);
+    q.push(2);
+    q.pop(t);
+    EXPECT_EQ(2u, counts.allocations);
+    EXPECT_EQ(counting_allocator<int>(&counts), q.get_allocator());
+  }
+  EXPECT_EQ(0u, counts.live);
+}
+
+TEST(partial_queue, memoryUsageMatchesAllocations)
+{
+  allocation_counts counts;
+  retro::partial_queue<double, counting_allocator<double>>
+    q{counting_allocator<double>(&counts)};
+  for (int i = 0; i < 100; i++)
+    q.push(i);
+  q.pop();
+
+  // Popped elements are still stored
+  auto report = q.memory_usage();
+  EXPECT_EQ(counts.live_bytes, report.total());
+  EXPECT_EQ(100 * sizeof(double), report.payloads);
+  EXPECT_EQ(0u, report.keys);
+}
@@ -0,0 +1,95 @@
+#include <gtest/gtest.h>
+
+#include "retro/sharded_map.hpp"
+
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+TEST(sharded_full_map, canFindInsertedKeys)
+{
+  retro::sharded_full_map<int, int> m(4);
+
+  for (int i = 0; i < 100; i++)
+    m.insert(std::make_pair(i, i * 2));
+
+  int val = 0;
+  for (int i = 0; i < 100; i++)
+  {
+    ASSERT_TRUE(m.find(i, val));
+    EXPECT_EQ(i * 2, val);
+  }
+  EXPECT_FALSE(m.find(100, val));
+}
+
+TEST(sharded_full_map, rejectsZeroShards)
+{
+  typedef retro::sharded_full_map<int, int> map_type;
+  EXPECT_THROW(map_type m(0), std::invalid_argument);
+}
+
+TEST(sharded_full_map, timePointsAreOrderedAcrossShards)
+{
+  retro::sharded_full_map<int, int> m(8);
+  std::vector<retro::sharded_full_map<int, int>::time_point> times;
+
+  for (int i = 0; i < 50; i++)
+    times.push_back(m.insert(std::make_pair(i, i)));
+  m.assign(0, 100);
+  m.erase(1);
+
+  for (std::size_t i = 1; i < times.size(); i++)
+    EXPECT_TRUE(times[i - 1] < times[i]);
+
+  // Just before the insertion of key i, only keys below i existed
+  int val = 0;
+  for (int i = 0; i < 50; i++)
+  {
+    for (int j = 0; j < 50; j++)
+      EXPECT_EQ(j < i, m.find(times[i], j, val));
+  }
+
+  ASSERT_TRUE(m.find(times[10], 0, val));
+  EXPECT_EQ(0, val);
+  ASSERT_TRUE(m.find(0, val));
+  EXPECT_EQ(100, val);
+  EXPECT_FALSE(m.find(1, val));
+}
+
+TEST(sharded_full_map, presentIsASnapshot)
+{
+  retro::sharded_full_map<int, int> m(2);
+  m.insert(std::make_pair(1, 1));
+  auto now = m.present();
+  m.assign(1, 2);
+  m.insert(std::make_pair(2, 2));
+
+  int val = 0;
+  ASSERT_TRUE(m.find(now, 1, val));
+  EXPECT_EQ(1, val);
+  EXPECT_FALSE(m.find(now, 2, val));
+}
+
+TEST(sharded_full_map, canInsertFromManyThreads)
+{
+  const int threads = 4, per_thread = 1000;
+  retro::sharded_full_map<int, int> m(8);
+
+  std::vector<std::thread> workers;
+  for (int t = 0; t < threads; t++)
+  {
+    workers.emplace_back([&m, t, per_thread]()
+    {
+      for (int i = 0; i < per_thread; i++)
+        m.insert(std::make_pair(t * per_thread + i, t));
+    });
+  }
+  for (auto &w : workers) w.join();
+
+  int val = 0;
+  for (int i = 0; i < threads * per_thread; i++)
+  {
+    ASSERT_TRUE(m.find(i, val));
+    EXPECT_EQ(i / per_thread, val);
+  }
+}
@@ -0,0 +1,253 @@
+#include <gtest/gtest.h>
+
+#include "retro/tiered_map.hpp"
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+std::string segment_path(int i)
+{
+  return "tiered_map_test_" + std::to_string(i) + ".seg";
+}
+
+} // end namespace
+
+TEST(tiered_full_map, queriesSpanHotAndColdTiers)
+{
+  retro::tiered_full_map<int, int> m;
+  retro::full_map<int, int> reference;
+
+  // Spill every 100 operations, keeping the same operations in a plain map
+  int segments = 0;
+  for (int i = 0; i < 450; i++)
+  {
+    int key = (i * 31) % 23;
+    if (i % 6 == 0)
+    {
+      m.erase(key);
+      reference.erase(key);
+    }
+    else
+    {
+      m.assign(key, i);
+      reference.assign(key, i);
+    }
+
+    if (i % 100 == 99)
+    {
+      ASSERT_TRUE(m.spill(segment_path(segments++).c_str()));
+    }
+  }
+  EXPECT_EQ(4U, m.segment_count());
+  EXPECT_EQ(400U, m.cold_events());
+
+  for (int key = 0; key < 24; key++)
+  {
+    auto it = reference.find(key);
+    const int *val = m.find(key);
+    ASSERT_EQ(it == reference.end(), val == 0);
+    if (val)
+    {
+      EXPECT_EQ(it->second, *val);
+    }
+  }
+
+  // Just before cold operation i, the map is as after the first i operations
+  retro::full_map<int, int> replay;
+  for (int i = 0; i < 400; i++)
+  {
+    auto t = m.at(i);
+    for (int key = 0; key < 23; key++)
+    {
+      auto it = replay.find(key);
+      const int *val = m.find(t, key);
+      ASSERT_EQ(it == replay.end(), val == 0);
+      if (val)
+      {
+        EXPECT_EQ(it->second, *val);
+      }
+    }
+
+    int key = (i * 31) % 23;
+    if (i % 6 == 0)
+      replay.erase(key);
+    else
+      replay.assign(key, i);
+  }
+
+  for (int i = 0; i < segments; i++) std::remove(segment_path(i).c_str());
+}
+
+TEST(tiered_full_map, hotTierCanBeChangedRetroactively)
+{
+  retro::tiered_full_map<int, int> m;
+  m.insert(std::make_pair(1, 10));
+  m.insert(std::make_pair(2, 20));
+  ASSERT_TRUE(m.spill(segment_path(0).c_str()));
+
+  auto t = m.assign(1, 11);
+  m.erase(2);
+  m.erase(t, 1);
+
+  // The erase just before t hides the cold value only until t
+  EXPECT_EQ(0, m.find(t, 1));
+  EXPECT_EQ(11, *m.find(1));
+  EXPECT_EQ(0, m.find(2));
+  EXPECT_EQ(20, *m.find(t, 2));
+  EXPECT_EQ(10, *m.find(m.at(1), 1));
+
+  // Reopening with the segment and an empty hot tier
+  retro::tiered_full_map<int, int> reopened;
+  ASSERT_TRUE(reopened.attach(segment_path(0).c_str()));
+  EXPECT_EQ(10, *reopened.find(1));
+  EXPECT_EQ(20, *reopened.find(2));
+
+  std::remove(segment_path(0).c_str());
+}
+
+TEST(tiered_full_map, coldHistoryIsReadOnly)
+{
+  retro::tiered_full_map<int, int> m;
+  m.insert(std::make_pair(1, 10));
+  m.insert(std::make_pair(2, 20));
+  ASSERT_TRUE(m.spill(segment_path(0).c_str()));
+
+  auto cold = m.at(1);
+  EXPECT_FALSE(m.insert(cold, std::make_pair(3, 30)).performed());
+  EXPECT_FALSE(m.erase(cold, 1).performed());
+  EXPECT_FALSE(m.assign(cold, 1, 11).performed());
+  EXPECT_FALSE(m.revert(cold));
+  EXPECT_FALSE(m.spill(segment_path(1).c_str(), cold));
+
+  // Nothing changed at present or in the past
+  EXPECT_EQ(10, *m.find(1));
+  EXPECT_EQ(0, m.find(3));
+  EXPECT_EQ(10, *m.find(cold, 1));
+  EXPECT_EQ(0, m.find(cold, 2));
+
+  auto t = m.assign(1, 11);
+  EXPECT_TRUE(t.performed());
+  EXPECT_TRUE(m.revert(t));
+  EXPECT_EQ(10, *m.find(1));
+
+  std::remove(segment_path(0).c_str());
+}
+
+TEST(tiered_full_map, spillOnlyWritesOperationsBeforeHorizon)
+{
+  retro::tiered_full_map<int, int> m;
+  m.insert(std::make_pair(1, 10));
+  m.insert(std::make_pair(2, 20));
+  m.erase(1);
+  auto horizon = m.assign(2, 21);
+  m.insert(std::make_pair(3, 30));
+  ASSERT_TRUE(m.spill(segment_path(0).c_str(), horizon));
+  EXPECT_EQ(3U, m.cold_events());
+
+  // The operations from the horizon on are still in the hot tier
+  auto t = m.erase(horizon, 3);
+  EXPECT_TRUE(t.performed());
+  EXPECT_EQ(21, *m.find(2));
+  EXPECT_EQ(20, *m.find(horizon, 2));
+  EXPECT_EQ(30, *m.find(3));
+  EXPECT_EQ(0, m.find(1));
+
+  // The next segment only counts the operations it adds
+  ASSERT_TRUE(m.spill(segment_path(1).c_str()));
+  EXPECT_EQ(6U, m.cold_events());
+  EXPECT_EQ(20, *m.find(m.at(3), 2));
+  EXPECT_EQ(0, m.find(m.at(3), 1));
+  EXPECT_EQ(20, *m.find(m.at(4), 2));
+  EXPECT_EQ(21, *m.find(m.at(5), 2));
+  EXPECT_EQ(0, m.find(m.at(5), 3));
+  EXPECT_EQ(30, *m.find(3));
+
+  // Reopening rebuilds the present state from the segments
+  retro::tiered_full_map<int, int> reopened;
+  ASSERT_TRUE(reopened.attach(segment_path(0).c_str()));
+  ASSERT_TRUE(reopened.attach(segment_path(1).c_str()));
+  EXPECT_EQ(6U, reopened.cold_events());
+  EXPECT_EQ(21, *reopened.find(2));
+  EXPECT_EQ(30, *reopened.find(3));
+  EXPECT_EQ(0, reopened.find(1));
+  EXPECT_EQ(20, *reopened.find(reopened.at(3), 2));
+
+  reopened.assign(4, 40);
+  EXPECT_FALSE(reopened.attach(segment_path(1).c_str()));
+
+  std::remove(segment_path(0).c_str());
+  std::remove(segment_path(1).c_str());
+}
+
+TEST(tiered_full_map, thawedHistoryCanBeChanged)
+{
+  retro::tiered_full_map<int, int> m;
+  retro::full_map<int, int> reference;
+  std::vector<retro::full_map<int, int>::time_point> times;
+  for (int i = 0; i < 60; i++)
+  {
+    int key = (i * 7) % 11;
+    m.assign(key, i);
+    times.push_back(reference.assign(key, i));
+    if (i % 20 == 19)
+    {
+      ASSERT_TRUE(m.spill(segment_path(i / 20).c_str()));
+    }
+  }
+
+  auto cold = m.at(45);
+  EXPECT_FALSE(m.erase(cold, 1).performed());
+
+  // Bring back the two newest segments
+  ASSERT_TRUE(m.thaw());
+  ASSERT_TRUE(m.thaw());
+  EXPECT_EQ(1U, m.segment_count());
+  EXPECT_EQ(20U, m.cold_events());
+
+  // Time points of thawed operations, old and new, now change the hot tier
+  EXPECT_TRUE(m.erase(cold, 1).performed());
+  reference.erase(times[45], 1);
+  EXPECT_TRUE(m.revert(m.at(30)));
+  reference.revert(times[30]);
+  EXPECT_FALSE(m.revert(m.at(10)));
+
+  for (int i = 0; i <= 60; i++)
+  {
+    if (i == 30) continue;
+    for (int key = 0; key < 11; key++)
+    {
+      auto t = i < 60 ? times[i] : reference.present();
+      auto it = reference.find(t, key);
+      const int *val = i < 60 ? m.find(m.at(i), key) : m.find(key);
+      ASSERT_EQ(it == reference.end(t), val == 0);
+      if (val)
+      {
+        EXPECT_EQ(it->second, *val);
+      }
+    }
+  }
+
+  // Spilling again writes the changed history to a new segment
+  ASSERT_TRUE(m.spill(segment_path(3).c_str()));
+  EXPECT_EQ(60U, m.cold_events());
+
+  retro::tiered_full_map<int, int> reopened;
+  ASSERT_TRUE(reopened.attach(segment_path(0).c_str()));
+  ASSERT_TRUE(reopened.attach(segment_path(3).c_str()));
+  for (int key = 0; key < 11; key++)
+  {
+    auto it = reference.find(key);
+    const int *val = reopened.find(key);
+    ASSERT_EQ(it == reference.end(), val == 0);
+    if (val)
+    {
+      EXPECT_EQ(it->second, *val);
+    }
+  }
+
+  for (int i = 0; i < 4; i++) std::remove(segment_path(i).c_str());
+}
@@ -0,0 +1,161 @@
+#include <gtest/gtest.h>
+
+#include "retro/traced_map.hpp"
+
+#include <csignal>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <sys/resource.h>
+#include <sys/stat.h>
+
+namespace
+{
+
+const char *path = "traced_map_test.trace";
+
+struct record
+{
+  std::uint8_t code;
+  std::uint64_t at;
+  std::uint64_t key;
+};
+
+std::vector<record> read_records(void)
+{
+  std::vector<record> records;
+  bool read = retro::detail::read_trace(
+      path, retro::detail::trace_map_magic, sizeof(std::uint64_t),
+      [&](std::uint8_t code, std::uint64_t at, const char *payload)
+      {
+        record r = { code, at, 0 };
+        std::memcpy(&r.key, payload, sizeof(r.key));
+        records.push_back(r);
+        return true;
+      });
+  EXPECT_TRUE(read);
+  return records;
+}
+
+} // end namespace
+
+TEST(traced_full_map, recordsOperationsAndQueries)
+{
+  std::remove(path);
+  {
+    retro::traced_full_map<std::string, int> m(64);
+    ASSERT_TRUE(m.open(path));
+
+    auto t1 = m.insert(std::make_pair(std::string("b"), 10));
+    m.assign("a", 20);
+    auto t3 = m.erase(t1, "a");
+    EXPECT_EQ(20, m.find("a")->second);
+    EXPECT_EQ(m.end(t3), m.find(t3, "b"));
+    EXPECT_EQ("b", m.begin(m.at(1))->first);
+    m.revert(t3);
+    EXPECT_EQ(2U, t3.ordinal());
+  }
+
+  auto records = read_records();
+  ASSERT_EQ(7U, records.size());
+
+  const std::uint64_t now = retro::detail::log_file::present;
+
+  // Keys are numbered in the order they are first used
+  EXPECT_EQ(static_cast<std::uint8_t>(retro::map::insert), records[0].code);
+  EXPECT_EQ(now, records[0].at);
+  EXPECT_EQ(0U, records[0].key);
+  EXPECT_EQ(static_cast<std::uint8_t>(retro::map::assign), records[1].code);
+  EXPECT_EQ(1U, records[1].key);
+  EXPECT_EQ(static_cast<std::uint8_t>(retro::map::erase), records[2].code);
+  EXPECT_EQ(0U, records[2].at);
+  EXPECT_EQ(1U, records[2].key);
+
+  // Queries refer to the time points they were made at
+  EXPECT_EQ(retro::detail::trace_find, records[3].code);
+  EXPECT_EQ(now, records[3].at);
+  EXPECT_EQ(1U, records[3].key);
+  EXPECT_EQ(retro::detail::trace_find, records[4].code);
+  EXPECT_EQ(2U, records[4].at);
+  EXPECT_EQ(0U, records[4].key);
+  EXPECT_EQ(retro::detail::trace_scan, records[5].code);
+  EXPECT_EQ(1U, records[5].at);
+
+  EXPECT_EQ(retro::detail::trace_revert, records[6].code);
+  EXPECT_EQ(2U, records[6].at);
+  std::remove(path);
+}
+
+TEST(traced_full_map, revertingThePresentIsNotRecorded)
+{
+  std::remove(path);
+  {
+    retro::traced_full_map<int, int> m;
+    ASSERT_TRUE(m.open(path));
+
+    m.insert(std::make_pair(1, 10));
+    m.revert(m.present());
+    EXPECT_EQ(10, m.find(1)->second);
+  }
+
+  // Only the insert and the find are recorded, so the trace replays
+  auto records = read_records();
+  ASSERT_EQ(2U, records.size());
+  EXPECT_EQ(static_cast<std::uint8_t>(retro::map::insert), records[0].code);
+  EXPECT_EQ(retro::detail::trace_find, records[1].code);
+  std::remove(path);
+}
+
+TEST(traced_full_map, onlyOpensBeforeAnyOperation)
+{
+  std::remove(path);
+  retro::traced_full_map<int, int> m;
+  m.insert(std::make_pair(1, 10));
+  EXPECT_FALSE(m.open(path));
+
+  // Nothing is recorded, but the map still works
+  m.assign(1, 11);
+  EXPECT_EQ(11, m.find(1)->second);
+  EXPECT_FALSE(retro::detail::read_trace(
+      path, retro::detail::trace_map_magic, sizeof(std::uint64_t),
+      [](std::uint8_t, std::uint64_t, const char *) { return true; }));
+}
+
+TEST(traced_full_map, stopsRecordingAtTheFirstFailedRecord)
+{
+  std::remove(path);
+  retro::traced_full_map<int, int> m(1);
+  ASSERT_TRUE(m.open(path));
+  m.insert(std::make_pair(1, 10));
+
+  // Only let the trace grow by part of a record
+  struct stat st;
+  ASSERT_EQ(0, ::stat(path, &st));
+  rlimit old, limited;
+  ASSERT_EQ(0, ::getrlimit(RLIMIT_FSIZE, &old));
+  limited = old;
+  limited.rlim_cur = st.st_size + 10;
+  auto handler = std::signal(SIGXFSZ, SIG_IGN);
+  ASSERT_EQ(0, ::setrlimit(RLIMIT_FSIZE, &limited));
+
+  m.insert(std::make_pair(2, 20));
+
+  ::setrlimit(RLIMIT_FSIZE, &old);
+  std::signal(SIGXFSZ, handler);
+  EXPECT_TRUE(m.failed());
+
+  // Later operations still work, but are not recorded
+  m.assign(1, 11);
+  EXPECT_EQ(11, m.find(1)->second);
+  EXPECT_EQ(20, m.find(2)->second);
+  EXPECT_FALSE(m.flush());
+  EXPECT_FALSE(m.close());
+
+  auto records = read_records();
+  ASSERT_EQ(1U, records.size());
+  EXPECT_EQ(static_cast<std::uint8_t>(retro::map::insert), records[0].code);
+  std::remove(path);
+}
@@ -0,0 +1,93 @@
+#include <gtest/gtest.h>
+
+#include "retro/traced_queue.hpp"
+
+#include <csignal>
+#include <cstdio>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include <sys/resource.h>
+#include <sys/stat.h>
+
+TEST(traced_partial_queue, recordsOperations)
+{
+  const char *path = "traced_queue_test.trace";
+  std::remove(path);
+  {
+    retro::traced_partial_queue<int> q(16);
+    ASSERT_TRUE(q.open(path));
+
+    auto t1 = q.push(1);
+    q.push(2);
+    q.pop();
+    q.push(t1, 0);
+    EXPECT_EQ(1, q.front());
+    q.revert(t1);
+  }
+
+  std::vector<std::pair<std::uint8_t, std::uint64_t>> records;
+  ASSERT_TRUE(retro::detail::read_trace(
+      path, retro::detail::trace_queue_magic, 0,
+      [&](std::uint8_t code, std::uint64_t at, const char *)
+      {
+        records.push_back(std::make_pair(code, at));
+        return true;
+      }));
+
+  const std::uint64_t now = retro::detail::log_file::present;
+  const std::uint8_t push = static_cast<std::uint8_t>(retro::queue::push);
+  const std::uint8_t pop = static_cast<std::uint8_t>(retro::queue::pop);
+
+  ASSERT_EQ(6U, records.size());
+  EXPECT_EQ(std::make_pair(push, now), records[0]);
+  EXPECT_EQ(std::make_pair(push, now), records[1]);
+  EXPECT_EQ(std::make_pair(pop, now), records[2]);
+  EXPECT_EQ(std::make_pair(push, std::uint64_t(0)), records[3]);
+  EXPECT_EQ(std::make_pair(retro::detail::trace_find, now), records[4]);
+  EXPECT_EQ(std::make_pair(retro::detail::trace_revert, std::uint64_t(0)),
+            records[5]);
+  std::remove(path);
+}
+
+TEST(traced_partial_queue, stopsRecordingAtTheFirstFailedRecord)
+{
+  const char *path = "traced_queue_test.trace";
+  std::remove(path);
+  retro::traced_partial_queue<int> q(1);
+  ASSERT_TRUE(q.open(path));
+  q.push(1);
+
+  // Only let the trace grow by part of a record
+  struct stat st;
+  ASSERT_EQ(0, ::stat(path, &st));
+  rlimit old, limited;
+  ASSERT_EQ(0, ::getrlimit(RLIMIT_FSIZE, &old));
+  limited = old;
+  limited.rlim_cur = st.st_size + 5;
+  auto handler = std::signal(SIGXFSZ, SIG_IGN);
+  ASSERT_EQ(0, ::setrlimit(RLIMIT_FSIZE, &limited));
+
+  q.push(2);
+
+  ::setrlimit(RLIMIT_FSIZE, &old);
+  std::signal(SIGXFSZ, handler);
+  EXPECT_TRUE(q.failed());
+
+  // Later operations still work, but are not recorded
+  q.pop();
+  EXPECT_EQ(2, q.front());
+  EXPECT_FALSE(q.close());
+
+  std::size_t records = 0;
+  ASSERT_TRUE(retro::detail::read_trace(
+      path, retro::detail::trace_queue_magic, 0,
+      [&](std::uint8_t, std::uint64_t, const char *)
+      {
+        records++;
+        return true;
+      }));
+  EXPECT_EQ(1U, records);
+  std::remove(path);
+}
@@ -0,0 +1,257 @@
+#include <gtest/gtest.h>
+
+#include "retro/unordered_map.hpp"
+#include "retro/detail/hash_table.hpp"
+
+#include <string>
+#include <vector>
+#include <map>
+#include <random>
+
+TEST(full_unordered_map, canFindInsertedElements)
+{
+  retro::full_unordered_map<int, int> m;
+
+  m.insert(std::make_pair(1, 1));
+  m.insert(std::make_pair(2, 2));
+  m.insert(std::make_pair(3, 3));
+
+  EXPECT_EQ(1, m.find(1)->first);
+  EXPECT_EQ(1, m.find(1)->second);
+  EXPECT_EQ(2, m.find(2)->first);
+  EXPECT_EQ(2, m.find(2)->second);
+  EXPECT_EQ(3, m.find(3)->first);
+  EXPECT_EQ(3, m.find(3)->second);
+  EXPECT_EQ(m.end(), m.find(0));
+  EXPECT_EQ(m.end(), m.find(4));
+}
+
+TEST(full_unordered_map, canFindManyStringKeys)
+{
+  retro::full_unordered_map<std::string, int> m;
+
+  for (int i = 0; i < 1000; i++)
+    m.insert(std::make_pair(std::to_string(i), i));
+
+  for (int i = 0; i < 1000; i++)
+    EXPECT_EQ(i, m.find(std::to_string(i))->second);
+  EXPECT_EQ(m.end(), m.find("1000"));
+}
+
+TEST(full_unordered_map, iteratesOverEachPresentElementOnce)
+{
+  retro::full_unordered_map<int, int> m;
+
+  for (int i = 0; i < 100; i++)
+    m.insert(std::make_pair(i, i));
+  for (int i = 0; i < 100; i += 2)
+    m.erase(i);
+
+  int count = 0, sum = 0;
+  for (auto it = m.begin(); it != m.end(); ++it, ++count)
+    sum += it->first;
+
+  EXPECT_EQ(50, count);
+  EXPECT_EQ(50 * 50, sum);
+}
+
+TEST(full_unordered_map, presentInsertionsCanBeRetroactivelyFound)
+{
+  retro::full_unordered_map<int, int> m;
+  auto t1 = m.insert(std::make_pair(1, 1));
+  auto t2 = m.insert(std::make_pair(2, 2));
+  auto t3 = m.insert(std::make_pair(3, 3));
+
+  // Before t1, the map is empty
+  EXPECT_EQ(m.end(t1), m.find(t1, 1));
+  EXPECT_EQ(m.end(t1), m.begin(t1));
+
+  // Before t2, the map contains '1'
+  EXPECT_EQ(1, m.find(t2, 1)->second);
+  EXPECT_EQ(m.end(t2), m.find(t2, 2));
+  EXPECT_EQ(m.end(t2), std::next(m.begin(t2)));
+
+  // Before t3, the map contains '1', '2'
+  EXPECT_EQ(1, m.find(t3, 1)->second);
+  EXPECT_EQ(2, m.find(t3, 2)->second);
+  EXPECT_EQ(m.end(t3), m.find(t3, 3));
+}
+
+TEST(full_unordered_map, retroactiveOperationsCanBeRetroactivelyFound)
+{
+  retro::full_unordered_map<int, int> m;
+  auto t3 = m.insert(std::make_pair(3, 3));
+  auto t1 = m.insert(t3, std::make_pair(1, 1));
+  auto e1 = m.erase(t3, 1);
+
+  // Before t1, the map is empty
+  EXPECT_EQ(m.end(t1), m.find(t1, 1));
+
+  // Before the erase, the map contains '1'
+  EXPECT_EQ(1, m.find(e1, 1)->second);
+
+  // Before t3, '1' has been erased again
+  EXPECT_EQ(m.end(t3), m.find(t3, 1));
+  EXPECT_EQ(m.end(t3), m.begin(t3));
+
+  // At present, only '3' exists
+  EXPECT_EQ(m.end(), m.find(1));
+  EXPECT_EQ(3, m.find(3)->second);
+}
+
+TEST(full_unordered_map, insertsOnExistingKeysHaveNoEffect)
+{
+  retro::full_unordered_map<int, int> m;
+  auto t1 = m.insert(std::make_pair(1, 1));
+  auto t2 = m.insert(std::make_pair(1, 2));
+  EXPECT_EQ(1, m.find(1)->second);
+
+  // The second insert takes effect once the first is gone.
+  m.revert(t1);
+  EXPECT_EQ(2, m.find(1)->second);
+  m.assign(t2, 1, 3);
+  EXPECT_EQ(3, m.find(1)->second);
+}
+
+TEST(full_unordered_map, canBeMovedAndStoredInVectors)
+{
+  typedef retro::full_unordered_map<int, int> map_type;
+
+  std::vector<map_type> maps;
+  for (int i = 0; i < 3; i++)
+  {
+    map_type m;
+    m.insert(std::make_pair(i, i));
+    maps.push_back(std::move(m));
+    EXPECT_EQ(m.end(), m.begin());
+  }
+
+  // Time points taken before the move still refer to the moved map.
+  auto t = maps[1].insert(std::make_pair(5, 5));
+  map_type taken = std::move(maps[1]);
+  EXPECT_EQ(maps[1].end(), maps[1].begin());
+  taken.insert(t, std::make_pair(6, 6));
+  EXPECT_EQ(6, taken.find(t, 6)->second);
+  EXPECT_EQ(taken.end(t), taken.find(t, 5));
+
+  // A map that was moved from can be used again.
+  maps[1].insert(std::make_pair(7, 7));
+  EXPECT_EQ(7, maps[1].find(7)->second);
+
+  maps[0] = std::move(taken);
+  EXPECT_EQ(1, maps[0].find(1)->second);
+  EXPECT_EQ(maps[0].end(), maps[0].find(0));
+  EXPECT_EQ(2, maps[2].find(2)->second);
+}
+
+namespace
+{
+
+// Counts the copies made of it, which moving does not.
+struct copy_counter
+{
+  copy_counter() { }
+  copy_counter(const copy_counter &) { copies++; }
+  copy_counter(copy_counter &&) noexcept { }
+  copy_counter &operator=(const copy_counter &) { copies++; return *this; }
+  copy_counter &operator=(copy_counter &&) noexcept { return *this; }
+
+  static int copies;
+};
+
+int copy_counter::copies = 0;
+
+} // end namespace
+
+TEST(hash_table, growingMovesEntriesWithoutCopyingValues)
+{
+  retro::detail::hash_table<std::string, copy_counter> table;
+  copy_counter::copies = 0;
+  for (int i = 0; i < 1000; i++)
+    table.find_or_insert("key" + std::to_string(i));
+
+  EXPECT_EQ(0, copy_counter::copies);
+  EXPECT_EQ(1000U, table.size());
+  EXPECT_NE(table.end(), table.find("key999"));
+}
+
+TEST(full_unordered_map, matchesFullMapOnTheSameOperations)
+{
+  retro::full_unordered_map<int, int> m;
+  retro::full_map<int, int> expected;
+  std::vector<retro::full_unordered_map<int, int>::time_point> times;
+  std::vector<retro::full_map<int, int>::time_point> expected_times;
+
+  std::mt19937 random(11);
+  for (int i = 0; i < 2000; i++)
+  {
+    int key = random() % 30, choice = random() % 7;
+    bool past = !times.empty() && choice % 2 == 1;
+    std::size_t at = past ? random() % times.size() : 0;
+    auto t = past ? times[at] : m.present();
+    auto expected_t = past ? expected_times[at] : expected.present();
+
+    if (choice < 2)
+    {
+      times.push_back(m.insert(t, std::make_pair(key, i)));
+      expected_times.push_back(expected.insert(expected_t,
+                                               std::make_pair(key, i)));
+    }
+    else if (choice < 4)
+    {
+      times.push_back(m.assign(t, key, i));
+      expected_times.push_back(expected.assign(expected_t, key, i));
+    }
+    else if (choice < 6)
+    {
+      times.push_back(m.erase(t, key));
+      expected_times.push_back(expected.erase(expected_t, key));
+    }
+    else if (past)
+    {
+      // A reverted time point is replaced by the present.
+      m.revert(t);
+      expected.revert(expected_t);
+      times[at] = m.present();
+      expected_times[at] = expected.present();
+    }
+  }
+  times.push_back(m.present());
+  expected_times.push_back(expected.present());
+
+  for (std::size_t i = 0; i < times.size(); i += 13)
+  {
+    for (int key = 0; key < 30; key++)
+    {
+      auto it = m.find(times[i], key);
+      auto expected_it = expected.find(expected_times[i], key);
+      ASSERT_EQ(expected_it == expected.end(expected_times[i]),
+                it == m.end(times[i]));
+      if (it != m.end(times[i]))
+      {
+        ASSERT_EQ(expected_it->second, it->second);
+      }
+    }
+
+    std::map<int, int> elements;
+    for (auto it = m.begin(times[i]); it != m.end(times[i]); ++it)
+      EXPECT_TRUE(elements.insert(std::make_pair(it->first,
+                                                 it->second)).second);
+    std::map<int, int> expected_elements;
+    for (auto it = expected.begin(expected_times[i]);
+         it != expected.end(expected_times[i]); ++it)
+      expected_elements.insert(std::make_pair(it->first, it->second));
+    ASSERT_EQ(expected_elements, elements);
+  }
+
+  for (int key = 0; key < 30; key++)
+  {
+    auto it = m.find(key);
+    auto expected_it = expected.find(key);
+    ASSERT_EQ(expected_it == expected.end(), it == m.end());
+    if (it != m.end())
+    {
+      EXPECT_EQ(expected_it->second, it->second);
+    }
+  }
+}
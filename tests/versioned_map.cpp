@@ -0,0 +1,293 @@
+#include <gtest/gtest.h>
+
+#include "retro/versioned_map.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+TEST(versioned_full_map, snapshotsOnlySeePublishedOperations)
+{
+  retro::versioned_full_map<int, int> m;
+  auto t1 = m.insert(std::make_pair(1, 1));
+
+  auto before = m.read();
+  EXPECT_EQ(before.end(), before.find(1));
+
+  m.publish();
+  auto after = m.read();
+  auto t2 = m.assign(1, 2);
+  m.insert(std::make_pair(2, 2));
+
+  ASSERT_NE(after.end(), after.find(1));
+  EXPECT_EQ(1, after.find(1)->second);
+  EXPECT_EQ(after.end(), after.find(2));
+  EXPECT_EQ(after.end(t1), after.find(t1, 1));
+
+  // A time point newer than the snapshot is after all of its events
+  ASSERT_NE(after.end(t2), after.find(t2, 1));
+  EXPECT_EQ(1, after.find(t2, 1)->second);
+
+  m.publish();
+  auto latest = m.read();
+  EXPECT_EQ(2, latest.find(1)->second);
+  EXPECT_EQ(1, latest.find(t2, 1)->second);
+  EXPECT_EQ(latest.end(t1), latest.find(t1, 1));
+}
+
+TEST(versioned_full_map, insertAndEraseOnlyChangeWhatTheyApplyTo)
+{
+  retro::versioned_full_map<int, int> m;
+  auto t1 = m.insert(std::make_pair(1, 1));
+  auto t2 = m.insert(std::make_pair(1, 2));
+  auto t3 = m.erase(2);
+  auto t4 = m.erase(1);
+  m.insert(std::make_pair(1, 3));
+  m.publish();
+
+  auto s = m.read();
+  EXPECT_EQ(1, s.find(t2, 1)->second);
+  EXPECT_EQ(1, s.find(t4, 1)->second);
+  EXPECT_EQ(s.end(t3), s.find(t3, 2));
+  EXPECT_EQ(3, s.find(1)->second);
+  EXPECT_EQ(s.end(t1), s.begin(t1));
+
+  // Iteration skips keys that do not exist at the time point
+  m.assign(0, 0);
+  m.assign(2, 2);
+  auto t5 = m.erase(1);
+  m.publish();
+  s = m.read();
+  std::vector<int> keys;
+  for (auto it = s.begin(t5); it != s.end(t5); ++it) keys.push_back(it->first);
+  EXPECT_EQ((std::vector<int>{0, 1, 2}), keys);
+  keys.clear();
+  for (auto it = s.begin(); it != s.end(); ++it) keys.push_back(it->first);
+  EXPECT_EQ((std::vector<int>{0, 2}), keys);
+}
+
+namespace
+{
+
+// A value that counts how many times values have been copied.
+struct counted
+{
+  static std::size_t copies;
+
+  explicit counted(int n) : n(n) {}
+  counted(const counted &other) : n(other.n) { copies++; }
+
+  int n;
+};
+
+std::size_t counted::copies = 0;
+
+} // end namespace
+
+TEST(versioned_full_map, writerDoesNotCopyTheMapAfterPublishing)
+{
+  retro::versioned_full_map<int, counted> m;
+  for (int i = 0; i < 1000; i++) m.assign(i, counted(i));
+  m.publish();
+  auto s = m.read();
+
+  // Only the values that are stored are copied
+  const counted value(-1);
+  const std::pair<const int, counted> element(1000, counted(1000));
+  counted::copies = 0;
+  m.assign(0, value);
+  m.insert(element);
+  m.publish();
+  EXPECT_EQ(2U, counted::copies);
+
+  EXPECT_EQ(0, s.find(0)->second.n);
+  EXPECT_EQ(-1, m.read().find(0)->second.n);
+}
+
+TEST(versioned_full_map, readersRunAlongsideWriter)
+{
+  retro::versioned_full_map<int, int> m;
+  std::vector<retro::versioned_full_map<int, int>::time_point> times;
+  for (int i = 0; i < 100; i++)
+    times.push_back(m.insert(std::make_pair(i, i)));
+  m.publish();
+
+  std::atomic<bool> done(false);
+  std::atomic<int> failures(0);
+
+  std::vector<std::thread> readers;
+  for (int r = 0; r < 3; r++)
+  {
+    readers.emplace_back([&]()
+    {
+      while (!done)
+      {
+        auto s = m.read();
+        for (int i = 0; i < 100; i++)
+        {
+          auto it = s.find(times[i], i);
+          if (it != s.end(times[i])) failures++;
+          it = s.find(times[99], i);
+          if (i < 99 && (it == s.end(times[99]) || it->second != i))
+            failures++;
+        }
+      }
+    });
+  }
+
+  for (int i = 100; i < 2000; i++)
+  {
+    m.insert(std::make_pair(i, i));
+    if (i % 100 == 0) m.publish();
+  }
+  done = true;
+  for (auto &r : readers) r.join();
+
+  EXPECT_EQ(0, failures);
+}
+
+TEST(versioned_full_map, reclaimKeepsEverythingFromTheHorizonOn)
+{
+  retro::versioned_full_map<int, int> m;
+  std::vector<retro::versioned_full_map<int, int>::time_point> times;
+  for (int i = 0; i < 1000; i++)
+  {
+    if (i % 7 == 3)
+      times.push_back(m.erase(i % 10));
+    else
+      times.push_back(m.assign(i % 10, i));
+  }
+  m.publish();
+
+  // Record what each key was at every time point from the horizon on.
+  auto contents = [&](const retro::versioned_full_map<int, int>::snapshot &s,
+                      std::size_t from)
+  {
+    std::vector<std::vector<int>> result;
+    for (std::size_t i = from; i < times.size(); i++)
+    {
+      std::vector<int> state;
+      for (auto it = s.begin(times[i]); it != s.end(times[i]); ++it)
+      {
+        state.push_back(it->first);
+        state.push_back(it->second);
+      }
+      result.push_back(state);
+    }
+    return result;
+  };
+  auto expected = contents(m.read(), 500);
+
+  m.forget(times[500]);
+  EXPECT_LT(400u, m.reclaim());
+  EXPECT_EQ(0u, m.reclaim());
+
+  auto s = m.read();
+  EXPECT_EQ(expected, contents(s, 500));
+
+  // Earlier time points are treated as the horizon.
+  EXPECT_EQ(expected.front(), contents(s, 0).front());
+  for (int key = 0; key < 10; key++)
+  {
+    auto it = s.find(times[10], key), at = s.find(times[500], key);
+    ASSERT_EQ(at == s.end(times[500]), it == s.end(times[10]));
+    if (it != s.end(times[10]))
+    {
+      EXPECT_EQ(at->second, it->second);
+    }
+  }
+}
+
+namespace
+{
+
+// A value that counts how many copies of it exist.
+struct tracked
+{
+  static int live;
+
+  explicit tracked(int n) : n(n) { live++; }
+  tracked(const tracked &other) : n(other.n) { live++; }
+  ~tracked(void) { live--; }
+
+  int n;
+};
+
+int tracked::live = 0;
+
+} // end namespace
+
+TEST(versioned_full_map, reclaimWaitsForSnapshotsThatMaySeeOldVersions)
+{
+  {
+    retro::versioned_full_map<int, tracked> m;
+    m.assign(0, tracked(0));
+    auto t = m.assign(0, tracked(1));
+    for (int i = 2; i < 100; i++) m.assign(0, tracked(i));
+    m.publish();
+    EXPECT_EQ(100, tracked::live);
+
+    // A snapshot taken before the horizon moved still sees the old versions.
+    auto old = m.read();
+    m.forget(m.read().present());
+    EXPECT_EQ(0u, m.reclaim());
+    EXPECT_EQ(0, old.find(t, 0)->second.n);
+
+    // Once it is gone, the history is pruned to the horizon, but the old one
+    // is kept while a snapshot of the epoch it was replaced in remains.
+    old = m.read();
+    EXPECT_EQ(99u, m.reclaim());
+    EXPECT_EQ(101, tracked::live);
+    EXPECT_EQ(99, old.find(t, 0)->second.n);
+
+    old = m.read();
+    EXPECT_EQ(0u, m.reclaim());
+    EXPECT_EQ(101, tracked::live);
+
+    old = m.read();
+    EXPECT_EQ(0u, m.reclaim());
+    EXPECT_EQ(1, tracked::live);
+    EXPECT_EQ(99, old.find(0)->second.n);
+  }
+  EXPECT_EQ(0, tracked::live);
+}
+
+TEST(versioned_full_map, readersRunAlongsideReclamation)
+{
+  retro::versioned_full_map<int, int> m;
+  for (int i = 0; i < 100; i++) m.assign(i, 0);
+  m.publish();
+
+  std::atomic<bool> done(false);
+  std::atomic<int> failures(0);
+
+  // Every key holds the same value at any time point, which only grows.
+  std::vector<std::thread> readers;
+  for (int r = 0; r < 3; r++)
+  {
+    readers.emplace_back([&]()
+    {
+      while (!done)
+      {
+        auto s = m.read();
+        int value = s.find(0)->second;
+        for (auto it = s.begin(); it != s.end(); ++it)
+          if (it->second != value) failures++;
+      }
+    });
+  }
+
+  for (int v = 1; v < 300; v++)
+  {
+    retro::versioned_full_map<int, int>::time_point t = m.assign(0, v);
+    for (int i = 1; i < 100; i++) m.assign(i, v);
+    m.publish();
+    m.forget(t);
+    m.reclaim();
+  }
+  done = true;
+  for (auto &r : readers) r.join();
+
+  EXPECT_EQ(0, failures);
+}